@@ -0,0 +1,1135 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <elf.h>
+#include "Assembler.hpp"
+
+namespace forest::assembler {
+
+	namespace {
+		struct RegisterInfo {
+			int mNumber;
+			int mSize;
+			bool mHighByte = false;
+			bool mNeedsRex = false;
+		};
+
+		const std::map<std::string, RegisterInfo>& getRegisters() {
+			static const std::map<std::string, RegisterInfo> registers = [] {
+				std::map<std::string, RegisterInfo> result;
+				const char* legacy[8] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+				for (int i = 0; i < 8; i++) {
+					result[std::string("r") + legacy[i]] = {i, 8};
+					result[std::string("e") + legacy[i]] = {i, 4};
+					result[legacy[i]] = {i, 2};
+				}
+				result["al"] = {0, 1};
+				result["cl"] = {1, 1};
+				result["dl"] = {2, 1};
+				result["bl"] = {3, 1};
+				result["spl"] = {4, 1, false, true};
+				result["bpl"] = {5, 1, false, true};
+				result["sil"] = {6, 1, false, true};
+				result["dil"] = {7, 1, false, true};
+				result["ah"] = {4, 1, true};
+				result["ch"] = {5, 1, true};
+				result["dh"] = {6, 1, true};
+				result["bh"] = {7, 1, true};
+				for (int i = 8; i < 16; i++) {
+					std::string name = "r" + std::to_string(i);
+					result[name] = {i, 8};
+					result[name + "d"] = {i, 4};
+					result[name + "w"] = {i, 2};
+					result[name + "b"] = {i, 1};
+				}
+				for (int i = 0; i < 16; i++) {
+					result["xmm" + std::to_string(i)] = {i, 16};
+				}
+				return result;
+			}();
+			return registers;
+		}
+
+		const std::map<std::string, int>& getConditionCodes() {
+			static const std::map<std::string, int> codes = {
+				{"o", 0}, {"no", 1}, {"b", 2}, {"c", 2}, {"nae", 2}, {"ae", 3}, {"nb", 3}, {"nc", 3},
+				{"e", 4}, {"z", 4}, {"ne", 5}, {"nz", 5}, {"be", 6}, {"na", 6}, {"a", 7}, {"nbe", 7},
+				{"s", 8}, {"ns", 9}, {"p", 10}, {"pe", 10}, {"np", 11}, {"po", 11},
+				{"l", 12}, {"nge", 12}, {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15}, {"nle", 15},
+			};
+			return codes;
+		}
+
+		std::string_view trim(std::string_view text) {
+			while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+			while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+			return text;
+		}
+
+		// Splits off the first word, `text` keeps the rest
+		std::string nextWord(std::string_view& text) {
+			text = trim(text);
+			size_t end = 0;
+			while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end]))) end++;
+			std::string word(text.substr(0, end));
+			text = trim(text.substr(end));
+			return word;
+		}
+
+		// Splits on the commas that aren't inside a string or a memory operand
+		std::vector<std::string_view> splitArguments(std::string_view text) {
+			std::vector<std::string_view> result;
+			text = trim(text);
+			if (text.empty()) return result;
+			char quote = 0;
+			int depth = 0;
+			size_t start = 0;
+			for (size_t i = 0; i < text.size(); i++) {
+				char c = text[i];
+				if (quote != 0) {
+					if (c == quote) quote = 0;
+				} else if (c == '"' || c == '\'' || c == '`') {
+					quote = c;
+				} else if (c == '[') {
+					depth++;
+				} else if (c == ']') {
+					depth--;
+				} else if (c == ',' && depth == 0) {
+					result.push_back(trim(text.substr(start, i - start)));
+					start = i + 1;
+				}
+			}
+			result.push_back(trim(text.substr(start)));
+			return result;
+		}
+
+		std::optional<int64_t> parseNumber(std::string_view text) {
+			if (text.empty()) return std::nullopt;
+			if (text.size() >= 3 && (text.front() == '\'' || text.front() == '"') && text.back() == text.front()) {
+				// Character constants are stored little endian, 'ab' is 0x6261
+				std::string_view characters = text.substr(1, text.size() - 2);
+				if (characters.size() > 8) return std::nullopt;
+				uint64_t value = 0;
+				for (size_t i = 0; i < characters.size(); i++) {
+					value |= uint64_t(static_cast<unsigned char>(characters[i])) << (8 * i);
+				}
+				return int64_t(value);
+			}
+			int base = 10;
+			if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) base = 16;
+			else if (text.size() > 2 && text[0] == '0' && (text[1] == 'b' || text[1] == 'B')) base = 2;
+			else if (text.size() > 2 && text[0] == '0' && (text[1] == 'o' || text[1] == 'O' || text[1] == 'q' || text[1] == 'Q')) base = 8;
+			if (base != 10) text.remove_prefix(2);
+			if (text.empty()) return std::nullopt;
+			uint64_t value = 0;
+			for (char c : text) {
+				if (c == '_') continue;
+				int digit;
+				if (c >= '0' && c <= '9') digit = c - '0';
+				else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+				else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+				else return std::nullopt;
+				if (digit >= base) return std::nullopt;
+				value = value * base + digit;
+			}
+			return int64_t(value);
+		}
+
+		bool isSymbolName(std::string_view text) {
+			if (text.empty() || std::isdigit(static_cast<unsigned char>(text.front()))) return false;
+			return std::all_of(text.begin(), text.end(), [](char c) {
+				return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == '$' || c == '@' || c == '?';
+			});
+		}
+
+		bool fitsInt8(int64_t value) {
+			return value >= INT8_MIN && value <= INT8_MAX;
+		}
+
+		bool fitsInt32(int64_t value) {
+			return value >= INT32_MIN && value <= INT32_MAX;
+		}
+
+		// Whether the value can be written in `size` bytes, either as a signed or as an unsigned number
+		bool fitsSize(int64_t value, int size) {
+			switch (size) {
+				case 1: return value >= INT8_MIN && value <= UINT8_MAX;
+				case 2: return value >= INT16_MIN && value <= UINT16_MAX;
+				case 4: return value >= INT32_MIN && value <= int64_t(UINT32_MAX);
+				default: return true;
+			}
+		}
+
+		int getDataSize(const std::string& directive) {
+			switch (directive.back()) {
+				case 'b': return 1;
+				case 'w': return 2;
+				case 'd': return 4;
+				case 'q': return 8;
+				default: return 0;
+			}
+		}
+
+		bool isDataDirective(const std::string& word) {
+			return word == "db" || word == "dw" || word == "dd" || word == "dq"
+				|| word == "resb" || word == "resw" || word == "resd" || word == "resq";
+		}
+
+		std::string toLower(std::string text) {
+			std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+			return text;
+		}
+	}
+
+	std::optional<std::vector<uint8_t>> Assembler::assemble(std::string_view source) {
+		*this = Assembler();
+		size_t lineNumber = 0;
+		while (!source.empty()) {
+			size_t end = source.find('\n');
+			std::string_view line = source.substr(0, end);
+			source = end == std::string_view::npos ? std::string_view() : source.substr(end + 1);
+			lineNumber++;
+			if (!assembleLine(line)) {
+				mError = "line " + std::to_string(lineNumber) + ": " + mError;
+				return std::nullopt;
+			}
+		}
+		if (!resolveFixups())
+			return std::nullopt;
+		return writeObject();
+	}
+
+	const std::string& Assembler::getError() const {
+		return mError;
+	}
+
+	bool Assembler::assembleLine(std::string_view line) {
+		// Strip the comment, a ';' in a string doesn't start one
+		char quote = 0;
+		size_t length = 0;
+		for (; length < line.size(); length++) {
+			char c = line[length];
+			if (quote != 0) {
+				if (c == quote) quote = 0;
+			} else if (c == '"' || c == '\'' || c == '`') {
+				quote = c;
+			} else if (c == ';') {
+				break;
+			}
+		}
+		std::string_view rest = trim(line.substr(0, length));
+		if (rest.empty()) return true;
+
+		std::string first = nextWord(rest);
+		if (first == "section") {
+			std::string name = nextWord(rest);
+			if (name == ".text") mCurrent = SectionId::TEXT;
+			else if (name == ".data") mCurrent = SectionId::DATA;
+			else if (name == ".bss") mCurrent = SectionId::BSS;
+			else if (name == ".rodata") mCurrent = SectionId::RODATA;
+			else return fail("unknown section " + name);
+			return true;
+		} else if (first == "global") {
+			mGlobals.insert(nextWord(rest));
+			return true;
+		} else if (first == "extern") {
+			mExterns.insert(nextWord(rest));
+			return true;
+		}
+
+		if (first.back() == ':') {
+			if (!defineLabel(first.substr(0, first.size() - 1))) return false;
+			if (rest.empty()) return true;
+			first = nextWord(rest);
+		} else if (!rest.empty() && isDataDirective(toLower(std::string(rest.substr(0, rest.find_first_of(" \t")))))) {
+			// `name db 1` is a label too, even without the colon
+			if (!defineLabel(first)) return false;
+			first = nextWord(rest);
+		}
+
+		first = toLower(first);
+		if (isDataDirective(first))
+			return assembleData(first, rest);
+
+		if (mCurrent == SectionId::BSS)
+			return fail("instructions can't go in .bss");
+		if (first == "rep" || first == "repe" || first == "repz") {
+			emit(uint8_t(0xF3));
+			first = toLower(nextWord(rest));
+		} else if (first == "repne" || first == "repnz") {
+			emit(uint8_t(0xF2));
+			first = toLower(nextWord(rest));
+		}
+		return assembleInstruction(first, rest);
+	}
+
+	bool Assembler::defineLabel(const std::string& name) {
+		if (name.empty()) return fail("empty label");
+		std::string fullName = name;
+		if (name[0] == '.') {
+			fullName = mLastLabel + name;
+		} else {
+			mLastLabel = name;
+		}
+		if (mSymbols.contains(fullName))
+			return fail("label " + fullName + " is defined twice");
+		mSymbols[fullName] = Symbol{mCurrent, here()};
+		return true;
+	}
+
+	bool Assembler::assembleData(const std::string& directive, std::string_view arguments) {
+		int unit = getDataSize(directive);
+		Section& section = mSections[int(mCurrent)];
+		if (directive.starts_with("res")) {
+			std::optional<int64_t> count = parseNumber(trim(arguments));
+			if (!count.has_value() || count.value() < 0) return fail("expected a count after " + directive);
+			if (mCurrent == SectionId::BSS)
+				section.mReserved += count.value() * unit;
+			else
+				section.mBytes.resize(section.mBytes.size() + count.value() * unit, 0);
+			return true;
+		}
+
+		if (mCurrent == SectionId::BSS)
+			return fail("initialised data can't go in .bss");
+		for (std::string_view item : splitArguments(arguments)) {
+			if (item.size() >= 2 && (item.front() == '"' || item.front() == '`' || (item.front() == '\'' && (unit == 1 || item.size() > 2 + unit))) && item.back() == item.front()) {
+				// A string, padded with zeroes to a whole amount of units
+				std::string_view characters = item.substr(1, item.size() - 2);
+				for (char c : characters) {
+					emit(uint8_t(c));
+				}
+				for (size_t i = characters.size(); i % unit != 0; i++) {
+					emit(uint8_t(0));
+				}
+				continue;
+			}
+			std::optional<Operand> value = parseOperand(item);
+			if (!value.has_value()) return false;
+			if (value->mKind != Operand::Kind::IMMEDIATE) return fail("expected a value in " + directive);
+			if (!value->mSymbol.empty()) {
+				if (unit != 4 && unit != 8) return fail("addresses have to be stored in a dword or qword");
+				mFixups.push_back(Fixup{mCurrent, here(), unit, value->mSymbol, value->mValue, uint32_t(unit == 8 ? R_X86_64_64 : R_X86_64_32)});
+				emit(0, unit);
+			} else {
+				if (!fitsSize(value->mValue, unit)) return fail("value doesn't fit in " + directive);
+				emit(uint64_t(value->mValue), unit);
+			}
+		}
+		return true;
+	}
+
+	std::optional<Operand> Assembler::parseOperand(std::string_view text) {
+		Operand operand;
+		text = trim(text);
+		std::string_view rest = text;
+		std::string keyword = toLower(nextWord(rest));
+		if (keyword == "byte") operand.mSize = 1;
+		else if (keyword == "word") operand.mSize = 2;
+		else if (keyword == "dword") operand.mSize = 4;
+		else if (keyword == "qword") operand.mSize = 8;
+		if (operand.mSize != 0)
+			text = rest;
+		if (text.empty()) {
+			fail("missing operand");
+			return std::nullopt;
+		}
+
+		auto reg = getRegisters().find(toLower(std::string(text)));
+		if (reg != getRegisters().end()) {
+			if (operand.mSize != 0 && operand.mSize != reg->second.mSize) {
+				fail("register " + reg->first + " doesn't have the size that was asked for");
+				return std::nullopt;
+			}
+			operand.mKind = Operand::Kind::REGISTER;
+			operand.mRegister = reg->second.mNumber;
+			operand.mSize = reg->second.mSize;
+			operand.mHighByte = reg->second.mHighByte;
+			operand.mNeedsRex = reg->second.mNeedsRex;
+			return operand;
+		}
+
+		bool memory = text.front() == '[';
+		if (memory) {
+			if (text.back() != ']') {
+				fail("expected a ']' to close the memory operand");
+				return std::nullopt;
+			}
+			operand.mKind = Operand::Kind::MEMORY;
+			text = trim(text.substr(1, text.size() - 2));
+		}
+
+		// A sum of registers, numbers and at most one label: rbp-8+rcx*4 or print_digit_pairs+r9*2
+		bool negative = false;
+		size_t start = 0;
+		char quote = 0;
+		for (size_t i = 0; i <= text.size(); i++) {
+			if (i < text.size() && quote != 0) {
+				if (text[i] == quote) quote = 0;
+				continue;
+			}
+			if (i < text.size() && text[i] == '\'') {
+				quote = '\'';
+				continue;
+			}
+			if (i == text.size() || text[i] == '+' || text[i] == '-') {
+				std::string_view term = trim(text.substr(start, i - start));
+				if (term.empty()) {
+					// A sign in front, like -8
+					if (i < text.size() && text[i] == '-') negative = !negative;
+					start = i + 1;
+					continue;
+				}
+				if (!parseTerm(term, negative, operand)) return std::nullopt;
+				negative = i < text.size() && text[i] == '-';
+				start = i + 1;
+			}
+		}
+		if (!memory && (operand.mBase >= 0 || operand.mIndex >= 0)) {
+			fail("registers can only be added together inside a memory operand");
+			return std::nullopt;
+		}
+		return operand;
+	}
+
+	bool Assembler::parseTerm(std::string_view term, bool negative, Operand& operand) {
+		size_t star = term.find('*');
+		if (star != std::string_view::npos) {
+			std::string_view left = trim(term.substr(0, star));
+			std::string_view right = trim(term.substr(star + 1));
+			auto registers = getRegisters();
+			auto leftRegister = registers.find(toLower(std::string(left)));
+			auto rightRegister = registers.find(toLower(std::string(right)));
+			if (leftRegister != registers.end() || rightRegister != registers.end()) {
+				const auto& reg = leftRegister != registers.end() ? leftRegister->second : rightRegister->second;
+				std::optional<int64_t> scale = parseNumber(leftRegister != registers.end() ? right : left);
+				if (negative || !scale.has_value() || reg.mSize != 8 || operand.mIndex >= 0)
+					return fail("invalid index in memory operand");
+				operand.mIndex = reg.mNumber;
+				operand.mScale = int(scale.value());
+				return true;
+			}
+			std::optional<int64_t> a = parseNumber(left);
+			std::optional<int64_t> b = parseNumber(right);
+			if (!a.has_value() || !b.has_value()) return fail("can't multiply " + std::string(term));
+			operand.mValue += (negative ? -1 : 1) * a.value() * b.value();
+			return true;
+		}
+
+		auto reg = getRegisters().find(toLower(std::string(term)));
+		if (reg != getRegisters().end()) {
+			if (negative || reg->second.mSize != 8) return fail("invalid register in memory operand");
+			if (operand.mBase < 0) {
+				operand.mBase = reg->second.mNumber;
+			} else if (operand.mIndex < 0) {
+				operand.mIndex = reg->second.mNumber;
+				operand.mScale = 1;
+			} else {
+				return fail("too many registers in memory operand");
+			}
+			return true;
+		}
+
+		std::optional<int64_t> number = parseNumber(term);
+		if (number.has_value()) {
+			operand.mValue += negative ? -number.value() : number.value();
+			return true;
+		}
+
+		if (isSymbolName(term)) {
+			if (negative || !operand.mSymbol.empty()) return fail("only a single label can be added to an operand");
+			operand.mSymbol = qualify(std::string(term));
+			return true;
+		}
+		return fail("can't parse operand " + std::string(term));
+	}
+
+	std::string Assembler::qualify(const std::string& label) const {
+		if (!label.empty() && label[0] == '.')
+			return mLastLabel + label;
+		return label;
+	}
+
+	bool Assembler::assembleInstruction(const std::string& mnemonic, std::string_view arguments) {
+		static const std::map<std::string, std::vector<uint8_t>> withoutOperands = {
+			{"ret", {0xC3}}, {"syscall", {0x0F, 0x05}}, {"nop", {0x90}}, {"leave", {0xC9}}, {"hlt", {0xF4}}, {"int3", {0xCC}},
+			{"cbw", {0x66, 0x98}}, {"cwde", {0x98}}, {"cdqe", {0x48, 0x98}},
+			{"cwd", {0x66, 0x99}}, {"cdq", {0x99}}, {"cqo", {0x48, 0x99}},
+			{"movsb", {0xA4}}, {"movsw", {0x66, 0xA5}}, {"movsq", {0x48, 0xA5}},
+			{"stosb", {0xAA}}, {"stosw", {0x66, 0xAB}}, {"stosd", {0xAB}}, {"stosq", {0x48, 0xAB}},
+		};
+		static const std::map<std::string, int> arithmetic = {
+			{"add", 0}, {"or", 1}, {"adc", 2}, {"sbb", 3}, {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7},
+		};
+		static const std::map<std::string, int> unary = {
+			{"not", 2}, {"neg", 3}, {"mul", 4}, {"div", 6}, {"idiv", 7},
+		};
+		static const std::map<std::string, int> shifts = {
+			{"rol", 0}, {"ror", 1}, {"rcl", 2}, {"rcr", 3}, {"shl", 4}, {"sal", 4}, {"shr", 5}, {"sar", 7},
+		};
+
+		std::vector<Operand> operands;
+		for (std::string_view argument : splitArguments(arguments)) {
+			std::optional<Operand> operand = parseOperand(argument);
+			if (!operand.has_value()) return false;
+			operands.push_back(operand.value());
+		}
+		using Kind = Operand::Kind;
+		auto isRM = [](const Operand& o) { return o.mKind == Kind::REGISTER || o.mKind == Kind::MEMORY; };
+		// The size of a two operand instruction follows from its registers or the size keyword of the memory operand
+		auto commonSize = [this](const Operand& a, const Operand& b) -> int {
+			if (a.mSize != 0 && b.mSize != 0 && a.mSize != b.mSize && b.mKind != Kind::IMMEDIATE) {
+				fail("operand sizes don't match");
+				return 0;
+			}
+			int size = a.mSize != 0 ? a.mSize : b.mKind != Kind::IMMEDIATE ? b.mSize : 0;
+			if (size == 0) fail("operation size not specified");
+			return size;
+		};
+
+		auto plain = withoutOperands.find(mnemonic);
+		if (plain != withoutOperands.end()) {
+			if (!operands.empty()) return fail(mnemonic + " doesn't take operands");
+			for (uint8_t byte : plain->second) emit(byte);
+			return true;
+		}
+
+		auto alu = arithmetic.find(mnemonic);
+		if (alu != arithmetic.end()) {
+			if (operands.size() != 2) return fail(mnemonic + " takes two operands");
+			const Operand& destination = operands[0];
+			const Operand& source = operands[1];
+			int n = alu->second;
+			int size = commonSize(destination, source);
+			if (size == 0) return false;
+			if (isRM(destination) && source.mKind == Kind::REGISTER)
+				return encodeModRM({uint8_t((size == 1 ? 0x00 : 0x01) + 8 * n)}, size, source.mRegister, source.mNeedsRex, source.mHighByte, destination, size == 8);
+			if (destination.mKind == Kind::REGISTER && source.mKind == Kind::MEMORY)
+				return encodeModRM({uint8_t((size == 1 ? 0x02 : 0x03) + 8 * n)}, size, destination.mRegister, destination.mNeedsRex, destination.mHighByte, source, size == 8);
+			if (isRM(destination) && source.mKind == Kind::IMMEDIATE) {
+				if (size == 1) {
+					return encodeModRM({0x80}, size, n, false, false, destination, false) && encodeImmediate(source, 1);
+				} else if (source.mSymbol.empty() && fitsInt8(source.mValue)) {
+					return encodeModRM({0x83}, size, n, false, false, destination, size == 8) && encodeImmediate(source, 1);
+				}
+				if (size == 8 && source.mSymbol.empty() && !fitsInt32(source.mValue))
+					return fail("immediate doesn't fit in a sign extended dword");
+				return encodeModRM({0x81}, size, n, false, false, destination, size == 8) && encodeImmediate(source, size == 2 ? 2 : 4);
+			}
+			return fail("invalid operands for " + mnemonic);
+		}
+
+		if (mnemonic == "mov") {
+			if (operands.size() != 2) return fail("mov takes two operands");
+			const Operand& destination = operands[0];
+			const Operand& source = operands[1];
+			int size = commonSize(destination, source);
+			if (size == 0) return false;
+			if (isRM(destination) && source.mKind == Kind::REGISTER)
+				return encodeModRM({uint8_t(size == 1 ? 0x88 : 0x89)}, size, source.mRegister, source.mNeedsRex, source.mHighByte, destination, size == 8);
+			if (destination.mKind == Kind::REGISTER && source.mKind == Kind::MEMORY)
+				return encodeModRM({uint8_t(size == 1 ? 0x8A : 0x8B)}, size, destination.mRegister, destination.mNeedsRex, destination.mHighByte, source, size == 8);
+			if (destination.mKind == Kind::REGISTER && source.mKind == Kind::IMMEDIATE) {
+				int reg = destination.mRegister;
+				auto shortForm = [&](uint8_t opcode, bool rexW, int immediateSize) {
+					uint8_t rex = (rexW ? 0x48 : 0) | (reg >= 8 ? 0x41 : 0) | (destination.mNeedsRex ? 0x40 : 0);
+					if (size == 2) emit(uint8_t(0x66));
+					if (rex != 0) emit(rex);
+					emit(uint8_t(opcode + (reg & 7)));
+					return encodeImmediate(source, immediateSize);
+				};
+				if (size == 1) return shortForm(0xB0, false, 1);
+				if (size == 2) return shortForm(0xB8, false, 2);
+				if (size == 4) return shortForm(0xB8, false, 4);
+				if (!source.mSymbol.empty() || !fitsInt32(source.mValue) && uint64_t(source.mValue) > UINT32_MAX)
+					return shortForm(0xB8, true, 8); // Addresses always get the full 64 bits
+				if (!fitsInt32(source.mValue))
+					return shortForm(0xB8, false, 4); // Writing the 32 bit register clears the top half
+				return encodeModRM({0xC7}, size, 0, false, false, destination, true) && encodeImmediate(source, 4);
+			}
+			if (destination.mKind == Kind::MEMORY && source.mKind == Kind::IMMEDIATE) {
+				if (size == 8 && source.mSymbol.empty() && !fitsInt32(source.mValue))
+					return fail("immediate doesn't fit in a sign extended dword");
+				return encodeModRM({uint8_t(size == 1 ? 0xC6 : 0xC7)}, size, 0, false, false, destination, size == 8)
+					&& encodeImmediate(source, size == 8 ? 4 : size);
+			}
+			return fail("invalid operands for mov");
+		}
+
+		if (mnemonic == "test") {
+			if (operands.size() != 2) return fail("test takes two operands");
+			Operand destination = operands[0];
+			Operand source = operands[1];
+			if (destination.mKind == Kind::REGISTER && source.mKind == Kind::MEMORY)
+				std::swap(destination, source);
+			int size = commonSize(destination, source);
+			if (size == 0) return false;
+			if (isRM(destination) && source.mKind == Kind::REGISTER)
+				return encodeModRM({uint8_t(size == 1 ? 0x84 : 0x85)}, size, source.mRegister, source.mNeedsRex, source.mHighByte, destination, size == 8);
+			if (isRM(destination) && source.mKind == Kind::IMMEDIATE)
+				return encodeModRM({uint8_t(size == 1 ? 0xF6 : 0xF7)}, size, 0, false, false, destination, size == 8)
+					&& encodeImmediate(source, size == 8 ? 4 : size);
+			return fail("invalid operands for test");
+		}
+
+		if (mnemonic == "lea") {
+			if (operands.size() != 2 || operands[0].mKind != Kind::REGISTER || operands[1].mKind != Kind::MEMORY || operands[0].mSize == 1)
+				return fail("lea takes a register and a memory operand");
+			return encodeModRM({0x8D}, operands[0].mSize, operands[0].mRegister, false, false, operands[1], operands[0].mSize == 8);
+		}
+
+		if (mnemonic == "movzx" || mnemonic == "movsx") {
+			if (operands.size() != 2 || operands[0].mKind != Kind::REGISTER || !isRM(operands[1]))
+				return fail(mnemonic + " takes a register and a register or memory operand");
+			const Operand& destination = operands[0];
+			const Operand& source = operands[1];
+			if ((source.mSize != 1 && source.mSize != 2) || destination.mSize <= source.mSize)
+				return fail("invalid operand sizes for " + mnemonic);
+			uint8_t opcode = uint8_t((mnemonic == "movzx" ? 0xB6 : 0xBE) + (source.mSize == 2 ? 1 : 0));
+			return encodeModRM({0x0F, opcode}, destination.mSize, destination.mRegister, source.mNeedsRex, source.mHighByte, source, destination.mSize == 8);
+		}
+
+		if (mnemonic == "movsxd") {
+			if (operands.size() != 2 || operands[0].mKind != Kind::REGISTER || operands[0].mSize != 8 || !isRM(operands[1]) || (operands[1].mSize != 4 && operands[1].mSize != 0))
+				return fail("movsxd takes a qword register and a dword operand");
+			return encodeModRM({0x63}, 8, operands[0].mRegister, false, false, operands[1], true);
+		}
+
+		if (mnemonic == "imul") {
+			if (operands.size() == 1)
+				return isRM(operands[0]) && operands[0].mSize != 0 ? encodeModRM({uint8_t(operands[0].mSize == 1 ? 0xF6 : 0xF7)}, operands[0].mSize, 5, false, false, operands[0], operands[0].mSize == 8) : fail("invalid operand for imul");
+			if (operands[0].mKind != Kind::REGISTER || operands[0].mSize == 1)
+				return fail("imul needs a word, dword or qword register");
+			int size = operands[0].mSize;
+			if (operands.size() == 2 && isRM(operands[1])) {
+				if (commonSize(operands[0], operands[1]) == 0) return false;
+				return encodeModRM({0x0F, 0xAF}, size, operands[0].mRegister, false, false, operands[1], size == 8);
+			}
+			const Operand& source = operands.size() == 2 ? operands[0] : operands[1];
+			const Operand& immediate = operands.back();
+			if (!isRM(source) || immediate.mKind != Kind::IMMEDIATE || !immediate.mSymbol.empty())
+				return fail("invalid operands for imul");
+			if (fitsInt8(immediate.mValue))
+				return encodeModRM({0x6B}, size, operands[0].mRegister, false, false, source, size == 8) && encodeImmediate(immediate, 1);
+			return encodeModRM({0x69}, size, operands[0].mRegister, false, false, source, size == 8) && encodeImmediate(immediate, size == 2 ? 2 : 4);
+		}
+
+		auto group = unary.find(mnemonic);
+		if (group != unary.end() || mnemonic == "inc" || mnemonic == "dec") {
+			// `div al, bl` names the accumulator explicitly, which doesn't change the encoding
+			if (operands.size() == 2 && group != unary.end() && group->second >= 4 && operands[0].mKind == Kind::REGISTER
+				&& operands[0].mRegister == 0 && !operands[0].mHighByte && operands[0].mSize == operands[1].mSize) {
+				operands.erase(operands.begin());
+			}
+			if (operands.size() != 1 || !isRM(operands[0]) || operands[0].mSize == 0)
+				return fail(mnemonic + " takes a register or a sized memory operand");
+			int size = operands[0].mSize;
+			if (group != unary.end())
+				return encodeModRM({uint8_t(size == 1 ? 0xF6 : 0xF7)}, size, group->second, false, false, operands[0], size == 8);
+			return encodeModRM({uint8_t(size == 1 ? 0xFE : 0xFF)}, size, mnemonic == "inc" ? 0 : 1, false, false, operands[0], size == 8);
+		}
+
+		auto shift = shifts.find(mnemonic);
+		if (shift != shifts.end()) {
+			if (operands.size() != 2 || !isRM(operands[0]) || operands[0].mSize == 0)
+				return fail(mnemonic + " takes a register or a sized memory operand and a count");
+			int size = operands[0].mSize;
+			const Operand& count = operands[1];
+			if (count.mKind == Kind::REGISTER && count.mSize == 1 && count.mRegister == 1 && !count.mNeedsRex)
+				return encodeModRM({uint8_t(size == 1 ? 0xD2 : 0xD3)}, size, shift->second, false, false, operands[0], size == 8);
+			if (count.mKind != Kind::IMMEDIATE || !count.mSymbol.empty())
+				return fail("the count of " + mnemonic + " has to be cl or a number");
+			if (count.mValue == 1)
+				return encodeModRM({uint8_t(size == 1 ? 0xD0 : 0xD1)}, size, shift->second, false, false, operands[0], size == 8);
+			return encodeModRM({uint8_t(size == 1 ? 0xC0 : 0xC1)}, size, shift->second, false, false, operands[0], size == 8) && encodeImmediate(count, 1);
+		}
+
+		if (mnemonic == "push" || mnemonic == "pop") {
+			if (operands.size() != 1) return fail(mnemonic + " takes one operand");
+			const Operand& operand = operands[0];
+			bool push = mnemonic == "push";
+			if (operand.mKind == Kind::REGISTER) {
+				if (operand.mSize != 8) return fail(mnemonic + " only takes qword registers");
+				if (operand.mRegister >= 8) emit(uint8_t(0x41));
+				emit(uint8_t((push ? 0x50 : 0x58) + (operand.mRegister & 7)));
+				return true;
+			}
+			if (operand.mKind == Kind::MEMORY)
+				return encodeModRM({uint8_t(push ? 0xFF : 0x8F)}, 8, push ? 6 : 0, false, false, operand, false);
+			if (!push) return fail("can't pop into an immediate");
+			if (operand.mSymbol.empty() && fitsInt8(operand.mValue)) {
+				emit(uint8_t(0x6A));
+				return encodeImmediate(operand, 1);
+			}
+			emit(uint8_t(0x68));
+			return encodeImmediate(operand, 4);
+		}
+
+		if (mnemonic == "call" || mnemonic == "jmp") {
+			if (operands.size() != 1) return fail(mnemonic + " takes one operand");
+			bool call = mnemonic == "call";
+			if (operands[0].mKind == Kind::IMMEDIATE)
+				return encodeBranch({uint8_t(call ? 0xE8 : 0xE9)}, operands[0], 4);
+			if (operands[0].mKind == Kind::REGISTER && operands[0].mSize != 8)
+				return fail(mnemonic + " needs a qword register");
+			return encodeModRM({0xFF}, 8, call ? 2 : 4, false, false, operands[0], false);
+		}
+
+		if (mnemonic == "loop" || mnemonic == "jrcxz") {
+			if (operands.size() != 1 || operands[0].mKind != Kind::IMMEDIATE) return fail(mnemonic + " takes a label");
+			return encodeBranch({uint8_t(mnemonic == "loop" ? 0xE2 : 0xE3)}, operands[0], 1);
+		}
+
+		const auto& conditions = getConditionCodes();
+		if (mnemonic.size() > 1 && mnemonic[0] == 'j' && conditions.contains(mnemonic.substr(1))) {
+			if (operands.size() != 1 || operands[0].mKind != Kind::IMMEDIATE) return fail(mnemonic + " takes a label");
+			return encodeBranch({0x0F, uint8_t(0x80 + conditions.at(mnemonic.substr(1)))}, operands[0], 4);
+		}
+
+		if (mnemonic.starts_with("set") && conditions.contains(mnemonic.substr(3))) {
+			if (operands.size() != 1 || !isRM(operands[0]) || (operands[0].mSize != 1 && operands[0].mSize != 0))
+				return fail(mnemonic + " takes a byte register or memory operand");
+			return encodeModRM({0x0F, uint8_t(0x90 + conditions.at(mnemonic.substr(3)))}, 1, 0, false, false, operands[0], false);
+		}
+
+		if (mnemonic.starts_with("cmov") && conditions.contains(mnemonic.substr(4))) {
+			if (operands.size() != 2 || operands[0].mKind != Kind::REGISTER || !isRM(operands[1]) || operands[0].mSize == 1)
+				return fail(mnemonic + " takes a register and a register or memory operand");
+			int size = commonSize(operands[0], operands[1]);
+			if (size == 0) return false;
+			return encodeModRM({0x0F, uint8_t(0x40 + conditions.at(mnemonic.substr(4)))}, size, operands[0].mRegister, false, false, operands[1], size == 8);
+		}
+
+		// The bit number is taken modulo the operand size for registers, but can reach past a memory operand
+		static const std::map<std::string, int> bitTests = {
+			{"bt", 4}, {"bts", 5}, {"btr", 6}, {"btc", 7},
+		};
+		auto bitTest = bitTests.find(mnemonic);
+		if (bitTest != bitTests.end()) {
+			if (operands.size() != 2 || !isRM(operands[0]))
+				return fail(mnemonic + " takes a register or memory operand and a bit number");
+			const Operand& bits = operands[0];
+			const Operand& number = operands[1];
+			if (number.mKind == Kind::REGISTER) {
+				int size = commonSize(bits, number);
+				if (size == 0) return false;
+				if (size == 1) return fail(mnemonic + " doesn't take byte operands");
+				return encodeModRM({0x0F, uint8_t(0xA3 + 8 * (bitTest->second - 4))}, size, number.mRegister, number.mNeedsRex, false, bits, size == 8);
+			}
+			if (number.mKind != Kind::IMMEDIATE || !number.mSymbol.empty() || bits.mSize < 2)
+				return fail("invalid operands for " + mnemonic);
+			return encodeModRM({0x0F, 0xBA}, bits.mSize, bitTest->second, false, false, bits, bits.mSize == 8) && encodeImmediate(number, 1);
+		}
+
+		if (mnemonic == "popcnt") {
+			if (operands.size() != 2 || operands[0].mKind != Kind::REGISTER || !isRM(operands[1]) || operands[0].mSize == 1)
+				return fail("popcnt takes a register and a register or memory operand");
+			int size = commonSize(operands[0], operands[1]);
+			if (size == 0) return false;
+			// The mandatory prefix goes before the operand size prefix and REX
+			emit(uint8_t(0xF3));
+			return encodeModRM({0x0F, 0xB8}, size, operands[0].mRegister, false, false, operands[1], size == 8);
+		}
+
+		// SSE2, on xmm registers: a mandatory prefix and a two byte opcode. Memory operands of the arithmetic have to be aligned
+		static const std::map<std::string, uint8_t> packed = {
+			{"paddb", 0xFC}, {"paddw", 0xFD}, {"paddd", 0xFE}, {"paddq", 0xD4},
+			{"psubb", 0xF8}, {"psubw", 0xF9}, {"psubd", 0xFA}, {"psubq", 0xFB},
+			{"pmullw", 0xD5}, {"pmuludq", 0xF4}, {"pand", 0xDB}, {"por", 0xEB}, {"pxor", 0xEF}, {"pcmpeqw", 0x75},
+			{"punpcklbw", 0x60}, {"punpcklwd", 0x61}, {"punpckldq", 0x62}, {"punpcklqdq", 0x6C},
+		};
+		// The opcode and the number in the reg field, the byte shifts move the whole register
+		static const std::map<std::string, std::pair<uint8_t, int>> packedShifts = {
+			{"psllw", {0x71, 6}}, {"pslld", {0x72, 6}}, {"psllq", {0x73, 6}}, {"pslldq", {0x73, 7}},
+			{"psrlw", {0x71, 2}}, {"psrld", {0x72, 2}}, {"psrlq", {0x73, 2}}, {"psrldq", {0x73, 3}},
+		};
+		static const std::map<std::string, uint8_t> shuffles = {
+			{"pshufd", 0x66}, {"pshuflw", 0xF2},
+		};
+		auto isXmm = [](const Operand& o) { return o.mKind == Kind::REGISTER && o.mSize == 16; };
+		auto isXmmOrMemory = [&](const Operand& o) { return isXmm(o) || (o.mKind == Kind::MEMORY && (o.mSize == 0 || o.mSize == 16)); };
+		auto encodeVector = [&](uint8_t prefix, uint8_t opcode, int reg, const Operand& rm, bool rexW) {
+			if (prefix != 0) emit(prefix);
+			return encodeModRM({0x0F, opcode}, 16, reg, false, false, rm, rexW);
+		};
+
+		auto vector = packed.find(mnemonic);
+		if (vector != packed.end()) {
+			if (operands.size() != 2 || !isXmm(operands[0]) || !isXmmOrMemory(operands[1]))
+				return fail(mnemonic + " takes an xmm register and an xmm register or memory operand");
+			return encodeVector(0x66, vector->second, operands[0].mRegister, operands[1], false);
+		}
+
+		auto vectorShift = packedShifts.find(mnemonic);
+		if (vectorShift != packedShifts.end()) {
+			if (operands.size() != 2 || !isXmm(operands[0]) || operands[1].mKind != Kind::IMMEDIATE || !operands[1].mSymbol.empty())
+				return fail(mnemonic + " takes an xmm register and a count");
+			return encodeVector(0x66, vectorShift->second.first, vectorShift->second.second, operands[0], false) && encodeImmediate(operands[1], 1);
+		}
+
+		auto shuffle = shuffles.find(mnemonic);
+		if (shuffle != shuffles.end()) {
+			if (operands.size() != 3 || !isXmm(operands[0]) || !isXmmOrMemory(operands[1]) || operands[2].mKind != Kind::IMMEDIATE)
+				return fail(mnemonic + " takes an xmm register, an xmm register or memory operand and an order");
+			return encodeVector(shuffle->second, 0x70, operands[0].mRegister, operands[1], false) && encodeImmediate(operands[2], 1);
+		}
+
+		if (mnemonic == "movdqu" || mnemonic == "movdqa") {
+			uint8_t prefix = mnemonic == "movdqu" ? 0xF3 : 0x66;
+			if (operands.size() != 2) return fail(mnemonic + " takes two operands");
+			if (isXmm(operands[0]) && isXmmOrMemory(operands[1]))
+				return encodeVector(prefix, 0x6F, operands[0].mRegister, operands[1], false);
+			if (operands[0].mKind == Kind::MEMORY && isXmm(operands[1]))
+				return encodeVector(prefix, 0x7F, operands[1].mRegister, operands[0], false);
+			return fail("invalid operands for " + mnemonic);
+		}
+
+		if (mnemonic == "movq" || mnemonic == "movd") {
+			int size = mnemonic == "movq" ? 8 : 4;
+			if (operands.size() != 2) return fail(mnemonic + " takes two operands");
+			const Operand& destination = operands[0];
+			const Operand& source = operands[1];
+			if (isXmm(destination) && isXmm(source) && size == 8)
+				return encodeVector(0xF3, 0x7E, destination.mRegister, source, false);
+			if (isXmm(destination) && isRM(source) && (source.mSize == size || (source.mKind == Kind::MEMORY && source.mSize == 0)))
+				return encodeVector(0x66, 0x6E, destination.mRegister, source, size == 8);
+			if (isRM(destination) && isXmm(source) && (destination.mSize == size || (destination.mKind == Kind::MEMORY && destination.mSize == 0)))
+				return encodeVector(0x66, 0x7E, source.mRegister, destination, size == 8);
+			return fail("invalid operands for " + mnemonic);
+		}
+
+		// Floating point on the low element of xmm registers, memory operands are the size of the element, and on every lane
+		static const std::map<std::string, std::pair<uint8_t, uint8_t>> scalars = {
+			{"addsd", {0xF2, 0x58}}, {"subsd", {0xF2, 0x5C}}, {"mulsd", {0xF2, 0x59}}, {"divsd", {0xF2, 0x5E}}, {"sqrtsd", {0xF2, 0x51}},
+			{"addss", {0xF3, 0x58}}, {"subss", {0xF3, 0x5C}}, {"mulss", {0xF3, 0x59}}, {"divss", {0xF3, 0x5E}}, {"sqrtss", {0xF3, 0x51}},
+			{"cvtsd2ss", {0xF2, 0x5A}}, {"cvtss2sd", {0xF3, 0x5A}}, {"ucomisd", {0x66, 0x2E}}, {"ucomiss", {0x00, 0x2E}},
+			{"xorpd", {0x66, 0x57}}, {"movapd", {0x66, 0x28}},
+			{"addps", {0x00, 0x58}}, {"subps", {0x00, 0x5C}}, {"mulps", {0x00, 0x59}},
+			{"addpd", {0x66, 0x58}}, {"subpd", {0x66, 0x5C}}, {"mulpd", {0x66, 0x59}},
+		};
+		auto isXmmOrScalar = [&](const Operand& o) {
+			return isXmm(o) || (o.mKind == Kind::MEMORY && (o.mSize == 0 || o.mSize == 4 || o.mSize == 8 || o.mSize == 16));
+		};
+
+		auto scalar = scalars.find(mnemonic);
+		if (scalar != scalars.end()) {
+			if (operands.size() != 2 || !isXmm(operands[0]) || !isXmmOrScalar(operands[1]))
+				return fail(mnemonic + " takes an xmm register and an xmm register or memory operand");
+			return encodeVector(scalar->second.first, scalar->second.second, operands[0].mRegister, operands[1], false);
+		}
+
+		if (mnemonic == "movsd" || mnemonic == "movss") {
+			uint8_t prefix = mnemonic == "movsd" ? 0xF2 : 0xF3;
+			if (operands.size() != 2) return fail(mnemonic + " takes two operands");
+			if (isXmm(operands[0]) && isXmmOrScalar(operands[1]))
+				return encodeVector(prefix, 0x10, operands[0].mRegister, operands[1], false);
+			if (operands[0].mKind == Kind::MEMORY && isXmm(operands[1]))
+				return encodeVector(prefix, 0x11, operands[1].mRegister, operands[0], false);
+			return fail("invalid operands for " + mnemonic);
+		}
+
+		// Conversions between integers and floating point, the size of the general purpose operand decides on REX.W
+		if (mnemonic == "cvtsi2sd" || mnemonic == "cvtsi2ss") {
+			uint8_t prefix = mnemonic == "cvtsi2sd" ? 0xF2 : 0xF3;
+			if (operands.size() != 2 || !isXmm(operands[0]) || !isRM(operands[1]) || (operands[1].mSize != 4 && operands[1].mSize != 8))
+				return fail(mnemonic + " takes an xmm register and a dword or qword operand");
+			return encodeVector(prefix, 0x2A, operands[0].mRegister, operands[1], operands[1].mSize == 8);
+		}
+		if (mnemonic == "cvttsd2si" || mnemonic == "cvttss2si" || mnemonic == "cvtsd2si" || mnemonic == "cvtss2si") {
+			uint8_t prefix = mnemonic.find("sd") != std::string::npos ? 0xF2 : 0xF3;
+			uint8_t opcode = mnemonic.starts_with("cvtt") ? 0x2C : 0x2D;
+			if (operands.size() != 2 || operands[0].mKind != Kind::REGISTER || (operands[0].mSize != 4 && operands[0].mSize != 8) || !isXmmOrScalar(operands[1]))
+				return fail(mnemonic + " takes a dword or qword register and an xmm register or memory operand");
+			return encodeVector(prefix, opcode, operands[0].mRegister, operands[1], operands[0].mSize == 8);
+		}
+
+		return fail("unsupported instruction " + mnemonic);
+	}
+
+	bool Assembler::encodeModRM(const std::vector<uint8_t>& opcode, int size, int reg, bool regNeedsRex, bool regHighByte, const Operand& rm, bool rexW) {
+		uint8_t rex = 0;
+		if (rexW) rex |= 0x48;
+		if (reg >= 8) rex |= 0x44;
+		bool needsRex = regNeedsRex;
+		bool highByte = regHighByte;
+		if (rm.mKind == Operand::Kind::REGISTER) {
+			if (rm.mRegister >= 8) rex |= 0x41;
+			needsRex |= rm.mNeedsRex;
+			highByte |= rm.mHighByte;
+		} else {
+			if (rm.mBase >= 8) rex |= 0x41;
+			if (rm.mIndex >= 8) rex |= 0x42;
+		}
+		if (needsRex) rex |= 0x40;
+		if (rex != 0 && highByte)
+			return fail("ah, ch, dh and bh can't be used in an instruction that needs a REX prefix");
+
+		if (size == 2) emit(uint8_t(0x66));
+		if (rex != 0) emit(rex);
+		for (uint8_t byte : opcode) emit(byte);
+
+		uint8_t regBits = uint8_t((reg & 7) << 3);
+		if (rm.mKind == Operand::Kind::REGISTER) {
+			emit(uint8_t(0xC0 | regBits | (rm.mRegister & 7)));
+			return true;
+		}
+
+		int scaleBits;
+		switch (rm.mScale) {
+			case 1: scaleBits = 0; break;
+			case 2: scaleBits = 1; break;
+			case 4: scaleBits = 2; break;
+			case 8: scaleBits = 3; break;
+			default: return fail("the scale of an index has to be 1, 2, 4 or 8");
+		}
+		if (rm.mIndex == 4) return fail("rsp can't be an index");
+		uint8_t indexBits = uint8_t((rm.mIndex < 0 ? 4 : rm.mIndex & 7) << 3);
+
+		auto displacement32 = [&]() {
+			if (!rm.mSymbol.empty()) {
+				mFixups.push_back(Fixup{mCurrent, here(), 4, rm.mSymbol, rm.mValue, R_X86_64_32S});
+				emit(0, 4);
+				return true;
+			}
+			if (!fitsInt32(rm.mValue)) return fail("displacement doesn't fit in a dword");
+			emit(uint64_t(rm.mValue), 4);
+			return true;
+		};
+
+		if (rm.mBase < 0) {
+			// Absolute address: a SIB byte without a base, followed by a 32 bit displacement
+			emit(uint8_t(0x04 | regBits));
+			emit(uint8_t(scaleBits << 6 | indexBits | 5));
+			return displacement32();
+		}
+
+		int mod;
+		if (!rm.mSymbol.empty()) mod = 2;
+		else if (rm.mValue == 0 && (rm.mBase & 7) != 5) mod = 0;
+		else if (fitsInt8(rm.mValue)) mod = 1;
+		else mod = 2;
+
+		if (rm.mIndex >= 0 || (rm.mBase & 7) == 4) {
+			emit(uint8_t(mod << 6 | regBits | 4));
+			emit(uint8_t(scaleBits << 6 | indexBits | (rm.mBase & 7)));
+		} else {
+			emit(uint8_t(mod << 6 | regBits | (rm.mBase & 7)));
+		}
+		if (mod == 1) emit(uint64_t(rm.mValue), 1);
+		if (mod == 2) return displacement32();
+		return true;
+	}
+
+	bool Assembler::encodeImmediate(const Operand& immediate, int size) {
+		if (immediate.mKind != Operand::Kind::IMMEDIATE) return fail("expected an immediate");
+		if (!immediate.mSymbol.empty()) {
+			if (size != 4 && size != 8) return fail("an address doesn't fit in a " + std::to_string(size) + " byte immediate");
+			mFixups.push_back(Fixup{mCurrent, here(), size, immediate.mSymbol, immediate.mValue, uint32_t(size == 8 ? R_X86_64_64 : R_X86_64_32S)});
+			emit(0, size);
+			return true;
+		}
+		if (!fitsSize(immediate.mValue, size)) return fail("immediate doesn't fit in " + std::to_string(size) + " bytes");
+		emit(uint64_t(immediate.mValue), size);
+		return true;
+	}
+
+	bool Assembler::encodeBranch(const std::vector<uint8_t>& opcode, const Operand& target, int size) {
+		if (target.mSymbol.empty()) return fail("a jump needs a label to jump to");
+		for (uint8_t byte : opcode) emit(byte);
+		// The displacement counts from the end of the instruction, which is where this field ends
+		mFixups.push_back(Fixup{mCurrent, here(), size, target.mSymbol, target.mValue - size, uint32_t(size == 1 ? R_X86_64_PC8 : R_X86_64_PC32)});
+		emit(0, size);
+		return true;
+	}
+
+	void Assembler::emit(uint8_t byte) {
+		mSections[int(mCurrent)].mBytes.push_back(byte);
+	}
+
+	void Assembler::emit(uint64_t value, int size) {
+		for (int i = 0; i < size; i++) {
+			emit(uint8_t(value >> (8 * i)));
+		}
+	}
+
+	uint64_t Assembler::here() const {
+		const Section& section = mSections[int(mCurrent)];
+		return mCurrent == SectionId::BSS ? section.mReserved : section.mBytes.size();
+	}
+
+	bool Assembler::fail(const std::string& reason) {
+		mError = reason;
+		return false;
+	}
+
+	bool Assembler::resolveFixups() {
+		for (const auto& fixup : mFixups) {
+			auto symbol = mSymbols.find(fixup.mSymbol);
+			bool defined = symbol != mSymbols.end();
+			if (!defined && !mExterns.contains(fixup.mSymbol))
+				return fail("undefined symbol " + fixup.mSymbol);
+
+			Section& section = mSections[int(fixup.mSection)];
+			bool pcRelative = fixup.mType == R_X86_64_PC32 || fixup.mType == R_X86_64_PC8;
+			if (pcRelative && defined && symbol->second.mSection == fixup.mSection) {
+				int64_t value = int64_t(symbol->second.mOffset) + fixup.mAddend - int64_t(fixup.mOffset);
+				if (fixup.mSize == 1 ? !fitsInt8(value) : !fitsInt32(value))
+					return fail("jump to " + fixup.mSymbol + " is out of range");
+				for (int i = 0; i < fixup.mSize; i++) {
+					section.mBytes[fixup.mOffset + i] = uint8_t(uint64_t(value) >> (8 * i));
+				}
+				continue;
+			}
+			// Calls to other objects and shared libraries go through the PLT when ld decides they need one
+			uint32_t type = fixup.mType == R_X86_64_PC32 && !defined ? R_X86_64_PLT32 : fixup.mType;
+			section.mRelocations.push_back(Relocation{fixup.mOffset, fixup.mSymbol, type, fixup.mAddend});
+		}
+		for (const auto& global : mGlobals) {
+			if (!mSymbols.contains(global) && !mExterns.contains(global))
+				return fail("global symbol " + global + " is never defined");
+		}
+		return true;
+	}
+
+	std::vector<uint8_t> Assembler::writeObject() const {
+		// Section header indices, in this order: null, 4 sections, their 4 relocation sections, symbols, names, section names
+		const char* sectionNames[c_SectionCount] = {".text", ".data", ".bss", ".rodata"};
+		const uint64_t sectionFlags[c_SectionCount] = {SHF_ALLOC | SHF_EXECINSTR, SHF_ALLOC | SHF_WRITE, SHF_ALLOC | SHF_WRITE, SHF_ALLOC};
+		const uint64_t sectionAlignment[c_SectionCount] = {16, 8, 8, 8};
+		const uint16_t symtabIndex = 1 + 2 * c_SectionCount;
+		const uint16_t strtabIndex = symtabIndex + 1;
+		const uint16_t shstrtabIndex = strtabIndex + 1;
+		const uint16_t sectionCount = shstrtabIndex + 1;
+
+		// Locals have to come before globals in the symbol table
+		std::vector<std::string> symbolOrder;
+		for (const auto& [name, symbol] : mSymbols) {
+			if (!mGlobals.contains(name) && !mExterns.contains(name)) symbolOrder.push_back(name);
+		}
+		size_t firstGlobal = symbolOrder.size() + 1;
+		for (const auto& [name, symbol] : mSymbols) {
+			if (mGlobals.contains(name) || mExterns.contains(name)) symbolOrder.push_back(name);
+		}
+		for (const auto& name : mExterns) {
+			if (!mSymbols.contains(name)) symbolOrder.push_back(name);
+		}
+
+		std::string strtab(1, '\0');
+		std::vector<Elf64_Sym> symbols(1);
+		std::map<std::string, uint32_t> symbolIndices;
+		for (const auto& name : symbolOrder) {
+			Elf64_Sym sym{};
+			sym.st_name = uint32_t(strtab.size());
+			strtab += name;
+			strtab += '\0';
+			auto defined = mSymbols.find(name);
+			bool global = symbolIndices.size() + 1 >= firstGlobal;
+			sym.st_info = ELF64_ST_INFO(global ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE);
+			if (defined != mSymbols.end()) {
+				sym.st_shndx = uint16_t(1 + int(defined->second.mSection));
+				sym.st_value = defined->second.mOffset;
+			} else {
+				sym.st_shndx = SHN_UNDEF;
+			}
+			symbolIndices[name] = uint32_t(symbols.size());
+			symbols.push_back(sym);
+		}
+
+		std::string shstrtab(1, '\0');
+		auto addName = [&shstrtab](const std::string& name) {
+			uint32_t offset = uint32_t(shstrtab.size());
+			shstrtab += name;
+			shstrtab += '\0';
+			return offset;
+		};
+
+		std::vector<uint8_t> file(sizeof(Elf64_Ehdr), 0);
+		auto append = [&file](const void* data, size_t size, size_t alignment) {
+			while (file.size() % alignment != 0) file.push_back(0);
+			size_t offset = file.size();
+			file.insert(file.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+			return offset;
+		};
+
+		std::vector<Elf64_Shdr> headers(sectionCount);
+		for (size_t i = 0; i < c_SectionCount; i++) {
+			const Section& section = mSections[i];
+			Elf64_Shdr& header = headers[1 + i];
+			header.sh_name = addName(sectionNames[i]);
+			header.sh_flags = sectionFlags[i];
+			header.sh_addralign = sectionAlignment[i];
+			if (SectionId(i) == SectionId::BSS) {
+				header.sh_type = SHT_NOBITS;
+				header.sh_offset = file.size();
+				header.sh_size = section.mReserved;
+			} else {
+				header.sh_type = SHT_PROGBITS;
+				header.sh_offset = append(section.mBytes.data(), section.mBytes.size(), sectionAlignment[i]);
+				header.sh_size = section.mBytes.size();
+			}
+
+			std::vector<Elf64_Rela> relocations;
+			for (const auto& relocation : section.mRelocations) {
+				Elf64_Rela rela{};
+				rela.r_offset = relocation.mOffset;
+				rela.r_info = ELF64_R_INFO(uint64_t(symbolIndices.at(relocation.mSymbol)), relocation.mType);
+				rela.r_addend = relocation.mAddend;
+				relocations.push_back(rela);
+			}
+			Elf64_Shdr& relaHeader = headers[1 + c_SectionCount + i];
+			relaHeader.sh_name = addName(std::string(".rela") + sectionNames[i]);
+			relaHeader.sh_type = SHT_RELA;
+			relaHeader.sh_flags = SHF_INFO_LINK;
+			relaHeader.sh_offset = append(relocations.data(), relocations.size() * sizeof(Elf64_Rela), 8);
+			relaHeader.sh_size = relocations.size() * sizeof(Elf64_Rela);
+			relaHeader.sh_link = symtabIndex;
+			relaHeader.sh_info = uint32_t(1 + i);
+			relaHeader.sh_addralign = 8;
+			relaHeader.sh_entsize = sizeof(Elf64_Rela);
+		}
+
+		Elf64_Shdr& symtab = headers[symtabIndex];
+		symtab.sh_name = addName(".symtab");
+		symtab.sh_type = SHT_SYMTAB;
+		symtab.sh_offset = append(symbols.data(), symbols.size() * sizeof(Elf64_Sym), 8);
+		symtab.sh_size = symbols.size() * sizeof(Elf64_Sym);
+		symtab.sh_link = strtabIndex;
+		symtab.sh_info = uint32_t(firstGlobal);
+		symtab.sh_addralign = 8;
+		symtab.sh_entsize = sizeof(Elf64_Sym);
+
+		Elf64_Shdr& strtabHeader = headers[strtabIndex];
+		strtabHeader.sh_name = addName(".strtab");
+		strtabHeader.sh_type = SHT_STRTAB;
+		strtabHeader.sh_offset = append(strtab.data(), strtab.size(), 1);
+		strtabHeader.sh_size = strtab.size();
+		strtabHeader.sh_addralign = 1;
+
+		Elf64_Shdr& shstrtabHeader = headers[shstrtabIndex];
+		shstrtabHeader.sh_name = addName(".shstrtab");
+		shstrtabHeader.sh_type = SHT_STRTAB;
+		shstrtabHeader.sh_offset = append(shstrtab.data(), shstrtab.size(), 1);
+		shstrtabHeader.sh_size = shstrtab.size();
+		shstrtabHeader.sh_addralign = 1;
+
+		size_t headersOffset = append(headers.data(), headers.size() * sizeof(Elf64_Shdr), 8);
+
+		Elf64_Ehdr elfHeader{};
+		std::memcpy(elfHeader.e_ident, ELFMAG, SELFMAG);
+		elfHeader.e_ident[EI_CLASS] = ELFCLASS64;
+		elfHeader.e_ident[EI_DATA] = ELFDATA2LSB;
+		elfHeader.e_ident[EI_VERSION] = EV_CURRENT;
+		elfHeader.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+		elfHeader.e_type = ET_REL;
+		elfHeader.e_machine = EM_X86_64;
+		elfHeader.e_version = EV_CURRENT;
+		elfHeader.e_shoff = headersOffset;
+		elfHeader.e_ehsize = sizeof(Elf64_Ehdr);
+		elfHeader.e_shentsize = sizeof(Elf64_Shdr);
+		elfHeader.e_shnum = sectionCount;
+		elfHeader.e_shstrndx = shstrtabIndex;
+		std::memcpy(file.data(), &elfHeader, sizeof(Elf64_Ehdr));
+		return file;
+	}
+
+} // forest::assembler
@@ -0,0 +1,114 @@
+#ifndef FOREST_ASSEMBLER_HPP
+#define FOREST_ASSEMBLER_HPP
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace forest::assembler {
+
+	enum class SectionId {
+		TEXT,
+		DATA,
+		BSS,
+		RODATA,
+	};
+	constexpr size_t c_SectionCount = 4;
+
+	struct Operand {
+		enum class Kind {
+			REGISTER,
+			MEMORY,
+			IMMEDIATE,
+		};
+
+		Kind mKind = Kind::IMMEDIATE;
+		int mSize = 0; // In bytes, 0 when it follows from the other operand
+		int mRegister = -1;
+		bool mHighByte = false; // ah, ch, dh and bh, which can't be encoded together with a REX prefix
+		bool mNeedsRex = false; // spl, bpl, sil and dil, which only exist with a REX prefix
+		int mBase = -1;
+		int mIndex = -1;
+		int mScale = 1;
+		int64_t mValue = 0; // The immediate, or the displacement of a memory operand
+		std::string mSymbol{}; // Label the value is relative to, if any
+	};
+
+	struct Relocation {
+		uint64_t mOffset{};
+		std::string mSymbol{};
+		uint32_t mType{};
+		int64_t mAddend{};
+	};
+
+	struct Section {
+		std::vector<uint8_t> mBytes{};
+		uint64_t mReserved{}; // Size of .bss, which has no bytes in the file
+		std::vector<Relocation> mRelocations{};
+	};
+
+	/**
+	 * Assembles the yasm syntax the code generator emits straight into an ELF64 relocatable object, so a translation unit
+	 * doesn't need a yasm process that parses the whole file again.
+	 * This only covers what the code generator actually uses. Anything else makes assemble() return nothing, with the
+	 * reason in getError(), so the caller can hand the text to yasm instead.
+	 * Jumps and calls always get a 32-bit displacement (only `loop` has a short one), and references to labels from
+	 * immediates and memory operands are absolute, like yasm does without `default rel`.
+	 */
+	class Assembler {
+	public:
+		std::optional<std::vector<uint8_t>> assemble(std::string_view source);
+		const std::string& getError() const;
+
+	private:
+		struct Symbol {
+			SectionId mSection{};
+			uint64_t mOffset{};
+		};
+
+		struct Fixup {
+			SectionId mSection{};
+			uint64_t mOffset{}; // Of the field that has to be filled in
+			int mSize{}; // 1, 4 or 8 bytes
+			std::string mSymbol{};
+			int64_t mAddend{};
+			uint32_t mType{}; // The relocation to emit when it can't be resolved here
+		};
+
+		Section mSections[c_SectionCount];
+		SectionId mCurrent = SectionId::TEXT;
+		std::map<std::string, Symbol> mSymbols;
+		std::set<std::string> mGlobals;
+		std::set<std::string> mExterns;
+		std::vector<Fixup> mFixups;
+		std::string mLastLabel{}; // Local labels starting with '.' belong to the last label without one
+		std::string mError{};
+
+		bool assembleLine(std::string_view line);
+		bool defineLabel(const std::string& name);
+		bool assembleData(const std::string& directive, std::string_view arguments);
+		bool assembleInstruction(const std::string& mnemonic, std::string_view arguments);
+
+		std::optional<Operand> parseOperand(std::string_view text);
+		bool parseTerm(std::string_view term, bool negative, Operand& operand);
+		std::string qualify(const std::string& label) const;
+
+		bool encodeModRM(const std::vector<uint8_t>& opcode, int size, int reg, bool regNeedsRex, bool regHighByte, const Operand& rm, bool rexW);
+		bool encodeImmediate(const Operand& immediate, int size);
+		bool encodeBranch(const std::vector<uint8_t>& opcode, const Operand& target, int size);
+		void emit(uint8_t byte);
+		void emit(uint64_t value, int size);
+		uint64_t here() const;
+		bool fail(const std::string& reason);
+
+		bool resolveFixups();
+		std::vector<uint8_t> writeObject() const;
+	};
+
+} // forest::assembler
+
+#endif //FOREST_ASSEMBLER_HPP
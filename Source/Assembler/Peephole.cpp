@@ -0,0 +1,1151 @@
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <set>
+#include "Peephole.hpp"
+
+namespace forest::assembler {
+
+	namespace {
+		constexpr int c_Accumulator = 0;
+		constexpr int c_Counter = 1;
+		constexpr int c_Data = 2;
+		constexpr int c_StackPointer = 4;
+		constexpr int c_BasePointer = 5;
+		constexpr uint32_t c_Flags = 1u << 16;
+		constexpr uint32_t c_Everything = (1u << 17) - 1;
+		constexpr uint32_t c_Stack = (1u << c_StackPointer) | (1u << c_BasePointer);
+		// rdi, rsi, rdx, rcx, r8 and r9 carry the arguments, and al the vector count of variadic C functions
+		constexpr uint32_t c_CallArguments = (1u << 7) | (1u << 6) | (1u << 2) | (1u << 1) | (1u << 8) | (1u << 9) | 1u;
+		// rax, rdi, rsi, rdx, r10, r8 and r9
+		constexpr uint32_t c_SystemCallArguments = 1u | (1u << 7) | (1u << 6) | (1u << 2) | (1u << 10) | (1u << 8) | (1u << 9);
+		// The return value and the registers a generated function saves for its caller: rax, rsp, rbp and r13 to r15.
+		// rbx and r12 are scratch registers that the generated code overwrites without saving them
+		constexpr uint32_t c_Returned = 1u | c_Stack | (0x7u << 13);
+		// Everything the System V convention lets the callee overwrite: rax, rcx, rdx, rsi, rdi, r8 to r11 and the flags
+		constexpr uint32_t c_CallClobbers = c_CallArguments | (1u << 10) | (1u << 11) | c_Flags;
+
+		struct RegisterName {
+			int mNumber;
+			int mSize;
+			bool mHighByte = false;
+		};
+
+		const std::map<std::string, RegisterName>& getRegisters() {
+			static const std::map<std::string, RegisterName> registers = [] {
+				std::map<std::string, RegisterName> result;
+				const char* legacy[8] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+				const char* bytes[8] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil"};
+				for (int i = 0; i < 8; i++) {
+					result[std::string("r") + legacy[i]] = {i, 8};
+					result[std::string("e") + legacy[i]] = {i, 4};
+					result[legacy[i]] = {i, 2};
+					result[bytes[i]] = {i, 1};
+				}
+				result["ah"] = {0, 1, true};
+				result["ch"] = {1, 1, true};
+				result["dh"] = {2, 1, true};
+				result["bh"] = {3, 1, true};
+				for (int i = 8; i < 16; i++) {
+					std::string name = "r" + std::to_string(i);
+					result[name] = {i, 8};
+					result[name + "d"] = {i, 4};
+					result[name + "w"] = {i, 2};
+					result[name + "b"] = {i, 1};
+				}
+				return result;
+			}();
+			return registers;
+		}
+
+		std::string getRegisterName(int number, int size) {
+			const char* legacy[8] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+			const char* bytes[8] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil"};
+			if (number >= 8) {
+				std::string name = "r" + std::to_string(number);
+				switch (size) {
+					case 1: return name + "b";
+					case 2: return name + "w";
+					case 4: return name + "d";
+					default: return name;
+				}
+			}
+			switch (size) {
+				case 1: return bytes[number];
+				case 2: return legacy[number];
+				case 4: return std::string("e") + legacy[number];
+				default: return std::string("r") + legacy[number];
+			}
+		}
+
+		const std::map<std::string, std::string>& getInversions() {
+			static const std::map<std::string, std::string> inversions = {
+				{"o", "no"}, {"no", "o"}, {"b", "ae"}, {"c", "nc"}, {"nae", "ae"}, {"ae", "b"}, {"nb", "b"}, {"nc", "c"},
+				{"e", "ne"}, {"z", "nz"}, {"ne", "e"}, {"nz", "z"}, {"be", "a"}, {"na", "a"}, {"a", "be"}, {"nbe", "be"},
+				{"s", "ns"}, {"ns", "s"}, {"p", "np"}, {"pe", "po"}, {"np", "p"}, {"po", "pe"},
+				{"l", "ge"}, {"nge", "ge"}, {"ge", "l"}, {"nl", "l"}, {"le", "g"}, {"ng", "g"}, {"g", "le"}, {"nle", "le"},
+			};
+			return inversions;
+		}
+
+		// The condition of a jcc, setcc or cmovcc, or nothing when the mnemonic isn't one
+		std::optional<std::string> getCondition(const std::string& mnemonic, std::string_view prefix) {
+			if (!mnemonic.starts_with(prefix)) return std::nullopt;
+			std::string condition = mnemonic.substr(prefix.size());
+			if (!getInversions().contains(condition)) return std::nullopt;
+			return condition;
+		}
+
+		std::string_view trim(std::string_view text) {
+			while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+			while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+			return text;
+		}
+
+		// Splits on the commas that aren't inside a string or a memory operand
+		std::vector<std::string> splitOperands(std::string_view text) {
+			std::vector<std::string> result;
+			text = trim(text);
+			if (text.empty()) return result;
+			char quote = 0;
+			int depth = 0;
+			size_t start = 0;
+			for (size_t i = 0; i < text.size(); i++) {
+				char c = text[i];
+				if (quote != 0) {
+					if (c == quote) quote = 0;
+				} else if (c == '"' || c == '\'' || c == '`') {
+					quote = c;
+				} else if (c == '[') {
+					depth++;
+				} else if (c == ']') {
+					depth--;
+				} else if (c == ',' && depth == 0) {
+					result.emplace_back(trim(text.substr(start, i - start)));
+					start = i + 1;
+				}
+			}
+			result.emplace_back(trim(text.substr(start)));
+			return result;
+		}
+
+		bool isMemory(const std::string& operand) {
+			return operand.find('[') != std::string::npos;
+		}
+
+		int getKeywordSize(std::string_view word) {
+			if (word == "byte") return 1;
+			if (word == "word") return 2;
+			if (word == "dword") return 4;
+			if (word == "qword") return 8;
+			return 0;
+		}
+
+		const char* getKeyword(int size) {
+			switch (size) {
+				case 1: return "byte";
+				case 2: return "word";
+				case 4: return "dword";
+				default: return "qword";
+			}
+		}
+
+		// The operand without its size keyword
+		std::string stripSize(const std::string& operand) {
+			size_t space = operand.find_first_of(" \t");
+			if (space != std::string::npos && getKeywordSize(operand.substr(0, space)) != 0)
+				return std::string(trim(std::string_view(operand).substr(space)));
+			return operand;
+		}
+
+		std::optional<RegisterName> getRegister(const std::string& operand) {
+			auto found = getRegisters().find(stripSize(operand));
+			if (found == getRegisters().end()) return std::nullopt;
+			return found->second;
+		}
+
+		// From the size keyword, or the register
+		int getSize(const std::string& operand) {
+			size_t space = operand.find_first_of(" \t");
+			if (space != std::string::npos) {
+				int size = getKeywordSize(operand.substr(0, space));
+				if (size != 0) return size;
+			}
+			std::optional<RegisterName> reg = getRegister(operand);
+			return reg.has_value() ? reg->mSize : 0;
+		}
+
+		std::optional<int64_t> parseImmediate(std::string_view text) {
+			bool negative = !text.empty() && text[0] == '-';
+			if (negative) text.remove_prefix(1);
+			int base = 10;
+			if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+				base = 16;
+				text.remove_prefix(2);
+			}
+			if (text.empty()) return std::nullopt;
+			uint64_t value = 0;
+			for (char c : text) {
+				int digit;
+				if (c >= '0' && c <= '9') digit = c - '0';
+				else if (base == 16 && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+				else if (base == 16 && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+				else return std::nullopt;
+				value = value * base + digit;
+			}
+			return negative ? -int64_t(value) : int64_t(value);
+		}
+
+		std::string toHex(uint64_t value) {
+			char digits[16];
+			auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value, 16);
+			return "0x" + std::string(digits, end);
+		}
+
+		/**
+		 * n / d for every unsigned 64-bit n is the high half of n * mMultiplier shifted right by mShift. When the
+		 * multiplier would need 65 bits mAdd is set, the high half t is then added in as (t + ((n - t) >> 1)) >> mShift
+		 * (Granlund and Montgomery)
+		 */
+		struct Reciprocal {
+			uint64_t mMultiplier;
+			int mShift;
+			bool mAdd;
+		};
+
+		Reciprocal getReciprocal(uint64_t divisor) {
+			int bits = 64 - std::countl_zero(divisor - 1);
+			for (int shift = 0; shift < bits; shift++) {
+				unsigned __int128 power = static_cast<unsigned __int128>(1) << (64 + shift);
+				unsigned __int128 multiplier = power / divisor + 1;
+				if (multiplier >> 64 == 0 && multiplier * divisor - power <= static_cast<unsigned __int128>(1) << shift)
+					return {uint64_t(multiplier), shift, false};
+			}
+			unsigned __int128 excess = (static_cast<unsigned __int128>(1) << bits) - divisor;
+			return {uint64_t((excess << 64) / divisor + 1), bits - 1, true};
+		}
+
+		bool fitsInt32(int64_t value) {
+			return value >= INT32_MIN && value <= INT32_MAX;
+		}
+
+		// Whether the value can be written in `size` bytes, either as a signed or as an unsigned number
+		bool fitsSize(int64_t value, int size) {
+			switch (size) {
+				case 1: return value >= INT8_MIN && value <= UINT8_MAX;
+				case 2: return value >= INT16_MIN && value <= UINT16_MAX;
+				case 4: return value >= INT32_MIN && value <= int64_t(UINT32_MAX);
+				default: return true;
+			}
+		}
+
+		// Calls `visit` with every word of the operand that names a register, it returns the replacement
+		template <typename Visit>
+		std::string mapRegisters(const std::string& operand, Visit visit) {
+			std::string result;
+			size_t i = 0;
+			while (i < operand.size()) {
+				if (!std::isalnum(static_cast<unsigned char>(operand[i]))) {
+					result += operand[i++];
+					continue;
+				}
+				size_t end = i;
+				while (end < operand.size() && (std::isalnum(static_cast<unsigned char>(operand[end])) || operand[end] == '_')) end++;
+				std::string word = operand.substr(i, end - i);
+				auto found = getRegisters().find(word);
+				result += found == getRegisters().end() ? word : visit(word, found->second);
+				i = end;
+			}
+			return result;
+		}
+
+		uint32_t getRegistersIn(const std::string& operand) {
+			uint32_t result = 0;
+			mapRegisters(operand, [&](const std::string& word, const RegisterName& reg) {
+				result |= 1u << reg.mNumber;
+				return word;
+			});
+			return result;
+		}
+
+		bool isLocal(const std::string& label) {
+			return !label.empty() && label[0] == '.';
+		}
+	}
+
+	Peephole::Peephole(std::set<std::string> exits, const std::map<std::string, Function>& functions) : mExits(std::move(exits)) {
+		for (const auto& function : functions) {
+			Effect& effect = mFunctions[function.first];
+			for (const auto& name : function.second.mArguments) {
+				effect.mUses |= getRegistersIn(name);
+			}
+			for (const auto& name : function.second.mClobbers) {
+				effect.mDefines |= getRegistersIn(name);
+			}
+			effect.mDefines |= c_Flags;
+			effect.mKills = effect.mDefines;
+		}
+	}
+
+	std::string Peephole::optimise(std::string_view source) {
+		mInstructions = parse(source);
+		// Each sweep finds what the rewrites of the previous one exposed, a few are enough for everything to settle
+		for (int i = 0; i < 16 && sweep(); i++) {}
+		return print(mInstructions);
+	}
+
+	std::vector<Instruction> Peephole::parse(std::string_view source) {
+		std::vector<Instruction> result;
+		bool inText = true;
+		while (!source.empty()) {
+			size_t end = source.find('\n');
+			std::string_view line = source.substr(0, end);
+			source = end == std::string_view::npos ? std::string_view() : source.substr(end + 1);
+
+			Instruction instruction;
+			instruction.mText = line;
+			// Strip the comment, a ';' in a string doesn't start one
+			char quote = 0;
+			size_t length = 0;
+			for (; length < line.size(); length++) {
+				char c = line[length];
+				if (quote != 0) {
+					if (c == quote) quote = 0;
+				} else if (c == '"' || c == '\'' || c == '`') {
+					quote = c;
+				} else if (c == ';') {
+					break;
+				}
+			}
+			std::string_view code = trim(line.substr(0, length));
+			if (length < line.size())
+				instruction.mComment = line.substr(code.data() + code.size() - line.data());
+			if (code.empty()) {
+				instruction.mKind = Instruction::Kind::COMMENT;
+				result.push_back(std::move(instruction));
+				continue;
+			}
+
+			size_t space = code.find_first_of(" \t");
+			std::string first(code.substr(0, space));
+			std::string_view rest = space == std::string_view::npos ? std::string_view() : trim(code.substr(space));
+			if (first == "section") {
+				inText = rest == ".text";
+			} else if (inText && first.back() == ':' && rest.empty()) {
+				instruction.mKind = Instruction::Kind::LABEL;
+				instruction.mMnemonic = first.substr(0, first.size() - 1);
+			} else if (inText && first.back() != ':' && first != "global" && first != "extern") {
+				// `name db 1` is data, not an instruction
+				static const std::set<std::string> directives = {"db", "dw", "dd", "dq", "dt", "resb", "resw", "resd", "resq", "equ", "times"};
+				if (!directives.contains(std::string(rest.substr(0, rest.find_first_of(" \t")))) && !directives.contains(first)) {
+					instruction.mKind = Instruction::Kind::INSTRUCTION;
+					std::transform(first.begin(), first.end(), first.begin(), [](unsigned char c) { return std::tolower(c); });
+					instruction.mMnemonic = first;
+					instruction.mOperands = splitOperands(rest);
+				}
+			}
+			result.push_back(std::move(instruction));
+		}
+		return result;
+	}
+
+	std::string Peephole::print(const std::vector<Instruction>& instructions) {
+		std::string result;
+		for (const auto& instruction : instructions) {
+			if (instruction.mKind != Instruction::Kind::INSTRUCTION) {
+				result += instruction.mText;
+			} else {
+				result += "\t" + instruction.mMnemonic;
+				for (size_t i = 0; i < instruction.mOperands.size(); i++) {
+					result += (i == 0 ? " " : ", ") + instruction.mOperands[i];
+				}
+				result += instruction.mComment;
+			}
+			result += "\n";
+		}
+		return result;
+	}
+
+	bool Peephole::sweep() {
+		mRemoved.assign(mInstructions.size(), false);
+		mExpansions.clear();
+		computeLiveness();
+		// The liveness isn't updated while rewriting. A rewrite never reads a register where it was dead before, but the
+		// instructions it changed may write other registers, so the next sweep looks at those again
+		bool changed = false;
+		for (size_t i = 0; i < mInstructions.size(); i++) {
+			if (mRemoved[i] || mInstructions[i].mKind != Instruction::Kind::INSTRUCTION) continue;
+			if (removeUnreachable(i) || removeDeadCode(i) || removeRedundantMove(i) || foldJumps(i) || foldComparison(i)
+				|| reduceMultiplication(i) || reduceDivision(i) || fuseReadModifyWrite(i) || forwardDefinition(i) || propagateCopy(i)) {
+				changed = true;
+				i = std::min(next(next(i)), mInstructions.size());
+			}
+		}
+
+		std::vector<Instruction> kept;
+		kept.reserve(mInstructions.size());
+		for (size_t i = 0; i < mInstructions.size(); i++) {
+			if (mRemoved[i]) continue;
+			auto expansion = mExpansions.find(i);
+			if (expansion == mExpansions.end())
+				kept.push_back(std::move(mInstructions[i]));
+			else
+				kept.insert(kept.end(), std::make_move_iterator(expansion->second.begin()), std::make_move_iterator(expansion->second.end()));
+		}
+		mInstructions = std::move(kept);
+		return changed;
+	}
+
+	void Peephole::computeLiveness() {
+		enum class Flow {
+			NEXT,
+			JUMP,
+			BRANCH,
+			STOP, // Anything can be read after it, a jump out of the function or a line that isn't understood
+			EXIT, // Nothing but what the instruction itself uses is read after it, a return or a runtime error
+		};
+		size_t count = mInstructions.size();
+		std::vector<Flow> flows(count, Flow::NEXT);
+		std::vector<size_t> targets(count, 0);
+		std::vector<size_t> callees(count, count); // The label of a function in the same file that is called
+		std::vector<Effect> effects(count);
+
+		// Local labels belong to the last label without a '.' before them
+		std::map<std::string, size_t> labels;
+		std::vector<std::string> scopes(count);
+		std::string scope;
+		for (size_t i = 0; i < count; i++) {
+			const Instruction& instruction = mInstructions[i];
+			if (instruction.mKind == Instruction::Kind::LABEL) {
+				if (!isLocal(instruction.mMnemonic)) scope = instruction.mMnemonic;
+				labels[isLocal(instruction.mMnemonic) ? scope + instruction.mMnemonic : instruction.mMnemonic] = i;
+			}
+			scopes[i] = scope;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			const Instruction& instruction = mInstructions[i];
+			if (instruction.mKind == Instruction::Kind::OTHER) {
+				flows[i] = Flow::STOP;
+				effects[i].mUses = c_Everything;
+				continue;
+			}
+			if (instruction.mKind != Instruction::Kind::INSTRUCTION) continue;
+			effects[i] = getEffect(instruction);
+			if (instruction.mMnemonic == "ret") {
+				flows[i] = Flow::EXIT;
+				continue;
+			}
+			if (instruction.mMnemonic == "call") {
+				// What a function in the same file reads at its start is all it takes as arguments
+				auto callee = labels.end();
+				if (instruction.mOperands.size() == 1 && !isLocal(instruction.mOperands[0]))
+					callee = labels.find(instruction.mOperands[0]);
+				if (callee != labels.end()) {
+					callees[i] = callee->second;
+					effects[i].mUses &= ~c_CallArguments;
+				} else if (instruction.mOperands.size() == 1 && mFunctions.contains(instruction.mOperands[0])) {
+					effects[i] = mFunctions.at(instruction.mOperands[0]);
+					effects[i].mUses |= c_Stack;
+				}
+				continue;
+			}
+			bool jump = instruction.mMnemonic == "jmp";
+			if (!jump && !getCondition(instruction.mMnemonic, "j").has_value()) continue;
+			auto target = labels.end();
+			if (instruction.mOperands.size() == 1 && isLocal(instruction.mOperands[0]))
+				target = labels.find(scopes[i] + instruction.mOperands[0]);
+			if (target == labels.end()) {
+				// Out of the function, to a runtime error that never comes back, or anything else
+				if (instruction.mOperands.size() == 1 && mExits.contains(instruction.mOperands[0])) {
+					flows[i] = jump ? Flow::EXIT : Flow::NEXT;
+				} else {
+					effects[i].mUses = c_Everything;
+					flows[i] = jump ? Flow::STOP : Flow::NEXT;
+				}
+				continue;
+			}
+			flows[i] = jump ? Flow::JUMP : Flow::BRANCH;
+			targets[i] = target->second;
+		}
+
+		mLiveOut.assign(count, 0);
+		std::vector<Registers> liveIn(count, 0);
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (size_t i = count; i-- > 0;) {
+				Registers out;
+				Registers next = i + 1 < count ? liveIn[i + 1] : 0; // Nothing runs after the end
+				switch (flows[i]) {
+					case Flow::NEXT: out = next; break;
+					case Flow::JUMP: out = liveIn[targets[i]]; break;
+					case Flow::BRANCH: out = next | liveIn[targets[i]]; break;
+					case Flow::EXIT: out = 0; break;
+					default: out = c_Everything; break;
+				}
+				Registers uses = effects[i].mUses;
+				if (callees[i] < count) uses |= liveIn[callees[i]] & c_CallArguments;
+				Registers in = uses | (out & ~effects[i].mKills) | c_Stack;
+				if (in != liveIn[i] || out != mLiveOut[i]) {
+					liveIn[i] = in;
+					mLiveOut[i] = out;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	size_t Peephole::next(size_t index) const {
+		for (size_t i = index + 1; i < mInstructions.size(); i++) {
+			if (!mRemoved[i] && mInstructions[i].mKind != Instruction::Kind::COMMENT) return i;
+		}
+		return mInstructions.size();
+	}
+
+	size_t Peephole::previous(size_t index) const {
+		for (size_t i = index; i-- > 0;) {
+			if (!mRemoved[i] && mInstructions[i].mKind != Instruction::Kind::COMMENT) return i;
+		}
+		return mInstructions.size();
+	}
+
+	bool Peephole::isDeadAfter(size_t index, Registers registers) const {
+		return (mLiveOut[index] & registers) == 0;
+	}
+
+	// The constant the register was last set to before the instruction, as long as nothing can jump in between
+	std::optional<int64_t> Peephole::findConstant(size_t index, int number) const {
+		Registers bit = 1u << number;
+		for (size_t i = previous(index); i < mInstructions.size(); i = previous(i)) {
+			const Instruction& instruction = mInstructions[i];
+			if (instruction.mKind != Instruction::Kind::INSTRUCTION || instruction.mMnemonic == "call") return std::nullopt;
+			Effect effect = getEffect(instruction);
+			if (effect.mUses == c_Everything) return std::nullopt;
+			if ((effect.mDefines & bit) == 0) continue;
+			if ((effect.mKills & bit) == 0) return std::nullopt;
+			if (instruction.mMnemonic == "xor" || instruction.mMnemonic == "sub") return 0; // Zeroing
+			if (instruction.mMnemonic != "mov") return std::nullopt;
+			std::optional<int64_t> value = parseImmediate(instruction.mOperands[1]);
+			if (value.has_value() && getSize(instruction.mOperands[0]) == 4) value = int64_t(uint32_t(value.value()));
+			return value;
+		}
+		return std::nullopt;
+	}
+
+	Peephole::Effect Peephole::getEffect(const Instruction& instruction) {
+		static const std::set<std::string> vector = {
+			"movd", "movq", "movdqu", "movdqa", "pshufd", "pshuflw", "paddb", "paddw", "paddd", "paddq", "psubb", "psubw", "psubd",
+			"psubq", "pmullw", "pmuludq", "pand", "por", "pxor", "pcmpeqw", "psllw", "pslld", "psllq", "pslldq", "psrlw", "psrld",
+			"psrlq", "psrldq", "punpcklbw", "punpcklwd", "punpckldq", "punpcklqdq", "movsd", "movss", "movapd", "xorpd", "addsd",
+			"subsd", "mulsd", "divsd", "sqrtsd", "addss", "subss", "mulss", "divss", "sqrtss", "cvtsi2sd", "cvtsi2ss", "cvttsd2si",
+			"cvttss2si", "cvtsd2si", "cvtss2si", "cvtsd2ss", "cvtss2sd", "addps", "subps", "mulps", "addpd", "subpd", "mulpd",
+		};
+		Effect effect;
+		const std::string& mnemonic = instruction.mMnemonic;
+		const auto& operands = instruction.mOperands;
+		auto read = [&](const std::string& operand) {
+			effect.mUses |= getRegistersIn(operand);
+		};
+		// Only a write of the whole register, or of the lower half which clears the rest, replaces the value before it
+		auto write = [&](const std::string& operand, bool reads) {
+			std::optional<RegisterName> reg = getRegister(operand);
+			if (!reg.has_value()) {
+				read(operand); // The address of the memory operand
+				return;
+			}
+			Registers bit = 1u << reg->mNumber;
+			effect.mDefines |= bit;
+			if (!reads && reg->mSize >= 4)
+				effect.mKills |= bit;
+			else
+				effect.mUses |= bit;
+		};
+		auto setFlags = [&](bool kills) {
+			effect.mDefines |= c_Flags;
+			if (kills) effect.mKills |= c_Flags;
+			else effect.mUses |= c_Flags;
+		};
+		auto everything = [&]() {
+			effect = Effect{c_Everything, 0, 0};
+			return effect;
+		};
+
+		if (mnemonic == "mov" || mnemonic == "movzx" || mnemonic == "movsx" || mnemonic == "movsxd" || mnemonic == "lea") {
+			if (operands.size() != 2) return everything();
+			write(operands[0], false);
+			read(operands[1]);
+		} else if (getCondition(mnemonic, "cmov").has_value()) {
+			if (operands.size() != 2) return everything();
+			write(operands[0], true);
+			read(operands[1]);
+			effect.mUses |= c_Flags;
+		} else if (getCondition(mnemonic, "set").has_value()) {
+			if (operands.size() != 1) return everything();
+			write(operands[0], true);
+			effect.mUses |= c_Flags;
+		} else if ((mnemonic == "xor" || mnemonic == "sub") && operands.size() == 2 && operands[0] == operands[1] && getRegister(operands[0]).has_value()) {
+			// Zeroing, the value before doesn't matter
+			write(operands[0], false);
+			setFlags(true);
+		} else if (mnemonic == "add" || mnemonic == "sub" || mnemonic == "and" || mnemonic == "or" || mnemonic == "xor" || mnemonic == "adc" || mnemonic == "sbb") {
+			if (operands.size() != 2) return everything();
+			write(operands[0], true);
+			read(operands[1]);
+			setFlags(mnemonic != "adc" && mnemonic != "sbb");
+		} else if (mnemonic == "cmp" || mnemonic == "test" || mnemonic == "ucomisd" || mnemonic == "ucomiss") {
+			if (operands.size() != 2) return everything();
+			read(operands[0]);
+			read(operands[1]);
+			setFlags(true);
+		} else if (mnemonic == "bt" || mnemonic == "bts" || mnemonic == "btr" || mnemonic == "btc") {
+			if (operands.size() != 2) return everything();
+			if (mnemonic == "bt") read(operands[0]);
+			else write(operands[0], true);
+			read(operands[1]);
+			setFlags(true);
+		} else if (mnemonic == "popcnt") {
+			if (operands.size() != 2) return everything();
+			write(operands[0], false);
+			read(operands[1]);
+			setFlags(true);
+		} else if (mnemonic == "inc" || mnemonic == "dec" || mnemonic == "neg" || mnemonic == "not") {
+			if (operands.size() != 1) return everything();
+			write(operands[0], true);
+			if (mnemonic != "not") setFlags(mnemonic == "neg"); // inc and dec keep the carry flag
+		} else if (mnemonic == "shl" || mnemonic == "sal" || mnemonic == "shr" || mnemonic == "sar" || mnemonic == "rol" || mnemonic == "ror") {
+			if (operands.size() != 2) return everything();
+			write(operands[0], true);
+			read(operands[1]);
+			// Shifting by 0 leaves the flags alone, and rotates only change the carry and overflow flags
+			std::optional<int64_t> count = parseImmediate(operands[1]);
+			setFlags(count.has_value() && count.value() != 0 && mnemonic[0] == 's');
+		} else if (mnemonic == "imul" && operands.size() >= 2) {
+			if (operands.size() > 3) return everything();
+			write(operands[0], operands.size() == 2);
+			for (size_t i = 1; i < operands.size(); i++) read(operands[i]);
+			setFlags(true);
+		} else if (mnemonic == "mul" || mnemonic == "imul" || mnemonic == "div" || mnemonic == "idiv") {
+			// `div rax, rbx` names the accumulator explicitly
+			if (operands.empty() || operands.size() > 2) return everything();
+			for (const auto& operand : operands) read(operand);
+			int size = getSize(operands.back());
+			if (size == 0) return everything();
+			Registers a = 1u << c_Accumulator;
+			Registers d = 1u << c_Data;
+			bool divide = mnemonic == "div" || mnemonic == "idiv";
+			effect.mUses |= a;
+			if (divide && size > 1) effect.mUses |= d;
+			if (size == 1) {
+				effect.mDefines |= a; // ax
+			} else {
+				effect.mDefines |= a | d;
+				if (size >= 4) effect.mKills |= a | d;
+				else effect.mUses |= a | d;
+			}
+			setFlags(true);
+		} else if (mnemonic == "cbw" || mnemonic == "cwde" || mnemonic == "cdqe") {
+			effect.mUses |= 1u << c_Accumulator;
+			effect.mDefines |= 1u << c_Accumulator;
+		} else if (mnemonic == "cwd" || mnemonic == "cdq" || mnemonic == "cqo") {
+			effect.mUses |= 1u << c_Accumulator;
+			effect.mDefines |= 1u << c_Data;
+			if (mnemonic == "cwd") effect.mUses |= 1u << c_Data;
+			else effect.mKills |= 1u << c_Data;
+		} else if (mnemonic == "push") {
+			if (operands.size() != 1) return everything();
+			read(operands[0]);
+		} else if (mnemonic == "pop") {
+			if (operands.size() != 1) return everything();
+			write(operands[0], false);
+		} else if (mnemonic == "call") {
+			// Only what it takes as arguments has to be live before it, and nothing it may clobber is expected to survive it
+			if (operands.size() != 1) return everything();
+			read(operands[0]);
+			effect.mUses |= c_CallArguments;
+			effect.mDefines |= c_CallClobbers;
+			effect.mKills |= c_CallClobbers;
+		} else if (mnemonic == "syscall") {
+			// The number and six arguments go in, the kernel only overwrites rax, rcx and r11
+			effect.mUses |= c_SystemCallArguments;
+			effect.mDefines |= 1u | (1u << c_Counter) | (1u << 11);
+			effect.mKills |= 1u | (1u << c_Counter) | (1u << 11);
+		} else if (mnemonic == "ret") {
+			effect.mUses |= c_Returned;
+		} else if (getCondition(mnemonic, "j").has_value()) {
+			effect.mUses |= c_Flags;
+		} else if (vector.contains(mnemonic)) {
+			// SSE, the xmm registers aren't tracked. Only a general purpose register it moves into is written
+			if (operands.empty()) return everything();
+			if (getRegister(operands[0]).has_value()) write(operands[0], false);
+			else read(operands[0]);
+			for (size_t i = 1; i < operands.size(); i++) read(operands[i]);
+		} else if (mnemonic != "jmp" && mnemonic != "nop") {
+			return everything();
+		}
+		effect.mUses |= c_Stack;
+		return effect;
+	}
+
+	bool Peephole::removeUnreachable(size_t index) {
+		const Instruction& instruction = mInstructions[index];
+		if (instruction.mMnemonic != "jmp" && instruction.mMnemonic != "ret") return false;
+		bool changed = false;
+		for (size_t i = next(index); i < mInstructions.size() && mInstructions[i].mKind == Instruction::Kind::INSTRUCTION; i = next(i)) {
+			mRemoved[i] = true;
+			changed = true;
+		}
+		return changed;
+	}
+
+	bool Peephole::removeDeadCode(size_t index) {
+		static const std::set<std::string> pure = {
+			"mov", "movzx", "movsx", "movsxd", "lea", "add", "sub", "and", "or", "xor", "adc", "sbb", "inc", "dec", "neg", "not",
+			"shl", "sal", "shr", "sar", "rol", "ror", "cmp", "test", "cbw", "cwde", "cdqe", "cwd", "cdq", "cqo", "bts", "btr", "btc",
+			"popcnt",
+		};
+		const Instruction& instruction = mInstructions[index];
+		const std::string& mnemonic = instruction.mMnemonic;
+		bool conditional = getCondition(mnemonic, "set").has_value() || getCondition(mnemonic, "cmov").has_value();
+		if (!pure.contains(mnemonic) && !conditional && !(mnemonic == "imul" && instruction.mOperands.size() >= 2)) return false;
+		// Stores are never dead
+		if (mnemonic != "cmp" && mnemonic != "test" && !instruction.mOperands.empty() && !getRegister(instruction.mOperands[0]).has_value())
+			return false;
+		Effect effect = getEffect(instruction);
+		if (effect.mDefines == 0 || (effect.mDefines & c_Stack) != 0 || !isDeadAfter(index, effect.mDefines)) return false;
+		mRemoved[index] = true;
+		return true;
+	}
+
+	bool Peephole::removeRedundantMove(size_t index) {
+		Instruction& instruction = mInstructions[index];
+		// Saving a register only to restore it right away, the slot below the stack pointer isn't read again
+		if (instruction.isInstruction("push") && instruction.mOperands.size() == 1) {
+			size_t restore = next(index);
+			if (restore >= mInstructions.size() || !mInstructions[restore].isInstruction("pop") || mInstructions[restore].mOperands.size() != 1) return false;
+			std::optional<RegisterName> saved = getRegister(instruction.mOperands[0]);
+			std::optional<RegisterName> restored = getRegister(mInstructions[restore].mOperands[0]);
+			if (!saved.has_value() || !restored.has_value() || saved->mSize != 8 || restored->mSize != 8) return false;
+			if (saved->mNumber == c_StackPointer || restored->mNumber == c_StackPointer) return false;
+			if (saved->mNumber == restored->mNumber) {
+				mRemoved[index] = true;
+			} else {
+				instruction.mMnemonic = "mov";
+				instruction.mOperands = {mInstructions[restore].mOperands[0], instruction.mOperands[0]};
+			}
+			mRemoved[restore] = true;
+			return true;
+		}
+		if (!instruction.isInstruction("mov") || instruction.mOperands.size() != 2) return false;
+		const std::string& destination = instruction.mOperands[0];
+		const std::string& source = instruction.mOperands[1];
+		std::optional<RegisterName> reg = getRegister(source);
+		// Writing a dword register clears the top half, so only the others do nothing
+		if (destination == source && reg.has_value() && reg->mSize != 4) {
+			mRemoved[index] = true;
+			return true;
+		}
+
+		// A value that is loaded right after it was stored is still in the register
+		if (!isMemory(destination) || !reg.has_value() || reg->mSize == 4 || reg->mHighByte) return false;
+		size_t load = next(index);
+		if (load >= mInstructions.size() || !mInstructions[load].isInstruction("mov") || mInstructions[load].mOperands.size() != 2) return false;
+		const Instruction& reload = mInstructions[load];
+		if (reload.mOperands[0] != source || stripSize(reload.mOperands[1]) != stripSize(destination)) return false;
+		if ((getRegistersIn(destination) & (1u << reg->mNumber)) != 0) return false;
+		mRemoved[load] = true;
+		return true;
+	}
+
+	bool Peephole::foldJumps(size_t index) {
+		Instruction& instruction = mInstructions[index];
+		if (instruction.mOperands.size() != 1) return false;
+		// Whether the label is one of those right after `after`
+		auto isNextLabel = [&](size_t after, const std::string& label) {
+			for (size_t i = next(after); i < mInstructions.size() && mInstructions[i].mKind == Instruction::Kind::LABEL; i = next(i)) {
+				if (mInstructions[i].mMnemonic == label) return true;
+			}
+			return false;
+		};
+
+		if (instruction.mMnemonic == "jmp") {
+			if (!isNextLabel(index, instruction.mOperands[0])) return false;
+			mRemoved[index] = true;
+			return true;
+		}
+
+		// `jl .inside; jmp .not; .inside:` is `jge .not`
+		std::optional<std::string> condition = getCondition(instruction.mMnemonic, "j");
+		if (!condition.has_value()) return false;
+		size_t jump = next(index);
+		if (jump >= mInstructions.size() || !mInstructions[jump].isInstruction("jmp") || mInstructions[jump].mOperands.size() != 1) return false;
+		if (!isNextLabel(jump, instruction.mOperands[0])) return false;
+		instruction.mMnemonic = "j" + getInversions().at(condition.value());
+		instruction.mOperands[0] = mInstructions[jump].mOperands[0];
+		mRemoved[jump] = true;
+		return true;
+	}
+
+	// A comparison is printed as `mov rcx, 0; mov rdx, 1; cmp a, b; cmovcc rcx, rdx; mov rax, rcx`, or `ucomisd` for
+	// floating point, and an if or until tests rax after it. The branch can use the flags of the comparison instead
+	bool Peephole::foldComparison(size_t index) {
+		const Instruction& test = mInstructions[index];
+		if (!test.isInstruction("test") || test.mOperands.size() != 2 || test.mOperands[0] != test.mOperands[1]) return false;
+		std::optional<RegisterName> value = getRegister(test.mOperands[0]);
+		if (!value.has_value() || value->mSize != 8) return false;
+
+		size_t branch = next(index);
+		if (branch >= mInstructions.size() || mInstructions[branch].mKind != Instruction::Kind::INSTRUCTION) return false;
+		std::optional<std::string> condition = getCondition(mInstructions[branch].mMnemonic, "j");
+		if (!condition.has_value() || (condition != "nz" && condition != "ne" && condition != "z" && condition != "e")) return false;
+		if (!isDeadAfter(branch, c_Flags)) return false;
+
+		// The copy into rax may already be folded into the test
+		std::string result = test.mOperands[0];
+		size_t select = previous(index);
+		if (select < mInstructions.size() && mInstructions[select].isInstruction("mov") && mInstructions[select].mOperands.size() == 2
+			&& mInstructions[select].mOperands[0] == result) {
+			result = mInstructions[select].mOperands[1];
+			select = previous(select);
+		}
+		if (select >= mInstructions.size() || mInstructions[select].mKind != Instruction::Kind::INSTRUCTION) return false;
+		std::optional<std::string> selected = getCondition(mInstructions[select].mMnemonic, "cmov");
+		if (!selected.has_value() || mInstructions[select].mOperands.size() != 2 || mInstructions[select].mOperands[0] != result) return false;
+		const std::string& one = mInstructions[select].mOperands[1];
+		size_t compare = previous(select);
+		if (compare >= mInstructions.size() || mInstructions[compare].mKind != Instruction::Kind::INSTRUCTION) return false;
+		const std::string& comparison = mInstructions[compare].mMnemonic;
+		if (comparison != "cmp" && comparison != "ucomisd" && comparison != "ucomiss") return false;
+
+		// Both constants have to be set before the comparison, in either order
+		bool zero = false, set = false;
+		size_t constant = compare;
+		for (int i = 0; i < 2; i++) {
+			constant = previous(constant);
+			if (constant >= mInstructions.size() || !mInstructions[constant].isInstruction("mov") || mInstructions[constant].mOperands.size() != 2) return false;
+			const auto& operands = mInstructions[constant].mOperands;
+			if (operands[0] == result && operands[1] == "0") zero = true;
+			else if (operands[0] == one && operands[1] == "1") set = true;
+		}
+		if (!zero || !set || result == one) return false;
+
+		bool taken = condition == "nz" || condition == "ne";
+		mInstructions[branch].mMnemonic = "j" + (taken ? selected.value() : getInversions().at(selected.value()));
+		mRemoved[index] = true;
+		return true;
+	}
+
+	// `mov r, x` followed by an instruction that is the only one to read r: x goes in its place
+	bool Peephole::propagateCopy(size_t index) {
+		static const std::set<std::string> substitutable = {
+			"mov", "movzx", "movsx", "movsxd", "lea", "add", "sub", "and", "or", "xor", "adc", "sbb", "cmp", "test", "imul", "push",
+		};
+		static const std::set<std::string> immediates = {"mov", "add", "sub", "and", "or", "xor", "adc", "sbb", "cmp"};
+		const Instruction& copy = mInstructions[index];
+		if (!copy.isInstruction("mov") || copy.mOperands.size() != 2) return false;
+		std::optional<RegisterName> copied = getRegister(copy.mOperands[0]);
+		if (!copied.has_value() || copied->mSize != 8 || (1u << copied->mNumber) & c_Stack) return false;
+		Registers bit = 1u << copied->mNumber;
+
+		size_t user = next(index);
+		if (user >= mInstructions.size() || mInstructions[user].mKind != Instruction::Kind::INSTRUCTION) return false;
+		Instruction& instruction = mInstructions[user];
+		if (!substitutable.contains(instruction.mMnemonic) || (instruction.mMnemonic == "imul" && instruction.mOperands.size() < 2)) return false;
+		if (!isDeadAfter(user, bit) || (getEffect(instruction).mUses & bit) == 0) return false;
+		bool readOnly = instruction.mMnemonic == "cmp" || instruction.mMnemonic == "test" || instruction.mMnemonic == "push";
+		if (!readOnly && !instruction.mOperands.empty()) {
+			std::optional<RegisterName> destination = getRegister(instruction.mOperands[0]);
+			if (destination.has_value() && destination->mNumber == copied->mNumber) return false;
+		}
+
+		const std::string& source = copy.mOperands[1];
+		std::optional<RegisterName> reg = getRegister(source);
+		if (reg.has_value()) {
+			// The stack pointer can't be an index
+			if (reg->mSize != 8 || reg->mNumber == c_StackPointer) return false;
+			std::vector<std::string> operands;
+			bool valid = true;
+			for (const auto& operand : instruction.mOperands) {
+				bool memory = isMemory(operand);
+				operands.push_back(mapRegisters(operand, [&](const std::string& word, const RegisterName& name) {
+					if (name.mNumber != copied->mNumber) return word;
+					if (name.mHighByte || (memory && name.mSize != 8)) valid = false;
+					return getRegisterName(reg->mNumber, name.mSize);
+				}));
+			}
+			if (!valid) return false;
+			instruction.mOperands = operands;
+			mRemoved[index] = true;
+			return true;
+		}
+
+		// Anything else can only take the place of a register that is read as the source
+		if (!immediates.contains(instruction.mMnemonic) || instruction.mOperands.size() != 2) return false;
+		std::optional<RegisterName> read = getRegister(instruction.mOperands[1]);
+		if (!read.has_value() || read->mNumber != copied->mNumber || read->mHighByte) return false;
+		const std::string& destination = instruction.mOperands[0];
+		if ((getRegistersIn(destination) & bit) != 0) return false;
+		int size = read->mSize;
+
+		std::optional<int64_t> immediate = parseImmediate(source);
+		if (immediate.has_value()) {
+			if (isMemory(destination)) {
+				if (getSize(destination) != size) return false;
+				if (size == 8 ? !fitsInt32(immediate.value()) : !fitsSize(immediate.value(), size)) return false;
+			} else if (instruction.mMnemonic != "mov" || size != 8) {
+				if (size == 8 ? !fitsInt32(immediate.value()) : !fitsSize(immediate.value(), size)) return false;
+			}
+		} else if (isMemory(source)) {
+			std::optional<RegisterName> target = getRegister(destination);
+			if (!target.has_value() || target->mSize != 8 || size != 8 || (getSize(source) != 0 && getSize(source) != 8)) return false;
+		} else {
+			return false;
+		}
+		instruction.mOperands[1] = source;
+		mRemoved[index] = true;
+		return true;
+	}
+
+	// `movzx r, x` followed by `mov d, r`, where r isn't read anymore, can load straight into d
+	bool Peephole::forwardDefinition(size_t index) {
+		Instruction& definition = mInstructions[index];
+		const std::string& mnemonic = definition.mMnemonic;
+		if (mnemonic != "mov" && mnemonic != "movzx" && mnemonic != "movsx" && mnemonic != "movsxd" && mnemonic != "lea") return false;
+		if (definition.mOperands.size() != 2) return false;
+		std::optional<RegisterName> defined = getRegister(definition.mOperands[0]);
+		if (!defined.has_value() || defined->mSize != 8 || (1u << defined->mNumber) & c_Stack) return false;
+
+		size_t copy = next(index);
+		if (copy >= mInstructions.size() || !mInstructions[copy].isInstruction("mov") || mInstructions[copy].mOperands.size() != 2) return false;
+		std::optional<RegisterName> destination = getRegister(mInstructions[copy].mOperands[0]);
+		std::optional<RegisterName> source = getRegister(mInstructions[copy].mOperands[1]);
+		if (!destination.has_value() || !source.has_value() || destination->mSize != 8 || source->mSize != 8) return false;
+		if (source->mNumber != defined->mNumber || destination->mNumber == defined->mNumber || destination->mNumber == c_StackPointer) return false;
+		if (!isDeadAfter(copy, 1u << defined->mNumber)) return false;
+		definition.mOperands[0] = mInstructions[copy].mOperands[0];
+		mRemoved[copy] = true;
+		return true;
+	}
+
+	// `mov r, x; op r, y; mov x, r` is `op x, y` when r isn't read afterwards
+	bool Peephole::fuseReadModifyWrite(size_t index) {
+		static const std::set<std::string> memoryOperations = {"add", "sub", "and", "or", "xor", "inc", "dec", "neg", "not"};
+		static const std::set<std::string> registerOperations = {"add", "sub", "and", "or", "xor", "inc", "dec", "neg", "not", "shl", "shr", "sar", "imul"};
+		const Instruction& load = mInstructions[index];
+		if ((load.mMnemonic != "mov" && load.mMnemonic != "movzx" && load.mMnemonic != "movsx") || load.mOperands.size() != 2) return false;
+		std::optional<RegisterName> temporary = getRegister(load.mOperands[0]);
+		if (!temporary.has_value() || temporary->mHighByte || (1u << temporary->mNumber) & c_Stack) return false;
+		Registers bit = 1u << temporary->mNumber;
+		const std::string& location = load.mOperands[1];
+		std::optional<RegisterName> variable = getRegister(location);
+		bool memory = isMemory(location);
+		int size; // Of the variable
+		if (variable.has_value()) {
+			if (load.mMnemonic != "mov" || temporary->mSize != 8 || variable->mSize != 8 || variable->mNumber == temporary->mNumber) return false;
+			if ((1u << variable->mNumber) & c_Stack) return false;
+			size = 8;
+		} else if (memory) {
+			size = load.mMnemonic == "mov" ? temporary->mSize : getSize(location);
+			if (size == 0 || (getSize(location) != 0 && getSize(location) != size)) return false;
+			if ((getRegistersIn(location) & bit) != 0) return false;
+		} else {
+			return false;
+		}
+
+		size_t operation = next(index);
+		if (operation >= mInstructions.size() || mInstructions[operation].mKind != Instruction::Kind::INSTRUCTION) return false;
+		Instruction& instruction = mInstructions[operation];
+		if (!(memory ? memoryOperations : registerOperations).contains(instruction.mMnemonic)) return false;
+		bool unary = instruction.mMnemonic == "inc" || instruction.mMnemonic == "dec" || instruction.mMnemonic == "neg" || instruction.mMnemonic == "not";
+		if (instruction.mOperands.size() != (unary ? 1 : 2)) return false;
+		std::optional<RegisterName> modified = getRegister(instruction.mOperands[0]);
+		if (!modified.has_value() || modified->mNumber != temporary->mNumber || modified->mHighByte) return false;
+		if (!unary && (getRegistersIn(instruction.mOperands[1]) & bit) != 0) return false;
+
+		size_t store = next(operation);
+		if (store >= mInstructions.size() || !mInstructions[store].isInstruction("mov") || mInstructions[store].mOperands.size() != 2) return false;
+		const auto& stored = mInstructions[store].mOperands;
+		std::optional<RegisterName> storedRegister = getRegister(stored[1]);
+		if (!storedRegister.has_value() || storedRegister->mNumber != temporary->mNumber || storedRegister->mSize != size || storedRegister->mHighByte) return false;
+		if (stripSize(stored[0]) != stripSize(location) || (getSize(stored[0]) != 0 && getSize(stored[0]) != size)) return false;
+		if (!isDeadAfter(store, bit)) return false;
+
+		if (variable.has_value()) {
+			// The same operation on the variable, at the same size, gives the same value and flags
+			instruction.mOperands[0] = getRegisterName(variable->mNumber, modified->mSize);
+		} else {
+			// Only the low bytes are stored, which don't depend on the ones above them. The flags do
+			if (modified->mSize < size || !isDeadAfter(store, c_Flags)) return false;
+			if (!unary) {
+				const std::string& operand = instruction.mOperands[1];
+				std::optional<int64_t> immediate = parseImmediate(operand);
+				std::optional<RegisterName> reg = getRegister(operand);
+				if (immediate.has_value()) {
+					if (size == 8 ? !fitsInt32(immediate.value()) : !fitsSize(immediate.value(), size)) return false;
+				} else if (reg.has_value() && !reg->mHighByte) {
+					instruction.mOperands[1] = getRegisterName(reg->mNumber, size);
+				} else {
+					return false;
+				}
+			}
+			instruction.mOperands[0] = std::string(getKeyword(size)) + " " + stripSize(location);
+		}
+		mRemoved[index] = true;
+		mRemoved[store] = true;
+		return true;
+	}
+
+	// `mov rbx, 8; mul rbx` is a shift, and any other constant an imul with an immediate, which doesn't touch rdx
+	bool Peephole::reduceMultiplication(size_t index) {
+		Instruction& instruction = mInstructions[index];
+		if ((instruction.mMnemonic != "mul" && instruction.mMnemonic != "imul") || instruction.mOperands.size() != 1) return false;
+		std::optional<RegisterName> factor = getRegister(instruction.mOperands[0]);
+		if (!factor.has_value() || factor->mHighByte || factor->mNumber == c_Accumulator || factor->mNumber == c_Data) return false;
+		int size = factor->mSize;
+		if (size == 1 || !isDeadAfter(index, (1u << c_Data) | c_Flags)) return false;
+		std::optional<int64_t> constant = findConstant(index, factor->mNumber);
+		if (!constant.has_value()) return false;
+
+		// Only the low half of the product is read, which is the same for signed and unsigned factors
+		uint64_t value = uint64_t(constant.value());
+		if (size < 8) value &= (uint64_t(1) << (size * 8)) - 1;
+		std::string accumulator = getRegisterName(c_Accumulator, size);
+		if (value != 0 && (value & (value - 1)) == 0) {
+			int shift = std::countr_zero(value);
+			if (shift == 0) {
+				// A dword multiplication still clears the top half of rax
+				if (size == 4) return false;
+				mRemoved[index] = true;
+				return true;
+			}
+			instruction.mMnemonic = "shl";
+			instruction.mOperands = {accumulator, std::to_string(shift)};
+			return true;
+		}
+		int64_t immediate;
+		if (size == 8) {
+			if (!fitsInt32(int64_t(value))) return false;
+			immediate = int64_t(value);
+		} else {
+			immediate = size == 4 ? int64_t(int32_t(value)) : int64_t(int16_t(value));
+		}
+		instruction.mMnemonic = "imul";
+		instruction.mOperands = {accumulator, accumulator, std::to_string(immediate)};
+		return true;
+	}
+
+	// Division by a power of two, with rdx cleared before it, is a shift, and the remainder in rdx an and
+	bool Peephole::reduceDivision(size_t index) {
+		Instruction& instruction = mInstructions[index];
+		if (instruction.mMnemonic != "div" && instruction.mMnemonic != "idiv") return false;
+		if (instruction.mOperands.empty() || instruction.mOperands.size() > 2) return false;
+		if (instruction.mOperands.size() == 2) {
+			std::optional<RegisterName> dividend = getRegister(instruction.mOperands[0]);
+			if (!dividend.has_value() || dividend->mNumber != c_Accumulator || dividend->mHighByte) return false;
+		}
+		std::optional<RegisterName> divisor = getRegister(instruction.mOperands.back());
+		if (!divisor.has_value() || divisor->mHighByte || divisor->mNumber == c_Accumulator || divisor->mNumber == c_Data) return false;
+		int size = divisor->mSize;
+		if (size == 1) return false;
+		// With rdx cleared the dividend is never negative, so signed division only differs when the divisor is
+		if (findConstant(index, c_Data) != 0) return false;
+		std::optional<int64_t> constant = findConstant(index, divisor->mNumber);
+		if (!constant.has_value()) return false;
+		uint64_t value = uint64_t(constant.value());
+		if (size < 8) value &= (uint64_t(1) << (size * 8)) - 1;
+		if (value < 2) return false;
+		if (instruction.mMnemonic == "idiv" && value >> (size * 8 - 1) != 0) return false;
+
+		// The remainder is copied out of rdx right after the division
+		size_t copy = next(index);
+		std::optional<RegisterName> destination;
+		if (copy < mInstructions.size() && mInstructions[copy].isInstruction("mov") && mInstructions[copy].mOperands.size() == 2) {
+			destination = getRegister(mInstructions[copy].mOperands[0]);
+			std::optional<RegisterName> source = getRegister(mInstructions[copy].mOperands[1]);
+			if (!destination.has_value() || !source.has_value() || source->mNumber != c_Data || source->mHighByte || source->mSize != size
+				|| destination->mSize != size || destination->mHighByte || destination->mNumber == c_Data)
+				destination.reset();
+		}
+		if ((value & (value - 1)) != 0)
+			return reduceDivisionByReciprocal(index, value, size, divisor->mNumber, destination.has_value() ? std::optional(destination->mNumber) : std::nullopt);
+
+		std::string accumulator = getRegisterName(c_Accumulator, size);
+		if (destination.has_value()) {
+			Registers clobbered = (1u << c_Data) | c_Flags;
+			if (destination->mNumber != c_Accumulator) clobbered |= 1u << c_Accumulator;
+			if (!isDeadAfter(copy, clobbered)) return false;
+			int64_t mask = int64_t(value - 1);
+			if (size == 8 && !fitsInt32(mask)) return false;
+			instruction.mMnemonic = "and";
+			instruction.mOperands = {accumulator, std::to_string(size == 4 ? int64_t(int32_t(mask)) : mask)};
+			if (destination->mNumber == c_Accumulator) mRemoved[copy] = true;
+			else mInstructions[copy].mOperands[1] = accumulator;
+			return true;
+		}
+		if (!isDeadAfter(index, (1u << c_Data) | c_Flags)) return false;
+		instruction.mMnemonic = "shr";
+		instruction.mOperands = {accumulator, std::to_string(std::countr_zero(value))};
+		return true;
+	}
+
+	/**
+	 * Division by any other constant is a multiplication by its reciprocal, and the remainder is the dividend minus the
+	 * quotient times the divisor. The dividend is kept in the register of the divisor when it is needed again, so that
+	 * register has to be dead after it. Word sized division is left alone
+	 */
+	bool Peephole::reduceDivisionByReciprocal(size_t index, uint64_t divisor, int size, int scratch, std::optional<int> destination) {
+		if (size != 4 && size != 8) return false;
+		Reciprocal reciprocal = getReciprocal(divisor);
+		bool remainder = destination.has_value();
+		size_t copy = next(index);
+		Registers clobbered = (1u << c_Data) | c_Flags;
+		if (remainder || reciprocal.mAdd) clobbered |= 1u << scratch;
+		if (remainder) {
+			if (!fitsInt32(int64_t(divisor))) return false;
+			if (destination.value() != c_Accumulator) clobbered |= 1u << c_Accumulator;
+			if (destination.value() == scratch) clobbered &= ~(1u << scratch);
+			if (!isDeadAfter(copy, clobbered)) return false;
+		} else if (!isDeadAfter(index, clobbered)) {
+			return false;
+		}
+
+		std::vector<Instruction> code;
+		auto emit = [&](const std::string& mnemonic, std::vector<std::string> operands) {
+			code.push_back(Instruction{Instruction::Kind::INSTRUCTION, mnemonic, std::move(operands)});
+		};
+		std::string dividend = getRegisterName(scratch, 8);
+		// A dword division only reads eax, the multiplication reads all of rax
+		if (size == 4)
+			emit("mov", {"eax", "eax"});
+		if (remainder || reciprocal.mAdd)
+			emit("mov", {dividend, "rax"});
+		emit("mov", {"rdx", toHex(reciprocal.mMultiplier)});
+		emit("mul", {"rdx"});
+		std::string quotient = "rdx";
+		if (reciprocal.mAdd) {
+			emit("mov", {"rax", dividend});
+			emit("sub", {"rax", "rdx"});
+			emit("shr", {"rax", "1"});
+			emit("add", {"rax", "rdx"});
+			quotient = "rax";
+		}
+		if (reciprocal.mShift > 0)
+			emit("shr", {quotient, std::to_string(reciprocal.mShift)});
+		if (remainder) {
+			emit("imul", {quotient, quotient, std::to_string(divisor)});
+			emit("sub", {dividend, quotient});
+			if (destination.value() == scratch) mRemoved[copy] = true;
+			else mInstructions[copy].mOperands[1] = getRegisterName(scratch, size);
+		} else if (quotient != "rax") {
+			emit("mov", {"rax", quotient});
+		}
+		code.back().mComment = mInstructions[index].mComment;
+
+		mExpansions[index] = std::move(code);
+		// Nothing else in this sweep looks through it, the instructions only take its place afterwards
+		mInstructions[index].mKind = Instruction::Kind::OTHER;
+		return true;
+	}
+
+} // forest::assembler
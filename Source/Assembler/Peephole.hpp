@@ -0,0 +1,110 @@
+#ifndef FOREST_PEEPHOLE_HPP
+#define FOREST_PEEPHOLE_HPP
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace forest::assembler {
+
+	struct Instruction {
+		enum class Kind {
+			INSTRUCTION,
+			LABEL,
+			COMMENT, // Nothing but a comment, or an empty line
+			OTHER, // Directives, data and anything else that is kept as it is
+		};
+
+		Kind mKind = Kind::OTHER;
+		std::string mMnemonic{}; // The name for labels
+		std::vector<std::string> mOperands{};
+		std::string mComment{}; // Everything after the code, starting with the spaces before the ';'
+		std::string mText{}; // The whole line, for comments and other lines
+
+		bool isInstruction(std::string_view mnemonic) const {
+			return mKind == Kind::INSTRUCTION && mMnemonic == mnemonic;
+		}
+	};
+
+	/**
+	 * Rewrites the assembly the code generator emits before it is assembled. The text is parsed into a list of
+	 * instructions, and every pass only replaces instructions whose result nothing reads anymore, which comes from a
+	 * liveness analysis of the registers and the flags over the jumps between local labels.
+	 * - Pushing and popping the same value, moving a register into itself and reloading a value that was just stored
+	 *   are removed
+	 * - Multiplication by a constant becomes a shift or an `imul` with an immediate, division and modulo by a power of
+	 *   two become a shift or an `and`, and by any other constant a multiplication by its reciprocal
+	 * - Moves into a register that is only read once are folded into that read, and values that are never read are
+	 *   removed, which also takes care of store-load pairs and the constant moves of comparisons
+	 * - `x = x op y` on a register or a stack slot is done in place
+	 * - A comparison that is only used by a branch jumps on its own flags, and a conditional jump over an unconditional
+	 *   one is inverted into a single one, like `cmp`/`jl`/`jmp` in loops
+	 * Anything it doesn't understand is treated as reading every register. Calls are expected to follow the System V
+	 * convention, the hand written runtime doesn't always do that so it shouldn't be passed through it.
+	 */
+	class Peephole {
+	public:
+		// What a function the generated code calls, but which isn't in the source, reads and overwrites
+		struct Function {
+			std::vector<std::string> mArguments{};
+			std::vector<std::string> mClobbers{};
+		};
+
+		/**
+		 * @param exits Labels that end the programme, like the runtime error handlers, nothing is read after jumping there
+		 * @param functions The hand written functions, anything else that is called is expected to follow the System V
+		 * convention and read all six argument registers
+		 */
+		explicit Peephole(std::set<std::string> exits = {}, const std::map<std::string, Function>& functions = {});
+
+		std::string optimise(std::string_view source);
+
+		static std::vector<Instruction> parse(std::string_view source);
+		static std::string print(const std::vector<Instruction>& instructions);
+
+	private:
+		using Registers = uint32_t; // One bit per general purpose register, numbered like the encoding, and the flags
+
+		struct Effect {
+			Registers mUses{};
+			Registers mDefines{}; // Everything that is written
+			Registers mKills{}; // Written completely, the value before doesn't matter anymore
+		};
+
+		std::set<std::string> mExits;
+		std::map<std::string, Effect> mFunctions;
+		std::vector<Instruction> mInstructions;
+		std::vector<bool> mRemoved;
+		std::map<size_t, std::vector<Instruction>> mExpansions; // Put in place of the instruction at the index after the sweep
+		std::vector<Registers> mLiveOut;
+
+		bool sweep();
+		void computeLiveness();
+		size_t next(size_t index) const;
+		size_t previous(size_t index) const;
+		bool isDeadAfter(size_t index, Registers registers) const;
+		std::optional<int64_t> findConstant(size_t index, int number) const;
+
+		bool removeDeadCode(size_t index);
+		bool removeUnreachable(size_t index);
+		bool foldJumps(size_t index);
+		bool foldComparison(size_t index);
+		bool propagateCopy(size_t index);
+		bool forwardDefinition(size_t index);
+		bool fuseReadModifyWrite(size_t index);
+		bool reduceMultiplication(size_t index);
+		bool reduceDivision(size_t index);
+		// `destination` is the register the remainder is copied into, nothing when only the quotient is read
+		bool reduceDivisionByReciprocal(size_t index, uint64_t divisor, int size, int scratch, std::optional<int> destination);
+		bool removeRedundantMove(size_t index);
+
+		static Effect getEffect(const Instruction& instruction);
+	};
+
+} // forest::assembler
+
+#endif //FOREST_PEEPHOLE_HPP
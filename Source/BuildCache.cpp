@@ -0,0 +1,133 @@
+#include <fstream>
+#include <sstream>
+#include <system_error>
+#include "BuildCache.hpp"
+
+namespace fs = std::filesystem;
+
+BuildCache::BuildCache(uint64_t configurationHash) {
+	// A different compiler can generate different code for the same source, so its identity is part of the key too
+	std::error_code error;
+	fs::path self = fs::read_symlink("/proc/self/exe", error);
+	std::stringstream identity;
+	identity << configurationHash;
+	if (!error) {
+		identity << ";" << fs::file_size(self, error);
+		identity << ";" << fs::last_write_time(self, error).time_since_epoch().count();
+	}
+	mConfigurationHash = hash(identity.str());
+}
+
+std::optional<BuildCache::Entry> BuildCache::lookup(const fs::path& source) const {
+	std::ifstream record(getRecordPath(source));
+	if (!record.is_open() || !fs::exists(getObjectPath(source)))
+		return std::nullopt;
+
+	Entry entry;
+	bool sameConfiguration = false;
+	size_t files = 0;
+	std::string line;
+	while (std::getline(record, line)) {
+		std::stringstream ss(line);
+		std::string kind;
+		ss >> kind;
+		if (kind == "config") {
+			uint64_t value;
+			ss >> std::hex >> value;
+			sameConfiguration = value == mConfigurationHash;
+		} else if (kind == "file") {
+			uint64_t expected;
+			ss >> std::hex >> expected;
+			ss.get(); // The space in front of the path, which can contain spaces itself
+			std::string path;
+			std::getline(ss, path);
+			std::optional<uint64_t> actual = hashFile(fromRecord(source, path));
+			if (!actual.has_value() || actual.value() != expected)
+				return std::nullopt;
+			files++;
+		} else if (kind == "import") {
+			ss.get();
+			std::string path;
+			std::getline(ss, path);
+			entry.imports.push_back(fromRecord(source, path).string());
+		} else if (kind == "lib") {
+			ss >> entry.libDependencies.emplace_back();
+		}
+	}
+	if (!sameConfiguration || files == 0)
+		return std::nullopt;
+	return entry;
+}
+
+void BuildCache::invalidate(const fs::path& source) const {
+	std::error_code error;
+	fs::remove(getRecordPath(source), error);
+	fs::remove(getObjectPath(source), error);
+}
+
+void BuildCache::store(const fs::path& source, const Entry& entry) const {
+	// Without an object file the build failed, and there is nothing to reuse next time
+	if (!fs::exists(getObjectPath(source)))
+		return;
+
+	std::stringstream record;
+	record << "config " << std::hex << mConfigurationHash << std::endl;
+	std::vector<fs::path> files = {source};
+	for (const auto& import : entry.imports) {
+		files.emplace_back(import);
+	}
+	for (const auto& file : files) {
+		std::optional<uint64_t> fileHash = hashFile(file);
+		if (!fileHash.has_value())
+			return;
+		record << "file " << fileHash.value() << " " << toRecord(source, file).string() << std::endl;
+	}
+	for (const auto& import : entry.imports) {
+		record << "import " << toRecord(source, import).string() << std::endl;
+	}
+	for (const auto& lib : entry.libDependencies) {
+		record << "lib " << lib << std::endl;
+	}
+
+	std::ofstream out(getRecordPath(source));
+	out << record.str();
+}
+
+fs::path BuildCache::getObjectPath(const fs::path& source) {
+	return source.parent_path() / "build" / source.stem().replace_extension("o");
+}
+
+fs::path BuildCache::getRecordPath(const fs::path& source) {
+	return source.parent_path() / "build" / source.stem().replace_extension("cache");
+}
+
+fs::path BuildCache::toRecord(const fs::path& source, const fs::path& path) {
+	fs::path directory = fs::absolute(getRecordPath(source).parent_path()).lexically_normal();
+	return fs::absolute(path).lexically_normal().lexically_relative(directory);
+}
+
+fs::path BuildCache::fromRecord(const fs::path& source, const std::string& path) {
+	return (getRecordPath(source).parent_path() / path).lexically_normal();
+}
+
+fs::path BuildCache::resolveImport(const fs::path& importer, const std::string& import) {
+	return fs::path(importer).replace_filename(import).lexically_normal();
+}
+
+uint64_t BuildCache::hash(std::string_view data, uint64_t seed) {
+	uint64_t value = seed;
+	for (char c : data) {
+		value ^= static_cast<unsigned char>(c);
+		value *= c_FnvPrime;
+	}
+	return value;
+}
+
+std::optional<uint64_t> BuildCache::hashFile(const fs::path& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return std::nullopt;
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	return hash(buffer.str());
+}
@@ -0,0 +1,51 @@
+#ifndef FOREST_BUILDCACHE_HPP
+#define FOREST_BUILDCACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Remembers what the object file of every translation unit was built from, so an unchanged unit can reuse it instead of
+ * being tokenised, parsed, compiled and assembled again.
+ * Next to `build/name.o` lives `build/name.cache`, which has the FNV-1a hash of the source and of every file it imports,
+ * the hash of the configuration and compiler it was built with, and what the driver needs to know about the unit
+ * without parsing it: its imports and the libraries it links against. Paths in the record are relative to the `build`
+ * directory it is in, so the cache still matches when the driver is run from another working directory.
+ */
+class BuildCache {
+public:
+	struct Entry {
+		std::vector<std::string> imports; // Resolved against the file with the `use`, which isn't the source for nested imports
+		std::vector<std::string> libDependencies;
+	};
+
+	explicit BuildCache(uint64_t configurationHash);
+
+	std::optional<Entry> lookup(const std::filesystem::path& source) const;
+	void invalidate(const std::filesystem::path& source) const;
+	void store(const std::filesystem::path& source, const Entry& entry) const;
+
+	static std::filesystem::path getObjectPath(const std::filesystem::path& source);
+	// The path of the import, relative to the file that has the `use`
+	static std::filesystem::path resolveImport(const std::filesystem::path& importer, const std::string& import);
+	static uint64_t hash(std::string_view data, uint64_t seed = c_FnvOffset);
+	static std::optional<uint64_t> hashFile(const std::filesystem::path& path);
+
+private:
+	static constexpr uint64_t c_FnvOffset = 0xCBF29CE484222325;
+	static constexpr uint64_t c_FnvPrime = 0x100000001B3;
+
+	uint64_t mConfigurationHash;
+
+	static std::filesystem::path getRecordPath(const std::filesystem::path& source);
+	// The path as it is written in the record of the source, relative to the directory of the record
+	static std::filesystem::path toRecord(const std::filesystem::path& source, const std::filesystem::path& path);
+	// A path from the record of the source, relative to the working directory again
+	static std::filesystem::path fromRecord(const std::filesystem::path& source, const std::string& path);
+};
+
+#endif //FOREST_BUILDCACHE_HPP
@@ -0,0 +1,115 @@
+#include "IR.hpp"
+
+namespace forest::ir {
+
+	bool Function::isTerminated(uint32_t block) const {
+		const BasicBlock& b = mBlocks.at(block);
+		return !b.mInstructions.empty() && isTerminator(mValues[b.mInstructions.back()].mOp);
+	}
+
+	const char* getOpCodeName(OpCode op) {
+		switch (op) {
+			case OpCode::UNDEFINED: return "undefined";
+			case OpCode::ARGUMENT: return "argument";
+			case OpCode::PHI: return "phi";
+			case OpCode::OPERATION: return "op";
+			case OpCode::CALL: return "call";
+			case OpCode::JUMP: return "jump";
+			case OpCode::BRANCH: return "branch";
+			case OpCode::RETURN: return "return";
+		}
+		return "unknown";
+	}
+
+	const char* getTypeName(Builtin_Type type) {
+		switch (type) {
+			case Builtin_Type::UI8: return "ui8";
+			case Builtin_Type::UI16: return "ui16";
+			case Builtin_Type::UI32: return "ui32";
+			case Builtin_Type::UI64: return "ui64";
+			case Builtin_Type::I8: return "i8";
+			case Builtin_Type::I16: return "i16";
+			case Builtin_Type::I32: return "i32";
+			case Builtin_Type::I64: return "i64";
+			case Builtin_Type::F8: return "f8";
+			case Builtin_Type::F16: return "f16";
+			case Builtin_Type::F32: return "f32";
+			case Builtin_Type::F64: return "f64";
+			case Builtin_Type::CHAR: return "char";
+			case Builtin_Type::BOOL: return "bool";
+			case Builtin_Type::REF: return "ref";
+			case Builtin_Type::ARRAY: return "array";
+			case Builtin_Type::VOID: return "void";
+			case Builtin_Type::STRUCT: return "struct";
+			case Builtin_Type::CLASS: return "class";
+			case Builtin_Type::VECTOR: return "vector";
+			case Builtin_Type::MATRIX: return "matrix";
+			case Builtin_Type::UNDEFINED: break;
+		}
+		return "undefined";
+	}
+
+	bool isTerminator(OpCode op) {
+		return op == OpCode::JUMP || op == OpCode::BRANCH || op == OpCode::RETURN;
+	}
+
+	std::ostream& operator<<(std::ostream& os, const Function& function) {
+		os << "function " << function.mName << " -> " << getTypeName(function.mReturnType) << " {" << std::endl;
+		for (const auto& block : function.mBlocks) {
+			os << "bb" << block.mId << ":";
+			if (!block.mPredecessors.empty()) {
+				os << " ; preds";
+				for (size_t i = 0; i < block.mPredecessors.size(); i++) {
+					os << (i == 0 ? " " : ", ") << "bb" << block.mPredecessors[i];
+				}
+			}
+			if (block.mLoopDepth > 0)
+				os << " ; loop depth " << block.mLoopDepth;
+			os << std::endl;
+
+			for (uint32_t id : block.mInstructions) {
+				const Instruction& instruction = function.value(id);
+				os << "\t";
+				if (instruction.mType != Builtin_Type::VOID)
+					os << "%" << instruction.mId << " = ";
+				os << getOpCodeName(instruction.mOp);
+				if (instruction.mType != Builtin_Type::VOID)
+					os << " " << getTypeName(instruction.mType);
+
+				if (instruction.mOp == OpCode::PHI) {
+					for (size_t i = 0; i < instruction.mOperands.size(); i++) {
+						os << (i == 0 ? " " : ", ") << "[%" << instruction.mOperands[i] << ", bb" << instruction.mTargets[i] << "]";
+					}
+				} else {
+					bool first = true;
+					auto separate = [&]() {
+						os << (first ? " " : ", ");
+						first = false;
+					};
+					if (instruction.mOp == OpCode::ARGUMENT) {
+						separate();
+						os << instruction.mConstant;
+					}
+					if (instruction.mOp == OpCode::CALL) {
+						separate();
+						os << instruction.mName;
+					}
+					for (uint32_t operand : instruction.mOperands) {
+						separate();
+						os << "%" << operand;
+					}
+					for (uint32_t target : instruction.mTargets) {
+						separate();
+						os << "bb" << target;
+					}
+				}
+				if (!instruction.mName.empty() && instruction.mOp != OpCode::CALL)
+					os << " ; " << instruction.mName;
+				os << std::endl;
+			}
+		}
+		os << "}" << std::endl;
+		return os;
+	}
+
+} // forest::ir
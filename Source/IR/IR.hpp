@@ -0,0 +1,69 @@
+#ifndef FOREST_IR_HPP
+#define FOREST_IR_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "Parser.hpp"
+
+namespace forest::ir {
+	using parser::Builtin_Type;
+
+	/**
+	 * The IR only describes what the register allocator needs to know about a function: its control flow, and where
+	 * every SSA value of a scalar local is defined and read. What the backend actually computes stays in the AST, an
+	 * operation is just the values of the locals it reads.
+	 */
+	enum class OpCode {
+		UNDEFINED, // Read of a variable that was never assigned on this path
+		ARGUMENT,
+		PHI,
+		OPERATION, // Anything the backend computes, operands: the values it reads. Defines a value when it has a type
+		CALL, // `name` is the callee, operands: the locals passed as they are
+		// Terminators
+		JUMP, // targets: destination
+		BRANCH, // operands: the values the condition reads, targets: when true, when false
+		RETURN, // operands: the values the returned expression reads
+	};
+
+	struct Instruction {
+		uint32_t mId{};
+		OpCode mOp{};
+		Builtin_Type mType{};
+		std::vector<uint32_t> mOperands{};
+		std::vector<uint32_t> mTargets{}; // Successors of a terminator, or the incoming block of every operand of a phi
+		int64_t mConstant{}; // Index of an argument
+		std::string mName{}; // Callee, or the name of the variable this value was assigned to
+		const void* mOrigin{}; // The Variable or FuncArg declaration in the AST this value is a definition of
+		uint32_t mBlock{};
+		bool mRemoved = false;
+	};
+
+	struct BasicBlock {
+		uint32_t mId{};
+		std::vector<uint32_t> mInstructions{};
+		std::vector<uint32_t> mPredecessors{};
+		std::vector<uint32_t> mSuccessors{};
+		uint32_t mLoopDepth{};
+	};
+
+	struct Function {
+		std::string mName{};
+		Builtin_Type mReturnType{};
+		std::vector<Instruction> mValues{}; // Indexed by the id of the instruction
+		std::vector<BasicBlock> mBlocks{}; // Indexed by the id of the block, the first one is the entry
+
+		const Instruction& value(uint32_t id) const { return mValues.at(id); }
+		bool isTerminated(uint32_t block) const;
+	};
+
+	const char* getOpCodeName(OpCode op);
+	const char* getTypeName(Builtin_Type type);
+	bool isTerminator(OpCode op);
+
+	std::ostream& operator<<(std::ostream& os, const Function& function);
+
+} // forest::ir
+
+#endif //FOREST_IR_HPP
@@ -0,0 +1,589 @@
+#include <algorithm>
+#include <stdexcept>
+#include "IRBuilder.hpp"
+
+namespace forest::ir {
+	using namespace forest::parser;
+
+	bool isScalar(Builtin_Type type) {
+		switch (type) {
+			case Builtin_Type::UI8:
+			case Builtin_Type::UI16:
+			case Builtin_Type::UI32:
+			case Builtin_Type::UI64:
+			case Builtin_Type::I8:
+			case Builtin_Type::I16:
+			case Builtin_Type::I32:
+			case Builtin_Type::I64:
+			case Builtin_Type::F32:
+			case Builtin_Type::F64:
+			case Builtin_Type::CHAR:
+			case Builtin_Type::BOOL:
+			case Builtin_Type::REF:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	std::optional<Function> IRBuilder::lowerFunction(const parser::Function& function, const std::string& className) {
+		mFunction = Function {};
+		mFunction.mName = className.empty() ? function.mName : className + "_" + function.mName;
+		mFunction.mReturnType = function.mReturnType.builtinType;
+		mLoopDepth = 0;
+		mAddressTaken.clear();
+		mScopes.clear();
+		mVariables.clear();
+		mCurrentDefinitions.clear();
+		mIncompletePhis.clear();
+		mSealed.clear();
+		mLayout.clear();
+		mReplacedBy.clear();
+		mLoopTargets.clear();
+
+		try {
+			findAddressTaken(function.mBody);
+			mScopes.emplace_back();
+			enterBlock(createBlock(true));
+
+			// Methods get the object as their first argument
+			int64_t index = className.empty() ? 0 : 1;
+			for (const auto& arg : function.mArgs) {
+				const void* variable = declare(&arg, arg.mType, arg.mName);
+				if (mVariables.at(variable).promoted) {
+					uint32_t value = emit(OpCode::ARGUMENT, arg.mType.builtinType, {}, index, arg.mName);
+					mFunction.mValues[value].mOrigin = variable;
+					writeVariable(variable, mCurrentBlock, value);
+				}
+				index++;
+			}
+
+			lowerBlock(function.mBody);
+			if (!mFunction.isTerminated(mCurrentBlock))
+				terminate(OpCode::RETURN, {}, {});
+		} catch (const std::exception& e) {
+			return std::nullopt;
+		}
+
+		renumberBlocks();
+		return mFunction;
+	}
+
+	uint32_t IRBuilder::createBlock(bool sealed) {
+		uint32_t id = mFunction.mBlocks.size();
+		mFunction.mBlocks.push_back(BasicBlock {id, {}, {}, {}, mLoopDepth});
+		mSealed.push_back(sealed);
+		return id;
+	}
+
+	void IRBuilder::enterBlock(uint32_t block) {
+		mCurrentBlock = block;
+		mLayout.push_back(block);
+	}
+
+	void IRBuilder::addEdge(uint32_t from, uint32_t to) {
+		mFunction.mBlocks[from].mSuccessors.push_back(to);
+		mFunction.mBlocks[to].mPredecessors.push_back(from);
+	}
+
+	void IRBuilder::sealBlock(uint32_t block) {
+		// Copied, filling in the operands can't add incomplete phis to this block but it can change the map
+		std::map<const void*, uint32_t> incomplete = mIncompletePhis[block];
+		mIncompletePhis.erase(block);
+		for (const auto& kv : incomplete) {
+			addPhiOperands(kv.first, kv.second);
+		}
+		mSealed[block] = true;
+	}
+
+	void IRBuilder::terminate(OpCode op, const std::vector<uint32_t>& operands, const std::vector<uint32_t>& targets) {
+		uint32_t id = emit(op, Builtin_Type::VOID, operands);
+		mFunction.mValues[id].mTargets = targets;
+		for (uint32_t target : targets) {
+			addEdge(mCurrentBlock, target);
+		}
+	}
+
+	void IRBuilder::jumpTo(uint32_t block) {
+		if (!mFunction.isTerminated(mCurrentBlock))
+			terminate(OpCode::JUMP, {}, {block});
+	}
+
+	void IRBuilder::startUnreachableBlock() {
+		// Code after return, break and skip still gets lowered, it just has no predecessors
+		enterBlock(createBlock(true));
+	}
+
+	void IRBuilder::renumberBlocks() {
+		std::vector<uint32_t> newIds(mFunction.mBlocks.size(), UINT32_MAX);
+		std::vector<uint32_t> order;
+		for (uint32_t block : mLayout) {
+			if (newIds[block] != UINT32_MAX) continue;
+			newIds[block] = order.size();
+			order.push_back(block);
+		}
+		for (uint32_t block = 0; block < mFunction.mBlocks.size(); block++) {
+			if (newIds[block] != UINT32_MAX) continue;
+			newIds[block] = order.size();
+			order.push_back(block);
+		}
+
+		std::vector<BasicBlock> blocks;
+		for (uint32_t block : order) {
+			BasicBlock b = mFunction.mBlocks[block];
+			b.mId = newIds[block];
+			for (auto& predecessor : b.mPredecessors) predecessor = newIds[predecessor];
+			for (auto& successor : b.mSuccessors) successor = newIds[successor];
+			blocks.push_back(b);
+		}
+		mFunction.mBlocks = blocks;
+		for (auto& instruction : mFunction.mValues) {
+			instruction.mBlock = newIds[instruction.mBlock];
+			for (auto& target : instruction.mTargets) target = newIds[target];
+		}
+	}
+
+	uint32_t IRBuilder::emit(OpCode op, Builtin_Type type, const std::vector<uint32_t>& operands, int64_t constant, const std::string& name) {
+		uint32_t id = mFunction.mValues.size();
+		Instruction instruction;
+		instruction.mId = id;
+		instruction.mOp = op;
+		instruction.mType = type;
+		instruction.mOperands = operands;
+		instruction.mConstant = constant;
+		instruction.mName = name;
+		instruction.mBlock = mCurrentBlock;
+		mFunction.mValues.push_back(instruction);
+		mFunction.mBlocks[mCurrentBlock].mInstructions.push_back(id);
+		return id;
+	}
+
+	const void* IRBuilder::declare(const void* declaration, const Type& type, const std::string& name) {
+		mScopes.back()[name] = declaration;
+		mVariables[declaration] = VariableInfo {type, name, isScalar(type.builtinType) && !mAddressTaken.contains(name)};
+		return declaration;
+	}
+
+	const void* IRBuilder::resolve(const std::string& name) const {
+		for (auto scope = mScopes.rbegin(); scope != mScopes.rend(); scope++) {
+			auto found = scope->find(name);
+			if (found != scope->end()) return found->second;
+		}
+		return nullptr;
+	}
+
+	void IRBuilder::writeVariable(const void* variable, uint32_t block, uint32_t value) {
+		mCurrentDefinitions[variable][block] = value;
+	}
+
+	uint32_t IRBuilder::readVariable(const void* variable, uint32_t block) {
+		auto& definitions = mCurrentDefinitions[variable];
+		auto found = definitions.find(block);
+		if (found != definitions.end())
+			return found->second;
+		return readVariableRecursive(variable, block);
+	}
+
+	uint32_t IRBuilder::readVariableRecursive(const void* variable, uint32_t block) {
+		uint32_t value;
+		std::vector<uint32_t> predecessors = mFunction.mBlocks[block].mPredecessors;
+		if (!mSealed[block]) {
+			// Not all predecessors are known yet, the operands get filled in once they are
+			value = createPhi(variable, block);
+			mIncompletePhis[block][variable] = value;
+		} else if (predecessors.empty()) {
+			value = createUndefined(variable);
+		} else if (predecessors.size() == 1) {
+			value = readVariable(variable, predecessors[0]);
+		} else {
+			// Break cycles by writing the phi before looking at the predecessors
+			value = createPhi(variable, block);
+			writeVariable(variable, block, value);
+			value = addPhiOperands(variable, value);
+		}
+		writeVariable(variable, block, value);
+		return value;
+	}
+
+	uint32_t IRBuilder::addPhiOperands(const void* variable, uint32_t phi) {
+		std::vector<uint32_t> predecessors = mFunction.mBlocks[mFunction.mValues[phi].mBlock].mPredecessors;
+		for (uint32_t predecessor : predecessors) {
+			uint32_t value = readVariable(variable, predecessor);
+			mFunction.mValues[phi].mOperands.push_back(value);
+			mFunction.mValues[phi].mTargets.push_back(predecessor);
+		}
+		return tryRemoveTrivialPhi(phi);
+	}
+
+	uint32_t IRBuilder::tryRemoveTrivialPhi(uint32_t phi) {
+		std::optional<uint32_t> same;
+		for (uint32_t operand : mFunction.mValues[phi].mOperands) {
+			if (operand == same || operand == phi) continue;
+			if (same.has_value()) return phi; // Merges at least two values, not trivial
+			same = operand;
+		}
+		if (!same.has_value()) {
+			// Unreachable, or only reads itself
+			same = createUndefined(mFunction.mValues[phi].mOrigin);
+		}
+
+		std::vector<uint32_t> users;
+		for (auto& instruction : mFunction.mValues) {
+			if (instruction.mRemoved || instruction.mId == phi) continue;
+			bool used = false;
+			for (auto& operand : instruction.mOperands) {
+				if (operand == phi) {
+					operand = same.value();
+					used = true;
+				}
+			}
+			if (used && instruction.mOp == OpCode::PHI)
+				users.push_back(instruction.mId);
+		}
+		for (auto& definitions : mCurrentDefinitions) {
+			for (auto& kv : definitions.second) {
+				if (kv.second == phi) kv.second = same.value();
+			}
+		}
+
+		Instruction& removed = mFunction.mValues[phi];
+		removed.mRemoved = true;
+		auto& instructions = mFunction.mBlocks[removed.mBlock].mInstructions;
+		instructions.erase(std::find(instructions.begin(), instructions.end(), phi));
+		mReplacedBy[phi] = same.value();
+
+		// Removing this phi might have made the phis that used it trivial too
+		for (uint32_t user : users) {
+			if (!mFunction.mValues[user].mRemoved)
+				tryRemoveTrivialPhi(user);
+		}
+		return resolveReplacement(same.value());
+	}
+
+	uint32_t IRBuilder::createPhi(const void* variable, uint32_t block) {
+		uint32_t id = mFunction.mValues.size();
+		Instruction phi;
+		phi.mId = id;
+		phi.mOp = OpCode::PHI;
+		phi.mType = mVariables.at(variable).type.builtinType;
+		phi.mName = mVariables.at(variable).name;
+		phi.mOrigin = variable;
+		phi.mBlock = block;
+		mFunction.mValues.push_back(phi);
+
+		// Phis go before every other instruction of the block
+		auto& instructions = mFunction.mBlocks[block].mInstructions;
+		auto position = instructions.begin();
+		while (position != instructions.end() && mFunction.mValues[*position].mOp == OpCode::PHI)
+			position++;
+		instructions.insert(position, id);
+		return id;
+	}
+
+	uint32_t IRBuilder::createUndefined(const void* variable) {
+		uint32_t id = mFunction.mValues.size();
+		Instruction undefined;
+		undefined.mId = id;
+		undefined.mOp = OpCode::UNDEFINED;
+		undefined.mOrigin = variable;
+		if (variable != nullptr) {
+			undefined.mType = mVariables.at(variable).type.builtinType;
+			undefined.mName = mVariables.at(variable).name;
+		}
+		undefined.mBlock = 0;
+		mFunction.mValues.push_back(undefined);
+		auto& instructions = mFunction.mBlocks[0].mInstructions;
+		instructions.insert(instructions.begin(), id);
+		return id;
+	}
+
+	uint32_t IRBuilder::resolveReplacement(uint32_t value) const {
+		auto found = mReplacedBy.find(value);
+		while (found != mReplacedBy.end()) {
+			value = found->second;
+			found = mReplacedBy.find(value);
+		}
+		return value;
+	}
+
+	void IRBuilder::assign(const std::string& name, const std::vector<uint32_t>& reads) {
+		const void* variable = resolve(name);
+		if (variable == nullptr || !mVariables.at(variable).promoted) {
+			// Stored to memory, the backend takes care of that
+			if (!reads.empty())
+				emit(OpCode::OPERATION, Builtin_Type::VOID, reads);
+			return;
+		}
+
+		const VariableInfo& info = mVariables.at(variable);
+		uint32_t value = emit(OpCode::OPERATION, info.type.builtinType, reads, 0, info.name);
+		mFunction.mValues[value].mOrigin = variable;
+		writeVariable(variable, mCurrentBlock, value);
+	}
+
+	void IRBuilder::read(const std::string& name, std::vector<uint32_t>& reads) {
+		// Globals, fields of the class and locals that live in memory aren't values
+		const void* variable = resolve(name);
+		if (variable != nullptr && mVariables.at(variable).promoted)
+			reads.push_back(readVariable(variable, mCurrentBlock));
+	}
+
+	void IRBuilder::lowerBlock(const Block& block) {
+		mScopes.emplace_back();
+		for (const auto& statement : block.statements) {
+			lowerStatement(statement);
+		}
+		mScopes.pop_back();
+	}
+
+	void IRBuilder::lowerStatement(const Statement& statement) {
+		switch (statement.mType) {
+			case Statement_Type::RETURN_CALL: {
+				std::vector<uint32_t> reads;
+				lowerExpression(statement.mContent, reads);
+				terminate(OpCode::RETURN, reads, {});
+				startUnreachableBlock();
+				break;
+			}
+			case Statement_Type::VAR_DECLARATION: {
+				const Variable& v = statement.variable.value();
+				declare(&v, v.mType, v.mName);
+				break;
+			}
+			case Statement_Type::VAR_DECL_ASSIGN: {
+				const Variable& v = statement.variable.value();
+				// The value is evaluated before the variable exists
+				std::vector<uint32_t> reads = lowerExpressions(v.mValues);
+				declare(&v, v.mType, v.mName);
+				assign(v.mName, reads);
+				break;
+			}
+			case Statement_Type::VAR_ASSIGNMENT: {
+				const Variable& v = statement.variable.value();
+				size_t index = v.mName.find('.');
+				std::vector<uint32_t> reads;
+				lowerExpression(statement.mContent, reads);
+				if (index == std::string::npos && statement.mContent == nullptr) {
+					for (uint32_t value : lowerExpressions(v.mValues))
+						reads.push_back(value);
+					assign(v.mName, reads);
+					break;
+				}
+				// An element or a field, stored through the variable before the dot
+				read(v.mName.substr(0, index), reads);
+				for (uint32_t value : lowerExpressions(v.mValues))
+					reads.push_back(value);
+				emit(OpCode::OPERATION, Builtin_Type::VOID, reads);
+				break;
+			}
+			case Statement_Type::FUNC_CALL: {
+				const FuncCallStatement& fc = statement.funcCall.value();
+				std::string callee;
+				if (!fc.mNamespace.empty())
+					callee += fc.mNamespace + "_";
+				if (!fc.mClassName.empty())
+					callee += fc.mClassName + "_";
+				callee += fc.mFunctionName;
+
+				// The call only reads what is passed as it is, arguments that have to be computed first are an operation before it
+				std::vector<uint32_t> args;
+				std::vector<uint32_t> computed;
+				if (!fc.mClassName.empty())
+					read(fc.mClassName, args);
+				for (const auto* arg : fc.mArgs) {
+					if (arg != nullptr && arg->isLeaf() && arg->mValue.mType == TokenType::IDENTIFIER)
+						read(arg->mValue.mText, args);
+					else
+						lowerExpression(arg, computed);
+				}
+				if (!computed.empty())
+					emit(OpCode::OPERATION, Builtin_Type::VOID, computed);
+				emit(OpCode::CALL, Builtin_Type::VOID, args, 0, callee);
+				break;
+			}
+			case Statement_Type::IF:
+				lowerIf(statement);
+				break;
+			case Statement_Type::LOOP:
+				lowerLoop(statement);
+				break;
+			case Statement_Type::BREAK:
+				if (!mLoopTargets.empty()) {
+					jumpTo(mLoopTargets.back().second);
+					startUnreachableBlock();
+				}
+				break;
+			case Statement_Type::SKIP:
+				if (!mLoopTargets.empty()) {
+					jumpTo(mLoopTargets.back().first);
+					startUnreachableBlock();
+				}
+				break;
+			case Statement_Type::NOTHING:
+			case Statement_Type::ARRAY_INDEX:
+				break;
+		}
+	}
+
+	void IRBuilder::lowerLoop(const Statement& statement) {
+		if (!statement.loopStatement.has_value()) return;
+		const LoopStatement& ls = statement.loopStatement.value();
+		if (!ls.mIterator.has_value() && statement.mContent != nullptr) {
+			// "until condition { ... }" isn't compiled by the backend either
+			return;
+		}
+
+		mScopes.emplace_back();
+		const std::string* iterator = nullptr;
+		if (ls.mIterator.has_value()) {
+			if (!ls.mRange.has_value())
+				throw std::runtime_error("Loop with an iterator but no range");
+			const Variable& v = ls.mIterator.value();
+			std::vector<uint32_t> minimum;
+			lowerExpression(ls.mRange.value().mMinimum, minimum);
+			declare(&v, v.mType, v.mName);
+			assign(v.mName, minimum);
+			iterator = &v.mName;
+		}
+
+		uint32_t exit = createBlock(false);
+		mLoopDepth++;
+		uint32_t header = createBlock(false);
+		uint32_t latch = createBlock(false);
+		jumpTo(header);
+		enterBlock(header);
+		if (iterator != nullptr) {
+			std::vector<uint32_t> condition;
+			lowerExpression(ls.mRange.value().mMaximum, condition);
+			read(*iterator, condition);
+			uint32_t body = createBlock(false);
+			terminate(OpCode::BRANCH, condition, {body, exit});
+			sealBlock(body);
+			enterBlock(body);
+		}
+
+		mLoopTargets.emplace_back(latch, exit);
+		lowerBlock(ls.mBody);
+		mLoopTargets.pop_back();
+		jumpTo(latch);
+		sealBlock(latch);
+		enterBlock(latch);
+		if (iterator != nullptr) {
+			std::vector<uint32_t> step;
+			if (ls.mStep.has_value())
+				lowerExpression(ls.mStep.value(), step);
+			read(*iterator, step);
+			assign(*iterator, step);
+		}
+		jumpTo(header);
+		sealBlock(header);
+		mLoopDepth--;
+		mScopes.pop_back();
+
+		sealBlock(exit);
+		enterBlock(exit);
+	}
+
+	void IRBuilder::lowerIf(const Statement& statement) {
+		const IfStatement& is = statement.ifStatement.value();
+		std::vector<uint32_t> condition;
+		lowerExpression(statement.mContent, condition);
+		uint32_t thenBlock = createBlock(false);
+		uint32_t elseBlock = is.mElseBody.has_value() ? createBlock(false) : 0;
+		uint32_t mergeBlock = createBlock(false);
+
+		terminate(OpCode::BRANCH, condition, {thenBlock, is.mElseBody.has_value() ? elseBlock : mergeBlock});
+		sealBlock(thenBlock);
+		enterBlock(thenBlock);
+		lowerBlock(is.mBody);
+		jumpTo(mergeBlock);
+		if (is.mElseBody.has_value()) {
+			sealBlock(elseBlock);
+			enterBlock(elseBlock);
+			lowerBlock(is.mElseBody.value());
+			jumpTo(mergeBlock);
+		}
+		sealBlock(mergeBlock);
+		enterBlock(mergeBlock);
+	}
+
+	void IRBuilder::lowerExpression(const Expression* expression, std::vector<uint32_t>& reads) {
+		if (expression == nullptr) return;
+
+		const Token& token = expression->mValue;
+		if (expression->isLeaf()) {
+			if (token.mType == TokenType::IDENTIFIER)
+				read(token.mText, reads);
+			return;
+		}
+		// Variables that have their address taken live in memory
+		if (token.mSubType == TokenSubType::OP_UNARY && token.mText == "\\")
+			return;
+		if (token.mText == ".") {
+			// The second child is the name of the field
+			lowerExpression(expression->mChildren.at(0), reads);
+			return;
+		}
+		if (token.mText == "(") {
+			// Children are the (namespaced) name of the callee, a "(" separator and then the arguments
+			bool parsingArgs = false;
+			for (const auto* child : expression->mChildren) {
+				if (parsingArgs)
+					lowerExpression(child, reads);
+				else if (child->mValue.mText == "(")
+					parsingArgs = true;
+				else if (child->mValue.mType == TokenType::IDENTIFIER)
+					read(child->mValue.mText, reads); // The object of a method call
+			}
+			return;
+		}
+		for (const auto* child : expression->mChildren) {
+			lowerExpression(child, reads);
+		}
+	}
+
+	std::vector<uint32_t> IRBuilder::lowerExpressions(const std::vector<Expression*>& expressions) {
+		std::vector<uint32_t> reads;
+		for (const auto* expression : expressions) {
+			lowerExpression(expression, reads);
+		}
+		return reads;
+	}
+
+	void IRBuilder::findAddressTaken(const Block& block) {
+		for (const auto& statement : block.statements) {
+			findAddressTaken(statement.mContent);
+			if (statement.variable.has_value()) {
+				for (const auto* value : statement.variable.value().mValues)
+					findAddressTaken(value);
+			}
+			if (statement.funcCall.has_value()) {
+				for (const auto* arg : statement.funcCall.value().mArgs)
+					findAddressTaken(arg);
+			}
+			if (statement.loopStatement.has_value()) {
+				const LoopStatement& ls = statement.loopStatement.value();
+				if (ls.mRange.has_value()) {
+					findAddressTaken(ls.mRange.value().mMinimum);
+					findAddressTaken(ls.mRange.value().mMaximum);
+				}
+				findAddressTaken(ls.mBody);
+			}
+			if (statement.ifStatement.has_value()) {
+				findAddressTaken(statement.ifStatement.value().mBody);
+				if (statement.ifStatement.value().mElseBody.has_value())
+					findAddressTaken(statement.ifStatement.value().mElseBody.value());
+			}
+		}
+	}
+
+	void IRBuilder::findAddressTaken(const Expression* expression) {
+		if (expression == nullptr) return;
+		if (expression->mValue.mText == "\\" && !expression->mChildren.empty() && expression->mChildren[0] != nullptr)
+			mAddressTaken.insert(expression->mChildren[0]->mValue.mText);
+		for (const auto* child : expression->mChildren) {
+			findAddressTaken(child);
+		}
+	}
+
+} // forest::ir
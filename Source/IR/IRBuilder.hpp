@@ -0,0 +1,82 @@
+#ifndef FOREST_IRBUILDER_HPP
+#define FOREST_IRBUILDER_HPP
+
+#include <map>
+#include <optional>
+#include <set>
+#include "IR.hpp"
+
+namespace forest::ir {
+
+	/**
+	 * Lowers the body of a function into SSA form for the register allocator.
+	 * Scalar locals that never have their address taken are promoted to SSA values directly while lowering, with the
+	 * algorithm from "Simple and Efficient Construction of Static Single Assignment Form" (Braun et al.). Every
+	 * expression is lowered to the values of the promoted locals it reads and nothing else, so a new construct only
+	 * needs a case here when it reads or assigns locals in a way the children of its expression don't show.
+	 */
+	class IRBuilder {
+	public:
+		/**
+		 * @return The function in SSA form, or nothing if it uses a construct the IR can't express yet
+		 */
+		std::optional<Function> lowerFunction(const parser::Function& function, const std::string& className = "");
+
+	private:
+		struct VariableInfo {
+			parser::Type type{};
+			std::string name{};
+			bool promoted = false;
+		};
+
+		Function mFunction;
+		uint32_t mCurrentBlock{};
+		uint32_t mLoopDepth{};
+		std::set<std::string> mAddressTaken;
+		std::vector<std::map<std::string, const void*>> mScopes;
+		std::map<const void*, VariableInfo> mVariables;
+		std::map<const void*, std::map<uint32_t, uint32_t>> mCurrentDefinitions;
+		std::map<uint32_t, std::map<const void*, uint32_t>> mIncompletePhis;
+		std::vector<bool> mSealed;
+		std::vector<uint32_t> mLayout; // Blocks in the order they were entered, which is the order the code is laid out in
+		std::map<uint32_t, uint32_t> mReplacedBy; // Trivial phis that were removed, and the value that replaced them
+		std::vector<std::pair<uint32_t, uint32_t>> mLoopTargets; // Skip and break target of every enclosing loop
+
+		uint32_t createBlock(bool sealed);
+		void enterBlock(uint32_t block);
+		void addEdge(uint32_t from, uint32_t to);
+		void sealBlock(uint32_t block);
+		void terminate(OpCode op, const std::vector<uint32_t>& operands, const std::vector<uint32_t>& targets);
+		void jumpTo(uint32_t block);
+		void startUnreachableBlock();
+		void renumberBlocks();
+		uint32_t emit(OpCode op, Builtin_Type type, const std::vector<uint32_t>& operands = {}, int64_t constant = 0, const std::string& name = "");
+
+		const void* declare(const void* declaration, const parser::Type& type, const std::string& name);
+		const void* resolve(const std::string& name) const;
+		void writeVariable(const void* variable, uint32_t block, uint32_t value);
+		uint32_t readVariable(const void* variable, uint32_t block);
+		uint32_t readVariableRecursive(const void* variable, uint32_t block);
+		uint32_t addPhiOperands(const void* variable, uint32_t phi);
+		uint32_t tryRemoveTrivialPhi(uint32_t phi);
+		uint32_t createPhi(const void* variable, uint32_t block);
+		uint32_t createUndefined(const void* variable);
+		uint32_t resolveReplacement(uint32_t value) const;
+		void assign(const std::string& name, const std::vector<uint32_t>& reads);
+		void read(const std::string& name, std::vector<uint32_t>& reads);
+
+		void lowerBlock(const parser::Block& block);
+		void lowerStatement(const parser::Statement& statement);
+		void lowerLoop(const parser::Statement& statement);
+		void lowerIf(const parser::Statement& statement);
+		void lowerExpression(const parser::Expression* expression, std::vector<uint32_t>& reads);
+		std::vector<uint32_t> lowerExpressions(const std::vector<parser::Expression*>& expressions);
+		void findAddressTaken(const parser::Block& block);
+		void findAddressTaken(const parser::Expression* expression);
+	};
+
+	bool isScalar(Builtin_Type type);
+
+} // forest::ir
+
+#endif //FOREST_IRBUILDER_HPP
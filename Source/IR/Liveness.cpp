@@ -0,0 +1,88 @@
+#include <map>
+#include <set>
+#include "Liveness.hpp"
+
+namespace forest::ir {
+
+	std::vector<LiveRange> computeLiveRanges(const Function& function) {
+		size_t blockCount = function.mBlocks.size();
+		std::vector<std::set<uint32_t>> liveIn(blockCount);
+		std::vector<std::set<uint32_t>> liveOut(blockCount);
+
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (size_t i = blockCount; i-- > 0;) {
+				const BasicBlock& block = function.mBlocks[i];
+				std::set<uint32_t> live;
+				for (uint32_t successor : block.mSuccessors) {
+					live.insert(liveIn[successor].begin(), liveIn[successor].end());
+					// Phi operands are used at the end of the block they come from
+					for (uint32_t id : function.mBlocks[successor].mInstructions) {
+						const Instruction& phi = function.value(id);
+						if (phi.mOp != OpCode::PHI) break;
+						for (size_t j = 0; j < phi.mOperands.size(); j++) {
+							if (phi.mTargets[j] == block.mId) live.insert(phi.mOperands[j]);
+						}
+					}
+				}
+				liveOut[i] = live;
+
+				for (auto it = block.mInstructions.rbegin(); it != block.mInstructions.rend(); it++) {
+					const Instruction& instruction = function.value(*it);
+					live.erase(instruction.mId);
+					if (instruction.mOp == OpCode::PHI) continue;
+					live.insert(instruction.mOperands.begin(), instruction.mOperands.end());
+				}
+				if (live != liveIn[i]) {
+					liveIn[i] = live;
+					changed = true;
+				}
+			}
+		}
+
+		std::vector<LiveRange> ranges(function.mValues.size());
+		auto extend = [&](uint32_t value, uint32_t start, uint32_t end) {
+			LiveRange& range = ranges[value];
+			if (!range.mLive) {
+				range = LiveRange {start, end, true};
+				return;
+			}
+			range.mStart = std::min(range.mStart, start);
+			range.mEnd = std::max(range.mEnd, end);
+		};
+
+		uint32_t position = 0;
+		for (size_t i = 0; i < blockCount; i++) {
+			const BasicBlock& block = function.mBlocks[i];
+			uint32_t blockStart = position;
+			uint32_t blockEnd = position + block.mInstructions.size();
+			position = blockEnd + 1;
+
+			// The last position every value is used at in this block
+			std::map<uint32_t, uint32_t> lastUse;
+			for (uint32_t value : liveOut[i]) {
+				lastUse[value] = blockEnd;
+			}
+			for (size_t j = block.mInstructions.size(); j-- > 0;) {
+				const Instruction& instruction = function.value(block.mInstructions[j]);
+				uint32_t at = blockStart + j;
+				if (instruction.mType != Builtin_Type::VOID) {
+					auto found = lastUse.find(instruction.mId);
+					extend(instruction.mId, at, found == lastUse.end() ? at : found->second);
+					if (found != lastUse.end()) lastUse.erase(found);
+				}
+				if (instruction.mOp == OpCode::PHI) continue;
+				for (uint32_t operand : instruction.mOperands) {
+					if (!lastUse.contains(operand)) lastUse[operand] = at;
+				}
+			}
+			// Whatever is left was live coming into the block
+			for (const auto& kv : lastUse) {
+				extend(kv.first, blockStart, kv.second);
+			}
+		}
+		return ranges;
+	}
+
+} // forest::ir
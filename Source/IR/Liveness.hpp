@@ -0,0 +1,25 @@
+#ifndef FOREST_LIVENESS_HPP
+#define FOREST_LIVENESS_HPP
+
+#include <cstdint>
+#include <vector>
+#include "IR.hpp"
+
+namespace forest::ir {
+
+	struct LiveRange {
+		uint32_t mStart{};
+		uint32_t mEnd{};
+		bool mLive = false; // Whether the value is defined at all, removed instructions aren't
+	};
+
+	/**
+	 * Numbers the instructions of the function in block order and computes the first and last position every value is
+	 * live at. A value that is live across the back edge of a loop is live for the entire loop.
+	 * @return The live range of every value, indexed by the id of the value
+	 */
+	std::vector<LiveRange> computeLiveRanges(const Function& function);
+
+} // forest::ir
+
+#endif //FOREST_LIVENESS_HPP
@@ -0,0 +1,433 @@
+#include <algorithm>
+#include "ConstantPropagation.hpp"
+#include "LoopInvariantCodeMotion.hpp"
+
+using namespace forest::parser;
+
+namespace forest::optimiser {
+
+	static int getSize(const Type& type) {
+		if (type.byteSize >= 8) return 3;
+		if (type.byteSize >= 4) return 2;
+		if (type.byteSize >= 2) return 1;
+		return 0;
+	}
+
+	static bool isSigned(const Type& type) {
+		return !type.name.empty() && type.name[0] == 'i'; // Same check as the backend
+	}
+
+	// Sign or zero extends the low bytes, like loading a variable of that size into rax does
+	static uint64_t extend(uint64_t bits, int size, bool sign) {
+		if (size >= 3) return bits;
+		int width = 8 << size;
+		uint64_t mask = (uint64_t(1) << width) - 1;
+		bits &= mask;
+		if (sign && ((bits >> (width - 1)) & 1))
+			bits |= ~mask;
+		return bits;
+	}
+
+	// Whether the value fits in the size without touching its sign bit, so every size and sign above it agrees on it
+	static bool fitsPositive(__int128 value, int size) {
+		return value >= 0 && value < (__int128(1) << ((8 << size) - 1));
+	}
+
+	void ConstantPropagation::run(Programme& p) {
+		mProgramme = &p;
+		for (auto& function : p.functions) {
+			run(function);
+		}
+		for (auto& klass : p.classes) {
+			for (auto& function : klass.second.mFunctions) {
+				run(function);
+			}
+		}
+	}
+
+	void ConstantPropagation::run(Function& function) {
+		mAddressTaken.clear();
+		mLocals.clear();
+		mReturnType = function.mReturnType;
+		findAddressTaken(function.mBody);
+		Environment environment;
+		propagate(function.mBody, environment);
+	}
+
+	void ConstantPropagation::propagate(Block& block, Environment& environment) {
+		std::vector<std::string> declared;
+		for (auto& statement : block.statements) {
+			switch (statement.mType) {
+				case Statement_Type::VAR_DECLARATION:
+				case Statement_Type::VAR_DECL_ASSIGN: {
+					const Variable& variable = statement.variable.value();
+					declared.push_back(variable.mName);
+					if (isInteger(variable.mType) && !mAddressTaken.contains(variable.mName))
+						mLocals.insert(variable.mName);
+					else
+						mLocals.erase(variable.mName);
+					if (statement.mType == Statement_Type::VAR_DECLARATION)
+						environment.erase(variable.mName); // Whatever was on the stack before
+					else
+						propagateStore(statement, environment);
+					break;
+				}
+				case Statement_Type::VAR_ASSIGNMENT:
+					propagateStore(statement, environment);
+					break;
+				case Statement_Type::RETURN_CALL:
+					fold(statement.mContent, environment, isScalar(mReturnType) ? Use::VALUE : Use::OTHER);
+					break;
+				case Statement_Type::FUNC_CALL:
+					for (auto*& arg : statement.funcCall.value().mArgs) {
+						fold(arg, environment, Use::OTHER);
+					}
+					break;
+				case Statement_Type::IF: {
+					IfStatement& is = statement.ifStatement.value();
+					std::optional<Constant> condition = fold(statement.mContent, environment, Use::VALUE);
+					Environment body = environment;
+					propagate(is.mBody, body);
+					Environment elseBody = environment;
+					if (is.mElseBody.has_value())
+						propagate(is.mElseBody.value(), elseBody);
+
+					if (condition.has_value() && condition->mExact) {
+						environment = condition->mBits != 0 ? body : elseBody;
+					} else {
+						merge(body, elseBody);
+						environment = body;
+					}
+					break;
+				}
+				case Statement_Type::LOOP: {
+					LoopStatement& ls = statement.loopStatement.value();
+					std::set<std::string> assigned;
+					findAssigned(ls.mBody, assigned);
+					if (ls.mIterator.has_value())
+						assigned.insert(ls.mIterator.value().mName);
+
+					// The minimum is only evaluated once, before anything in the loop ran
+					if (ls.mRange.has_value())
+						fold(ls.mRange.value().mMinimum, environment, Use::VALUE);
+					for (const auto& name : assigned) {
+						environment.erase(name);
+					}
+					if (ls.mRange.has_value())
+						fold(ls.mRange.value().mMaximum, environment, Use::VALUE);
+					if (!ls.mIterator.has_value() && statement.mContent != nullptr)
+						fold(statement.mContent, environment, Use::OTHER);
+
+					// What the loop doesn't assign is the same on every iteration and after it, the rest is unknown
+					Environment body = environment;
+					propagate(ls.mBody, body);
+					break;
+				}
+				default:
+					break;
+			}
+		}
+
+		// A variable with the same name outside this block could have had any value in the meantime
+		for (const auto& name : declared) {
+			environment.erase(name);
+			mLocals.erase(name);
+		}
+	}
+
+	void ConstantPropagation::propagateStore(Statement& statement, Environment& environment) {
+		Variable& variable = statement.variable.value();
+		if (statement.mType == Statement_Type::VAR_ASSIGNMENT)
+			fold(statement.mContent, environment, Use::VALUE); // The index of `arr[i] = value`
+
+		// Elements of arrays and refs are stored the same way as scalars
+		bool indirect = variable.mType.builtinType == Builtin_Type::ARRAY || variable.mType.builtinType == Builtin_Type::REF;
+		const Type& target = indirect && !variable.mType.subTypes.empty() ? variable.mType.subTypes[0] : variable.mType;
+		Use use = isScalar(target) ? Use::VALUE : Use::OTHER;
+		std::optional<Constant> value;
+		for (auto*& expression : variable.mValues) {
+			value = fold(expression, environment, use);
+		}
+
+		bool tracked = mLocals.contains(variable.mName) && statement.mContent == nullptr && variable.mValues.size() == 1;
+		// Without all of its bytes known, the value can only be stored in something that doesn't need more of them
+		if (!tracked || !value.has_value() || (!value->mExact && getSize(variable.mType) > value->mSize)) {
+			environment.erase(variable.mName);
+			return;
+		}
+		Constant stored = store(value.value(), variable.mType);
+		environment[variable.mName] = stored;
+		replace(variable.mValues[0], stored);
+	}
+
+	std::optional<ConstantPropagation::Constant> ConstantPropagation::fold(Expression*& expression, const Environment& environment, Use use) {
+		if (expression == nullptr) return std::nullopt;
+		const Token& token = expression->mValue;
+		// Literals folded by the parser keep their (null) children
+		if (token.mType == TokenType::LITERAL) {
+			if (token.mSubType != TokenSubType::INTEGER_LITERAL) return std::nullopt;
+			return getLiteral(token.mText);
+		}
+
+		std::optional<Constant> result;
+		const std::string& op = token.mText;
+		size_t children = expression->mChildren.size();
+		bool unary = token.mSubType == TokenSubType::OP_UNARY && children == 1 && (op == "-" || op == "~" || op == "!");
+		bool binary = token.mSubType != TokenSubType::OP_UNARY && children == 2 && (op == "+" || op == "-" || op == "*" || op == "/" || op == "%"
+			|| op == "&" || op == "|" || op == "^" || op == "<<" || op == ">>"
+			|| op == "<" || op == "<=" || op == ">" || op == ">=" || op == "==" || op == "!=");
+		if (children == 0) {
+			if (token.mType != TokenType::IDENTIFIER) return std::nullopt;
+			auto it = environment.find(token.mText);
+			if (it == environment.end()) return std::nullopt;
+			result = it->second;
+		} else if (token.mType == TokenType::OPERATOR && (unary || binary)
+				&& std::none_of(expression->mChildren.begin(), expression->mChildren.end(), [](const Expression* child) { return child == nullptr; })) {
+			std::optional<Constant> left = fold(expression->mChildren[0], environment, Use::OPERAND);
+			std::optional<Constant> right = binary ? fold(expression->mChildren[1], environment, Use::OPERAND) : std::nullopt;
+			if (!left.has_value() || (binary && !right.has_value())) return std::nullopt;
+			result = binary ? evaluate(op, left.value(), right.value()) : evaluate(op, left.value());
+			if (!result.has_value()) return std::nullopt;
+		} else {
+			// Calls, indexing, properties and addresses read their children in their own way, only the index is a plain value
+			bool index = op == "[" && children == 2;
+			for (size_t i = 0; i < children; i++) {
+				fold(expression->mChildren[i], environment, index && i == 1 ? Use::VALUE : Use::OTHER);
+			}
+			return std::nullopt;
+		}
+
+		if (result->mExact) {
+			Type literalType = getIntegerLiteralType(getText(result.value()));
+			bool sameType = getSize(literalType) == result->mSize && isSigned(literalType) == result->mSigned;
+			if (use == Use::VALUE || (use == Use::OPERAND && sameType))
+				replace(expression, result.value());
+		}
+		return result;
+	}
+
+	void ConstantPropagation::replace(Expression*& expression, const Constant& constant) {
+		std::string text = getText(constant);
+		if (expression->mValue.mType == TokenType::LITERAL && expression->mChildren.empty() && expression->mValue.mText == text)
+			return;
+		Expression* literal = mProgramme->arena->create();
+		literal->mValue = expression->mValue;
+		literal->mValue.mType = TokenType::LITERAL;
+		literal->mValue.mSubType = TokenSubType::INTEGER_LITERAL;
+		literal->mValue.mText = text;
+		expression = literal;
+	}
+
+	std::optional<ConstantPropagation::Constant> ConstantPropagation::evaluate(const std::string& op, const Constant& left, const Constant& right) {
+		if (!left.mExact || !right.mExact) return std::nullopt;
+		Constant result;
+		result.mSize = left.mSize == 0 || right.mSize > left.mSize ? right.mSize : left.mSize;
+		result.mSigned = left.mSigned || right.mSigned;
+		__int128 a = left.mSigned ? __int128(int64_t(left.mBits)) : __int128(left.mBits);
+		__int128 b = right.mSigned ? __int128(int64_t(right.mBits)) : __int128(right.mBits);
+		bool wide = result.mSize == 3;
+		bool operandsFit = fitsPositive(a, result.mSize) && fitsPositive(b, result.mSize);
+
+		if (op == "<" || op == "<=" || op == ">" || op == ">=" || op == "==" || op == "!=") {
+			// A signed compare of the low bytes, which only matches the types when both fit in them as signed numbers
+			__int128 half = __int128(1) << ((8 << result.mSize) - 1);
+			if (a < -half || a >= half || b < -half || b >= half) return std::nullopt;
+			bool holds = op == "<" ? a < b : op == "<=" ? a <= b : op == ">" ? a > b : op == ">=" ? a >= b : op == "==" ? a == b : a != b;
+			result.mBits = holds ? 1 : 0;
+			return result;
+		}
+
+		if (op == "<<" || op == ">>") {
+			// Always shifts all of rax, logically
+			if (b < 0 || b > 63) return std::nullopt;
+			if (op == ">>") {
+				if (a < 0) return std::nullopt;
+				result.mBits = left.mBits >> int(b);
+			} else {
+				result.mBits = left.mBits << int(b);
+			}
+			result.mExact = extend(result.mBits, result.mSize, result.mSigned) == result.mBits;
+			return result;
+		}
+
+		if (op == "/" || op == "%") {
+			if (b == 0) return std::nullopt;
+			if (wide) {
+				if (result.mSigned) {
+					// rdx is cleared instead of sign extended, so only a dividend that isn't negative divides correctly
+					int64_t dividend = int64_t(left.mBits);
+					int64_t divisor = int64_t(right.mBits);
+					if (dividend < 0) return std::nullopt;
+					result.mBits = uint64_t(op == "/" ? dividend / divisor : dividend % divisor);
+				} else {
+					result.mBits = op == "/" ? left.mBits / right.mBits : left.mBits % right.mBits;
+				}
+				return result;
+			}
+			if (!operandsFit) return std::nullopt;
+			result.mBits = uint64_t(op == "/" ? a / b : a % b);
+			result.mExact = false; // The other half of the division ends up in the upper bytes of rax
+			return result;
+		}
+
+		uint64_t bits;
+		if (op == "+") bits = left.mBits + right.mBits;
+		else if (op == "-") bits = left.mBits - right.mBits;
+		else if (op == "*") bits = left.mBits * right.mBits;
+		else if (op == "&") bits = left.mBits & right.mBits;
+		else if (op == "|") bits = left.mBits | right.mBits;
+		else if (op == "^") bits = left.mBits ^ right.mBits;
+		else return std::nullopt;
+		result.mBits = bits;
+		if (wide) return result;
+
+		// Below 8 bytes only the low bytes are computed, the ones above keep what was loaded, unless nothing carries into them
+		if (operandsFit) {
+			__int128 exact = op == "+" ? a + b : op == "-" ? a - b : op == "*" ? a * b : op == "&" ? (a & b) : op == "|" ? (a | b) : (a ^ b);
+			if (fitsPositive(exact, result.mSize)) {
+				result.mBits = uint64_t(exact);
+				return result;
+			}
+		}
+		result.mExact = false;
+		return result;
+	}
+
+	std::optional<ConstantPropagation::Constant> ConstantPropagation::evaluate(const std::string& op, const Constant& operand) {
+		if (!operand.mExact) return std::nullopt;
+		// Unary operators work on all of rax
+		Constant result{0, 3, false, true};
+		if (op == "-") result.mBits = 0 - operand.mBits;
+		else if (op == "~") result.mBits = ~operand.mBits;
+		else result.mBits = operand.mBits == 0 ? 1 : 0;
+		return result;
+	}
+
+	std::optional<ConstantPropagation::Constant> ConstantPropagation::getLiteral(const std::string& text) {
+		std::string_view digits = text;
+		bool negative = !digits.empty() && digits[0] == '-';
+		if (negative) digits.remove_prefix(1);
+		int base = 10;
+		if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) base = 16;
+		else if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'b' || digits[1] == 'B')) base = 2;
+		if (base != 10) digits.remove_prefix(2);
+		if (digits.empty()) return std::nullopt;
+
+		unsigned __int128 value = 0;
+		for (char c : digits) {
+			int digit;
+			if (c >= '0' && c <= '9') digit = c - '0';
+			else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+			else return std::nullopt;
+			if (digit >= base) return std::nullopt;
+			value = value * base + digit;
+			if (value > UINT64_MAX) return std::nullopt;
+		}
+
+		Type type = getIntegerLiteralType(text);
+		Constant constant;
+		constant.mBits = negative ? 0 - uint64_t(value) : uint64_t(value);
+		constant.mSize = getSize(type);
+		constant.mSigned = isSigned(type);
+		return constant;
+	}
+
+	std::string ConstantPropagation::getText(const Constant& constant) {
+		if (constant.mSigned && int64_t(constant.mBits) < 0)
+			return std::to_string(int64_t(constant.mBits));
+		return std::to_string(constant.mBits);
+	}
+
+	// What a variable of the type holds after rax is stored in it
+	ConstantPropagation::Constant ConstantPropagation::store(const Constant& constant, const Type& type) {
+		int size = getSize(type);
+		bool sign = isSigned(type);
+		return Constant{extend(constant.mBits, size, sign), size, sign, true};
+	}
+
+	bool ConstantPropagation::isInteger(const Type& type) {
+		switch (type.builtinType) {
+			case Builtin_Type::UI8:
+			case Builtin_Type::UI16:
+			case Builtin_Type::UI32:
+			case Builtin_Type::UI64:
+			case Builtin_Type::I8:
+			case Builtin_Type::I16:
+			case Builtin_Type::I32:
+			case Builtin_Type::I64:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	// Keeps only what both paths agree on
+	void ConstantPropagation::merge(Environment& environment, const Environment& other) {
+		for (auto it = environment.begin(); it != environment.end();) {
+			auto match = other.find(it->first);
+			bool same = match != other.end() && match->second.mBits == it->second.mBits && match->second.mSize == it->second.mSize
+				&& match->second.mSigned == it->second.mSigned && match->second.mExact == it->second.mExact;
+			it = same ? std::next(it) : environment.erase(it);
+		}
+	}
+
+	void ConstantPropagation::findAssigned(const Block& block, std::set<std::string>& assigned) {
+		for (const auto& statement : block.statements) {
+			if (statement.variable.has_value()) {
+				const std::string& name = statement.variable.value().mName;
+				assigned.insert(name.substr(0, name.find('.')));
+			}
+			if (statement.loopStatement.has_value()) {
+				const LoopStatement& ls = statement.loopStatement.value();
+				if (ls.mIterator.has_value())
+					assigned.insert(ls.mIterator.value().mName);
+				findAssigned(ls.mBody, assigned);
+			}
+			if (statement.ifStatement.has_value()) {
+				findAssigned(statement.ifStatement.value().mBody, assigned);
+				if (statement.ifStatement.value().mElseBody.has_value())
+					findAssigned(statement.ifStatement.value().mElseBody.value(), assigned);
+			}
+		}
+	}
+
+	void ConstantPropagation::findAddressTaken(const Block& block) {
+		for (const auto& statement : block.statements) {
+			findAddressTaken(statement.mContent);
+			if (statement.variable.has_value()) {
+				for (const auto* value : statement.variable.value().mValues) {
+					findAddressTaken(value);
+				}
+			}
+			if (statement.funcCall.has_value()) {
+				for (const auto* arg : statement.funcCall.value().mArgs) {
+					findAddressTaken(arg);
+				}
+			}
+			if (statement.loopStatement.has_value()) {
+				const LoopStatement& ls = statement.loopStatement.value();
+				if (ls.mRange.has_value()) {
+					findAddressTaken(ls.mRange.value().mMinimum);
+					findAddressTaken(ls.mRange.value().mMaximum);
+				}
+				findAddressTaken(ls.mBody);
+			}
+			if (statement.ifStatement.has_value()) {
+				findAddressTaken(statement.ifStatement.value().mBody);
+				if (statement.ifStatement.value().mElseBody.has_value())
+					findAddressTaken(statement.ifStatement.value().mElseBody.value());
+			}
+		}
+	}
+
+	void ConstantPropagation::findAddressTaken(const Expression* expression) {
+		if (expression == nullptr) return;
+		if (expression->mValue.mSubType == TokenSubType::OP_UNARY && expression->mValue.mText == "\\" && !expression->mChildren.empty() && expression->mChildren[0] != nullptr)
+			mAddressTaken.insert(expression->mChildren[0]->mValue.mText);
+		for (const auto* child : expression->mChildren) {
+			findAddressTaken(child);
+		}
+	}
+
+} // forest::optimiser
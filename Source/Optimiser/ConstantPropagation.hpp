@@ -0,0 +1,65 @@
+#ifndef FOREST_CONSTANTPROPAGATION_HPP
+#define FOREST_CONSTANTPROPAGATION_HPP
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include "Parser.hpp"
+
+namespace forest::optimiser {
+
+	/**
+	 * Tracks which integer locals hold a known value at every point of a function body, and folds the operations that
+	 * only read constants into a single literal. `ui64 window = 0xE000000000000000; window >>= 1;` becomes a store of
+	 * the shifted value, and `if (window == 0)` right after it a literal condition.
+	 * Values are computed the way the backend computes them: at the size of the biggest operand, truncated when stored
+	 * into a smaller variable. An operation whose upper bits the backend leaves unspecified, like an overflowing ui8
+	 * addition, is only folded into a store that keeps the low bytes. A literal only replaces an operand when the
+	 * backend would give it the same size and sign as what it replaces, so the operations around it don't change width.
+	 */
+	class ConstantPropagation {
+	public:
+		void run(parser::Programme& p);
+
+	private:
+		struct Constant {
+			uint64_t mBits{}; // What the backend has in rax for this value
+			int mSize{}; // The size it is computed at, 0 to 3 for 1 to 8 bytes
+			bool mSigned{};
+			bool mExact = true; // False when only the low mSize bytes are known
+		};
+		using Environment = std::map<std::string, Constant>;
+
+		enum class Use {
+			VALUE, // The whole value ends up in rax, like the value of a store, a condition or an index
+			OPERAND, // Operand of an operation, which takes its size from the operand
+			OTHER, // Argument of a call, address of, indexed array... has to keep its form
+		};
+
+		parser::Programme* mProgramme{};
+		parser::Type mReturnType{};
+		std::set<std::string> mAddressTaken;
+		std::set<std::string> mLocals; // Integer locals in scope, anything else with a name can change behind our back
+
+		void run(parser::Function& function);
+		void propagate(parser::Block& block, Environment& environment);
+		void propagateStore(parser::Statement& statement, Environment& environment);
+		std::optional<Constant> fold(parser::Expression*& expression, const Environment& environment, Use use);
+		void replace(parser::Expression*& expression, const Constant& constant);
+
+		static std::optional<Constant> evaluate(const std::string& op, const Constant& left, const Constant& right);
+		static std::optional<Constant> evaluate(const std::string& op, const Constant& operand);
+		static std::optional<Constant> getLiteral(const std::string& text);
+		static std::string getText(const Constant& constant);
+		static Constant store(const Constant& constant, const parser::Type& type);
+		static bool isInteger(const parser::Type& type);
+		static void merge(Environment& environment, const Environment& other);
+		static void findAssigned(const parser::Block& block, std::set<std::string>& assigned);
+		void findAddressTaken(const parser::Block& block);
+		void findAddressTaken(const parser::Expression* expression);
+	};
+
+} // forest::optimiser
+
+#endif //FOREST_CONSTANTPROPAGATION_HPP
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <string_view>
+#include <vector>
+#include "DeadCodeElimination.hpp"
+
+using namespace forest::parser;
+
+namespace forest::optimiser {
+
+	DeadCodeElimination::DeadCodeElimination(const CompileContext& ctx) : mContext(ctx) {}
+
+	void DeadCodeElimination::run(Programme& p) {
+		for (auto& function : p.functions) {
+			eliminate(function.mBody);
+		}
+		for (auto& klass : p.classes) {
+			for (auto& function : klass.second.mFunctions) {
+				eliminate(function.mBody);
+			}
+		}
+		removeUnreachableFunctions(p);
+	}
+
+	void DeadCodeElimination::eliminate(Block& block) {
+		std::vector<Statement> statements;
+		bool reachable = true;
+		auto keep = [&](Statement& statement) {
+			if (!reachable) return;
+			statements.push_back(std::move(statement));
+			Statement_Type type = statements.back().mType;
+			// Nothing after these in the same block can run
+			if (type == Statement_Type::RETURN_CALL || type == Statement_Type::BREAK || type == Statement_Type::SKIP)
+				reachable = false;
+		};
+
+		for (auto& statement : block.statements) {
+			if (!reachable) break;
+			if (statement.mType == Statement_Type::LOOP && statement.loopStatement.has_value()) {
+				eliminate(statement.loopStatement.value().mBody);
+			} else if (statement.mType == Statement_Type::IF && statement.ifStatement.has_value()) {
+				IfStatement& is = statement.ifStatement.value();
+				eliminate(is.mBody);
+				if (is.mElseBody.has_value())
+					eliminate(is.mElseBody.value());
+
+				std::optional<bool> condition = getCondition(statement.mContent);
+				if (condition.has_value()) {
+					if (!condition.value()) {
+						if (!is.mElseBody.has_value()) continue; // The body never runs
+						// Only the else runs, which is the same as an if that is always taken
+						is.mBody = std::move(is.mElseBody.value());
+						statement.mContent->mValue.mText = "1";
+						statement.mContent->mValue.mSubType = TokenSubType::INTEGER_LITERAL;
+					}
+					is.mElse = std::nullopt;
+					is.mElseBody = std::nullopt;
+					// Anything the body declares has to stay in its own scope, with its own stack memory
+					if (is.mBody.stackMemory == 0) {
+						for (auto& inner : is.mBody.statements) {
+							keep(inner);
+						}
+						continue;
+					}
+				}
+			}
+			keep(statement);
+		}
+		block.statements = std::move(statements);
+	}
+
+	void DeadCodeElimination::removeUnreachableFunctions(Programme& p) {
+		std::map<std::string, const Function*> functions;
+		std::vector<const Function*> worklist;
+		for (const auto& function : p.functions) {
+			functions[function.mName] = &function;
+			if (function.mName == "main" || isExported(function.mName))
+				worklist.push_back(&function);
+		}
+
+		// Methods and globals are always kept, so whatever they call is reachable too
+		std::set<std::string> references;
+		for (const auto& klass : p.classes) {
+			for (const auto& function : klass.second.mFunctions) {
+				findReferences(function.mBody, references);
+			}
+		}
+		for (const auto& variable : p.variables) {
+			for (const auto* value : variable.second.mValues) {
+				findReferences(value, references);
+			}
+		}
+		for (const auto& name : references) {
+			auto found = functions.find(name);
+			if (found != functions.end())
+				worklist.push_back(found->second);
+		}
+
+		std::set<std::string> reachable;
+		while (!worklist.empty()) {
+			const Function* function = worklist.back();
+			worklist.pop_back();
+			if (!reachable.insert(function->mName).second) continue;
+			references.clear();
+			findReferences(function->mBody, references);
+			for (const auto& name : references) {
+				auto found = functions.find(name);
+				if (found != functions.end() && !reachable.contains(name))
+					worklist.push_back(found->second);
+			}
+		}
+
+		std::erase_if(p.functions, [&](const Function& function) { return !reachable.contains(function.mName); });
+	}
+
+	// Same check the backend does before it makes a function global
+	bool DeadCodeElimination::isExported(const std::string& name) const {
+		const auto& convention = mContext.getSymbolConvention(name);
+		if (convention == mContext.conventionsEnd) return false;
+		return ((*convention).modifiers & Modifiers::PUBLIC) == Modifiers::PUBLIC;
+	}
+
+	std::optional<bool> DeadCodeElimination::getCondition(const Expression* expression) {
+		if (expression == nullptr || expression->mValue.mType != TokenType::LITERAL) return std::nullopt;
+		if (expression->mValue.mSubType != TokenSubType::INTEGER_LITERAL && expression->mValue.mSubType != TokenSubType::BOOLEAN_LITERAL)
+			return std::nullopt;
+		// Collapsed literals keep their (empty) children
+		if (std::any_of(expression->mChildren.begin(), expression->mChildren.end(), [](const Expression* child) { return child != nullptr; }))
+			return std::nullopt;
+
+		std::string_view digits = expression->mValue.mText;
+		if (!digits.empty() && digits[0] == '-') digits.remove_prefix(1);
+		if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X' || digits[1] == 'b' || digits[1] == 'B'))
+			digits.remove_prefix(2);
+		if (digits.empty()) return std::nullopt;
+		bool nonZero = false;
+		for (char c : digits) {
+			if (!std::isxdigit(static_cast<unsigned char>(c))) return std::nullopt;
+			if (c != '0') nonZero = true;
+		}
+		return nonZero;
+	}
+
+	void DeadCodeElimination::findReferences(const Block& block, std::set<std::string>& references) {
+		for (const auto& statement : block.statements) {
+			findReferences(statement.mContent, references);
+			if (statement.funcCall.has_value()) {
+				const FuncCallStatement& fc = statement.funcCall.value();
+				if (fc.mClassName.empty() && !fc.mIsExternal)
+					references.insert(fc.mFunctionName);
+				for (const auto* arg : fc.mArgs) {
+					findReferences(arg, references);
+				}
+			}
+			if (statement.variable.has_value()) {
+				for (const auto* value : statement.variable.value().mValues) {
+					findReferences(value, references);
+				}
+			}
+			if (statement.loopStatement.has_value()) {
+				const LoopStatement& ls = statement.loopStatement.value();
+				if (ls.mRange.has_value()) {
+					findReferences(ls.mRange.value().mMinimum, references);
+					findReferences(ls.mRange.value().mMaximum, references);
+				}
+				if (ls.mStep.has_value())
+					findReferences(ls.mStep.value(), references);
+				findReferences(ls.mBody, references);
+			}
+			if (statement.ifStatement.has_value()) {
+				findReferences(statement.ifStatement.value().mBody, references);
+				if (statement.ifStatement.value().mElseBody.has_value())
+					findReferences(statement.ifStatement.value().mElseBody.value(), references);
+			}
+		}
+	}
+
+	// Calls inside expressions are an identifier under a '(' node, any identifier is taken as a possible call
+	void DeadCodeElimination::findReferences(const Expression* expression, std::set<std::string>& references) {
+		if (expression == nullptr) return;
+		if (expression->mValue.mType == TokenType::IDENTIFIER)
+			references.insert(expression->mValue.mText);
+		for (const auto* child : expression->mChildren) {
+			findReferences(child, references);
+		}
+	}
+
+} // forest::optimiser
@@ -0,0 +1,38 @@
+#ifndef FOREST_DEADCODEELIMINATION_HPP
+#define FOREST_DEADCODEELIMINATION_HPP
+
+#include <optional>
+#include <set>
+#include <string>
+#include "ConfigParser.hpp"
+#include "Parser.hpp"
+
+namespace forest::optimiser {
+
+	/**
+	 * Removes code that can never run, so the backend doesn't emit it.
+	 * An `if` whose condition is a literal (usually one ConstantPropagation left behind) keeps only the branch that is
+	 * taken, spliced into the surrounding block when it declares nothing of its own. Statements after a `return`,
+	 * `break` or `skip` in the same block are dropped. Functions that aren't reachable from `main` or from a function
+	 * exported to other translation units through a public naming convention are removed from the programme.
+	 */
+	class DeadCodeElimination {
+	public:
+		explicit DeadCodeElimination(const parser::CompileContext& ctx);
+		void run(parser::Programme& p);
+
+	private:
+		const parser::CompileContext& mContext;
+
+		void eliminate(parser::Block& block);
+		void removeUnreachableFunctions(parser::Programme& p);
+		bool isExported(const std::string& name) const;
+
+		static std::optional<bool> getCondition(const parser::Expression* expression);
+		static void findReferences(const parser::Block& block, std::set<std::string>& references);
+		static void findReferences(const parser::Expression* expression, std::set<std::string>& references);
+	};
+
+} // forest::optimiser
+
+#endif //FOREST_DEADCODEELIMINATION_HPP
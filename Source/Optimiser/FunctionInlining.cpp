@@ -0,0 +1,369 @@
+#include <algorithm>
+#include <iterator>
+#include "FunctionInlining.hpp"
+#include "LoopInvariantCodeMotion.hpp"
+
+using namespace forest::parser;
+
+namespace forest::optimiser {
+
+	// Assignments to a property are stored as `name.property`, only the variable itself is renamed
+	static std::string rename(const std::string& name, const std::map<std::string, std::string>& renames) {
+		size_t dot = name.find('.');
+		auto found = renames.find(name.substr(0, dot));
+		if (found == renames.end()) return name;
+		return dot == std::string::npos ? found->second : found->second + name.substr(dot);
+	}
+
+	// Whether the statement leaves the block it is in: a return, or a break or skip that isn't inside a loop of its own
+	static bool jumpsOut(const Statement& statement, bool inLoop) {
+		if (statement.mType == Statement_Type::RETURN_CALL) return true;
+		if ((statement.mType == Statement_Type::BREAK || statement.mType == Statement_Type::SKIP) && !inLoop) return true;
+		std::vector<const Block*> blocks;
+		if (statement.loopStatement.has_value()) {
+			blocks.push_back(&statement.loopStatement.value().mBody);
+			inLoop = true;
+		}
+		if (statement.ifStatement.has_value()) {
+			blocks.push_back(&statement.ifStatement.value().mBody);
+			if (statement.ifStatement.value().mElseBody.has_value())
+				blocks.push_back(&statement.ifStatement.value().mElseBody.value());
+		}
+		for (const auto* block : blocks) {
+			for (const auto& inner : block->statements) {
+				if (jumpsOut(inner, inLoop)) return true;
+			}
+		}
+		return false;
+	}
+
+	void FunctionInlining::run(Programme& p) {
+		mProgramme = &p;
+		findCandidates(p);
+		if (mCandidates.empty()) return;
+		for (auto& function : p.functions) {
+			mCallerNames.clear();
+			std::set<std::string> used;
+			for (const auto& arg : function.mArgs) {
+				mCallerNames.insert(arg.mName);
+			}
+			findNames(function.mBody, mCallerNames, used);
+			inlineBlock(function.mBody);
+		}
+	}
+
+	void FunctionInlining::findCandidates(const Programme& p) {
+		mCandidates.clear();
+		for (const auto& function : p.functions) {
+			if (function.mName == "main" || function.mArgs.size() > 6) continue;
+			bool argumentsFit = std::all_of(function.mArgs.begin(), function.mArgs.end(), [](const FuncArg& arg) {
+				return isScalar(arg.mType) || arg.mType.builtinType == Builtin_Type::REF;
+			});
+			if (!argumentsFit || containsCall(function.mBody) || getCost(function.mBody) > c_MaximumCost) continue;
+
+			// The only way out has to be the end of the body, there is nothing to jump to once it is inlined
+			const auto& statements = function.mBody.statements;
+			bool returnsEarly = false;
+			for (size_t i = 0; i < statements.size(); i++) {
+				bool isLast = i + 1 == statements.size();
+				if (!(isLast && statements[i].mType == Statement_Type::RETURN_CALL) && jumpsOut(statements[i], false))
+					returnsEarly = true;
+			}
+			if (returnsEarly) continue;
+
+			Candidate candidate;
+			candidate.mFunction = &function;
+			std::set<std::string> used;
+			for (const auto& arg : function.mArgs) {
+				candidate.mLocals.insert(arg.mName);
+			}
+			findNames(function.mBody, candidate.mLocals, used);
+			std::set_difference(used.begin(), used.end(), candidate.mLocals.begin(), candidate.mLocals.end(), std::inserter(candidate.mGlobals, candidate.mGlobals.end()));
+			mCandidates[function.mName] = candidate;
+		}
+	}
+
+	void FunctionInlining::inlineBlock(Block& block) {
+		std::vector<Statement> statements;
+		for (auto& statement : block.statements) {
+			if (statement.loopStatement.has_value())
+				inlineBlock(statement.loopStatement.value().mBody);
+			if (statement.ifStatement.has_value()) {
+				inlineBlock(statement.ifStatement.value().mBody);
+				if (statement.ifStatement.value().mElseBody.has_value())
+					inlineBlock(statement.ifStatement.value().mElseBody.value());
+			}
+			if (!inlineCall(statement, block, statements))
+				statements.push_back(statement);
+		}
+		block.statements = std::move(statements);
+	}
+
+	bool FunctionInlining::inlineCall(Statement& statement, Block& block, std::vector<Statement>& statements) {
+		Expression** value = nullptr; // Where the returned value goes, nothing for a call statement
+		std::string name;
+		std::vector<Expression*> args;
+		switch (statement.mType) {
+			case Statement_Type::FUNC_CALL: {
+				const FuncCallStatement& fc = statement.funcCall.value();
+				if (!fc.mNamespace.empty() || !fc.mClassName.empty() || fc.mIsExternal) return false;
+				name = fc.mFunctionName;
+				args = fc.mArgs;
+				break;
+			}
+			case Statement_Type::VAR_DECL_ASSIGN:
+			case Statement_Type::VAR_ASSIGNMENT: {
+				Variable& variable = statement.variable.value();
+				// An index would be evaluated after the body instead of after the call
+				if (statement.mContent != nullptr || variable.mValues.size() != 1 || !isCall(variable.mValues[0])) return false;
+				value = &variable.mValues[0];
+				break;
+			}
+			case Statement_Type::RETURN_CALL:
+				if (!isCall(statement.mContent)) return false;
+				value = &statement.mContent;
+				break;
+			default:
+				return false;
+		}
+		if (value != nullptr) {
+			name = (*value)->mChildren[0]->mValue.mText;
+			args.assign((*value)->mChildren.begin() + 2, (*value)->mChildren.end());
+		}
+
+		const Candidate* candidate = findCandidate(name, args);
+		if (candidate == nullptr) return false;
+		const Function& function = *candidate->mFunction;
+		const auto& body = function.mBody.statements;
+		bool returnsValue = !body.empty() && body.back().mType == Statement_Type::RETURN_CALL && body.back().mContent != nullptr;
+		if (value != nullptr && !returnsValue) return false;
+
+		std::map<std::string, std::string> renames;
+		std::string prefix = "$inline" + std::to_string(mInlineCount++) + "_";
+		for (const auto& local : candidate->mLocals) {
+			renames[local] = prefix + local;
+		}
+
+		// Arguments are passed in a full register and stored at the size of the parameter, like a declaration does
+		for (size_t i = 0; i < args.size(); i++) {
+			const FuncArg& arg = function.mArgs[i];
+			Statement parameter;
+			parameter.mType = Statement_Type::VAR_DECL_ASSIGN;
+			parameter.variable = Variable(arg.mType, renames[arg.mName], {clone(args[i], {})});
+			reserve(block, arg.mType);
+			statements.push_back(parameter);
+		}
+		for (size_t i = 0; i < body.size(); i++) {
+			if (body[i].mType == Statement_Type::RETURN_CALL) break;
+			Statement inlined = clone(body[i], renames);
+			if (inlined.mType == Statement_Type::VAR_DECLARATION || inlined.mType == Statement_Type::VAR_DECL_ASSIGN)
+				reserve(block, inlined.variable.value().mType);
+			else if (inlined.mType == Statement_Type::LOOP && inlined.loopStatement.value().mIterator.has_value())
+				reserve(block, inlined.loopStatement.value().mIterator.value().mType);
+			statements.push_back(inlined);
+		}
+		if (value != nullptr) {
+			*value = clone(body.back().mContent, renames);
+			statements.push_back(statement);
+		}
+		return true;
+	}
+
+	const FunctionInlining::Candidate* FunctionInlining::findCandidate(const std::string& name, const std::vector<Expression*>& args) const {
+		auto found = mCandidates.find(name);
+		if (found == mCandidates.end()) return nullptr;
+		const Candidate& candidate = found->second;
+		if (candidate.mFunction->mArgs.size() != args.size()) return nullptr;
+		// Arguments go from a call with its own evaluation order to declarations, so they can't have side effects
+		for (const auto* arg : args) {
+			if (arg == nullptr || containsCall(arg) || arg->mValue.mSubType == TokenSubType::STRING_LITERAL) return nullptr;
+		}
+		// A global the body reads can't be shadowed by a local of the caller
+		for (const auto& global : candidate.mGlobals) {
+			if (mCallerNames.contains(global)) return nullptr;
+		}
+		return &candidate;
+	}
+
+	Expression* FunctionInlining::clone(const Expression* expression, const std::map<std::string, std::string>& renames) const {
+		if (expression == nullptr) return nullptr;
+		Expression* copy = mProgramme->arena->create();
+		copy->mValue = expression->mValue;
+		if (copy->mValue.mType == TokenType::IDENTIFIER)
+			copy->mValue.mText = rename(copy->mValue.mText, renames);
+		// A collapsed literal still has the operands it was folded from, the copy is only the literal
+		if (copy->mValue.mType == TokenType::LITERAL) return copy;
+		bool isProperty = copy->mValue.mType == TokenType::OPERATOR && copy->mValue.mText == "." && expression->mChildren.size() == 2;
+		for (size_t i = 0; i < expression->mChildren.size(); i++) {
+			copy->mChildren.push_back(clone(expression->mChildren[i], isProperty && i == 1 ? std::map<std::string, std::string>() : renames));
+		}
+		return copy;
+	}
+
+	Statement FunctionInlining::clone(const Statement& statement, const std::map<std::string, std::string>& renames) const {
+		Statement copy = statement;
+		copy.mContent = clone(statement.mContent, renames);
+		if (copy.variable.has_value()) {
+			Variable& variable = copy.variable.value();
+			variable.mName = rename(variable.mName, renames);
+			for (auto& value : variable.mValues) {
+				value = clone(value, renames);
+			}
+		}
+		if (copy.funcCall.has_value()) {
+			for (auto& arg : copy.funcCall.value().mArgs) {
+				arg = clone(arg, renames);
+			}
+		}
+		if (copy.loopStatement.has_value()) {
+			LoopStatement& ls = copy.loopStatement.value();
+			if (ls.mIterator.has_value())
+				ls.mIterator.value().mName = rename(ls.mIterator.value().mName, renames);
+			if (ls.mRange.has_value()) {
+				ls.mRange.value().mMinimum = clone(ls.mRange.value().mMinimum, renames);
+				ls.mRange.value().mMaximum = clone(ls.mRange.value().mMaximum, renames);
+			}
+			if (ls.mStep.has_value())
+				ls.mStep = clone(ls.mStep.value(), renames);
+			ls.mBody = clone(ls.mBody, renames);
+		}
+		if (copy.ifStatement.has_value()) {
+			IfStatement& is = copy.ifStatement.value();
+			is.mBody = clone(is.mBody, renames);
+			if (is.mElseBody.has_value())
+				is.mElseBody = clone(is.mElseBody.value(), renames);
+		}
+		for (auto& sub : copy.mSubStatements) {
+			sub = clone(sub, renames);
+		}
+		return copy;
+	}
+
+	Block FunctionInlining::clone(const Block& block, const std::map<std::string, std::string>& renames) const {
+		Block copy = block;
+		for (auto& statement : copy.statements) {
+			statement = clone(statement, renames);
+		}
+		return copy;
+	}
+
+	// `name(args)` parses to '(' with the name, a copy of the '(' and then the arguments
+	bool FunctionInlining::isCall(const Expression* expression) {
+		if (expression == nullptr || expression->mValue.mType != TokenType::OPERATOR || expression->mValue.mText != "(") return false;
+		if (expression->mChildren.size() < 2 || expression->mChildren[0] == nullptr || expression->mChildren[1] == nullptr) return false;
+		return expression->mChildren[0]->mValue.mType == TokenType::IDENTIFIER && expression->mChildren[1]->mValue.mText == "(";
+	}
+
+	bool FunctionInlining::containsCall(const Expression* expression) {
+		if (expression == nullptr) return false;
+		if (expression->mValue.mType == TokenType::OPERATOR && expression->mValue.mText == "(") return true;
+		return std::any_of(expression->mChildren.begin(), expression->mChildren.end(), [](const Expression* child) { return containsCall(child); });
+	}
+
+	bool FunctionInlining::containsCall(const Block& block) {
+		for (const auto& statement : block.statements) {
+			if (statement.mType == Statement_Type::FUNC_CALL || containsCall(statement.mContent)) return true;
+			if (statement.variable.has_value()) {
+				for (const auto* value : statement.variable.value().mValues) {
+					if (containsCall(value)) return true;
+				}
+			}
+			if (statement.loopStatement.has_value()) {
+				const LoopStatement& ls = statement.loopStatement.value();
+				if (ls.mRange.has_value() && (containsCall(ls.mRange.value().mMinimum) || containsCall(ls.mRange.value().mMaximum))) return true;
+				if (ls.mStep.has_value() && containsCall(ls.mStep.value())) return true;
+				if (containsCall(ls.mBody)) return true;
+			}
+			if (statement.ifStatement.has_value()) {
+				const IfStatement& is = statement.ifStatement.value();
+				if (containsCall(is.mBody) || (is.mElseBody.has_value() && containsCall(is.mElseBody.value()))) return true;
+			}
+		}
+		return false;
+	}
+
+	int FunctionInlining::getCost(const Expression* expression) {
+		if (expression == nullptr) return 0;
+		int cost = 1;
+		for (const auto* child : expression->mChildren) {
+			cost += getCost(child);
+		}
+		return cost;
+	}
+
+	int FunctionInlining::getCost(const Block& block) {
+		int cost = 0;
+		for (const auto& statement : block.statements) {
+			cost += 1 + getCost(statement.mContent);
+			if (statement.variable.has_value()) {
+				for (const auto* value : statement.variable.value().mValues) {
+					cost += getCost(value);
+				}
+			}
+			if (statement.loopStatement.has_value()) {
+				const LoopStatement& ls = statement.loopStatement.value();
+				if (ls.mRange.has_value())
+					cost += getCost(ls.mRange.value().mMinimum) + getCost(ls.mRange.value().mMaximum);
+				cost += getCost(ls.mBody);
+			}
+			if (statement.ifStatement.has_value()) {
+				cost += getCost(statement.ifStatement.value().mBody);
+				if (statement.ifStatement.value().mElseBody.has_value())
+					cost += getCost(statement.ifStatement.value().mElseBody.value());
+			}
+		}
+		return cost;
+	}
+
+	void FunctionInlining::findNames(const Block& block, std::set<std::string>& declared, std::set<std::string>& used) {
+		for (const auto& statement : block.statements) {
+			findNames(statement.mContent, used);
+			if (statement.variable.has_value()) {
+				const Variable& variable = statement.variable.value();
+				std::string name = variable.mName.substr(0, variable.mName.find('.'));
+				if (statement.mType == Statement_Type::VAR_DECLARATION || statement.mType == Statement_Type::VAR_DECL_ASSIGN)
+					declared.insert(name);
+				else
+					used.insert(name);
+				for (const auto* value : variable.mValues) {
+					findNames(value, used);
+				}
+			}
+			if (statement.funcCall.has_value()) {
+				for (const auto* arg : statement.funcCall.value().mArgs) {
+					findNames(arg, used);
+				}
+			}
+			if (statement.loopStatement.has_value()) {
+				const LoopStatement& ls = statement.loopStatement.value();
+				if (ls.mIterator.has_value())
+					declared.insert(ls.mIterator.value().mName);
+				if (ls.mRange.has_value()) {
+					findNames(ls.mRange.value().mMinimum, used);
+					findNames(ls.mRange.value().mMaximum, used);
+				}
+				if (ls.mStep.has_value())
+					findNames(ls.mStep.value(), used);
+				findNames(ls.mBody, declared, used);
+			}
+			if (statement.ifStatement.has_value()) {
+				findNames(statement.ifStatement.value().mBody, declared, used);
+				if (statement.ifStatement.value().mElseBody.has_value())
+					findNames(statement.ifStatement.value().mElseBody.value(), declared, used);
+			}
+		}
+	}
+
+	void FunctionInlining::findNames(const Expression* expression, std::set<std::string>& used) {
+		if (expression == nullptr) return;
+		if (expression->mValue.mType == TokenType::IDENTIFIER)
+			used.insert(expression->mValue.mText);
+		if (expression->mValue.mType == TokenType::LITERAL) return;
+		bool isProperty = expression->mValue.mType == TokenType::OPERATOR && expression->mValue.mText == "." && expression->mChildren.size() == 2;
+		findNames(expression->mChildren.empty() ? nullptr : expression->mChildren[0], used);
+		for (size_t i = 1; i < expression->mChildren.size() && !isProperty; i++) {
+			findNames(expression->mChildren[i], used);
+		}
+	}
+
+} // forest::optimiser
@@ -0,0 +1,60 @@
+#ifndef FOREST_FUNCTIONINLINING_HPP
+#define FOREST_FUNCTIONINLINING_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "Parser.hpp"
+
+namespace forest::optimiser {
+
+	/**
+	 * Replaces calls to small leaf functions with their body. A call saves and restores seven argument registers and goes
+	 * through a whole prologue and epilogue, which costs more than most helpers do themselves.
+	 * A function is inlined when it calls nothing, only returns at the end of its body, takes at most six scalar or ref
+	 * arguments and stays under c_MaximumCost expression nodes and statements. The arguments become declarations of the
+	 * parameters, the body goes before the statement with the call, and the call is replaced with the returned value.
+	 * Parameters and locals are renamed to `$inlineN_name` so they can't clash with the caller.
+	 * Only whole values are replaced: a call statement, a declaration or assignment of the call, or a return of it, with
+	 * arguments that don't call anything themselves. Class methods read their fields through rdi, they aren't inlined.
+	 */
+	class FunctionInlining {
+	public:
+		void run(parser::Programme& p);
+
+	private:
+		static constexpr int c_MaximumCost = 48;
+
+		struct Candidate {
+			const parser::Function* mFunction{};
+			std::set<std::string> mLocals{}; // Parameters and declared variables, everything that gets renamed
+			std::set<std::string> mGlobals{}; // Other names it reads, which the caller must not shadow
+		};
+
+		parser::Programme* mProgramme{};
+		std::map<std::string, Candidate> mCandidates;
+		std::set<std::string> mCallerNames; // Everything the function being optimised declares
+		uint32_t mInlineCount{};
+
+		void findCandidates(const parser::Programme& p);
+		void inlineBlock(parser::Block& block);
+		bool inlineCall(parser::Statement& statement, parser::Block& block, std::vector<parser::Statement>& statements);
+		const Candidate* findCandidate(const std::string& name, const std::vector<parser::Expression*>& args) const;
+
+		parser::Expression* clone(const parser::Expression* expression, const std::map<std::string, std::string>& renames) const;
+		parser::Statement clone(const parser::Statement& statement, const std::map<std::string, std::string>& renames) const;
+		parser::Block clone(const parser::Block& block, const std::map<std::string, std::string>& renames) const;
+
+		static bool isCall(const parser::Expression* expression);
+		static bool containsCall(const parser::Expression* expression);
+		static bool containsCall(const parser::Block& block);
+		static int getCost(const parser::Expression* expression);
+		static int getCost(const parser::Block& block);
+		static void findNames(const parser::Block& block, std::set<std::string>& declared, std::set<std::string>& used);
+		static void findNames(const parser::Expression* expression, std::set<std::string>& used);
+	};
+
+} // forest::optimiser
+
+#endif //FOREST_FUNCTIONINLINING_HPP
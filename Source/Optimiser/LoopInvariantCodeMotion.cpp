@@ -0,0 +1,405 @@
+#include "LoopInvariantCodeMotion.hpp"
+
+using namespace forest::parser;
+
+namespace forest::optimiser {
+
+	bool isScalar(const Type& type) {
+		switch (type.builtinType) {
+			case Builtin_Type::UI8:
+			case Builtin_Type::UI16:
+			case Builtin_Type::UI32:
+			case Builtin_Type::UI64:
+			case Builtin_Type::I8:
+			case Builtin_Type::I16:
+			case Builtin_Type::I32:
+			case Builtin_Type::I64:
+			case Builtin_Type::CHAR:
+			case Builtin_Type::BOOL:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	static bool isPureOperator(const Expression* expression, bool allowTrapping) {
+		if (expression->mValue.mType != TokenType::OPERATOR) return false;
+		const std::string& op = expression->mValue.mText;
+		if (expression->mValue.mSubType == TokenSubType::OP_UNARY)
+			return expression->mChildren.size() == 1 && (op == "-" || op == "~" || op == "!");
+		if (expression->mChildren.size() != 2) return false;
+		if (op == "/" || op == "%") return allowTrapping;
+		return op == "+" || op == "-" || op == "*" || op == "&" || op == "|" || op == "^" || op == "<<" || op == ">>"
+			|| op == "<" || op == "<=" || op == ">" || op == ">=" || op == "==" || op == "!=";
+	}
+
+	static Type getTypeFromSize(int size, bool sign) {
+		const char* names[2][4] = {{"ui8", "ui16", "ui32", "ui64"}, {"i8", "i16", "i32", "i64"}};
+		const Builtin_Type types[2][4] = {
+			{Builtin_Type::UI8, Builtin_Type::UI16, Builtin_Type::UI32, Builtin_Type::UI64},
+			{Builtin_Type::I8, Builtin_Type::I16, Builtin_Type::I32, Builtin_Type::I64}
+		};
+		size_t bytes = size_t(1) << size;
+		return Type(names[sign][size], types[sign][size], {}, bytes, bytes);
+	}
+
+	static int getSizeFromByteSize(size_t byteSize) {
+		if (byteSize >= 8) return 3;
+		if (byteSize >= 4) return 2;
+		if (byteSize >= 2) return 1;
+		return 0;
+	}
+
+	// Like getSizeFromNumber in the backend, which reads the text with atol, so hexadecimal literals count as a single byte
+	Type getIntegerLiteralType(const std::string& text) {
+		int64_t value = atol(text.c_str());
+		if (value < 0) {
+			if (value >= -128) return getTypeFromSize(0, true);
+			if (value >= -32768) return getTypeFromSize(1, true);
+			if (value >= -2147483648) return getTypeFromSize(2, true);
+			return getTypeFromSize(3, true);
+		}
+		if (value <= 255) return getTypeFromSize(0, false);
+		if (value <= 65535) return getTypeFromSize(1, false);
+		if (value <= 4294967295) return getTypeFromSize(2, false);
+		return getTypeFromSize(3, false);
+	}
+
+	// The stack memory of a block is the sum of its variables, plus twice the biggest one (see Parser::expectBlock)
+	void reserve(Block& block, const Type& type) {
+		if (type.byteSize > block.biggestAlloc) {
+			block.stackMemory += 2 * (type.byteSize - block.biggestAlloc);
+			block.biggestAlloc = type.byteSize;
+		}
+		block.stackMemory += type.byteSize;
+	}
+
+	void LoopInvariantCodeMotion::run(Programme& p) {
+		mProgramme = &p;
+		for (auto& function : p.functions) {
+			run(function);
+		}
+		for (auto& klass : p.classes) {
+			for (auto& function : klass.second.mFunctions) {
+				run(function);
+			}
+		}
+	}
+
+	void LoopInvariantCodeMotion::run(Function& function) {
+		mScopes.clear();
+		mAddressTaken.clear();
+		mScopes.emplace_back();
+		for (const auto& arg : function.mArgs) {
+			mScopes.back()[arg.mName] = arg.mType;
+		}
+		findAddressTaken(function.mBody);
+		optimiseBlock(function.mBody);
+		mScopes.clear();
+	}
+
+	void LoopInvariantCodeMotion::optimiseBlock(Block& block) {
+		mScopes.emplace_back();
+		std::vector<Statement> statements = block.statements;
+		block.statements.clear();
+		for (auto& statement : statements) {
+			switch (statement.mType) {
+				case Statement_Type::VAR_DECLARATION:
+				case Statement_Type::VAR_DECL_ASSIGN:
+					mScopes.back()[statement.variable.value().mName] = statement.variable.value().mType;
+					break;
+				case Statement_Type::IF: {
+					IfStatement& is = statement.ifStatement.value();
+					optimiseBlock(is.mBody);
+					if (is.mElseBody.has_value())
+						optimiseBlock(is.mElseBody.value());
+					break;
+				}
+				case Statement_Type::LOOP: {
+					LoopStatement& ls = statement.loopStatement.value();
+					if (!ls.mIterator.has_value() && statement.mContent != nullptr) break; // `until` loops aren't compiled yet
+					mScopes.emplace_back();
+					if (ls.mIterator.has_value())
+						mScopes.back()[ls.mIterator.value().mName] = ls.mIterator.value().mType;
+					optimiseBlock(ls.mBody); // Inner loops first, so what they hoist can be hoisted further by this loop
+					mScopes.pop_back();
+
+					for (const auto& temporary : hoist(ls)) {
+						reserve(block, temporary.variable.value().mType);
+						block.statements.push_back(temporary);
+					}
+					if (ls.mIterator.has_value())
+						mScopes.back()[ls.mIterator.value().mName] = ls.mIterator.value().mType;
+					break;
+				}
+				default:
+					break;
+			}
+			block.statements.push_back(statement);
+		}
+		mScopes.pop_back();
+	}
+
+	std::vector<Statement> LoopInvariantCodeMotion::hoist(LoopStatement& ls) {
+		LoopInfo info;
+		analyse(ls.mBody, info);
+		std::vector<Statement> hoisted;
+		if (ls.mIterator.has_value() && ls.mRange.has_value()) {
+			info.modified.insert(ls.mIterator.value().mName);
+			analyse(ls.mRange.value().mMaximum, info);
+
+			// The maximum is evaluated before every iteration, including the first, so it may trap as well
+			Expression*& maximum = ls.mRange.value().mMaximum;
+			if (maximum != nullptr && !maximum->mChildren.empty() && isInvariant(maximum, info, true))
+				maximum = createTemporary(maximum, ls.mIterator.value().mType, hoisted);
+		}
+
+		// Values hoisted out of inner loops end up at the top of this body, they can move out further if this loop doesn't change them either
+		for (size_t i = 0; i < ls.mBody.statements.size();) {
+			const Statement& statement = ls.mBody.statements[i];
+			if (statement.mType == Statement_Type::VAR_DECL_ASSIGN && mTemporaries.contains(statement.variable.value().mName)
+					&& isInvariant(statement.variable.value().mValues[0], info, false)) {
+				info.modified.erase(statement.variable.value().mName);
+				hoisted.push_back(statement);
+				ls.mBody.statements.erase(ls.mBody.statements.begin() + long(i));
+				continue;
+			}
+			i++;
+		}
+
+		hoistFromBlock(ls.mBody, info, hoisted);
+		return hoisted;
+	}
+
+	void LoopInvariantCodeMotion::hoistFromBlock(Block& block, const LoopInfo& info, std::vector<Statement>& hoisted) {
+		for (auto& statement : block.statements) {
+			switch (statement.mType) {
+				case Statement_Type::VAR_DECL_ASSIGN:
+				case Statement_Type::VAR_ASSIGNMENT:
+					hoistFromExpression(statement.mContent, info, hoisted);
+					for (auto* value : statement.variable.value().mValues) {
+						hoistFromExpression(value, info, hoisted);
+					}
+					break;
+				case Statement_Type::RETURN_CALL:
+					hoistFromExpression(statement.mContent, info, hoisted);
+					break;
+				case Statement_Type::FUNC_CALL:
+					for (auto* arg : statement.funcCall.value().mArgs) {
+						hoistFromExpression(arg, info, hoisted);
+					}
+					break;
+				case Statement_Type::IF: {
+					IfStatement& is = statement.ifStatement.value();
+					hoistFromExpression(statement.mContent, info, hoisted);
+					hoistFromBlock(is.mBody, info, hoisted);
+					if (is.mElseBody.has_value())
+						hoistFromBlock(is.mElseBody.value(), info, hoisted);
+					break;
+				}
+				case Statement_Type::LOOP: {
+					// The body of an inner loop already had its turn, anything left in there depends on the inner loop
+					LoopStatement& ls = statement.loopStatement.value();
+					if (ls.mRange.has_value()) {
+						hoistFromExpression(ls.mRange.value().mMinimum, info, hoisted);
+						hoistFromExpression(ls.mRange.value().mMaximum, info, hoisted);
+					}
+					break;
+				}
+				default:
+					break;
+			}
+		}
+	}
+
+	void LoopInvariantCodeMotion::hoistFromExpression(Expression* expression, const LoopInfo& info, std::vector<Statement>& hoisted) {
+		if (expression == nullptr || expression->mChildren.empty()) return;
+
+		// Only operands of arithmetic are replaced, everything else (calls, indexing, properties) treats its children specially
+		bool replaceChildren = isPureOperator(expression, true);
+		for (auto& child : expression->mChildren) {
+			if (child == nullptr) continue;
+			if (replaceChildren) {
+				bool isGlobal = false;
+				bool isVariable = child->mChildren.empty() && child->mValue.mType == TokenType::IDENTIFIER && findType(child->mValue.mText, &isGlobal) != nullptr;
+				// Operations are hoisted as a whole, and globals so the hoisted copy can end up in a register
+				if (!child->mChildren.empty() && isInvariant(child, info, false)) {
+					child = createTemporary(child, getTypeOf(child), hoisted);
+					continue;
+				} else if (isVariable && isGlobal && isInvariant(child, info, false)) {
+					child = createTemporary(child, *findType(child->mValue.mText), hoisted);
+					continue;
+				}
+			}
+			hoistFromExpression(child, info, hoisted);
+		}
+	}
+
+	Expression* LoopInvariantCodeMotion::createTemporary(Expression* value, const Type& type, std::vector<Statement>& hoisted) {
+		std::string name = "$licm" + std::to_string(mTemporaryCount++);
+		mTemporaries[name] = type;
+
+		Statement statement;
+		statement.mType = Statement_Type::VAR_DECL_ASSIGN;
+		statement.variable = Variable(type, name, {value});
+		hoisted.push_back(statement);
+
+		Expression* identifier = mProgramme->arena->create();
+		identifier->mValue = value->mValue;
+		identifier->mValue.mType = TokenType::IDENTIFIER;
+		identifier->mValue.mSubType = TokenSubType::USER_DEFINED;
+		identifier->mValue.mText = name;
+		return identifier;
+	}
+
+	bool LoopInvariantCodeMotion::isInvariant(const Expression* expression, const LoopInfo& info, bool allowTrapping) const {
+		if (expression == nullptr) return false;
+		if (expression->mChildren.empty()) {
+			if (expression->mValue.mType == TokenType::IDENTIFIER)
+				return isInvariant(expression->mValue.mText, info);
+			if (expression->mValue.mType != TokenType::LITERAL) return false;
+			return expression->mValue.mSubType == TokenSubType::INTEGER_LITERAL
+				|| expression->mValue.mSubType == TokenSubType::CHAR_LITERAL
+				|| expression->mValue.mSubType == TokenSubType::BOOLEAN_LITERAL;
+		}
+
+		if (!isPureOperator(expression, allowTrapping)) return false;
+		for (const auto* child : expression->mChildren) {
+			if (!isInvariant(child, info, allowTrapping)) return false;
+		}
+		return true;
+	}
+
+	bool LoopInvariantCodeMotion::isInvariant(const std::string& name, const LoopInfo& info) const {
+		if (info.modified.contains(name) || mAddressTaken.contains(name)) return false;
+		bool isGlobal = false;
+		const Type* type = findType(name, &isGlobal);
+		// Unknown names are members of the class, which any call could change
+		if (type == nullptr || !isScalar(*type)) return false;
+		return !isGlobal || !info.writesMemory;
+	}
+
+	const Type* LoopInvariantCodeMotion::findType(const std::string& name, bool* isGlobal) const {
+		if (isGlobal != nullptr) *isGlobal = false;
+		auto temporary = mTemporaries.find(name);
+		if (temporary != mTemporaries.end()) return &temporary->second;
+		for (auto scope = mScopes.rbegin(); scope != mScopes.rend(); scope++) {
+			auto it = scope->find(name);
+			if (it != scope->end()) return &it->second;
+		}
+		if (mProgramme != nullptr) {
+			auto it = mProgramme->variables.find(name);
+			if (it != mProgramme->variables.end()) {
+				if (isGlobal != nullptr) *isGlobal = true;
+				return &it->second.mType;
+			}
+		}
+		return nullptr;
+	}
+
+	// Mirrors the operand sizes the backend uses in printExpression, so the hoisted value is computed at the same width
+	Type LoopInvariantCodeMotion::getTypeOf(const Expression* expression) const {
+		if (expression->mChildren.empty()) {
+			if (expression->mValue.mType == TokenType::IDENTIFIER)
+				return *findType(expression->mValue.mText);
+			if (expression->mValue.mSubType != TokenSubType::INTEGER_LITERAL)
+				return getTypeFromSize(1, false); // Chars and booleans are loaded as words
+			return getIntegerLiteralType(expression->mValue.mText);
+		}
+		if (expression->mValue.mSubType == TokenSubType::OP_UNARY)
+			return getTypeFromSize(3, false);
+
+		Type left = getTypeOf(expression->mChildren[0]);
+		Type right = getTypeOf(expression->mChildren[1]);
+		int leftSize = getSizeFromByteSize(left.byteSize);
+		int rightSize = getSizeFromByteSize(right.byteSize);
+		int size = leftSize == 0 || rightSize > leftSize ? rightSize : leftSize;
+		bool sign = left.name[0] == 'i' || right.name[0] == 'i';
+		return getTypeFromSize(size, sign);
+	}
+
+	void LoopInvariantCodeMotion::analyse(const Block& block, LoopInfo& info) {
+		for (const auto& statement : block.statements) {
+			analyse(statement.mContent, info);
+			if (statement.variable.has_value()) {
+				const Variable& v = statement.variable.value();
+				if (statement.mType == Statement_Type::VAR_DECLARATION || statement.mType == Statement_Type::VAR_DECL_ASSIGN || statement.mType == Statement_Type::VAR_ASSIGNMENT)
+					info.modified.insert(v.mName.substr(0, v.mName.find('.')));
+				if (statement.mType == Statement_Type::VAR_ASSIGNMENT && v.mType.builtinType == Builtin_Type::REF)
+					info.writesMemory = true;
+				for (const auto* value : v.mValues) {
+					analyse(value, info);
+				}
+			}
+			if (statement.funcCall.has_value()) {
+				info.writesMemory = true;
+				for (const auto* arg : statement.funcCall.value().mArgs) {
+					analyse(arg, info);
+				}
+			}
+			if (statement.loopStatement.has_value()) {
+				const LoopStatement& ls = statement.loopStatement.value();
+				if (ls.mIterator.has_value())
+					info.modified.insert(ls.mIterator.value().mName);
+				if (ls.mRange.has_value()) {
+					analyse(ls.mRange.value().mMinimum, info);
+					analyse(ls.mRange.value().mMaximum, info);
+				}
+				analyse(ls.mBody, info);
+			}
+			if (statement.ifStatement.has_value()) {
+				analyse(statement.ifStatement.value().mBody, info);
+				if (statement.ifStatement.value().mElseBody.has_value())
+					analyse(statement.ifStatement.value().mElseBody.value(), info);
+			}
+		}
+	}
+
+	void LoopInvariantCodeMotion::analyse(const Expression* expression, LoopInfo& info) {
+		if (expression == nullptr) return;
+		if (expression->mValue.mType == TokenType::OPERATOR && expression->mValue.mText == "(" && !expression->mChildren.empty())
+			info.writesMemory = true;
+		for (const auto* child : expression->mChildren) {
+			analyse(child, info);
+		}
+	}
+
+	void LoopInvariantCodeMotion::findAddressTaken(const Block& block) {
+		for (const auto& statement : block.statements) {
+			findAddressTaken(statement.mContent);
+			if (statement.variable.has_value()) {
+				for (const auto* value : statement.variable.value().mValues) {
+					findAddressTaken(value);
+				}
+			}
+			if (statement.funcCall.has_value()) {
+				for (const auto* arg : statement.funcCall.value().mArgs) {
+					findAddressTaken(arg);
+				}
+			}
+			if (statement.loopStatement.has_value()) {
+				const LoopStatement& ls = statement.loopStatement.value();
+				if (ls.mRange.has_value()) {
+					findAddressTaken(ls.mRange.value().mMinimum);
+					findAddressTaken(ls.mRange.value().mMaximum);
+				}
+				findAddressTaken(ls.mBody);
+			}
+			if (statement.ifStatement.has_value()) {
+				findAddressTaken(statement.ifStatement.value().mBody);
+				if (statement.ifStatement.value().mElseBody.has_value())
+					findAddressTaken(statement.ifStatement.value().mElseBody.value());
+			}
+		}
+	}
+
+	void LoopInvariantCodeMotion::findAddressTaken(const Expression* expression) {
+		if (expression == nullptr) return;
+		if (expression->mValue.mSubType == TokenSubType::OP_UNARY && expression->mValue.mText == "\\" && !expression->mChildren.empty())
+			mAddressTaken.insert(expression->mChildren[0]->mValue.mText);
+		for (const auto* child : expression->mChildren) {
+			findAddressTaken(child);
+		}
+	}
+
+} // forest::optimiser
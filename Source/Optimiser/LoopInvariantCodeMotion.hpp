@@ -0,0 +1,58 @@
+#ifndef FOREST_LOOPINVARIANTCODEMOTION_HPP
+#define FOREST_LOOPINVARIANTCODEMOTION_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "Parser.hpp"
+
+namespace forest::optimiser {
+
+	/**
+	 * Moves computations that give the same result on every iteration of a loop to right before the loop.
+	 * The range maximum of `loop i, a..b` is re-evaluated before every iteration, and operator sub-expressions in the body
+	 * are recomputed every time they are reached. When everything they read stays the same for the whole loop, they are
+	 * computed once into a new local variable called `$licmN` instead, which can never clash with a name from the source.
+	 */
+	class LoopInvariantCodeMotion {
+	public:
+		void run(parser::Programme& p);
+
+	private:
+		struct LoopInfo {
+			std::set<std::string> modified{}; // Variables that are assigned, declared or iterated over in the loop
+			bool writesMemory = false; // Calls a function or stores through a ref, so globals can change too
+		};
+
+		parser::Programme* mProgramme{};
+		std::vector<std::map<std::string, parser::Type>> mScopes;
+		std::map<std::string, parser::Type> mTemporaries;
+		std::set<std::string> mAddressTaken;
+		uint32_t mTemporaryCount{};
+
+		void run(parser::Function& function);
+		void optimiseBlock(parser::Block& block);
+		std::vector<parser::Statement> hoist(parser::LoopStatement& ls);
+		void hoistFromBlock(parser::Block& block, const LoopInfo& info, std::vector<parser::Statement>& hoisted);
+		void hoistFromExpression(parser::Expression* expression, const LoopInfo& info, std::vector<parser::Statement>& hoisted);
+		parser::Expression* createTemporary(parser::Expression* value, const parser::Type& type, std::vector<parser::Statement>& hoisted);
+
+		bool isInvariant(const parser::Expression* expression, const LoopInfo& info, bool allowTrapping) const;
+		bool isInvariant(const std::string& name, const LoopInfo& info) const;
+		const parser::Type* findType(const std::string& name, bool* isGlobal = nullptr) const;
+		parser::Type getTypeOf(const parser::Expression* expression) const;
+
+		static void analyse(const parser::Block& block, LoopInfo& info);
+		static void analyse(const parser::Expression* expression, LoopInfo& info);
+		void findAddressTaken(const parser::Block& block);
+		void findAddressTaken(const parser::Expression* expression);
+	};
+
+	bool isScalar(const parser::Type& type);
+	parser::Type getIntegerLiteralType(const std::string& text);
+	void reserve(parser::Block& block, const parser::Type& type);
+
+} // forest::optimiser
+
+#endif //FOREST_LOOPINVARIANTCODEMOTION_HPP
@@ -0,0 +1,20 @@
+#include "Optimiser.hpp"
+#include "ConstantPropagation.hpp"
+#include "DeadCodeElimination.hpp"
+#include "FunctionInlining.hpp"
+#include "LoopInvariantCodeMotion.hpp"
+
+namespace forest::optimiser {
+
+	void Optimiser::optimise(parser::Programme& p, const parser::CompileContext& ctx) {
+		FunctionInlining inlining;
+		inlining.run(p);
+		ConstantPropagation constants;
+		constants.run(p);
+		DeadCodeElimination dce(ctx);
+		dce.run(p);
+		LoopInvariantCodeMotion licm;
+		licm.run(p);
+	}
+
+} // forest::optimiser
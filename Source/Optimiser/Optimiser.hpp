@@ -0,0 +1,19 @@
+#ifndef FOREST_OPTIMISER_HPP
+#define FOREST_OPTIMISER_HPP
+
+#include "ConfigParser.hpp"
+#include "Parser.hpp"
+
+namespace forest::optimiser {
+
+	/**
+	 * Runs the optimisation passes over the AST of a programme, in place, before it is handed to the backend.
+	 */
+	class Optimiser {
+	public:
+		void optimise(parser::Programme& p, const parser::CompileContext& ctx);
+	};
+
+} // forest::optimiser
+
+#endif //FOREST_OPTIMISER_HPP
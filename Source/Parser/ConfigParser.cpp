@@ -85,6 +85,27 @@ namespace forest::parser {
 						ss << _currentToken->mText;
 						_currentToken++;
 						m_Configuration.m_Entrypoint = ss.str();
+					} else if (configTypeOpt.value().mText == "StdoutBuffering") {
+						std::optional<Token> buffering = expectIdentifier();
+						if (!buffering.has_value()) {
+							std::cerr << "Expected a buffering mode (Full, Line, None) at " << *_currentToken << std::endl;
+							return;
+						}
+						m_Configuration.m_StdoutBuffering = getBufferingFromConfig(buffering.value().mText);
+					} else if (configTypeOpt.value().mText == "Assembler") {
+						std::optional<Token> assembler = expectIdentifier();
+						if (!assembler.has_value()) {
+							std::cerr << "Expected an assembler (Builtin, Yasm) at " << *_currentToken << std::endl;
+							return;
+						}
+						m_Configuration.m_Assembler = getAssemblerFromConfig(assembler.value().mText);
+					} else if (configTypeOpt.value().mText == "LoopUnroll") {
+						if (_currentToken == _tokensEnd || _currentToken->mSubType != TokenSubType::INTEGER_LITERAL) {
+							std::cerr << "Expected the number of copies of a loop body after LoopUnroll" << std::endl;
+							return;
+						}
+						m_Configuration.m_LoopUnroll = std::stoul(_currentToken->mText);
+						_currentToken++;
 					}
 					break;
 				}
@@ -237,4 +258,24 @@ namespace forest::parser {
 			return BuildType::DEBUG;
 		}
 	}
+
+	StdoutBuffering CompileContext::getBufferingFromConfig(const std::string& config) {
+		if (config == "Line") {
+			return StdoutBuffering::LINE;
+		} else if (config == "None") {
+			return StdoutBuffering::NONE;
+		} else {
+			return StdoutBuffering::FULL;
+		}
+	}
+
+	AssemblerKind CompileContext::getAssemblerFromConfig(const std::string& config) {
+		if (config == "Yasm") {
+			return AssemblerKind::YASM;
+		} else if (config == "Builtin") {
+			return AssemblerKind::BUILTIN;
+		} else {
+			return AssemblerKind::DEFAULT;
+		}
+	}
 }
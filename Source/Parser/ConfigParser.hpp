@@ -69,9 +69,24 @@ namespace forest::parser {
 		RELEASE
 	};
 
+	enum class StdoutBuffering {
+		FULL, // Flushed when the buffer is full, before reading input or making a syscall, and on exit
+		LINE, // Also flushed after every write that ends in a newline
+		NONE, // Every write is its own syscall
+	};
+
+	enum class AssemblerKind {
+		DEFAULT, // The build type decides: yasm for Debug, which is the only one that writes DWARF, the built-in one otherwise
+		BUILTIN, // Assembled in-process, falls back to yasm for anything it can't encode. It writes no debug information
+		YASM,
+	};
+
 	struct Configuration {
 		std::string m_Entrypoint{};
 		BuildType m_BuildType{};
+		StdoutBuffering m_StdoutBuffering{};
+		AssemblerKind m_Assembler{};
+		size_t m_LoopUnroll{}; // Copies of a loop body per jump back, 0 lets the build type decide
 	};
 
 	class CompileContext {
@@ -93,6 +108,8 @@ namespace forest::parser {
 		HeaderType expectHeader();
 		std::optional<ConventionEntry> expectConvention();
 		BuildType getTypeFromConfig(const std::string& config);
+		StdoutBuffering getBufferingFromConfig(const std::string& config);
+		AssemblerKind getAssemblerFromConfig(const std::string& config);
 	};
 }
 
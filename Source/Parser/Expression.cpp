@@ -1,26 +1,28 @@
+#include <algorithm>
+#include <cstdio>
 #include "Expression.hpp"
 
 namespace forest::parser {
 
-	Expression::~Expression() {
-		for (const auto& exp : mChildren) {
-			delete exp;
+	namespace {
+		// Enough digits to read back the same double, std::to_string only keeps six decimals
+		std::string floatToString(double value) {
+			char buffer[32];
+			std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+			return buffer;
 		}
-		mChildren.clear();
 	}
 
-
-	Expression::Expression() {
-		mValue = {};
-		mChildren = {};
+	Expression* ExpressionArena::create() {
+		if (mUsed == c_ChunkSize) {
+			mChunks.push_back(std::make_unique<Expression[]>(c_ChunkSize));
+			mUsed = 0;
+		}
+		return &mChunks.back()[mUsed++];
 	}
 
-	Expression::Expression(const Expression& rhs) {
-		mValue = rhs.mValue;
-		for (const auto& exp : rhs.mChildren) {
-			Expression* newExp = new Expression(*exp);
-			mChildren.push_back(newExp);
-		}
+	size_t ExpressionArena::size() const {
+		return mChunks.empty() ? 0 : (mChunks.size() - 1) * c_ChunkSize + mUsed;
 	}
 
 	void Expression::Collapse() {
@@ -58,7 +60,7 @@ namespace forest::parser {
 
 				mValue.mType = TokenType::LITERAL;
 				mValue.mSubType = TokenSubType::FLOAT_LITERAL;
-				mValue.mText = std::to_string(left - right);
+				mValue.mText = floatToString(left - right);
 			}
 		} else if (mValue.mText == "+") {
 			if (leftExp->mValue.mSubType == TokenSubType::STRING_LITERAL || rightExp->mValue.mSubType == TokenSubType::STRING_LITERAL) {
@@ -78,7 +80,7 @@ namespace forest::parser {
 
 				mValue.mType = TokenType::LITERAL;
 				mValue.mSubType = TokenSubType::FLOAT_LITERAL;
-				mValue.mText = std::to_string(left + right);
+				mValue.mText = floatToString(left + right);
 			}
 		} else if (mValue.mText == "/") {
 			if (leftExp->mValue.mSubType == TokenSubType::STRING_LITERAL || rightExp->mValue.mSubType == TokenSubType::STRING_LITERAL) return;
@@ -95,21 +97,21 @@ namespace forest::parser {
 
 				mValue.mType = TokenType::LITERAL;
 				mValue.mSubType = TokenSubType::FLOAT_LITERAL;
-				mValue.mText = std::to_string(left / right);
+				mValue.mText = floatToString(left / right);
 			} else if (leftExp->mValue.mSubType == TokenSubType::FLOAT_LITERAL && rightExp->mValue.mSubType == TokenSubType::INTEGER_LITERAL) {
 				double left = std::stod(leftExp->mValue.mText);
 				int64_t right = std::stol(rightExp->mValue.mText);
 
 				mValue.mType = TokenType::LITERAL;
-				mValue.mSubType = TokenSubType::INTEGER_LITERAL;
-				mValue.mText = std::to_string(left / right);
+				mValue.mSubType = TokenSubType::FLOAT_LITERAL;
+				mValue.mText = floatToString(left / right);
 			} else if (leftExp->mValue.mSubType == TokenSubType::FLOAT_LITERAL && rightExp->mValue.mSubType == TokenSubType::FLOAT_LITERAL) {
 				double left = std::stod(leftExp->mValue.mText);
 				double right = std::stod(rightExp->mValue.mText);
 
 				mValue.mType = TokenType::LITERAL;
 				mValue.mSubType = TokenSubType::FLOAT_LITERAL;
-				mValue.mText = std::to_string(left / right);
+				mValue.mText = floatToString(left / right);
 			}
 		} else if (mValue.mText == "*") {
 			if (leftExp->mValue.mSubType == TokenSubType::STRING_LITERAL && rightExp->mValue.mSubType == TokenSubType::STRING_LITERAL) return;
@@ -144,7 +146,7 @@ namespace forest::parser {
 
 				mValue.mType = TokenType::LITERAL;
 				mValue.mSubType = TokenSubType::FLOAT_LITERAL;
-				mValue.mText = std::to_string(left * right);
+				mValue.mText = floatToString(left * right);
 			}
 		} else if (mValue.mText == "%") {
 			if (leftExp->mValue.mSubType == TokenSubType::STRING_LITERAL || rightExp->mValue.mSubType == TokenSubType::STRING_LITERAL) return;
@@ -160,11 +162,16 @@ namespace forest::parser {
 			}
 		}
 
-		delete leftExp;
+		// Operators on literals that can't be folded, like comparisons, keep their operands
+		if (mValue.mType != TokenType::LITERAL) return;
+		// The children stay in the arena, they are just no longer part of this tree
 		mChildren[0] = nullptr;
-		delete rightExp;
 		mChildren[1] = nullptr;
 	}
 
+	bool Expression::isLeaf() const {
+		return std::all_of(mChildren.begin(), mChildren.end(), [](const Expression* child) { return child == nullptr; });
+	}
+
 
 } // forest::parser
@@ -1,19 +1,38 @@
 #ifndef FOREST_EXPRESSION_HPP
 #define FOREST_EXPRESSION_HPP
 
+#include <memory>
 #include "Tokeniser.hpp"
 
 namespace forest::parser {
 
+	/**
+	 * A node in an expression tree. Nodes are owned by the ExpressionArena they were created in, so copying a node
+	 * (or a Variable holding nodes) only copies the pointers to its children and never frees anything.
+	 */
 	class Expression {
 	public:
 		std::vector<Expression*> mChildren;
 		Token mValue {};
 
-		~Expression();
-		Expression();
-		Expression(Expression const& rhs);
 		void Collapse();
+		// No children, or only the empty slots Collapse leaves behind when it folds an operator into a literal
+		bool isLeaf() const;
+	};
+
+	/**
+	 * Bump allocator for the expressions of one compilation. Nodes are handed out from fixed size chunks, so a pointer
+	 * stays valid for as long as the arena lives and everything is released together when the last owner lets go of it.
+	 */
+	class ExpressionArena {
+	public:
+		Expression* create();
+		size_t size() const;
+
+	private:
+		static constexpr size_t c_ChunkSize = 512;
+		std::vector<std::unique_ptr<Expression[]>> mChunks;
+		size_t mUsed = c_ChunkSize; // Nodes handed out from the last chunk
 	};
 
 } // forest::parser
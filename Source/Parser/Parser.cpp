@@ -34,10 +34,15 @@ namespace forest::parser {
 	Programme Parser::parse(std::vector<Token>& tokens) {
 		mCurrentToken = tokens.begin();
 		std::vector<Function> functions;
+		std::vector<Function> importedFunctions;
 		std::vector<Import> imports;
 		mTokensEnd = tokens.end();
+		// Imported tokens get spliced in front of the rest, so remember which file this translation unit is
+		const std::string* ownFile = tokens.empty() ? nullptr : tokens.begin()->file;
+		std::vector<std::string> ownStructs; // Imported ones are reported when their own file is compiled
 		while (mCurrentToken != mTokensEnd) {
 			if (mCurrentToken->mText == "#") {
+				std::vector<Token>::iterator current = mCurrentToken;
 				// Parse special statement
 				// #depends(c)
 				// #assert(a == 3)
@@ -49,58 +54,76 @@ namespace forest::parser {
 						if (t.mType == TokenType::IDENTIFIER) {
 							libDependencies.push_back(t.mText);
 						}
+					} else if (special.value().mType == SpecialStatementType::SOA) {
+						std::optional<Struct> s = expectStruct();
+						if (!s.has_value()) {
+							std::cerr << "[Parser]: Expected a struct after #soa at " << *mCurrentToken << std::endl;
+							continue;
+						}
+						s.value().mSoA = true;
+						structs.insert({s.value().mName, s.value()});
+						sizeCache[s.value().mName] = s.value().mSize;
+						if (ownFile == current->file)
+							ownStructs.push_back(s.value().mName);
 					}
 				}
-			} else if (mCurrentToken->mText == "struct" || mCurrentToken->mText == "aligned") {
+			} else if (mCurrentToken->mText == "struct" || mCurrentToken->mText == "aligned" || mCurrentToken->mText == "reordered") {
+				std::vector<Token>::iterator current = mCurrentToken;
 				std::optional<Struct> s = expectStruct();
 				if (s.has_value()) {
 					structs.insert({s.value().mName, s.value()});
 					sizeCache[s.value().mName] = s.value().mSize;
+					if (ownFile == current->file)
+						ownStructs.push_back(s.value().mName);
 				}
 			} else if (mCurrentToken->mText == "class" || mCurrentToken->mText == "aligned") {
 				std::vector<Token>::iterator current = mCurrentToken;
 				std::optional<Class> c = expectClass();
 				if (c.has_value()) {
 					Class& klass = c.value();
-					if (tokens.begin()->file != current->file)
+					if (ownFile != current->file)
 						klass.mFunctions.clear(); // We don't want to compile the functions of an external class to this translation unit
 					classes.insert({klass.mName, klass});
 					sizeCache[klass.mName] = klass.mSize;
 				}
 			} else if (mCurrentToken->mText == "use") {
+				std::filesystem::path filePath = *mCurrentToken->file; // Imports are relative to the file that has the `use`
 				std::optional<Import> import = expectImport();
 				if (import.has_value()) {
+					import.value().mFrom = filePath.string();
 					imports.push_back(import.value());
-					std::filesystem::path filePath = tokens.begin()->file;
 					std::filesystem::path tempPath = filePath.replace_filename(import.value().mPath);
-					std::ifstream file;
-					std::stringstream buffer;
-					file.open(tempPath);
-					buffer << file.rdbuf();
-					file.close();
-					std::vector<Token> importTokens = Tokeniser::parse(buffer.str(), tempPath);
-					tokens.insert(mCurrentToken, importTokens.begin(), importTokens.end());
+					std::vector<Token> importTokens = Tokeniser::parseFile(tempPath);
+					mCurrentToken = tokens.insert(mCurrentToken, importTokens.begin(), importTokens.end()); // The insert invalidates the old iterator
 					mTokensEnd = tokens.end();
 				}
 			} else {
+				std::vector<Token>::iterator current = mCurrentToken;
 				std::optional<Function> f = expectFunction();
 				if (!f.has_value()) {
-					std::vector<Token>::iterator current = mCurrentToken;
+					current = mCurrentToken;
 					std::optional<Statement> var = tryParseVariableDeclaration();
 					// Top level variable declaration
 					if (var.has_value()) {
-						if (tokens.begin()->file == current->file || mCurrentToken == mTokensEnd)
+						if (ownFile == current->file)
 							variables.insert(std::make_pair(var.value().variable.value().mName, var.value().variable.value()));
 					}
 				} else {
 					//std::cout << "Successfully parsed function " << f->mName << std::endl;
-					if (tokens.begin()->file == mCurrentToken->file || mCurrentToken == mTokensEnd)
+					if (ownFile == current->file) {
 						functions.push_back(f.value());
+					} else {
+						// Compiled in its own translation unit, calls to it only need to know its signature
+						f.value().mBody = Block{};
+						importedFunctions.push_back(f.value());
+					}
 				}
 			}
 		}
 
-		std::vector<std::string> internals = {"writeln", "write", "read", "readln", "alloc", "dealloc"};
+		reportStructLayouts(ownStructs);
+
+		std::vector<std::string> internals = {"writeln", "write", "read", "readln", "alloc", "dealloc", "dot", "cross"};
 		for (const auto& fc : _funcCalls) {
 			bool found = false;
 			if (!fc.mClassName.empty()) {
@@ -115,7 +138,7 @@ namespace forest::parser {
 			if (!found)
 				externalFunctions.push_back(fc);
 		}
-		return Programme { functions, literals, externalFunctions, libDependencies, imports, variables, structs, classes, requires_libs };
+		return Programme { functions, literals, externalFunctions, libDependencies, imports, variables, structs, classes, requires_libs, mArena, importedFunctions };
 	}
 
 	std::optional<Token> Parser::peekNextToken() {
@@ -366,6 +389,9 @@ namespace forest::parser {
 			actualType = SpecialStatementType::DEPENDENCY;
 		} else if (type.value().mText == "assert") {
 			actualType = SpecialStatementType::ASSERT;
+		} else if (type.value().mText == "soa") {
+			// An attribute of the struct that follows, it has no arguments
+			return SpecialStatement {SpecialStatementType::SOA, nullptr};
 		} else {
 			std::cerr << "[Parser]: Unexpected special statement '" << type.value().mText << "' at " << *mCurrentToken << std::endl;
 			return std::nullopt;
@@ -384,6 +410,7 @@ namespace forest::parser {
 
 	std::optional<Struct> Parser::expectStruct() {
 		std::optional<Token> align = expectIdentifier("aligned");
+		std::optional<Token> reorder = expectIdentifier("reordered");
 		std::optional<Token> keyword = expectIdentifier("struct");
 		if (!keyword.has_value()) return std::nullopt;
 		std::vector<Token>::iterator saved = mCurrentToken;
@@ -398,8 +425,6 @@ namespace forest::parser {
 
 		Struct s;
 		s.mName = sname.value().mText;
-		size_t offset = 0;
-		size_t alignTo = 1;
 
 		while(!expectOperator("}").has_value()) {
 			// Parse fields
@@ -447,30 +472,88 @@ namespace forest::parser {
 
 			sf.mType = t;
 			sf.mNames = names;
+			sf.mOffset = 0;
+			s.mFields.push_back(sf);
+		}
+
+		// Only the declaration decides the layout, so every translation unit agrees on the offsets. A struct is laid out in
+		// declaration order unless it is declared `reordered`, an aligned one in declaration order is laid out like C would
+		layoutStruct(s, align.has_value(), reorder.has_value());
+		return s;
+	}
+
+	void Parser::layoutStruct(Struct& s, bool aligned, bool reorder) {
+		std::vector<size_t> order;
+		for (size_t i = 0; i < s.mFields.size(); i++)
+			order.push_back(i);
+		if (reorder) {
+			std::stable_sort(order.begin(), order.end(), [&s](size_t a, size_t b) {
+				return getFieldAlignment(s.mFields[a].mType) > getFieldAlignment(s.mFields[b].mType);
+			});
+		}
 
+		size_t offset = 0;
+		size_t alignTo = 1;
+		for (size_t i : order) {
+			StructField& sf = s.mFields[i];
 			// Align logic
-			if (align.has_value()) {
+			if (aligned) {
 				// If we have to align
-				if (t.alignTo > alignTo) {
-					alignTo = t.alignTo;
+				if (sf.mType.alignTo > alignTo) {
+					alignTo = sf.mType.alignTo;
 				}
-				size_t padding = (t.alignTo - offset % t.alignTo) % t.alignTo;
+				size_t padding = (sf.mType.alignTo - offset % sf.mType.alignTo) % sf.mType.alignTo;
 				offset += padding;
 			}
 
 			sf.mOffset = offset;
-			offset += type.value().byteSize;
-			s.mFields.push_back(sf);
+			offset += sf.mType.byteSize;
 		}
 
-		if (align.has_value()) {
+		if (aligned) {
 			// If we have to align
 			// Set offset to be multiple of alignTo
 			offset += (alignTo - offset % alignTo) % alignTo;
 		}
 
 		s.mSize = offset; // This is after all fields calculated their offset, including the last one
-		return s;
+		s.mAligned = aligned;
+		s.mReordered = reorder && !std::is_sorted(order.begin(), order.end());
+	}
+
+	size_t Parser::getFieldAlignment(const Type& type) {
+		size_t alignTo = type.alignTo == 0 ? 1 : type.alignTo;
+		return std::min<size_t>(alignTo & -alignTo, 16);
+	}
+
+	void Parser::reportStructLayouts(const std::vector<std::string>& names) const {
+		for (const std::string& name : names) {
+			const Struct& s = structs.at(name);
+			size_t used = 0;
+			size_t misaligned = 0;
+			for (const StructField& sf : s.mFields) {
+				used += sf.mType.byteSize;
+				if (sf.mOffset % getFieldAlignment(sf.mType) != 0) misaligned++;
+			}
+			if (s.mSize == used && misaligned == 0) continue; // Nothing is wasted
+			// Translation units are parsed on several threads, so every line is written at once
+			std::stringstream line;
+			line << "[Parser]: Struct '" << name << "' is " << s.mSize << " bytes with " << s.mSize - used << " bytes of padding";
+			if (misaligned > 0)
+				line << " and " << misaligned << " misaligned field(s)";
+			if (s.mAligned) {
+				Struct sorted = s;
+				layoutStruct(sorted, true, true);
+				if (sorted.mSize < s.mSize)
+					line << ", declaring it 'reordered' would make it " << sorted.mSize << " bytes";
+			} else if (!s.mReordered) {
+				line << ", declaring it 'reordered' would sort its fields by alignment";
+			}
+			if (s.mSoA)
+				line << ", arrays of it are stored as a struct of arrays";
+			line << std::endl;
+			std::cout << line.str();
+		}
 	}
 
 	std::optional<Class> Parser::expectClass() {
@@ -581,7 +664,7 @@ namespace forest::parser {
 			mCurrentToken++;
 		}
 		expectSemicolon(); // Discard this
-		return Import { ss.str() };
+		return Import { ss.str(), {} };
 	}
 
 	std::optional<Statement> Parser::tryParseFunctionCall() {
@@ -866,8 +949,7 @@ namespace forest::parser {
 				return std::nullopt;
 			}
 
-			Type transformedType = Type {actualType.name + "[]", Builtin_Type::ARRAY, {actualType}, len * actualType.byteSize, actualType.alignTo };
-			actualType = transformedType;
+			actualType = getArrayType(actualType.name + "[]", actualType, len);
 		}
 
 		std::optional<Token> semi = expectSemicolon();
@@ -918,7 +1000,7 @@ namespace forest::parser {
 					return std::nullopt;
 				}
 			}
-		} else if (actualType.builtinType == Builtin_Type::STRUCT) {
+		} else if (actualType.builtinType == Builtin_Type::STRUCT || (hasFields(actualType.builtinType) && (mCurrentToken->mText == "{" || mCurrentToken->mText == "@"))) {
 			if (!ParseStructAssignment(actualType.name, values))
 				return std::nullopt;
 		} else if (actualType.builtinType == Builtin_Type::CLASS) {
@@ -975,11 +1057,26 @@ namespace forest::parser {
 					return std::nullopt;
 				}
 				statement.mContent = expression;
+
+				// arr[i].field = value;
+				if (v.mType.subTypes[0].builtinType == Builtin_Type::STRUCT && expectOperator(".").has_value()) {
+					std::optional<Token> propName = expectIdentifier();
+					if (!propName.has_value()) {
+						std::cerr << "[Parser]: Expected a property name for the assignment of an element of array " << name.value().mText << " at " << *mCurrentToken << std::endl;
+						return std::nullopt;
+					}
+					if (structs[v.mType.subTypes[0].name].getIndexOfProperty(propName.value().mText) == -1) {
+						std::cerr << "[Parser]: Could not find property " << propName.value().mText << " in struct " << v.mType.subTypes[0].name << " at " << *mCurrentToken << std::endl;
+						mCurrentToken = saved;
+						return std::nullopt;
+					}
+					v.mName += "." + propName.value().mText;
+				}
 			} else {
 				redefinition = true;
 				statement.mContent = nullptr;
 			}
-		} else if (v.mType.builtinType == Builtin_Type::STRUCT || (v.mType.builtinType == Builtin_Type::REF && v.mType.subTypes[0].builtinType == Builtin_Type::STRUCT)) {
+		} else if (hasFields(v.mType.builtinType) || (v.mType.builtinType == Builtin_Type::REF && v.mType.subTypes[0].builtinType == Builtin_Type::STRUCT)) {
 			// Access property
 			std::optional<Token> dot = expectOperator(".");
 			if (!dot.has_value()) {
@@ -1105,7 +1202,7 @@ namespace forest::parser {
 					return std::nullopt;
 				}
 				values.push_back(expression);
-			} else if (v.mType.builtinType == Builtin_Type::STRUCT) {
+			} else if (v.mType.builtinType == Builtin_Type::STRUCT || (hasFields(v.mType.builtinType) && (mCurrentToken->mText == "{" || mCurrentToken->mText == "@"))) {
 				if (!ParseStructAssignment(v.mType.name, values))
 					return std::nullopt;
 			} else {
@@ -1117,13 +1214,13 @@ namespace forest::parser {
 				values.push_back(expression);
 			}
 		} else {
-			if (v.mType.builtinType == Builtin_Type::ARRAY && v.mType.subTypes[0].builtinType == Builtin_Type::STRUCT) {
+			if (v.mType.builtinType == Builtin_Type::ARRAY && v.mType.subTypes[0].builtinType == Builtin_Type::STRUCT && v.mName.find('.') == std::string::npos) {
 				if (!ParseStructAssignment(v.mType.subTypes[0].name, values))
 					return std::nullopt;
 			} else if (op.mText == "++" || op.mText == "--") {
 				// Don't parse expression
 				// TODO: These aren't handled correctly, also in compilation... Fix it
-				Expression* opNode = new Expression;
+				Expression* opNode = mArena->create();
 				opNode->mValue = op;
 				values.push_back(opNode);
 			} else {
@@ -1135,10 +1232,36 @@ namespace forest::parser {
 				// if last character of operator is '=' but not '=' itself, add nodes to expression
 				if (op.mText[op.mText.size() - 1] == '=' && op.mText != "=") {
 					op.mText.pop_back();
-					Expression* nameNode = new Expression;
+					Expression* nameNode = mArena->create();
 					nameNode->mValue = name.value();
 					nameNode->mValue.mText = v.mName;
-					Expression* opNode = new Expression;
+					if (v.mType.builtinType == Builtin_Type::ARRAY && statement.mContent != nullptr) {
+						// `arr[i] += value` reads the element, `arr[i].field += value` the field of it
+						size_t dot = v.mName.find('.');
+						nameNode->mValue.mText = v.mName.substr(0, dot);
+						Expression* indexNode = mArena->create();
+						indexNode->mValue = name.value();
+						indexNode->mValue.mType = TokenType::OPERATOR;
+						indexNode->mValue.mSubType = TokenSubType::OP_BINARY;
+						indexNode->mValue.mText = "[";
+						indexNode->mChildren.push_back(nameNode);
+						indexNode->mChildren.push_back(statement.mContent);
+						nameNode = indexNode;
+						if (dot != std::string::npos) {
+							Expression* fieldNode = mArena->create();
+							fieldNode->mValue = name.value();
+							fieldNode->mValue.mText = v.mName.substr(dot + 1);
+							Expression* dotNode = mArena->create();
+							dotNode->mValue = name.value();
+							dotNode->mValue.mType = TokenType::OPERATOR;
+							dotNode->mValue.mSubType = TokenSubType::DOT;
+							dotNode->mValue.mText = ".";
+							dotNode->mChildren.push_back(indexNode);
+							dotNode->mChildren.push_back(fieldNode);
+							nameNode = dotNode;
+						}
+					}
+					Expression* opNode = mArena->create();
 					opNode->mValue = op;
 					opNode->mChildren.push_back(nameNode);
 					opNode->mChildren.push_back(expression);
@@ -1312,9 +1435,29 @@ namespace forest::parser {
 							len = stol(length.value().mText);
 						}
 					}
-					return Type{"array<>", Builtin_Type::ARRAY, types, len * childType.value().byteSize, childType.value().alignTo};
+					return getArrayType("array<>", childType.value(), len);
 				} else if (id->mText == "ref") {
 					return Type{"ref<>", Builtin_Type::REF, types, 8, 8};
+				} else if ((id->mText.size() == 4 && id->mText.starts_with("vec")) || (id->mText.size() == 6 && id->mText.starts_with("mat") && id->mText[4] == 'x')) {
+					// vecN<T> and matRxC<T> from std::math
+					bool isVector = id->mText[0] == 'v';
+					size_t rows = isVector ? 1 : id->mText[3] - '0';
+					size_t columns = id->mText[isVector ? 3 : 5] - '0';
+					Builtin_Type element = childType.value().builtinType;
+					if (rows < 1 || rows > 4 || columns < 2 || columns > 4 || (!isVector && rows < 2)) {
+						std::cerr << "[Parser]: Vectors and matrices have 2 to 4 rows and columns, got '" << id->mText << "' at " << id.value() << std::endl;
+						mCurrentToken = saved;
+						return std::nullopt;
+					}
+					if (!((element >= Builtin_Type::UI8 && element <= Builtin_Type::I64) || element == Builtin_Type::F32 || element == Builtin_Type::F64)) {
+						std::cerr << "[Parser]: The elements of '" << id->mText << "' have to be integers, f32 or f64, got '" << childType.value().name << "' at " << id.value() << std::endl;
+						mCurrentToken = saved;
+						return std::nullopt;
+					}
+					Type type = isVector ? getVectorType(columns, childType.value()) : getMatrixType(rows, columns, childType.value());
+					if (!structs.contains(type.name))
+						structs.insert({type.name, getComponents(type)});
+					return type;
 				} else {
 					// TODO: This byteSize value is not correct
 					// Basically, we have a generic class here, so we should fetch its size + size of generic argument * how many times it's used, or if just a reference, 8
@@ -1341,7 +1484,6 @@ namespace forest::parser {
 				return std::nullopt;
 			}
 
-			std::vector<Type> types;
 			Type t = Type {id->mText, getTypeFromName(id->mText), {}, 0, 0};
 
 			size_t size = 8;
@@ -1352,13 +1494,62 @@ namespace forest::parser {
 			t.byteSize = size;
 			t.alignTo = size;
 
-			types.emplace_back(t);
-			return Type {id->mText + "[]", Builtin_Type::ARRAY, types, len * size, t.alignTo};
+			return getArrayType(id->mText + "[]", t, len);
 		}
 
 		return Type {id->mText, getTypeFromName(id->mText), {}, sizeCache[id->mText], sizeCache[id->mText]};
 	}
 
+	Type Parser::getVectorType(size_t lanes, const Type& element) {
+		size_t byteSize = std::max<size_t>((lanes == 3 ? 4 : lanes) * element.byteSize, 4);
+		return Type {"vec" + std::to_string(lanes) + "<" + element.name + ">", Builtin_Type::VECTOR, {element}, byteSize, std::min<size_t>(byteSize, 16)};
+	}
+
+	Type Parser::getMatrixType(size_t rows, size_t columns, const Type& element) {
+		Type row = getVectorType(columns, element);
+		std::string name = "mat" + std::to_string(rows) + "x" + std::to_string(columns) + "<" + element.name + ">";
+		return Type {name, Builtin_Type::MATRIX, {element}, rows * row.byteSize, row.alignTo};
+	}
+
+	std::pair<size_t, size_t> Parser::getShape(const Type& type) {
+		if (type.builtinType == Builtin_Type::MATRIX)
+			return {type.name[3] - '0', type.name[5] - '0'};
+		return {1, type.name[3] - '0'};
+	}
+
+	Type Parser::getArrayType(const std::string& name, const Type& element, size_t length) {
+		if (element.builtinType == Builtin_Type::BOOL)
+			return Type {"bool[" + std::to_string(length) + "]", Builtin_Type::ARRAY, {element}, (length + 63) / 64 * 8, 8};
+		return Type {name, Builtin_Type::ARRAY, {element}, length * element.byteSize, element.alignTo};
+	}
+
+	bool Parser::isPacked(const Type& type) {
+		return type.builtinType == Builtin_Type::ARRAY && !type.subTypes.empty() && type.subTypes[0].builtinType == Builtin_Type::BOOL;
+	}
+
+	size_t Parser::getLength(const Type& type) {
+		if (isPacked(type))
+			return std::stoul(type.name.substr(type.name.find('[') + 1));
+		return type.subTypes[0].byteSize == 0 ? 0 : type.byteSize / type.subTypes[0].byteSize;
+	}
+
+	Struct Parser::getComponents(const Type& type) {
+		static const std::vector<std::string> vectorNames[4] = {{"x", "r"}, {"y", "g"}, {"z", "b"}, {"w", "a"}};
+		auto [rows, columns] = getShape(type);
+		const Type& element = type.subTypes[0];
+		size_t rowSize = type.byteSize / rows;
+		Struct s {type.name, {}, type.byteSize};
+		for (size_t row = 0; row < rows; row++) {
+			for (size_t column = 0; column < columns; column++) {
+				std::vector<std::string> names = vectorNames[column];
+				if (type.builtinType == Builtin_Type::MATRIX)
+					names = {"m" + std::to_string(row) + std::to_string(column)};
+				s.mFields.push_back(StructField {names, element, row * rowSize + column * element.byteSize});
+			}
+		}
+		return s;
+	}
+
 	Expression* Parser::expectExpression(Statement& statementContext, bool collapse) {
 		std::vector<Token>::iterator saved = mCurrentToken;
 		// While no semicolon for variable assignment or return call, parse
@@ -1434,9 +1625,9 @@ namespace forest::parser {
 					//            [
 					//         /     \
 					//        id       index of array
-					Expression* node = new Expression;
+					Expression* node = mArena->create();
 					node->mValue = arrayIndex.value();
-					Expression* left = new Expression;
+					Expression* left = mArena->create();
 					left->mValue = identifier.value();
 					Expression* right = expectExpression(newStatement);
 					expectOperator("]"); // We discard this value because we don't need it
@@ -1453,9 +1644,9 @@ namespace forest::parser {
 					std::optional<Token> funcCall = expectOperator("(");
 					Statement newStatement;
 					newStatement.mType = Statement_Type::FUNC_CALL;
-					Expression* node = new Expression;
+					Expression* node = mArena->create();
 					node->mValue = funcCall.value();
-					Expression* left = new Expression;
+					Expression* left = mArena->create();
 					left->mValue = identifier.value();
 
 					bool isExternal = false;
@@ -1487,7 +1678,7 @@ namespace forest::parser {
 					node->mChildren.push_back(left);
 
 					// We do this to separate between function identifier and arguments
-					Expression* copy = new Expression;
+					Expression* copy = mArena->create();
 					copy->mValue = node->mValue;
 					node->mChildren.push_back(copy);
 
@@ -1515,13 +1706,13 @@ namespace forest::parser {
 						std::cerr << "[Parser]: Unknown variable '" << identifier.value().mText << "' at " << identifier.value() << std::endl;
 						return nullptr;
 					}
-					Expression* node = new Expression;
+					Expression* node = mArena->create();
 					node->mValue = identifier.value();
 					nodes.push_back(node);
 				}
 			} else if (mCurrentToken->mType == TokenType::OPERATOR) {
 				std::optional<Token> op = expectOperator();
-				Expression* node = new Expression;
+				Expression* node = mArena->create();
 				node->mValue = op.value();
 				nodes.push_back(node);
 				if (op.value().mText == ".") {
@@ -1530,7 +1721,7 @@ namespace forest::parser {
 				}
 			} else if (mCurrentToken->mType == TokenType::LITERAL) {
 				std::optional<Token> literal = expectLiteral();
-				Expression* node = new Expression;
+				Expression* node = mArena->create();
 				node->mValue = literal.value();
 				nodes.push_back(node);
 			}
@@ -1630,7 +1821,7 @@ namespace forest::parser {
 				mCurrentToken = saved;
 				return false;
 			}
-			Expression* atExp = new Expression;
+			Expression* atExp = mArena->create();
 			atExp->mValue = at.value();
 			atExp->mChildren.push_back(expression);
 			values.push_back(atExp);
@@ -1676,7 +1867,7 @@ namespace forest::parser {
 					return false;
 				}
 				values[fieldIndex] = expression;
-				insertPositions.erase(insertPositions.begin() + fieldIndex);
+				insertPositions.erase(std::remove(insertPositions.begin(), insertPositions.end(), fieldIndex), insertPositions.end());
 			} else {
 				Expression* expression = expectExpression(statement);
 
@@ -1724,7 +1915,7 @@ namespace forest::parser {
 				mCurrentToken = saved;
 				return false;
 			}
-			Expression* atExp = new Expression;
+			Expression* atExp = mArena->create();
 			atExp->mValue = at.value();
 			atExp->mChildren.push_back(expression);
 			values.push_back(atExp);
@@ -1770,7 +1961,7 @@ namespace forest::parser {
 					return false;
 				}
 				values[fieldIndex] = expression;
-				insertPositions.erase(insertPositions.begin() + fieldIndex);
+				insertPositions.erase(std::remove(insertPositions.begin(), insertPositions.end(), fieldIndex), insertPositions.end());
 			} else {
 				Expression* expression = expectExpression(statement);
 
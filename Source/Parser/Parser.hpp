@@ -33,8 +33,20 @@ namespace forest::parser {
 		VOID,
 		STRUCT,
 		CLASS,
+		VECTOR, // vec2<T> to vec4<T> from std::math, the element type is the only sub type
+		MATRIX, // mat2x2<T> to mat4x4<T>, rows of vectors
 	};
 
+	// Vectors and matrices are laid out like a struct, with a field for every component
+	inline bool hasFields(Builtin_Type type) {
+		return type == Builtin_Type::STRUCT || type == Builtin_Type::VECTOR || type == Builtin_Type::MATRIX;
+	}
+
+	// The floating point types SSE has instructions for, f8 and f16 have none
+	inline bool isFloat(Builtin_Type type) {
+		return type == Builtin_Type::F32 || type == Builtin_Type::F64;
+	}
+
 	enum class Statement_Type {
 		NOTHING,
 		VAR_DECLARATION,
@@ -53,6 +65,7 @@ namespace forest::parser {
 		NOTHING,
 		DEPENDENCY,
 		ASSERT,
+		SOA, // #soa in front of a struct, arrays of it keep each field in its own contiguous array
 	};
 
 	struct Type {
@@ -93,6 +106,12 @@ namespace forest::parser {
 		std::string mName;
 		std::vector<StructField> mFields;
 		size_t mSize;
+		bool mAligned = false;
+		// mFields stays in declaration order for positional initialisers, only the offsets follow the sorted layout
+		bool mReordered = false;
+		// An array T[N] of a #soa struct is N of the first field, then N of the second one and so on. Field i of element j is
+		// at N * mOffset + j * byteSize, so the columns follow the same order and alignment as the fields of a single struct
+		bool mSoA = false;
 
 		int getIndexOfProperty(const std::string& propertyName) const {
 			for (int i = 0; i < mFields.size(); i++) {
@@ -138,14 +157,6 @@ namespace forest::parser {
 			mName = name;
 			mValues = values;
 		}
-		Variable(Variable const& rhs) {
-			mType = rhs.mType;
-			mName = rhs.mName;
-			for (auto& expression: rhs.mValues) {
-				Expression* e = new Expression(*expression);
-				mValues.push_back(e);
-			}
-		}
 	};
 
 	struct Range {
@@ -220,6 +231,7 @@ namespace forest::parser {
 
 	struct Import {
 		std::string mPath;
+		std::string mFrom; // The file with the `use`, the path is relative to it
 	};
 
 	struct Programme {
@@ -232,6 +244,8 @@ namespace forest::parser {
 		std::map<std::string, Struct> structs;
 		std::map<std::string, Class> classes;
 		bool requires_libs = false;
+		std::shared_ptr<ExpressionArena> arena; // Owns every expression in the programme
+		std::vector<Function> importedFunctions; // Defined in the files this one imports, only the signatures are kept
 
 		std::optional<Literal> findLiteralByAlias(const std::string& alias) const {
 			for (const auto& literal : literals) {
@@ -283,6 +297,36 @@ namespace forest::parser {
 		std::optional<Statement> tryParseIfStatement();
 		Expression* expectExpression(Statement& statementContext, bool collapse = false);
 
+		/**
+		 * The layout of vecN<T>: the lanes of vec3 are padded to 4 and the whole is rounded up to at least 4 bytes, so it
+		 * can be moved into an xmm register with one instruction. It is aligned to its size, up to the 16 bytes of a register
+		 */
+		static Type getVectorType(size_t lanes, const Type& element);
+		// matRxC<T> is R rows of vecC<T>, row-major
+		static Type getMatrixType(size_t rows, size_t columns, const Type& element);
+		// The rows and columns of a vector or matrix type, a vector is a single row
+		static std::pair<size_t, size_t> getShape(const Type& type);
+		// The fields x, y, z and w (or r, g, b and a) of a vector and m00 to m33 of a matrix
+		static Struct getComponents(const Type& type);
+		/**
+		 * T[N] and array<T; N>. bool[N] is packed into a bitset of whole qwords, flag i is bit i % 64 of qword i / 64. As
+		 * its size doesn't give the length anymore, the length is kept in the name like the shape of a vector
+		 */
+		static Type getArrayType(const std::string& name, const Type& element, size_t length);
+		static bool isPacked(const Type& type);
+		// The number of elements of an array type
+		static size_t getLength(const Type& type);
+		/**
+		 * Sets the field offsets and size of a struct. `aligned` pads every field to its alignment and the size to the
+		 * biggest one, otherwise fields are packed. `reorder` places the fields by descending alignment, which keeps
+		 * packed fields on their natural alignment and leaves an aligned struct with only its tail padding
+		 */
+		static void layoutStruct(Struct& s, bool aligned, bool reorder);
+		// The natural alignment of a field, the largest power of two (up to 16) its alignTo is a multiple of
+		static size_t getFieldAlignment(const Type& type);
+		// Prints the size and padding of the structs declared in this translation unit that waste space or misalign a field
+		void reportStructLayouts(const std::vector<std::string>& names) const;
+
 		std::vector<Token>::iterator mCurrentToken;
 		std::vector<Token>::iterator mTokensEnd;
 		std::vector<Literal> literals;
@@ -293,6 +337,7 @@ namespace forest::parser {
 		std::map<std::string, Variable> variables;
 		std::map<std::string, size_t> sizeCache;
 		bool requires_libs = false;
+		std::shared_ptr<ExpressionArena> mArena = std::make_shared<ExpressionArena>();
 
 	private:
 		uint32_t biggestAlloc = 0;
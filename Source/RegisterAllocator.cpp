@@ -0,0 +1,272 @@
+#include <algorithm>
+#include "RegisterAllocator.hpp"
+#include "Liveness.hpp"
+
+std::map<const void*, std::string> RegisterAllocator::allocate(const Function& function, bool includeArgs) {
+	mPosition = 0;
+	mLoopDepth = 0;
+	mIntervals.clear();
+	mScopes.clear();
+	mScopes.emplace_back();
+
+	for (const auto& arg : function.mArgs) {
+		if (includeArgs && function.mName != "main") {
+			declare(&arg, Variable {arg.mType, arg.mName, {}});
+		} else {
+			// Still shadows the name so uses inside the body don't resolve to anything else
+			mScopes.back()[arg.mName] = mIntervals.size();
+			mIntervals.push_back(LiveInterval {&arg, arg.mName, arg.mType.builtinType, 0, 0, 0, false});
+		}
+	}
+	visitBlock(function.mBody);
+	return assignRegisters();
+}
+
+std::map<const void*, std::string> RegisterAllocator::allocate(const Function& function, const forest::ir::Function& irFunction, bool includeArgs) {
+	using namespace forest::ir;
+	mIntervals.clear();
+
+	std::vector<LiveRange> ranges = computeLiveRanges(irFunction);
+	std::map<const void*, size_t> intervals;
+	for (const auto& value : irFunction.mValues) {
+		if (value.mRemoved || value.mOrigin == nullptr) continue;
+		const LiveRange& range = ranges[value.mId];
+		auto found = intervals.find(value.mOrigin);
+		if (found == intervals.end()) {
+			intervals[value.mOrigin] = mIntervals.size();
+			mIntervals.push_back(LiveInterval {value.mOrigin, value.mName, value.mType, range.mStart, range.mEnd, 0, isCandidate(value.mType)});
+			continue;
+		}
+		LiveInterval& interval = mIntervals[found->second];
+		interval.start = std::min(interval.start, range.mStart);
+		interval.end = std::max(interval.end, range.mEnd);
+	}
+
+	for (const auto& block : irFunction.mBlocks) {
+		for (uint32_t id : block.mInstructions) {
+			const Instruction& instruction = irFunction.value(id);
+			if (instruction.mOp == OpCode::ARGUMENT && instruction.mOrigin != nullptr && (!includeArgs || function.mName == "main"))
+				mIntervals[intervals[instruction.mOrigin]].eligible = false;
+			// Phis don't exist in the generated code, their operands aren't uses
+			if (instruction.mOp == OpCode::PHI) continue;
+
+			bool isStdCall = instruction.mOp == OpCode::CALL && (instruction.mName.starts_with("stdout_") || instruction.mName.starts_with("stdin_"));
+			for (uint32_t operand : instruction.mOperands) {
+				const Instruction& value = irFunction.value(operand);
+				if (value.mOrigin == nullptr) continue;
+				LiveInterval& interval = mIntervals[intervals[value.mOrigin]];
+				interval.weight += uint64_t(1) << std::min(3u * block.mLoopDepth, 48u);
+				// stdout.write of a byte variable writes straight from its address
+				if (isStdCall && value.mType == Builtin_Type::UI8)
+					interval.eligible = false;
+			}
+		}
+	}
+	return assignRegisters();
+}
+
+std::map<const void*, std::string> RegisterAllocator::assignRegisters() {
+	std::vector<LiveInterval*> sorted;
+	for (auto& interval : mIntervals) {
+		if (interval.eligible && interval.weight > 0)
+			sorted.push_back(&interval);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const LiveInterval* a, const LiveInterval* b) {
+		return a->start < b->start;
+	});
+
+	std::map<const void*, std::string> result;
+	std::vector<std::pair<LiveInterval*, std::string>> active;
+	// Reversed so that r13 is handed out first
+	std::vector<std::string> free(std::rbegin(c_Registers), std::rend(c_Registers));
+
+	for (LiveInterval* current : sorted) {
+		// Expire the intervals that ended before this one starts, their registers can be reused
+		for (auto it = active.begin(); it != active.end();) {
+			if (it->first->end < current->start) {
+				free.push_back(it->second);
+				it = active.erase(it);
+			} else {
+				it++;
+			}
+		}
+
+		if (!free.empty()) {
+			active.emplace_back(current, free.back());
+			free.pop_back();
+			result[current->declaration] = active.back().second;
+			continue;
+		}
+
+		// Under pressure, the least used value lives on the stack
+		auto cheapest = std::min_element(active.begin(), active.end(), [](const auto& a, const auto& b) {
+			return a.first->weight < b.first->weight;
+		});
+		if (cheapest->first->weight < current->weight) {
+			std::string reg = cheapest->second;
+			result.erase(cheapest->first->declaration);
+			active.erase(cheapest);
+			active.emplace_back(current, reg);
+			result[current->declaration] = reg;
+		}
+	}
+	return result;
+}
+
+void RegisterAllocator::declare(const void* declaration, const Variable& variable) {
+	mScopes.back()[variable.mName] = mIntervals.size();
+	LiveInterval interval {declaration, variable.mName, variable.mType.builtinType, mPosition, mPosition, 0, isCandidate(variable.mType)};
+	mIntervals.push_back(interval);
+}
+
+void RegisterAllocator::use(const std::string& name) {
+	for (auto scope = mScopes.rbegin(); scope != mScopes.rend(); scope++) {
+		auto found = scope->find(name);
+		if (found == scope->end()) continue;
+
+		LiveInterval& interval = mIntervals[found->second];
+		interval.end = std::max(interval.end, mPosition);
+		interval.weight += uint64_t(1) << std::min(3u * mLoopDepth, 48u);
+		return;
+	}
+}
+
+void RegisterAllocator::markIneligible(const std::string& name, Builtin_Type onlyType) {
+	for (auto scope = mScopes.rbegin(); scope != mScopes.rend(); scope++) {
+		auto found = scope->find(name);
+		if (found == scope->end()) continue;
+
+		LiveInterval& interval = mIntervals[found->second];
+		if (onlyType == Builtin_Type::UNDEFINED || interval.type == onlyType)
+			interval.eligible = false;
+		return;
+	}
+}
+
+void RegisterAllocator::visitBlock(const Block& block) {
+	mScopes.emplace_back();
+	for (const auto& statement : block.statements) {
+		visitStatement(statement);
+	}
+	mScopes.pop_back();
+}
+
+void RegisterAllocator::visitStatement(const Statement& statement) {
+	mPosition++;
+	switch (statement.mType) {
+		case Statement_Type::VAR_DECLARATION:
+			declare(&statement.variable.value(), statement.variable.value());
+			break;
+		case Statement_Type::VAR_DECL_ASSIGN:
+			// The value is evaluated before the variable exists
+			for (const auto& value : statement.variable.value().mValues)
+				visitExpression(value);
+			declare(&statement.variable.value(), statement.variable.value());
+			use(statement.variable.value().mName);
+			break;
+		case Statement_Type::VAR_ASSIGNMENT: {
+			const Variable& v = statement.variable.value();
+			visitExpression(statement.mContent);
+			for (const auto& value : v.mValues)
+				visitExpression(value);
+			uint64_t index = v.mName.find('.');
+			use(index == std::string::npos ? v.mName : v.mName.substr(0, index));
+			break;
+		}
+		case Statement_Type::RETURN_CALL:
+			visitExpression(statement.mContent);
+			break;
+		case Statement_Type::FUNC_CALL: {
+			const FuncCallStatement& fc = statement.funcCall.value();
+			for (const auto& arg : fc.mArgs) {
+				visitExpression(arg);
+				// stdout.write of a byte variable writes straight from its address
+				if ((fc.mClassName == "stdout" || fc.mClassName == "stdin") && arg != nullptr && arg->mValue.mType == TokenType::IDENTIFIER)
+					markIneligible(arg->mValue.mText, Builtin_Type::UI8);
+			}
+			if (!fc.mClassName.empty())
+				use(fc.mClassName);
+			break;
+		}
+		case Statement_Type::IF: {
+			const IfStatement& is = statement.ifStatement.value();
+			visitExpression(statement.mContent);
+			visitBlock(is.mBody);
+			if (is.mElseBody.has_value())
+				visitBlock(is.mElseBody.value());
+			break;
+		}
+		case Statement_Type::LOOP: {
+			if (!statement.loopStatement.has_value()) break;
+			const LoopStatement& ls = statement.loopStatement.value();
+			uint32_t loopStart = mPosition;
+			visitExpression(statement.mContent);
+			mScopes.emplace_back();
+			if (ls.mRange.has_value()) {
+				visitExpression(ls.mRange.value().mMinimum);
+			}
+			if (ls.mIterator.has_value()) {
+				declare(&ls.mIterator.value(), ls.mIterator.value());
+			}
+			mLoopDepth++;
+			if (ls.mRange.has_value())
+				visitExpression(ls.mRange.value().mMaximum);
+			if (ls.mStep.has_value())
+				visitExpression(ls.mStep.value());
+			visitBlock(ls.mBody);
+			mPosition++;
+			if (ls.mIterator.has_value())
+				use(ls.mIterator.value().mName);
+			mLoopDepth--;
+			mScopes.pop_back();
+
+			// Anything that lives across the back edge has to stay alive for the whole loop
+			uint32_t loopEnd = mPosition;
+			for (auto& interval : mIntervals) {
+				if (interval.start < loopStart && interval.end >= loopStart)
+					interval.end = std::max(interval.end, loopEnd);
+			}
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+void RegisterAllocator::visitExpression(const Expression* expression) {
+	if (expression == nullptr) return;
+
+	if (expression->mValue.mType == TokenType::IDENTIFIER) {
+		use(expression->mValue.mText);
+		return;
+	}
+	if (expression->mValue.mText == "\\" && !expression->mChildren.empty() && expression->mChildren[0] != nullptr) {
+		// Values that have their address taken have to live in memory
+		markIneligible(expression->mChildren[0]->mValue.mText);
+	}
+	for (const auto& child : expression->mChildren) {
+		visitExpression(child);
+	}
+}
+
+bool RegisterAllocator::isCandidate(const Type& type) {
+	return isCandidate(type.builtinType);
+}
+
+bool RegisterAllocator::isCandidate(Builtin_Type type) {
+	switch (type) {
+		case Builtin_Type::UI8:
+		case Builtin_Type::UI16:
+		case Builtin_Type::UI32:
+		case Builtin_Type::UI64:
+		case Builtin_Type::I8:
+		case Builtin_Type::I16:
+		case Builtin_Type::I32:
+		case Builtin_Type::I64:
+		case Builtin_Type::CHAR:
+		case Builtin_Type::BOOL:
+			return true;
+		default:
+			return false;
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef FOREST_REGISTERALLOCATOR_HPP
+#define FOREST_REGISTERALLOCATOR_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Parser.hpp"
+#include "IR.hpp"
+
+using namespace forest::parser;
+
+struct LiveInterval {
+	const void* declaration{}; // The Variable or FuncArg in the AST that introduced this value
+	std::string name{};
+	Builtin_Type type{};
+	uint32_t start{};
+	uint32_t end{};
+	uint64_t weight{}; // Uses, weighted by the loop depth they occur at
+	bool eligible = true;
+};
+
+/**
+ * Linear-scan register allocator for the scalar locals of a single function.
+ * Each local gets a live interval covering every SSA value of it in the IR of the function and the intervals are then
+ * assigned to the callee-saved registers the code generator never uses as scratch registers.
+ * Under pressure the interval with the lowest weight stays on the stack.
+ * When the function can't be lowered to the IR, the intervals come from the statement positions in the AST instead,
+ * stretched to the end of any loop a local is used in but declared outside of.
+ */
+class RegisterAllocator {
+public:
+	static constexpr const char* c_Registers[] = {"r13", "r14", "r15"};
+
+	/**
+	 * Allocates registers for the locals of the function.
+	 * The result maps the address of the declaring Variable/FuncArg to the 64-bit name of the register.
+	 * @param includeArgs Whether arguments are candidates too. Class methods keep their arguments in the argument registers.
+	 */
+	std::map<const void*, std::string> allocate(const Function& function, bool includeArgs = true);
+	std::map<const void*, std::string> allocate(const Function& function, const forest::ir::Function& irFunction, bool includeArgs = true);
+
+private:
+	uint32_t mPosition = 0;
+	uint32_t mLoopDepth = 0;
+	std::vector<LiveInterval> mIntervals;
+	std::vector<std::map<std::string, size_t>> mScopes;
+
+	std::map<const void*, std::string> assignRegisters();
+	void declare(const void* declaration, const Variable& variable);
+	void use(const std::string& name);
+	void markIneligible(const std::string& name, Builtin_Type onlyType = Builtin_Type::UNDEFINED);
+	void visitBlock(const Block& block);
+	void visitStatement(const Statement& statement);
+	void visitExpression(const Expression* expression);
+	static bool isCandidate(const Type& type);
+	static bool isCandidate(Builtin_Type type);
+};
+
+#endif //FOREST_REGISTERALLOCATOR_HPP
@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <elf.h>
+#include "Assembler.hpp"
+#include "Peephole.hpp"
+
+using namespace forest::assembler;
+
+class AssemblerTests : public ::testing::Test {
+
+	void SetUp() override {
+
+	}
+
+	void TearDown() override {
+
+	}
+
+protected:
+	Assembler assembler;
+	std::vector<uint8_t> object;
+
+	bool assemble(const std::string& code) {
+		std::optional<std::vector<uint8_t>> result = assembler.assemble(code);
+		if (!result.has_value()) return false;
+		object = result.value();
+		return true;
+	}
+
+	const Elf64_Shdr* findSection(const std::string& name) const {
+		Elf64_Ehdr header;
+		std::memcpy(&header, object.data(), sizeof(header));
+		const auto* sections = reinterpret_cast<const Elf64_Shdr*>(object.data() + header.e_shoff);
+		const char* names = reinterpret_cast<const char*>(object.data() + sections[header.e_shstrndx].sh_offset);
+		for (size_t i = 0; i < header.e_shnum; i++) {
+			if (name == names + sections[i].sh_name) return &sections[i];
+		}
+		return nullptr;
+	}
+
+	std::vector<uint8_t> getText() const {
+		const Elf64_Shdr* text = findSection(".text");
+		return {object.begin() + text->sh_offset, object.begin() + text->sh_offset + text->sh_size};
+	}
+};
+
+TEST_F(AssemblerTests, AssemblerEncodeRegisterAndImmediateForms) {
+	ASSERT_TRUE(assemble("section .text\n\tmov rax, 60\n\tmov r9, [rsp+8]\n\tadd qword [rbp-16], 1\n\tsyscall ; exit\n"));
+	std::vector<uint8_t> expected = {
+		0x48, 0xC7, 0xC0, 0x3C, 0x00, 0x00, 0x00, // mov rax, 60
+		0x4C, 0x8B, 0x4C, 0x24, 0x08, // mov r9, [rsp+8]
+		0x48, 0x83, 0x45, 0xF0, 0x01, // add qword [rbp-16], 1
+		0x0F, 0x05, // syscall
+	};
+	EXPECT_EQ(getText(), expected);
+}
+
+TEST_F(AssemblerTests, AssemblerResolveLocalJumpsWithoutRelocations) {
+	ASSERT_TRUE(assemble("section .text\nmain:\n.loop:\n\tdec rcx\n\tjnz .loop\n\tret\n"));
+	std::vector<uint8_t> expected = {
+		0x48, 0xFF, 0xC9, // dec rcx
+		0x0F, 0x85, 0xF7, 0xFF, 0xFF, 0xFF, // jnz main.loop, 9 bytes back from the end of the jump
+		0xC3,
+	};
+	EXPECT_EQ(getText(), expected);
+	EXPECT_EQ(findSection(".rela.text")->sh_size, 0);
+}
+
+TEST_F(AssemblerTests, AssemblerEmitRelocationForExternalCall) {
+	ASSERT_TRUE(assemble("extern stdout_flush\nsection .text\nglobal _start\n_start:\n\tcall stdout_flush\n"));
+	const Elf64_Shdr* rela = findSection(".rela.text");
+	ASSERT_EQ(rela->sh_size, sizeof(Elf64_Rela));
+	Elf64_Rela relocation;
+	std::memcpy(&relocation, object.data() + rela->sh_offset, sizeof(relocation));
+	EXPECT_EQ(relocation.r_offset, 1);
+	EXPECT_EQ(ELF64_R_TYPE(relocation.r_info), R_X86_64_PLT32);
+	EXPECT_EQ(relocation.r_addend, -4);
+}
+
+TEST_F(AssemblerTests, AssemblerEncodeVectorInstructions) {
+	ASSERT_TRUE(assemble("section .text\n\tmovdqu xmm0, [rbp-16]\n\tpaddb xmm0, xmm9\n\tmovq xmm8, rax\n\tpshufd xmm1, xmm1, 0\n"
+		"\tpsllq xmm2, 3\n\tmovdqu [rbp-16+r11*4], xmm14\n\tpmuludq xmm0, xmm1\n\tpsrldq xmm3, 4\n\tpshuflw xmm1, xmm2, 0xC9\n"));
+	std::vector<uint8_t> expected = {
+		0xF3, 0x0F, 0x6F, 0x45, 0xF0, // movdqu xmm0, [rbp-16]
+		0x66, 0x41, 0x0F, 0xFC, 0xC1, // paddb xmm0, xmm9
+		0x66, 0x4C, 0x0F, 0x6E, 0xC0, // movq xmm8, rax
+		0x66, 0x0F, 0x70, 0xC9, 0x00, // pshufd xmm1, xmm1, 0
+		0x66, 0x0F, 0x73, 0xF2, 0x03, // psllq xmm2, 3
+		0xF3, 0x46, 0x0F, 0x7F, 0x74, 0x9D, 0xF0, // movdqu [rbp-16+r11*4], xmm14
+		0x66, 0x0F, 0xF4, 0xC1, // pmuludq xmm0, xmm1
+		0x66, 0x0F, 0x73, 0xDB, 0x04, // psrldq xmm3, 4
+		0xF2, 0x0F, 0x70, 0xCA, 0xC9, // pshuflw xmm1, xmm2, 0xC9
+	};
+	EXPECT_EQ(getText(), expected);
+	EXPECT_FALSE(assemble("section .text\n\tmov rax, xmm0\n"));
+}
+
+TEST_F(AssemblerTests, AssemblerEncodeScalarFloatInstructions) {
+	ASSERT_TRUE(assemble("section .text\n\tmovsd xmm0, qword [rbp-8]\n\taddsd xmm0, xmm1\n\tcvtsi2sd xmm1, rax\n\tcvttsd2si rax, xmm0\n"
+		"\tucomisd xmm0, xmm1\n\tmovss dword [rbp-4], xmm9\n\tcvtss2sd xmm0, xmm0\n\tucomiss xmm0, xmm1\n"
+		"\tmulps xmm2, xmm3\n\taddpd xmm0, xmm10\n"));
+	std::vector<uint8_t> expected = {
+		0xF2, 0x0F, 0x10, 0x45, 0xF8, // movsd xmm0, qword [rbp-8]
+		0xF2, 0x0F, 0x58, 0xC1, // addsd xmm0, xmm1
+		0xF2, 0x48, 0x0F, 0x2A, 0xC8, // cvtsi2sd xmm1, rax
+		0xF2, 0x48, 0x0F, 0x2C, 0xC0, // cvttsd2si rax, xmm0
+		0x66, 0x0F, 0x2E, 0xC1, // ucomisd xmm0, xmm1
+		0xF3, 0x44, 0x0F, 0x11, 0x4D, 0xFC, // movss dword [rbp-4], xmm9
+		0xF3, 0x0F, 0x5A, 0xC0, // cvtss2sd xmm0, xmm0
+		0x0F, 0x2E, 0xC1, // ucomiss xmm0, xmm1
+		0x0F, 0x59, 0xD3, // mulps xmm2, xmm3
+		0x66, 0x41, 0x0F, 0x58, 0xC2, // addpd xmm0, xmm10
+	};
+	EXPECT_EQ(getText(), expected);
+	EXPECT_FALSE(assemble("section .text\n\tcvtsi2sd xmm0, ax\n"));
+}
+
+TEST_F(AssemblerTests, AssemblerEncodeBitInstructions) {
+	ASSERT_TRUE(assemble("section .text\n\tbt r12, rax\n\tbts rbx, r11\n\tbtr r12, r11\n\tbt qword [rbp-8], 3\n\tpopcnt r12, qword [rax+r11*8]\n"));
+	std::vector<uint8_t> expected = {
+		0x49, 0x0F, 0xA3, 0xC4, // bt r12, rax
+		0x4C, 0x0F, 0xAB, 0xDB, // bts rbx, r11
+		0x4D, 0x0F, 0xB3, 0xDC, // btr r12, r11
+		0x48, 0x0F, 0xBA, 0x65, 0xF8, 0x03, // bt qword [rbp-8], 3
+		0xF3, 0x4E, 0x0F, 0xB8, 0x24, 0xD8, // popcnt r12, qword [rax+r11*8]
+	};
+	EXPECT_EQ(getText(), expected);
+	EXPECT_FALSE(assemble("section .text\n\tbt al, 3\n"));
+}
+
+TEST_F(AssemblerTests, AssemblerRejectUnsupportedInstruction) {
+	EXPECT_FALSE(assemble("section .text\n\tcpuid\n"));
+	EXPECT_NE(assembler.getError().find("cpuid"), std::string::npos);
+	EXPECT_FALSE(assemble("section .text\n\tjmp nowhere\n"));
+}
+
+TEST_F(AssemblerTests, PeepholeReduceMultiplicationAndDivision) {
+	Peephole peephole;
+	EXPECT_EQ(peephole.optimise("f:\n\tmov rax, rdi\n\tmov rcx, 8\n\tmul rcx\n\tret\n"), "f:\n\tmov rax, rdi\n\tshl rax, 3\n\tret\n");
+	EXPECT_EQ(peephole.optimise("f:\n\tmov rax, rdi\n\tmov rcx, 8\n\txor rdx, rdx\n\tdiv rcx\n\tmov rax, rdx\n\tret\n"), "f:\n\tmov rax, rdi\n\tand rax, 7\n\tret\n");
+	// Any other divisor is a multiplication by its reciprocal, 7 needs the 65-bit form
+	EXPECT_EQ(peephole.optimise("f:\n\tmov rax, rdi\n\tmov rcx, 10\n\txor rdx, rdx\n\tdiv rcx\n\tret\n"),
+		"f:\n\tmov rax, rdi\n\tmov rdx, 0xcccccccccccccccd\n\tmul rdx\n\tshr rdx, 3\n\tmov rax, rdx\n\tret\n");
+	EXPECT_EQ(peephole.optimise("f:\n\tmov rax, rdi\n\tmov rcx, 7\n\txor rdx, rdx\n\tdiv rcx\n\tmov rax, rdx\n\tret\n"),
+		"f:\n\tmov rax, rdi\n\tmov rcx, rax\n\tmov rdx, 0x2492492492492493\n\tmul rdx\n\tmov rax, rcx\n\tsub rax, rdx\n\tshr rax, 1\n"
+		"\tadd rax, rdx\n\tshr rax, 2\n\timul rax, rax, 7\n\tsub rcx, rax\n\tmov rax, rcx\n\tret\n");
+}
+
+TEST_F(AssemblerTests, PeepholeFoldConstantBeforeReturn) {
+	// rbx is a scratch register, the caller doesn't read it after the ret
+	EXPECT_EQ(Peephole().optimise("f:\n\tmov rax, rdi\n\tmov rbx, 1\n\tsub rax, rbx\n\tret\n"), "f:\n\tmov rax, rdi\n\tsub rax, 1\n\tret\n");
+	// Registers the function saved for its caller are still read by it
+	std::string code = "f:\n\tmov r13, 1\n\tret\n";
+	EXPECT_EQ(Peephole().optimise(code), code);
+}
+
+TEST_F(AssemblerTests, PeepholeFoldLoopCondition) {
+	std::string code = "f:\n"
+		".label1:\n\tmov rax, 16\n\tcmp r14b, al ; LOOP i\n\tjl .inside_label1\n\tjmp .not_label1\n"
+		".inside_label1:\n\tinc r14b\n\tjmp .label1\n"
+		".not_label1:\n\tmov rax, 0\n\tret\n";
+	std::string expected = "f:\n"
+		".label1:\n\tcmp r14b, 16 ; LOOP i\n\tjge .not_label1\n"
+		".inside_label1:\n\tinc r14b\n\tjmp .label1\n"
+		".not_label1:\n\tmov rax, 0\n\tret\n";
+	EXPECT_EQ(Peephole().optimise(code), expected);
+}
+
+TEST_F(AssemblerTests, PeepholeKeepValuesThatAreRead) {
+	// rdx holds the high half of the product
+	std::string code = "f:\n\tmov rax, rdi\n\tmov rcx, 3\n\tmul rcx\n\tmov rax, rdx\n\tret\n";
+	EXPECT_EQ(Peephole().optimise(code), code);
+	// Nothing is known about what the called function reads
+	code = "f:\n\tmov rbx, 5\n\tpush rbx\n\tcall g\n\tpop rbx\n\tret\n";
+	EXPECT_EQ(Peephole().optimise(code), code);
+	// Broadcasting a value into an xmm register reads it
+	code = "f:\n\tmov rax, 5\n\tmovq xmm8, rax\n\tpshufd xmm8, xmm8, 0\n\tret\n";
+	EXPECT_EQ(Peephole().optimise(code), code);
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include "X86_64LinuxYasmCompiler.hpp"
+
+using namespace forest::parser;
+
+class BackendTests : public ::testing::Test {
+
+	void SetUp() override {
+		directory = fs::temp_directory_path() / "forest-backend-tests";
+		fs::create_directories(directory);
+	}
+
+	void TearDown() override {
+		fs::remove_all(directory);
+	}
+
+protected:
+	fs::path directory;
+
+	// The assembly is kept next to the object file
+	std::string compile(const std::string& code, BuildType buildType = BuildType::DEBUG) {
+		fs::path source = directory / "testing.tree";
+		std::vector<Token> tokens = Tokeniser::parse(code, source.string());
+		Programme programme = Parser().parse(tokens);
+		CompileContext ctx;
+		ctx.m_Configuration.m_BuildType = buildType;
+		ctx.m_Configuration.m_Assembler = AssemblerKind::BUILTIN; // Doesn't depend on yasm being installed
+		X86_64LinuxYasmCompiler().compile(source, programme, ctx);
+		std::ifstream assembly(directory / "build" / "testing.asm");
+		std::stringstream ss;
+		ss << assembly.rdbuf();
+		return ss.str();
+	}
+
+	// The lines from the label of the function up to the next label that isn't local to it
+	static std::string getFunction(const std::string& assembly, const std::string& name) {
+		size_t start = assembly.find("\n" + name + ":\n");
+		if (start == std::string::npos) return "";
+		std::stringstream lines(assembly.substr(start + 1));
+		std::string line;
+		std::string result;
+		std::getline(lines, line);
+		result += line + "\n";
+		while (std::getline(lines, line)) {
+			if (!line.empty() && line[0] != '.' && line[0] != ';' && line[0] != '\t' && line.back() == ':') break;
+			result += line + "\n";
+		}
+		return result;
+	}
+};
+
+TEST_F(BackendTests, BackendFoldedFloatDeclaration) {
+	std::string assembly = compile("i32 main(string[] argv) { f64 negative = 0.0 - 3.75; f64 sum = 1.5 + 2.0; return 0; }");
+	// The folded literals are loaded as they are, not converted from whatever is left in rax
+	EXPECT_EQ(assembly.find("cvtsi2sd"), std::string::npos);
+	EXPECT_NE(assembly.find("mov rax, 0xC00E000000000000"), std::string::npos); // -3.75
+	EXPECT_NE(assembly.find("mov rax, 0x400C000000000000"), std::string::npos); // 3.5
+}
+
+TEST_F(BackendTests, BackendFloatVectorArithmetic) {
+	std::string assembly = compile("i32 main(string[] argv) { vec4<f32> a = { 1.0, 2.0, 3.0, 4.0 }; vec2<f64> b = { 1.0, 2.0 };"
+		" vec4<f32> c = (a * a) + a; vec2<f64> d = b - b; f64 e = dot(b, b); return 0; }");
+	EXPECT_NE(assembly.find("mulps"), std::string::npos);
+	EXPECT_NE(assembly.find("addps"), std::string::npos);
+	EXPECT_NE(assembly.find("subpd"), std::string::npos);
+	EXPECT_NE(assembly.find("mulpd"), std::string::npos);
+	// Integer lanes would be added with paddd and friends
+	EXPECT_EQ(assembly.find("padd"), std::string::npos);
+}
+
+TEST_F(BackendTests, BackendBoundsCheckElimination) {
+	const std::string inRange = "i32 main(string[] argv) { ui8[16] a = { 0 }; ui64 t = 0; loop i, 0..16 { ui64 x = a[i]; t = t + x; } return 0; }";
+	// Release drops the check for an index the loop range keeps inside the array, Debug keeps every check
+	EXPECT_EQ(compile(inRange, BuildType::RELEASE).find("jge array_out_of_bounds"), std::string::npos);
+	EXPECT_NE(compile(inRange).find("jge array_out_of_bounds"), std::string::npos);
+	// The range goes past the end of the array
+	std::string assembly = compile("i32 main(string[] argv) { ui8[16] a = { 0 }; ui64 t = 0; loop i, 0..20 { ui64 x = a[i]; t = t + x; } return 0; }", BuildType::RELEASE);
+	EXPECT_NE(assembly.find("jge array_out_of_bounds"), std::string::npos);
+	// The body moves the iterator out of the range
+	assembly = compile("i32 main(string[] argv) { ui8[16] a = { 0 }; ui64 t = 0; loop i, 0..16 { i = i + 5; ui64 x = a[i]; t = t + x; } return 0; }", BuildType::RELEASE);
+	EXPECT_NE(assembly.find("jge array_out_of_bounds"), std::string::npos);
+}
+
+TEST_F(BackendTests, BackendTailCalls) {
+	std::string assembly = compile("ui64 sum(ui64 n, ui64 acc) { if (n == 0) { return acc; } return sum(n - 1, acc + n); }"
+		" ui64 fact(ui64 n) { if (n <= 1) { return 1; } return n * fact(n - 1); }"
+		" i64 subr(i64 n) { if (n <= 0) { return 0; } return subr(n - 1) - 1; }"
+		" f64 halve(f64 x, ui64 n) { if (n == 0) { return x; } return halve(x / 2.0, n - 1); }"
+		" i32 main(string[] argv) { ui64 s = sum(10, 0); ui64 f = fact(10); i64 r = subr(5); f64 h = halve(8.0, 2); return 0; }");
+	// A call in tail position jumps back to the top of the function
+	std::string function = getFunction(assembly, "sum");
+	EXPECT_NE(function.find("jmp .tail_call"), std::string::npos);
+	EXPECT_EQ(function.find("call "), std::string::npos);
+	// Multiplying the result of the call is folded into an accumulator
+	function = getFunction(assembly, "fact");
+	EXPECT_NE(function.find("; TAIL CALL accumulator"), std::string::npos);
+	EXPECT_NE(function.find("jmp .tail_call"), std::string::npos);
+	EXPECT_EQ(function.find("call "), std::string::npos);
+	// Subtraction doesn't commute, so the call stays
+	function = getFunction(assembly, "subr");
+	EXPECT_NE(function.find("call subr"), std::string::npos);
+	EXPECT_EQ(function.find("tail_call"), std::string::npos);
+	// Floating point arguments come in xmm registers, which the jump doesn't refill
+	function = getFunction(assembly, "halve");
+	EXPECT_NE(function.find("call halve"), std::string::npos);
+	EXPECT_EQ(function.find("tail_call"), std::string::npos);
+}
+
+TEST_F(BackendTests, BackendFixedStackFrame) {
+	std::string assembly = compile("ui64 Pick(ui64 n) { ui64 r = 0; if (n > 1) { ui64[2] first = { n, 1 }; r = first[0]; }"
+		" else { ui64[2] second = { n, 2 }; r = second[1]; } return r; } i32 main(string[] argv) { ui64 p = Pick(5); return 0; }");
+	std::string function = getFunction(assembly, "Pick");
+	// The whole frame is reserved once in the prologue, the scopes don't move rsp
+	size_t frame = function.find("\tsub rsp, ");
+	ASSERT_NE(frame, std::string::npos);
+	EXPECT_NE(function.substr(frame, function.find('\n', frame) - frame).find("; FRAME"), std::string::npos);
+	EXPECT_EQ(function.find("\tsub rsp, ", frame + 1), std::string::npos);
+	EXPECT_EQ(function.find("\tadd rsp, "), std::string::npos);
+	// The arrays of the two branches are never live at the same time, so they share their slot
+	size_t first = function.find("; VAR_DECL_ASSIGN ARRAY variable first[0]");
+	size_t second = function.find("; VAR_DECL_ASSIGN ARRAY variable second[0]");
+	ASSERT_NE(first, std::string::npos);
+	ASSERT_NE(second, std::string::npos);
+	auto slot = [&](size_t position) {
+		size_t start = function.rfind('[', position);
+		return function.substr(start, function.find(']', start) - start + 1);
+	};
+	EXPECT_EQ(slot(first), slot(second));
+}
+
+TEST_F(BackendTests, BackendConstantArrays) {
+	std::string assembly = compile("i32 main(string[] argv) { ui64[4] fixed = { 1, 2, 3, 4 }; ui64[4] changed = { 5, 6, 7, 8 }; ui64 k = 2;"
+		" if (k > 1) { if (k > 0) { changed[1] = 9; } } ui64 a = fixed[k]; ui64 b = changed[k]; return 0; }");
+	// Both initialisers are read-only data
+	EXPECT_NE(assembly.find("constant_array1 dq 1, 2, 3, 4; fixed"), std::string::npos);
+	EXPECT_NE(assembly.find("constant_array2 dq 5, 6, 7, 8; changed"), std::string::npos);
+	// An array that is never written is read where it is, the one written in the nested if is copied onto the stack first
+	EXPECT_NE(assembly.find("[constant_array1+rax*8]; printExpression array fixed"), std::string::npos);
+	EXPECT_NE(assembly.find("movdqu xmm0, [constant_array2+0]"), std::string::npos);
+	EXPECT_EQ(assembly.find("movdqu xmm0, [constant_array1+"), std::string::npos);
+}
+
+TEST_F(BackendTests, BackendLiveArguments) {
+	std::string assembly = compile("ui64 fibonacci(ui64 n) { if (n <= 1) { return 1; } return fibonacci(n - 2) + fibonacci(n - 1); }"
+		" ui64 Add(ui64 a, ui64 b) { return a + b; } void Show(ui64 a, ui64 b) { stdout.writeln(a); }"
+		" i32 main(string[] argv) { ui64 f = fibonacci(10); ui64 x = 4; Show(Add(1, 2), x); e:puts(\"external\"); return 0; }");
+	// n was moved out of rdi in the prologue, nothing has to survive the recursive calls
+	std::string function = getFunction(assembly, "fibonacci");
+	EXPECT_NE(function.find("call fibonacci"), std::string::npos);
+	EXPECT_EQ(function.find("push rdi"), std::string::npos);
+	// The second argument of Show is already in rsi when Add is called for the first one
+	size_t saved = assembly.find("\tpush rsi\n");
+	ASSERT_NE(saved, std::string::npos);
+	size_t call = assembly.find("\tcall Add\n", saved);
+	ASSERT_NE(call, std::string::npos);
+	EXPECT_EQ(assembly.find("\tpop rsi\n", call), call + std::string("\tcall Add\n").size());
+	// C functions expect rsp to be 16-byte aligned at the call
+	EXPECT_NE(assembly.find("\tand rsp, -16\n\tcall puts\n"), std::string::npos);
+}
+
+TEST_F(BackendTests, BackendRegisterLocals) {
+	std::string assembly = compile("ui64 Count() { ui64 total = 0; loop i, 0..100 { total = total + 3; } return total; }"
+		" i32 main(string[] argv) { ui64 s = Count(); return 0; }");
+	std::string function = getFunction(assembly, "Count");
+	// The accumulator of the loop lives in a callee-saved register instead of the stack
+	EXPECT_NE(function.find("\tpush r13\n"), std::string::npos);
+	EXPECT_NE(function.find("\tadd r13, 3\n"), std::string::npos);
+	EXPECT_NE(function.find("register variable total"), std::string::npos);
+}
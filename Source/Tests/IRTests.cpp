@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "Parser.hpp"
+#include "IRBuilder.hpp"
+#include "Liveness.hpp"
+
+using namespace forest::parser;
+using namespace forest::ir;
+
+class IRTests : public ::testing::Test {
+
+	void SetUp() override {
+
+	}
+
+	void TearDown() override {
+
+	}
+
+protected:
+	Parser parser;
+	IRBuilder builder;
+	Programme programme;
+
+	std::optional<forest::ir::Function> lower(const std::string& code, const std::string& functionName) {
+		std::vector<Token> tokens = Tokeniser::parse(code, "testing.tree");
+		programme = parser.parse(tokens);
+		for (const auto& function : programme.functions) {
+			if (function.mName == functionName)
+				return builder.lowerFunction(function);
+		}
+		return std::nullopt;
+	}
+
+	static std::vector<const Instruction*> findAll(const forest::ir::Function& function, OpCode op) {
+		std::vector<const Instruction*> result;
+		for (const auto& block : function.mBlocks) {
+			for (uint32_t id : block.mInstructions) {
+				if (function.value(id).mOp == op)
+					result.push_back(&function.value(id));
+			}
+		}
+		return result;
+	}
+};
+
+TEST_F(IRTests, IRLowerStraightLineHasNoPhis) {
+	std::optional<forest::ir::Function> function = lower("i32 main(string[] argv) { ui64 x = 5; ui64 y = x + 1; return 0; }", "main");
+	ASSERT_TRUE(function.has_value());
+
+	ASSERT_EQ(function->mBlocks.size(), 2); // Entry, and the unreachable block after the return
+	EXPECT_TRUE(findAll(function.value(), OpCode::PHI).empty());
+
+	std::vector<const Instruction*> operations = findAll(function.value(), OpCode::OPERATION);
+	ASSERT_EQ(operations.size(), 2);
+	EXPECT_STREQ(operations[0]->mName.c_str(), "x");
+	EXPECT_TRUE(operations[0]->mOperands.empty());
+	EXPECT_STREQ(operations[1]->mName.c_str(), "y");
+	EXPECT_EQ(operations[1]->mType, Builtin_Type::UI64);
+	ASSERT_EQ(operations[1]->mOperands.size(), 1);
+	EXPECT_EQ(operations[1]->mOperands[0], operations[0]->mId);
+}
+
+TEST_F(IRTests, IRLowerIfMergesWithPhi) {
+	std::optional<forest::ir::Function> function = lower("ui64 pick(bool c) { ui64 x = 1; if (c) { x = 2; } return x; } i32 main(string[] argv) { return 0; }", "pick");
+	ASSERT_TRUE(function.has_value());
+
+	std::vector<const Instruction*> phis = findAll(function.value(), OpCode::PHI);
+	ASSERT_EQ(phis.size(), 1);
+	const Instruction& phi = *phis[0];
+	EXPECT_STREQ(phi.mName.c_str(), "x");
+	ASSERT_EQ(phi.mOperands.size(), 2);
+	EXPECT_EQ(function->mBlocks[phi.mBlock].mPredecessors.size(), 2);
+	EXPECT_NE(phi.mOperands[0], phi.mOperands[1]);
+	for (uint32_t operand : phi.mOperands) {
+		EXPECT_EQ(function->value(operand).mOp, OpCode::OPERATION);
+		EXPECT_STREQ(function->value(operand).mName.c_str(), "x");
+	}
+
+	std::vector<const Instruction*> returns = findAll(function.value(), OpCode::RETURN);
+	ASSERT_FALSE(returns.empty());
+	ASSERT_EQ(returns[0]->mOperands.size(), 1);
+	EXPECT_EQ(returns[0]->mOperands[0], phi.mId);
+}
+
+TEST_F(IRTests, IRLowerUnchangedVariableInLoopHasNoPhi) {
+	std::optional<forest::ir::Function> function = lower("ui64 sum(ui64 n) { ui64 total = 0; loop i, 0..10 { total = total + n; } return total; } i32 main(string[] argv) { return 0; }", "sum");
+	ASSERT_TRUE(function.has_value());
+
+	// The iterator and the total change in the loop, n doesn't so its phi has to be removed as trivial
+	std::vector<const Instruction*> phis = findAll(function.value(), OpCode::PHI);
+	ASSERT_EQ(phis.size(), 2);
+	std::vector<std::string> names;
+	for (const auto* phi : phis) {
+		names.push_back(phi->mName);
+		EXPECT_GT(function->mBlocks[phi->mBlock].mLoopDepth, 0);
+	}
+	std::sort(names.begin(), names.end());
+	EXPECT_STREQ(names[0].c_str(), "i");
+	EXPECT_STREQ(names[1].c_str(), "total");
+
+	std::vector<const Instruction*> arguments = findAll(function.value(), OpCode::ARGUMENT);
+	ASSERT_EQ(arguments.size(), 1);
+	bool usesArgument = false;
+	for (const auto* operation : findAll(function.value(), OpCode::OPERATION)) {
+		if (operation->mName != "total") continue;
+		for (uint32_t operand : operation->mOperands) {
+			usesArgument |= operand == arguments[0]->mId;
+		}
+	}
+	EXPECT_TRUE(usesArgument);
+}
+
+TEST_F(IRTests, IRLowerAddressTakenVariableLivesInMemory) {
+	std::optional<forest::ir::Function> function = lower("i32 main(string[] argv) { ui64 x = 5; ref<ui64> r = \\x; x = 6; ui64 y = x; return 0; }", "main");
+	ASSERT_TRUE(function.has_value());
+
+	// x is never a value, r is and y is defined without reading anything
+	for (const auto& value : function->mValues) {
+		EXPECT_STRNE(value.mName.c_str(), "x");
+	}
+	std::vector<const Instruction*> operations = findAll(function.value(), OpCode::OPERATION);
+	ASSERT_EQ(operations.size(), 2);
+	EXPECT_STREQ(operations[0]->mName.c_str(), "r");
+	EXPECT_STREQ(operations[1]->mName.c_str(), "y");
+	EXPECT_TRUE(operations[1]->mOperands.empty());
+}
+
+TEST_F(IRTests, IRLowerArrayIndexReadsIndex) {
+	std::optional<forest::ir::Function> function = lower("i32 main(string[] argv) { ui32[3] arr = {1, 2, 3}; ui64 i = 1; ui32 x = arr[i]; arr[i] = x; return 0; }", "main");
+	ASSERT_TRUE(function.has_value());
+
+	// The array lives in memory, only the index and the stored value are read
+	std::vector<const Instruction*> operations = findAll(function.value(), OpCode::OPERATION);
+	ASSERT_EQ(operations.size(), 3);
+	EXPECT_STREQ(operations[0]->mName.c_str(), "i");
+	EXPECT_STREQ(operations[1]->mName.c_str(), "x");
+	EXPECT_EQ(operations[1]->mOperands, std::vector<uint32_t> {operations[0]->mId});
+	EXPECT_EQ(operations[2]->mType, Builtin_Type::VOID);
+	EXPECT_EQ(operations[2]->mOperands, (std::vector<uint32_t> {operations[0]->mId, operations[1]->mId}));
+}
+
+TEST_F(IRTests, IRLivenessCoversLoop) {
+	std::optional<forest::ir::Function> function = lower("ui64 sum(ui64 n) { ui64 total = 0; loop i, 0..10 { total = total + n; } return total; } i32 main(string[] argv) { return 0; }", "sum");
+	ASSERT_TRUE(function.has_value());
+
+	std::vector<LiveRange> ranges = computeLiveRanges(function.value());
+	const Instruction* argument = findAll(function.value(), OpCode::ARGUMENT)[0];
+	const Instruction* back = findAll(function.value(), OpCode::JUMP).back();
+	// n is used in the loop body, so it has to survive until the back edge
+	uint32_t lastJump = 0;
+	uint32_t position = 0;
+	for (const auto& block : function->mBlocks) {
+		for (uint32_t id : block.mInstructions) {
+			if (id == back->mId) lastJump = position;
+			position++;
+		}
+		position++;
+	}
+	EXPECT_TRUE(ranges[argument->mId].mLive);
+	EXPECT_GE(ranges[argument->mId].mEnd, lastJump);
+}
+
+TEST_F(IRTests, IRPrintFunction) {
+	std::optional<forest::ir::Function> function = lower("ui64 add(ui64 a, ui64 b) { ui64 sum = a + b; return sum; } i32 main(string[] argv) { return 0; }", "add");
+	ASSERT_TRUE(function.has_value());
+
+	std::stringstream ss;
+	ss << function.value();
+	std::string text = ss.str();
+	EXPECT_NE(text.find("function add -> ui64 {"), std::string::npos);
+	EXPECT_NE(text.find("%0 = argument ui64 0 ; a"), std::string::npos);
+	EXPECT_NE(text.find("%1 = argument ui64 1 ; b"), std::string::npos);
+	EXPECT_NE(text.find("%2 = op ui64 %0, %1 ; sum"), std::string::npos);
+	EXPECT_NE(text.find("return %2"), std::string::npos);
+}
@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+#include "Parser.hpp"
+#include "LoopInvariantCodeMotion.hpp"
+#include "ConstantPropagation.hpp"
+#include "DeadCodeElimination.hpp"
+#include "FunctionInlining.hpp"
+
+using namespace forest::parser;
+using namespace forest::optimiser;
+
+class OptimiserTests : public ::testing::Test {
+
+	void SetUp() override {
+
+	}
+
+	void TearDown() override {
+
+	}
+
+protected:
+	Parser parser;
+	Programme programme;
+
+	template <typename Pass = LoopInvariantCodeMotion>
+	Function& optimise(const std::string& code, const std::string& functionName) {
+		std::vector<Token> tokens = Tokeniser::parse(code, "testing.tree");
+		parser = Parser();
+		programme = parser.parse(tokens);
+		Pass pass;
+		pass.run(programme);
+		for (auto& function : programme.functions) {
+			if (function.mName == functionName)
+				return function;
+		}
+		throw std::runtime_error("Function not found");
+	}
+
+	// Constant propagation first, like the optimiser does, so conditions can be folded to literals
+	void eliminate(const std::string& code, const CompileContext& ctx = CompileContext()) {
+		std::vector<Token> tokens = Tokeniser::parse(code, "testing.tree");
+		parser = Parser();
+		programme = parser.parse(tokens);
+		ConstantPropagation constants;
+		constants.run(programme);
+		DeadCodeElimination dce(ctx);
+		dce.run(programme);
+	}
+
+	static const Statement* findLoop(const Block& block) {
+		for (const auto& statement : block.statements) {
+			if (statement.mType == Statement_Type::LOOP) return &statement;
+		}
+		return nullptr;
+	}
+
+	static std::vector<const Variable*> findTemporaries(const Block& block) {
+		std::vector<const Variable*> result;
+		for (const auto& statement : block.statements) {
+			if (statement.mType == Statement_Type::VAR_DECL_ASSIGN && statement.variable.value().mName.starts_with("$licm"))
+				result.push_back(&statement.variable.value());
+		}
+		return result;
+	}
+};
+
+TEST_F(OptimiserTests, LICMHoistsRangeMaximum) {
+	std::string code = "ui64 sum(ui64 n) { ui64 total = 0; loop i, 0..n * 2 { total = total + i; } return total; } i32 main(string[] argv) { return 0; }";
+	std::vector<Token> tokens = Tokeniser::parse(code, "testing.tree");
+	size_t originalStackMemory = Parser().parse(tokens).functions[0].mBody.stackMemory;
+	Function& function = optimise(code, "sum");
+
+	std::vector<const Variable*> temporaries = findTemporaries(function.mBody);
+	ASSERT_EQ(temporaries.size(), 1);
+	EXPECT_STREQ(temporaries[0]->mValues[0]->mValue.mText.c_str(), "*");
+
+	const Statement* loop = findLoop(function.mBody);
+	ASSERT_NE(loop, nullptr);
+	const Expression* maximum = loop->loopStatement.value().mRange.value().mMaximum;
+	EXPECT_EQ(maximum->mValue.mType, TokenType::IDENTIFIER);
+	EXPECT_EQ(maximum->mValue.mText, temporaries[0]->mName);
+	// The temporary has the type of the iterator, since that's the width it is compared at
+	EXPECT_EQ(temporaries[0]->mType.builtinType, loop->loopStatement.value().mIterator.value().mType.builtinType);
+	EXPECT_GT(function.mBody.stackMemory, originalStackMemory);
+}
+
+TEST_F(OptimiserTests, LICMHoistsInvariantOperandsFromBody) {
+	Function& function = optimise("ui64 sum(ui64 a, ui64 b) { ui64 total = 0; loop i, 0..10 { total = total + (a * b); } return total; } i32 main(string[] argv) { return 0; }", "sum");
+
+	std::vector<const Variable*> temporaries = findTemporaries(function.mBody);
+	ASSERT_EQ(temporaries.size(), 1);
+	EXPECT_STREQ(temporaries[0]->mValues[0]->mValue.mText.c_str(), "*");
+	EXPECT_EQ(temporaries[0]->mType.builtinType, Builtin_Type::UI64);
+
+	const Statement* loop = findLoop(function.mBody);
+	ASSERT_NE(loop, nullptr);
+	const Expression* value = loop->loopStatement.value().mBody.statements[0].variable.value().mValues[0];
+	ASSERT_EQ(value->mChildren.size(), 2);
+	EXPECT_EQ(value->mChildren[1]->mValue.mText, temporaries[0]->mName);
+}
+
+TEST_F(OptimiserTests, LICMKeepsVariantAndTrappingExpressions) {
+	Function& function = optimise("ui64 sum(ui64 a, ui64 b) { ui64 total = 0; loop i, 0..10 { a = a + 1; total = total + (a * b); total = total + (b / a); total = total + (61 - i); } return total; } i32 main(string[] argv) { return 0; }", "sum");
+	EXPECT_TRUE(findTemporaries(function.mBody).empty());
+}
+
+TEST_F(OptimiserTests, LICMHoistsOutOfNestedLoops) {
+	Function& function = optimise("ui64 sum(ui64 n) { ui64 total = 0; loop j, 0..10 { loop i, 0..n * 2 { total = total + i; } } return total; } i32 main(string[] argv) { return 0; }", "sum");
+
+	// The maximum of the inner loop doesn't depend on the outer loop either, so it ends up before the outer loop
+	std::vector<const Variable*> temporaries = findTemporaries(function.mBody);
+	ASSERT_EQ(temporaries.size(), 1);
+	const Statement* outer = findLoop(function.mBody);
+	ASSERT_NE(outer, nullptr);
+	EXPECT_TRUE(findTemporaries(outer->loopStatement.value().mBody).empty());
+}
+
+TEST_F(OptimiserTests, LICMKeepsGlobalsWhenLoopCallsFunctions) {
+	Function& function = optimise("ui64 g = 3; ui64 f() { return 1; } ui64 sum() { ui64 total = 0; loop i, 0..10 { ui64 x = f(); total = total + (g * 2); } return total; } i32 main(string[] argv) { return 0; }", "sum");
+	EXPECT_TRUE(findTemporaries(function.mBody).empty());
+
+	Function& withoutCall = optimise("ui64 g = 3; ui64 sum() { ui64 total = 0; loop i, 0..10 { total = total + (g * 2); } return total; } i32 main(string[] argv) { return 0; }", "sum");
+	EXPECT_EQ(findTemporaries(withoutCall.mBody).size(), 1);
+}
+
+TEST_F(OptimiserTests, ConstantPropagationFoldsAcrossStatements) {
+	Function& function = optimise<ConstantPropagation>("ui64 shifted() { ui64 window = 0xE000000000000000; window >>= 1; return window; } i32 main(string[] argv) { return 0; }", "shifted");
+
+	const auto& statements = function.mBody.statements;
+	ASSERT_EQ(statements.size(), 3);
+	EXPECT_EQ(statements[1].variable.value().mValues[0]->mValue.mText, "8070450532247928832");
+	EXPECT_EQ(statements[2].mContent->mValue.mType, TokenType::LITERAL);
+	EXPECT_EQ(statements[2].mContent->mValue.mText, "8070450532247928832");
+}
+
+TEST_F(OptimiserTests, ConstantPropagationWrapsToTheVariableType) {
+	Function& function = optimise<ConstantPropagation>("ui8 wrapped() { ui8 small = 200; small += 100; if (small < 50) { return small; } return 0; } i32 main(string[] argv) { return 0; }", "wrapped");
+
+	const auto& statements = function.mBody.statements;
+	ASSERT_EQ(statements.size(), 4);
+	EXPECT_EQ(statements[1].variable.value().mValues[0]->mValue.mText, "44");
+	EXPECT_EQ(statements[2].mContent->mValue.mText, "1");
+	EXPECT_EQ(statements[2].ifStatement.value().mBody.statements[0].mContent->mValue.mText, "44");
+}
+
+TEST_F(OptimiserTests, ConstantPropagationForgetsWhatLoopsAssign) {
+	Function& function = optimise<ConstantPropagation>("ui64 halve() { ui64 w = 64; ui64 n = 3; loop i, 0..n { w >>= 1; } return w + n; } i32 main(string[] argv) { return 0; }", "halve");
+
+	const auto& statements = function.mBody.statements;
+	ASSERT_EQ(statements.size(), 4);
+	const LoopStatement& loop = statements[2].loopStatement.value();
+	EXPECT_EQ(loop.mRange.value().mMaximum->mValue.mText, "3");
+	EXPECT_EQ(loop.mBody.statements[0].variable.value().mValues[0]->mValue.mText, ">>");
+	// n isn't assigned in the loop, but w is
+	const Expression* result = statements[3].mContent;
+	ASSERT_EQ(result->mChildren.size(), 2);
+	EXPECT_EQ(result->mChildren[0]->mValue.mText, "w");
+	EXPECT_EQ(result->mChildren[1]->mValue.mText, "n"); // A ui64 3 isn't the same operand as a literal 3, which is a byte
+}
+
+TEST_F(OptimiserTests, DCEKeepsOnlyTheTakenBranch) {
+	eliminate("ui64 pick() { ui64 debug = 0; if (debug == 1) { return 1; } else { return 2; } if (debug == 0) { ui64 x = 3; return x; } return 4; } i32 main(string[] argv) { return pick(); }");
+
+	const auto& statements = programme.functions[0].mBody.statements;
+	ASSERT_EQ(statements.size(), 2);
+	// The else body declares nothing, so it replaces the if, and nothing after its return is kept
+	EXPECT_EQ(statements[1].mType, Statement_Type::RETURN_CALL);
+	EXPECT_EQ(statements[1].mContent->mValue.mText, "2");
+}
+
+TEST_F(OptimiserTests, DCEKeepsScopedBranchesAsIf) {
+	eliminate("ui64 pick() { ui64 debug = 0; if (debug == 0) { ui64 x = 3; return x; } else { return 2; } return 4; } i32 main(string[] argv) { return pick(); }");
+
+	const auto& statements = programme.functions[0].mBody.statements;
+	ASSERT_EQ(statements.size(), 3);
+	ASSERT_EQ(statements[1].mType, Statement_Type::IF);
+	EXPECT_FALSE(statements[1].ifStatement.value().mElseBody.has_value());
+	EXPECT_EQ(statements[1].ifStatement.value().mBody.statements.size(), 2);
+	EXPECT_EQ(statements[2].mContent->mValue.mText, "4"); // The if body could still be skipped as far as this block knows
+}
+
+TEST_F(OptimiserTests, DCERemovesStatementsAfterBreak) {
+	eliminate("ui64 first(ui64 n) { ui64 total = 0; loop i, 0..n { total = i; break; total = 7; } return total; total = 8; } i32 main(string[] argv) { return first(3); }");
+
+	const auto& statements = programme.functions[0].mBody.statements;
+	ASSERT_EQ(statements.size(), 3);
+	EXPECT_EQ(statements[1].loopStatement.value().mBody.statements.size(), 2);
+	EXPECT_EQ(statements[1].loopStatement.value().mBody.statements[1].mType, Statement_Type::BREAK);
+	EXPECT_EQ(statements[2].mType, Statement_Type::RETURN_CALL);
+}
+
+TEST_F(OptimiserTests, DCERemovesFunctionsUnreachableFromMain) {
+	eliminate("ui64 helper() { return 1; } ui64 unused() { return 2; } ui64 unusedToo() { return unused(); } ui64 deeper() { return helper(); } void called() { return; } i32 main(string[] argv) { ui64 x = deeper(); called(); return 0; }");
+
+	std::vector<std::string> names;
+	for (const auto& function : programme.functions) {
+		names.push_back(function.mName);
+	}
+	EXPECT_EQ(names, std::vector<std::string>({"helper", "deeper", "called", "main"}));
+}
+
+TEST_F(OptimiserTests, InliningReplacesCallWithBody) {
+	std::string code = "ui64 square(ui8 v) { ui64 wide = v; return wide * wide; } i32 main(string[] argv) { ui64 x = 300; ui64 y = square(x + 1); return 0; }";
+	std::vector<Token> tokens = Tokeniser::parse(code, "testing.tree");
+	size_t originalStackMemory = Parser().parse(tokens).functions[1].mBody.stackMemory;
+	Function& function = optimise<FunctionInlining>(code, "main");
+
+	const auto& statements = function.mBody.statements;
+	ASSERT_EQ(statements.size(), 5);
+	// The argument is stored at the size of the parameter, like the call did
+	const Variable& parameter = statements[1].variable.value();
+	EXPECT_EQ(parameter.mName, "$inline0_v");
+	EXPECT_EQ(parameter.mType.builtinType, Builtin_Type::UI8);
+	EXPECT_EQ(parameter.mValues[0]->mValue.mText, "+");
+	EXPECT_EQ(statements[2].variable.value().mName, "$inline0_wide");
+	EXPECT_EQ(statements[2].variable.value().mValues[0]->mValue.mText, "$inline0_v");
+	const Expression* value = statements[3].variable.value().mValues[0];
+	EXPECT_EQ(value->mValue.mText, "*");
+	EXPECT_EQ(value->mChildren[0]->mValue.mText, "$inline0_wide");
+	EXPECT_GT(function.mBody.stackMemory, originalStackMemory);
+}
+
+TEST_F(OptimiserTests, InliningSkipsCallsAndEarlyReturns) {
+	Function& function = optimise<FunctionInlining>("ui64 leaf(ui64 v) { return v + 1; } ui64 caller(ui64 v) { ui64 r = leaf(v); return r; } ui64 early(ui64 v) { if (v > 3) { return 3; } return v; } "
+		"i32 main(string[] argv) { ui64 a = caller(1); ui64 b = early(5); return 0; }", "main");
+
+	const auto& statements = function.mBody.statements;
+	ASSERT_EQ(statements.size(), 3);
+	EXPECT_EQ(statements[0].variable.value().mValues[0]->mValue.mText, "("); // caller calls leaf
+	EXPECT_EQ(statements[1].variable.value().mValues[0]->mValue.mText, "("); // early returns from inside an if
+	// leaf itself was inlined into caller
+	EXPECT_EQ(programme.functions[1].mBody.statements[1].variable.value().mValues[0]->mValue.mText, "+");
+}
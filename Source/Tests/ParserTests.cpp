@@ -330,6 +330,26 @@ TEST_F(ParserTests, ParserExpressionCollapse4Modulo3) {
 	EXPECT_STREQ(expression->mValue.mText.c_str(), "1");
 }
 
+TEST_F(ParserTests, ParserExpressionCollapseFloatDivision) {
+	std::vector<Token> tokens = Tokeniser::parse("(10.0 / 4) + 0.125;", "testing.tree");
+	parser.mCurrentToken = tokens.begin();
+	parser.mTokensEnd = tokens.end();
+
+	Statement s;
+	s.mType = Statement_Type::VAR_DECLARATION;
+	Expression* expression = parser.expectExpression(s);
+	ASSERT_NE(expression, nullptr);
+	expression->Collapse();
+
+	ASSERT_NE(expression, nullptr);
+	ASSERT_EQ(expression->mChildren[0], nullptr);
+	ASSERT_EQ(expression->mChildren[1], nullptr);
+
+	EXPECT_EQ(expression->mValue.mType, TokenType::LITERAL);
+	EXPECT_EQ(expression->mValue.mSubType, TokenSubType::FLOAT_LITERAL);
+	EXPECT_STREQ(expression->mValue.mText.c_str(), "2.625");
+}
+
 TEST_F(ParserTests, ParserExpressionCollapse3TimesString) {
 	std::vector<Token> tokens = Tokeniser::parse("3 * \"Hello\";", "testing.tree");
 	parser.mCurrentToken = tokens.begin();
@@ -350,6 +370,22 @@ TEST_F(ParserTests, ParserExpressionCollapse3TimesString) {
 	EXPECT_STREQ(expression->mValue.mText.c_str(), "HelloHelloHello");
 }
 
+TEST_F(ParserTests, ParserExpressionsLiveInTheProgrammeArena) {
+	std::vector<Token> tokens = Tokeniser::parse("i32 main(string[] argv) { ui64 x = 4 + 1; return 0; }", "testing.tree");
+	Programme programme = parser.parse(tokens);
+	parser = Parser();
+
+	ASSERT_NE(programme.arena, nullptr);
+	EXPECT_GE(programme.arena->size(), 3);
+
+	const Statement& declaration = programme.functions[0].mBody.statements[0];
+	ASSERT_TRUE(declaration.variable.has_value());
+	Variable copy = declaration.variable.value();
+	ASSERT_EQ(copy.mValues.size(), 1);
+	EXPECT_EQ(copy.mValues[0], declaration.variable.value().mValues[0]); // Copies share the nodes instead of cloning them
+	EXPECT_STREQ(copy.mValues[0]->mValue.mText.c_str(), "5");
+}
+
 TEST_F(ParserTests, ParserTryParseReturnStatement) {
 	std::vector<Token> tokens = Tokeniser::parse("return 0;", "testing.tree");
 	parser.mCurrentToken = tokens.begin();
@@ -788,3 +824,118 @@ TEST_F(ParserTests, ParserTryParseBadAlignedStruct) {
 	ASSERT_EQ(sf3.mNames.size(), 1);
 	EXPECT_STREQ(sf3.mNames[0].c_str(), "val3");
 }
+
+TEST_F(ParserTests, ParserTryParseReorderedStruct) {
+	std::vector<Token> tokens = Tokeniser::parse("reordered struct Test { ui8 val1; ui64 val2; ui16 val3; ui32 val4; }", "testing.tree");
+	parser.mCurrentToken = tokens.begin();
+	parser.mTokensEnd = tokens.end();
+
+	std::optional<Struct> s = parser.expectStruct();
+	ASSERT_TRUE(s.has_value());
+
+	Struct st = s.value();
+	EXPECT_EQ(st.mSize, 15);
+	EXPECT_TRUE(st.mReordered);
+
+	// Fields stay in declaration order, only their offsets are sorted by alignment
+	ASSERT_EQ(st.mFields.size(), 4);
+	EXPECT_STREQ(st.mFields[0].mNames[0].c_str(), "val1");
+	EXPECT_EQ(st.mFields[0].mOffset, 14);
+	EXPECT_EQ(st.mFields[1].mOffset, 0);
+	EXPECT_EQ(st.mFields[2].mOffset, 12);
+	EXPECT_EQ(st.mFields[3].mOffset, 8);
+}
+
+TEST_F(ParserTests, ParserTryParseReinterpretedStruct) {
+	std::vector<Token> tokens = Tokeniser::parse("ui8[16] s_buffer; struct Test { ui8 val1; ui64 val2; } reordered struct Other { ui8 val1; ui64 val2; }"
+		" ui8 main() { Test t = @(\\s_buffer); Other o = @(\\s_buffer); return 0; }", "testing.tree");
+
+	Programme programme = parser.parse(tokens);
+	ASSERT_TRUE(programme.structs.contains("Test"));
+	ASSERT_TRUE(programme.structs.contains("Other"));
+
+	// Reading a struct out of raw memory doesn't change its layout, other translation units only see the declaration
+	const Struct& st = programme.structs.at("Test");
+	EXPECT_FALSE(st.mReordered);
+	EXPECT_EQ(st.mFields[0].mOffset, 0);
+	EXPECT_EQ(st.mFields[1].mOffset, 1);
+	const Struct& other = programme.structs.at("Other");
+	EXPECT_TRUE(other.mReordered);
+	EXPECT_EQ(other.mFields[0].mOffset, 8);
+	EXPECT_EQ(other.mFields[1].mOffset, 0);
+}
+
+TEST_F(ParserTests, ParserTryParseSoAStruct) {
+	std::vector<Token> tokens = Tokeniser::parse("#soa struct Particle { ui8 alive; f32 x; } ui8 main() { Particle[8] ps; ps[2].x = 1.5; return 0; }", "testing.tree");
+
+	Programme programme = parser.parse(tokens);
+	ASSERT_TRUE(programme.structs.contains("Particle"));
+	EXPECT_TRUE(programme.structs.at("Particle").mSoA);
+	EXPECT_EQ(programme.structs.at("Particle").mSize, 5);
+
+	ASSERT_EQ(programme.functions.size(), 1);
+	const std::vector<Statement>& statements = programme.functions[0].mBody.statements;
+	ASSERT_GE(statements.size(), 2);
+	ASSERT_TRUE(statements[1].variable.has_value());
+	EXPECT_EQ(statements[1].mType, Statement_Type::VAR_ASSIGNMENT);
+	EXPECT_STREQ(statements[1].variable.value().mName.c_str(), "ps.x");
+	ASSERT_NE(statements[1].mContent, nullptr);
+	EXPECT_STREQ(statements[1].mContent->mValue.mText.c_str(), "2");
+}
+
+TEST_F(ParserTests, ParserTryParseVectorAndMatrixTypes) {
+	std::vector<Token> tokens = Tokeniser::parse("vec3<i32> mat2x3<i16>", "testing.tree");
+	parser.mCurrentToken = tokens.begin();
+	parser.mTokensEnd = tokens.end();
+
+	std::optional<Type> vector = parser.expectType();
+	ASSERT_TRUE(vector.has_value());
+	EXPECT_EQ(vector->builtinType, Builtin_Type::VECTOR);
+	EXPECT_STREQ(vector->name.c_str(), "vec3<i32>");
+	EXPECT_EQ(vector->byteSize, 16);
+	EXPECT_EQ(vector->alignTo, 16);
+	ASSERT_EQ(vector->subTypes.size(), 1);
+	EXPECT_EQ(vector->subTypes[0].builtinType, Builtin_Type::I32);
+
+	const Struct& lanes = parser.structs.at("vec3<i32>");
+	ASSERT_EQ(lanes.mFields.size(), 3);
+	EXPECT_EQ(lanes.getIndexOfProperty("z"), 2);
+	EXPECT_EQ(lanes.getIndexOfProperty("b"), 2);
+	EXPECT_EQ(lanes.mFields[2].mOffset, 8);
+
+	std::optional<Type> matrix = parser.expectType();
+	ASSERT_TRUE(matrix.has_value());
+	EXPECT_EQ(matrix->builtinType, Builtin_Type::MATRIX);
+	EXPECT_STREQ(matrix->name.c_str(), "mat2x3<i16>");
+	EXPECT_EQ(matrix->byteSize, 16);
+	EXPECT_EQ(matrix->alignTo, 8);
+
+	const Struct& elements = parser.structs.at("mat2x3<i16>");
+	ASSERT_EQ(elements.mFields.size(), 6);
+	EXPECT_EQ(elements.getIndexOfProperty("m12"), 5);
+	EXPECT_EQ(elements.mFields[5].mOffset, 12);
+}
+
+TEST_F(ParserTests, ParserTryParsePackedBoolArray) {
+	std::vector<Token> tokens = Tokeniser::parse("bool[100] flags = {1, 0, 1};", "testing.tree");
+	parser.mCurrentToken = tokens.begin();
+	parser.mTokensEnd = tokens.end();
+
+	std::optional<Statement> statement = parser.expectStatement();
+	ASSERT_TRUE(statement.has_value());
+	ASSERT_TRUE(statement.value().variable.has_value());
+	const Type& type = statement.value().variable.value().mType;
+
+	EXPECT_EQ(type.builtinType, Builtin_Type::ARRAY);
+	EXPECT_STREQ(type.name.c_str(), "bool[100]");
+	EXPECT_TRUE(Parser::isPacked(type));
+	// 100 flags take two qwords
+	EXPECT_EQ(type.byteSize, 16);
+	EXPECT_EQ(type.alignTo, 8);
+	EXPECT_EQ(Parser::getLength(type), 100);
+
+	Type bytes = Parser::getArrayType("ui8[]", Type {"ui8", Builtin_Type::UI8, {}, 1, 1}, 100);
+	EXPECT_FALSE(Parser::isPacked(bytes));
+	EXPECT_EQ(bytes.byteSize, 100);
+	EXPECT_EQ(Parser::getLength(bytes), 100);
+}
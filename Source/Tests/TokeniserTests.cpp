@@ -180,6 +180,33 @@ TEST_F(TokeniserTests, TokeniserParseShouldTokeniseNamespace) {
 	EXPECT_STREQ(third.mText.c_str(), "function");
 }
 
+TEST_F(TokeniserTests, TokeniserParseShouldShareFileNameAndKeepOffsets) {
+	std::string code = "ui64 value_2 = \"a b\"; // done\nx1";
+	std::vector<Token> tokens = forest::parser::Tokeniser::parse(code, filePath);
+
+	ASSERT_EQ(tokens.size(), 6);
+
+	Token second = tokens[1];
+	EXPECT_EQ(second.mSubType, TokenSubType::USER_DEFINED);
+	EXPECT_STREQ(second.mText.c_str(), "value_2");
+	EXPECT_EQ(second.mStartOffset, 6);
+	EXPECT_EQ(second.mEndOffset, 13);
+
+	Token fourth = tokens[3];
+	EXPECT_EQ(fourth.mSubType, TokenSubType::STRING_LITERAL);
+	EXPECT_STREQ(fourth.mText.c_str(), "a b");
+
+	Token last = tokens[5];
+	EXPECT_STREQ(last.mText.c_str(), "x1");
+	EXPECT_EQ(last.mLineNumber, 2);
+	EXPECT_EQ(last.mStartOffset, 1);
+
+	std::vector<Token> again = forest::parser::Tokeniser::parse(code, filePath);
+	EXPECT_EQ(tokens[0].file, again[0].file);
+	EXPECT_EQ(tokens[0].file, last.file);
+	EXPECT_STREQ(tokens[0].file->c_str(), "testing_file.tree");
+}
+
 TEST_F(TokeniserTests, TokeniserEndTokenShouldConvertSubtypes) {
 	std::vector<Token> tokens;
 
@@ -2,13 +2,32 @@
 #include <stdexcept>
 #include <iostream>
 #include <sstream>
+#include <mutex>
+#include <set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "Tokeniser.hpp"
 
 namespace forest::parser {
-	std::vector<Token> Tokeniser::parse(const std::string &inProgram, const std::string& fileName) {
+	namespace {
+		bool isIdentifierChar(char c) {
+			return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+		}
+
+		// Length of the run starting at `from` up to (not including) the first character in `stops`
+		size_t runLength(std::string_view text, size_t from, std::string_view stops) {
+			size_t stop = text.find_first_of(stops, from);
+			return (stop == std::string_view::npos ? text.size() : stop) - from;
+		}
+	}
+
+	std::vector<Token> Tokeniser::parse(std::string_view inProgram, const std::string& fileName) {
 		std::vector<Token> tokens;
+		tokens.reserve(inProgram.size() / 8);
 		Token currentToken;
-		currentToken.file = fileName;
+		currentToken.file = intern(fileName);
 		
 		int start = 0;
 		int end = 0;
@@ -17,9 +36,7 @@ namespace forest::parser {
 			char currChar = inProgram[i];
 			start++;
 			end++;
-			Token lastToken {};
-			if (!tokens.empty())
-				lastToken = tokens.back();
+			TokenSubType lastSubType = tokens.empty() ? TokenSubType::NOTHING : tokens.back().mSubType;
 
 			if (currentToken.mType == TokenType::STRING_ESCAPE_SEQUENCE || currentToken.mType == TokenType::CHAR_ESCAPE_SEQUENCE) {
 				switch (currChar) {
@@ -48,7 +65,12 @@ namespace forest::parser {
 				currentToken.mEndOffset = end + 1;
 				continue;
 			} else if (currentToken.mSubType == TokenSubType::STRING_LITERAL && currChar != '\\' && currChar != '"') {
-				currentToken.mText.append(1, currChar);
+				// Take everything up to the next quote or escape in one go
+				size_t length = runLength(inProgram, i, "\\\"");
+				currentToken.mText.append(inProgram.substr(i, length));
+				start += int(length) - 1;
+				end += int(length) - 1;
+				i += length - 1;
 				continue;
 			} else if (currentToken.mSubType == TokenSubType::CHAR_LITERAL && currChar != '\\' && currChar != '\'') {
 				currentToken.mText.append(1, currChar);
@@ -70,7 +92,11 @@ namespace forest::parser {
 				}
 				continue;
 			} else if (currentToken.mType == TokenType::SINGLELINE_COMMENT && currChar != '\n') {
-				currentToken.mText.append(1, currChar);
+				size_t length = runLength(inProgram, i, "\n");
+				currentToken.mText.append(inProgram.substr(i, length));
+				start += int(length) - 1;
+				end += int(length) - 1;
+				i += length - 1;
 				continue;
 			} else if (currentToken.mType == TokenType::POTENTIAL_NEGATIVE_NUMBER && !isdigit(currChar)) {
 				currentToken.mType = TokenType::OPERATOR;
@@ -113,7 +139,7 @@ namespace forest::parser {
 					}
 					break;
 				case '.':
-					if ((currentToken.mType == TokenType::NOTHING || currentToken.mType == TokenType::IDENTIFIER || currentToken.mType == TokenType::OPERATOR) && lastToken.mSubType != TokenSubType::DOT) {
+					if ((currentToken.mType == TokenType::NOTHING || currentToken.mType == TokenType::IDENTIFIER || currentToken.mType == TokenType::OPERATOR) && lastSubType != TokenSubType::DOT) {
 						endToken(currentToken, tokens);
 						currentToken.mType = TokenType::OPERATOR;
 						currentToken.mSubType = TokenSubType::DOT;
@@ -134,7 +160,7 @@ namespace forest::parser {
 						currentToken.mEndOffset = end + 1;
 						currentToken.mText.append(2, currChar);
 						endToken(currentToken, tokens);
-					} else if (lastToken.mSubType == TokenSubType::DOT) { // A 2nd dot -> range operator
+					} else if (lastSubType == TokenSubType::DOT) { // A 2nd dot -> range operator
 						tokens.pop_back();
 						currentToken.mText.append(2, currChar);
 						currentToken.mType = TokenType::OPERATOR;
@@ -467,6 +493,17 @@ namespace forest::parser {
 						currentToken.mText.append(1, currChar);
 						currentToken.mEndOffset = end + 1;
 					}
+					if (currentToken.mType == TokenType::IDENTIFIER) {
+						// The rest of the identifier can't change the token, so slice it off at once
+						size_t length = 0;
+						while (i + 1 + length < inProgram.size() && isIdentifierChar(inProgram[i + 1 + length]))
+							length++;
+						currentToken.mText.append(inProgram.substr(i + 1, length));
+						start += int(length);
+						end += int(length);
+						i += length;
+						currentToken.mEndOffset = end + 1;
+					}
 					break;
 			}
 		}
@@ -475,6 +512,44 @@ namespace forest::parser {
 		return tokens;
 	}
 
+	std::vector<Token> Tokeniser::parseFile(const std::string& fileName) {
+		int fd = open(fileName.c_str(), O_RDONLY);
+		if (fd == -1)
+			return parse(std::string_view(), fileName);
+
+		struct stat info{};
+		if (fstat(fd, &info) == -1 || info.st_size == 0) {
+			close(fd);
+			return parse(std::string_view(), fileName);
+		}
+
+		size_t size = info.st_size;
+		void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED) {
+			std::cerr << "Could not map file '" << fileName << "' into memory" << std::endl;
+			throw std::runtime_error("Tokeniser error");
+		}
+		madvise(mapping, size, MADV_SEQUENTIAL);
+
+		std::vector<Token> tokens;
+		try {
+			tokens = parse(std::string_view(static_cast<const char*>(mapping), size), fileName);
+		} catch (...) {
+			munmap(mapping, size);
+			throw;
+		}
+		munmap(mapping, size);
+		return tokens;
+	}
+
+	const std::string* Tokeniser::intern(const std::string& fileName) {
+		static std::mutex mutex;
+		static std::set<std::string> names;
+		std::lock_guard<std::mutex> lock(mutex);
+		return &*names.insert(fileName).first;
+	}
+
 	void Tokeniser::endToken(Token& currentToken, std::vector<Token>& tokens) {
 		if (currentToken.mType == TokenType::IDENTIFIER) {
 			if (currentToken.mText == "return") {
@@ -515,12 +590,12 @@ namespace forest::parser {
 		mStartOffset = 0;
 		mEndOffset = 0;
 		mLineNumber = 1;
-		file = "";
+		file = nullptr;
 	}
 
 	void Token::debugPrint() const {
 		std::cout << "Token (" << TokenTypes[int(mType)] << ", " << TokenSubTypes[int(mSubType)]
-		<< ", \"" << mText << "\" " << file << ":" << mLineNumber << ":" << mStartOffset << "-" << mEndOffset << ")"
+		<< ", \"" << mText << "\" " << (file ? *file : "") << ":" << mLineNumber << ":" << mStartOffset << "-" << mEndOffset << ")"
 		<< std::endl;
 	}
 
@@ -529,7 +604,7 @@ namespace forest::parser {
 	}
 
 	std::ostream& operator<<(std::ostream& os, const Token& t) {
-		os << t.file << ":" << t.mLineNumber << ":" << t.mStartOffset ;
+		os << (t.file ? *t.file : "") << ":" << t.mLineNumber << ":" << t.mStartOffset ;
 		return os;
 	}
 
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace forest::parser {
 
@@ -82,7 +83,7 @@ namespace forest::parser {
 		size_t mStartOffset{0};
 		size_t mEndOffset{0};
 		size_t mLineNumber{1};
-		std::string file{};
+		const std::string* file{}; // Interned by the Tokeniser, so tokens from the same file share one name
 
 		Token();
 
@@ -94,10 +95,13 @@ namespace forest::parser {
 
 	class Tokeniser {
 	public:
-		static std::vector<Token> parse(const std::string& inProgram, const std::string& fileName);
+		static std::vector<Token> parse(std::string_view inProgram, const std::string& fileName);
+		// Maps the file into memory and tokenises it in place, without reading it into a string first
+		static std::vector<Token> parseFile(const std::string& fileName);
+		static const std::string* intern(const std::string& fileName);
 
 		static void endToken(Token& token, std::vector<Token>& tokens);
-		inline static size_t mLine;
+		inline static thread_local size_t mLine; // Per thread, so translation units can be tokenised in parallel
 	};
 
 	std::ostream& operator<<(std::ostream&, const Token&);
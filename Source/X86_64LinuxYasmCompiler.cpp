@@ -2,8 +2,13 @@
 #include <fstream>
 #include <map>
 #include <algorithm>
+#include <bit>
+#include <charconv>
+#include <functional>
 #include <iostream>
 #include "X86_64LinuxYasmCompiler.hpp"
+#include "Assembler.hpp"
+#include "Peephole.hpp"
 
 X86_64LinuxYasmCompiler::X86_64LinuxYasmCompiler() {
 	syscallTable = {
@@ -353,8 +358,20 @@ X86_64LinuxYasmCompiler::X86_64LinuxYasmCompiler() {
 
 
 int X86_64LinuxYasmCompiler::addToSymbols(int* offset, const Variable& variable, const std::string& reg, bool isGlobal) {
+	const Type& scalar = variable.mType.builtinType == Builtin_Type::ARRAY && !variable.mType.subTypes.empty() ? variable.mType.subTypes[0] : variable.mType;
+	if (scalar.builtinType == Builtin_Type::F8 || scalar.builtinType == Builtin_Type::F16) {
+		std::cerr << "[X86_64 Compiler]: ERROR: Variable '" << variable.mName << "' is a " << scalar.name << ", x86-64 only has instructions for f32 and f64" << std::endl;
+		exit(1);
+	}
 	int result = getSizeFromType(variable.mType);
 
+	auto assigned = registerAssignments.find(&variable);
+	if (!isGlobal && assigned != registerAssignments.end()) {
+		// Lives in a register for its entire lifetime, so it takes no stack space
+		symbolTable.insert(std::make_pair(variable.mName, SymbolInfo {assigned->second, 0, variable.mType, result, false, true}));
+		return result;
+	}
+
 	if (!isGlobal) {
 		std::string checkReg = reg.substr(0, 3);
 		char op = reg.size() == 4 ? reg[3] : '-';
@@ -371,6 +388,273 @@ int X86_64LinuxYasmCompiler::addToSymbols(int* offset, const Variable& variable,
 	return result;
 }
 
+std::vector<std::string> X86_64LinuxYasmCompiler::getSavedRegisters() {
+	std::vector<std::string> result;
+	for (const char* reg : RegisterAllocator::c_Registers) {
+		for (const auto& kv : registerAssignments) {
+			if (kv.second == reg) {
+				result.emplace_back(reg);
+				break;
+			}
+		}
+	}
+	return result;
+}
+
+void X86_64LinuxYasmCompiler::printRegisterStore(std::ostream& outfile, const SymbolInfo& symbol, const std::string& source) {
+	bool sign = symbol.type.name[0] == 'i'; // This might cause a problem later with user-defined types starting with i
+	if (symbol.size < 2)
+		outfile << "	" << (sign ? "movsx " : "movzx ") << symbol.reg << ", " << getRegister(source, symbol.size) << std::endl;
+	else if (symbol.size == 2 && sign)
+		outfile << "	movsxd " << symbol.reg << ", " << getRegister(source, symbol.size) << std::endl;
+	else
+		outfile << "	mov " << getRegister(symbol.reg.substr(1), symbol.size) << ", " << getRegister(source, symbol.size) << std::endl;
+}
+
+int X86_64LinuxYasmCompiler::printSaveRegisters(std::ostream& outfile, const std::vector<std::string>& registers) {
+	for (const auto& reg : registers) {
+		outfile << "\tpush " << reg << std::endl;
+	}
+	// Keep the stack 16-byte aligned like it was without the saved registers
+	int saveSize = nearestMultipleOf(int(registers.size()) * 8, 16);
+	if (saveSize != int(registers.size()) * 8)
+		outfile << "\tsub rsp, 8" << std::endl;
+	return -saveSize;
+}
+
+std::optional<std::string> X86_64LinuxYasmCompiler::getConstantArray(const Variable& variable) {
+	if (variable.mType.builtinType != Builtin_Type::ARRAY || variable.mType.subTypes.empty()) return std::nullopt;
+	auto found = constantArrays.find(&variable);
+	if (found != constantArrays.end()) return found->second;
+
+	const Type& element = variable.mType.subTypes[0];
+	if (element.byteSize == 0 || variable.mValues.size() != Parser::getLength(variable.mType)) return std::nullopt;
+	bool packed = Parser::isPacked(variable.mType);
+	std::vector<uint64_t> words(packed ? variable.mType.byteSize / 8 : 0);
+	std::stringstream values;
+	for (size_t i = 0; i < variable.mValues.size(); i++) {
+		const Expression* value = variable.mValues[i];
+		if (value == nullptr || !value->isLeaf()) return std::nullopt;
+		const Token& token = value->mValue;
+		if (packed) {
+			if (token.mSubType != TokenSubType::INTEGER_LITERAL && token.mSubType != TokenSubType::BOOLEAN_LITERAL) return std::nullopt;
+			if (std::stoll(token.mText, nullptr, 0) != 0)
+				words[i / 64] |= uint64_t(1) << (i % 64);
+			continue;
+		}
+		if (i > 0)
+			values << ", ";
+		if (token.mSubType == TokenSubType::FLOAT_LITERAL || (isFloat(element.builtinType) && token.mSubType == TokenSubType::INTEGER_LITERAL)) {
+			// Truncating a float into an integer element is left to the code that does it at runtime
+			if (!isFloat(element.builtinType)) return std::nullopt;
+			values << getFloatBits(token.mText, element.builtinType);
+		} else if (token.mSubType == TokenSubType::INTEGER_LITERAL || token.mSubType == TokenSubType::BOOLEAN_LITERAL) {
+			values << token.mText;
+		} else if (token.mSubType == TokenSubType::CHAR_LITERAL) {
+			values << int(token.mText[0]);
+		} else {
+			return std::nullopt;
+		}
+	}
+	for (size_t i = 0; i < words.size(); i++) {
+		values << (i > 0 ? ", " : "") << "0x" << std::hex << words[i] << std::dec;
+	}
+	std::string label = "constant_array" + std::to_string(constantArrays.size() + 1);
+	readOnlyData << "\t" << label << " " << getDefineBytes(packed ? 8 : element.byteSize) << " " << values.str() << "; " << variable.mName << std::endl;
+	constantArrays[&variable] = label;
+	return label;
+}
+
+void X86_64LinuxYasmCompiler::printBlockCopy(std::ostream& outfile, const VectorLocation& source, const VectorLocation& destination, size_t byteSize) {
+	const char* sizes[] = {"byte", "word", "dword", "qword"};
+	int copied = 0;
+	for (const auto& [chunk, size] : getVectorChunks(byteSize)) {
+		printVectorMove(outfile, 0, source.at(chunk), size, false);
+		printVectorMove(outfile, 0, destination.at(chunk), size, true);
+		copied = chunk + size;
+	}
+	// What is left of arrays of bytes and words
+	for (int size : {1, 0}) {
+		if (int(byteSize) - copied < (1 << size)) continue;
+		outfile << "\tmov " << getRegister("a", size) << ", " << sizes[size] << " " << source.at(copied) << std::endl;
+		outfile << "\tmov " << sizes[size] << " " << destination.at(copied) << ", " << getRegister("a", size) << std::endl;
+		copied += 1 << size;
+	}
+}
+
+std::string X86_64LinuxYasmCompiler::printBitWord(std::ostream& outfile, const std::string& name, const std::string& index) {
+	const SymbolInfo& array = symbolTable[name];
+	std::string start = VectorLocation {array.reg, array.offset}.at(0);
+	std::string address = "qword " + start.substr(0, start.size() - (array.offset == 0 ? 3 : 1)) + "+r10*8]";
+	outfile << "\tmov r10, " << index << std::endl;
+	outfile << "\tshr r10, 6" << std::endl;
+	outfile << "\tmov r12, " << address << "; packed bool array " << name << std::endl;
+	return address;
+}
+
+void X86_64LinuxYasmCompiler::printBitStore(std::ostream& outfile, const std::string& name, const Expression* value) {
+	std::string address = printBitWord(outfile, name, "r11");
+	const Token& token = value->mValue;
+	if (value->isLeaf() && (token.mSubType == TokenSubType::BOOLEAN_LITERAL || token.mSubType == TokenSubType::INTEGER_LITERAL)) {
+		outfile << "\t" << (std::stoll(token.mText, nullptr, 0) != 0 ? "bts" : "btr") << " r12, r11" << std::endl;
+	} else {
+		// Both outcomes and then a conditional move, there is no telling which way a branch on the flags would go
+		outfile << "\tmov rbx, r12" << std::endl;
+		outfile << "\tbts rbx, r11" << std::endl;
+		outfile << "\tbtr r12, r11" << std::endl;
+		outfile << "\ttest al, al" << std::endl;
+		outfile << "\tcmovnz r12, rbx" << std::endl;
+	}
+	outfile << "\tmov " << address << ", r12; packed bool array " << name << std::endl;
+}
+
+void X86_64LinuxYasmCompiler::printBitReduction(std::ostream& outfile, const Expression* expression) {
+	const std::string& function = expression->mChildren[0]->mValue.mText;
+	std::vector<const Expression*> arguments = getArguments(expression);
+	auto symbol = arguments.size() == 1 && arguments[0]->mValue.mType == TokenType::IDENTIFIER ? symbolTable.find(arguments[0]->mValue.mText) : symbolTable.end();
+	if (symbol == symbolTable.end() || !Parser::isPacked(symbol->second.type)) {
+		std::cerr << "[X86_64 Compiler]: ERROR: " << function << " takes a bool array" << std::endl;
+		exit(1);
+	}
+	const SymbolInfo& array = symbol->second;
+	VectorLocation start {array.reg, array.offset};
+	size_t length = Parser::getLength(array.type);
+	size_t words = length / 64;
+	auto accumulate = [&](const std::string& word) {
+		if (function == "count") {
+			outfile << "\tpopcnt r12, " << word << std::endl;
+			outfile << "\tadd rax, r12" << std::endl;
+		} else {
+			outfile << "\t" << (function == "any" ? "or" : "and") << " rax, " << word << std::endl;
+		}
+	};
+
+	outfile << "\tmov rax, " << (function == "all" ? "-1" : "0") << "; " << function << " " << symbol->first << std::endl;
+	if (words <= 4) {
+		for (size_t i = 0; i < words; i++) {
+			accumulate("qword " + start.at(int(i) * 8));
+		}
+	} else {
+		std::string label = ".bit_label" + std::to_string(++labelCount);
+		std::string address = start.at(0);
+		outfile << "\tmov r11, 0" << std::endl;
+		outfile << label << ":" << std::endl;
+		accumulate("qword " + address.substr(0, address.size() - (array.offset == 0 ? 3 : 1)) + "+r11*8]");
+		outfile << "\tinc r11" << std::endl;
+		outfile << "\tcmp r11, " << words << std::endl;
+		outfile << "\tjl " << label << std::endl;
+	}
+	if (length % 64 != 0) {
+		// The bits past the end of the array are never written, all sets them and the others clear them
+		uint64_t mask = (uint64_t(1) << (length % 64)) - 1;
+		outfile << "\tmov r12, qword " << start.at(int(words) * 8) << std::endl;
+		outfile << "\tmov r10, 0x" << std::hex << (function == "all" ? ~mask : mask) << std::dec << std::endl;
+		outfile << "\t" << (function == "all" ? "or" : "and") << " r12, r10" << std::endl;
+		accumulate("r12");
+	}
+	if (function == "any") {
+		outfile << "\ttest rax, rax" << std::endl;
+		outfile << "\tsetnz al" << std::endl;
+		outfile << "\tmovzx rax, al" << std::endl;
+	} else if (function == "all") {
+		outfile << "\tcmp rax, -1" << std::endl;
+		outfile << "\tsete al" << std::endl;
+		outfile << "\tmovzx rax, al" << std::endl;
+	}
+}
+
+bool X86_64LinuxYasmCompiler::isBitReduction(const Programme& p, const Expression* call) {
+	if (call->mChildren.size() < 2 || call->mChildren[1]->mValue.mText != "(") return false;
+	const std::string& name = call->mChildren[0]->mValue.mText;
+	return (name == "count" || name == "any" || name == "all") && findCallee(p, call) == nullptr;
+}
+
+const StructField* X86_64LinuxYasmCompiler::findElementField(const Programme& p, const Expression* expression) {
+	if (expression->mValue.mText != "." || expression->mChildren.size() != 2) return nullptr;
+	const Expression* indexing = expression->mChildren[0];
+	if (indexing->mValue.mText != "[" || indexing->mChildren.size() != 2) return nullptr;
+	auto symbol = symbolTable.find(indexing->mChildren[0]->mValue.mText);
+	if (symbol == symbolTable.end()) return nullptr;
+	const Type& type = symbol->second.type;
+	if (type.builtinType != Builtin_Type::ARRAY || type.subTypes.empty() || type.subTypes[0].builtinType != Builtin_Type::STRUCT) return nullptr;
+	return findField(p, type.subTypes[0], expression->mChildren[1]->mValue.mText);
+}
+
+std::string X86_64LinuxYasmCompiler::getElementFieldAddress(std::ostream& outfile, const Programme& p, const std::string& name, const StructField& field, const std::string& index) {
+	const SymbolInfo& array = symbolTable[name];
+	const Struct& s = p.structs.at(array.type.subTypes[0].name);
+	size_t stride = s.mSoA ? field.mType.byteSize : s.mSize;
+	int64_t displacement = array.offset + int64_t(s.mSoA ? Parser::getLength(array.type) * field.mOffset : field.mOffset);
+	std::string scale = stride == 1 ? "" : "*" + std::to_string(stride);
+	if (stride != 1 && stride != 2 && stride != 4 && stride != 8) {
+		outfile << "	imul " << index << ", " << index << ", " << stride << std::endl;
+		scale = "";
+	}
+	std::stringstream address;
+	address << "[" << array.reg;
+	if (displacement > 0)
+		address << "+" << displacement;
+	else if (displacement < 0)
+		address << "-" << -displacement;
+	address << "+" << index << scale << "]";
+	return address.str();
+}
+
+std::string X86_64LinuxYasmCompiler::printElementField(std::ostream& outfile, const Programme& p, const Expression* expression, const StructField& field) {
+	const Expression* indexing = expression->mChildren[0];
+	const std::string& name = indexing->mChildren[0]->mValue.mText;
+	const SymbolInfo& array = symbolTable[name];
+	printExpression(outfile, p, indexing->mChildren[1], 0);
+	int64_t length = Parser::getLength(array.type);
+	if (array.offset > 0) {
+		outfile << "	cmp rax, qword " << array.location() << "; check bounds" << std::endl;
+		outfile << "	jge array_out_of_bounds" << std::endl;
+	} else if (boundsChecks || !isInBounds(indexing->mChildren[1], length)) {
+		outfile << "	cmp rax, " << length << "; check bounds" << std::endl;
+		outfile << "	jge array_out_of_bounds" << std::endl;
+	}
+	return getElementFieldAddress(outfile, p, name, field, "rax");
+}
+
+void X86_64LinuxYasmCompiler::printFrame(std::ostream& outfile, int savedOffset) {
+	// Below the saved registers, a multiple of 16 like they are so the stack stays aligned
+	int frameSize = nearestMultipleOf(-frameDepth, 16) + savedOffset;
+	if (frameSize > 0)
+		outfile << "\tsub rsp, " << frameSize << "; FRAME" << std::endl;
+}
+
+void X86_64LinuxYasmCompiler::printRestoreRegisters(std::ostream& outfile, const std::vector<std::string>& registers) {
+	for (size_t i = 0; i < registers.size(); i++) {
+		outfile << "\tmov " << registers[i] << ", [rbp-" << (i + 1) * 8 << "]" << std::endl;
+	}
+}
+
+std::vector<std::string> X86_64LinuxYasmCompiler::printSaveArguments(std::ostream& outfile) {
+	for (const auto& reg : liveArguments) {
+		outfile << "\tpush " << reg << std::endl;
+	}
+	return liveArguments;
+}
+
+void X86_64LinuxYasmCompiler::printRestoreArguments(std::ostream& outfile, const std::vector<std::string>& registers) {
+	for (auto reg = registers.rbegin(); reg != registers.rend(); reg++) {
+		outfile << "\tpop " << *reg << std::endl;
+	}
+}
+
+void X86_64LinuxYasmCompiler::printCall(std::ostream& outfile, const std::string& target, bool alignStack) {
+	if (!alignStack) {
+		outfile << "\tcall " << target << std::endl;
+		return;
+	}
+	// Locals and temporaries only keep rsp 8-byte aligned, C code expects it to be 16-byte aligned at the call.
+	// rbx is never live across a call, and is preserved by the callee
+	outfile << "\tmov rbx, rsp" << std::endl;
+	outfile << "\tand rsp, -16" << std::endl;
+	outfile << "\tcall " << target << std::endl;
+	outfile << "\tmov rsp, rbx" << std::endl;
+}
+
 void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, const CompileContext& ctx) {
 	fs::path fileName = filePath.stem();
 	std::string parentPath = filePath.parent_path().string();
@@ -378,8 +662,9 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 	fs::create_directory(buildPath);
 	fs::path outPath = buildPath;
 	outPath /= fileName.concat(".asm");
-	std::ofstream outfile;
-	outfile.open(outPath);
+	std::stringstream outfile;
+	boundsChecks = ctx.m_Configuration.m_BuildType == BuildType::DEBUG;
+	loopUnroll = ctx.m_Configuration.m_LoopUnroll != 0 ? ctx.m_Configuration.m_LoopUnroll : boundsChecks ? 1 : 4;
 
 	std::vector<Variable> constantVars;
 	std::vector<Variable> initVars;
@@ -398,6 +683,14 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 		}
 	}
 
+	// The assembler has no floating point data, f32 and f64 values are written as their bits
+	auto getInitialiser = [](const Variable& variable, const Expression* value) {
+		const Type& type = variable.mType.builtinType == Builtin_Type::ARRAY ? variable.mType.subTypes[0] : variable.mType;
+		if (isFloat(type.builtinType) && (value->mValue.mSubType == TokenSubType::FLOAT_LITERAL || value->mValue.mSubType == TokenSubType::INTEGER_LITERAL))
+			return getFloatBits(value->mValue.mText, type.builtinType);
+		return value->mValue.mText;
+	};
+
 	labelCount = 0;
 	ifCount = 0;
 	if (!constantVars.empty()) {
@@ -406,7 +699,7 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 			addToSymbols(nullptr, constVar, constVar.mName, true);
 			outfile << "\t" << constVar.mName << " " << getDefineBytes(constVar.mType.byteSize) << " ";
 			for (int i = 0; i < constVar.mValues.size(); i++) {
-				outfile << constVar.mValues[i]->mValue.mText;
+				outfile << getInitialiser(constVar, constVar.mValues[i]);
 				if (i != constVar.mValues.size() - 1)
 					outfile << ", ";
 			}
@@ -430,7 +723,7 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 			addToSymbols(nullptr, initVar, initVar.mName, true);
 			outfile << "\t" << initVar.mName << " " << getDefineBytes(initVar.mType.byteSize) << " ";
 			for (int i = 0; i < initVar.mValues.size(); i++) {
-				outfile << initVar.mValues[i]->mValue.mText;
+				outfile << getInitialiser(initVar, initVar.mValues[i]);
 				if (i != initVar.mValues.size() - 1)
 					outfile << ", ";
 			}
@@ -443,37 +736,61 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 			addToSymbols(nullptr, otherVar, otherVar.mName, true);
 			if (otherVar.mType.builtinType != Builtin_Type::ARRAY)
 				outfile << "\t" << otherVar.mName << " " << getReserveBytes(otherVar.mType.byteSize) << " " << otherVar.mValues.size() << std::endl;
+			else if (Parser::isPacked(otherVar.mType))
+				outfile << "\t" << otherVar.mName << " " << getReserveBytes(8) << " " << otherVar.mType.byteSize / 8 << std::endl;
+			else if (otherVar.mType.subTypes[0].builtinType == Builtin_Type::STRUCT)
+				outfile << "\t" << otherVar.mName << " " << getReserveBytes(1) << " " << otherVar.mType.byteSize << std::endl;
 			else
-				outfile << "\t" << otherVar.mName << " " << getReserveBytes(otherVar.mType.subTypes[0].byteSize) << " " << otherVar.mType.byteSize /otherVar.mType.subTypes[0].byteSize << std::endl;
+				outfile << "\t" << otherVar.mName << " " << getReserveBytes(otherVar.mType.subTypes[0].byteSize) << " " << Parser::getLength(otherVar.mType) << std::endl;
 		}
 	}
+	bool hasMain = std::any_of(p.functions.begin(), p.functions.end(), [](const Function& function) { return function.mName == "main"; });
+	if (hasMain) {
+		outfile << "section .bss" << std::endl;
+		outfile << "\tstdout_buffer resb " << c_StdoutBufferSize << std::endl;
+		outfile << "\tstdout_length resq 1" << std::endl;
+	}
 	outfile << std::endl;
 	outfile << "section .text" << std::endl;
 
-	std::vector<FuncCallStatement> external;
+	std::set<std::string> external;
 	for (const auto& funcCall : p.externalFunctions) {
-		if (std::find(external.begin(), external.end(), funcCall) == external.end()) {
-			outfile << "\textern ";
-			if (!funcCall.mNamespace.empty())
-				outfile << funcCall.mNamespace << "_";
-			if (!funcCall.mClassName.empty())
-				outfile << funcCall.mClassName << "_";
-			outfile << funcCall.mFunctionName << std::endl;
-			external.push_back(funcCall);
-		}
+		std::string symbol;
+		if (!funcCall.mNamespace.empty())
+			symbol += funcCall.mNamespace + "_";
+		if (!funcCall.mClassName.empty())
+			symbol += funcCall.mClassName + "_";
+		symbol += funcCall.mFunctionName;
+		if (external.insert(symbol).second)
+			outfile << "\textern " << symbol << std::endl;
+	}
+	// Calls in expressions are only known once the functions are printed, their externs go here afterwards
+	std::streamoff externsEnd = outfile.tellp();
+
+	if (!hasMain) {
+		outfile << "\textern stdout_write" << std::endl;
+		outfile << "\textern stdout_write_byte" << std::endl;
+		outfile << "\textern stdout_flush" << std::endl;
 	}
 
 	setup(outfile);
+	if (hasMain) {
+		printStdoutRuntime(outfile, ctx.m_Configuration.m_StdoutBuffering);
+	}
 
 	if (p.requires_libs) {
 		printLibs(outfile);
 	}
+	// Everything above is hand written and doesn't keep to the calling convention, the peephole pass only gets the code
+	// generated for the programme
+	std::streamoff generatedStart = outfile.tellp();
 	// Loop over functions
 	// Start with prologue 'push rbp', 'mov rbp, rsp'
 	// For every variable, keep track of the offset
 	// End with epilogue 'pop rbp'
 
 	const char callingConvention[6][4] = {"di", "si", "d", "c", "8", "9"};
+	std::stringstream irOutput;
 
 	for (const auto& klass : p.classes) {
 		currentClass = klass.first;
@@ -485,26 +802,60 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 				}
 			}
 			outfile << klass.first << "_" << function.mName << ":" << std::endl;
+			// Methods keep their arguments in the argument registers, only the locals are candidates
+			std::optional<forest::ir::Function> irFunction = irBuilder.lowerFunction(function, klass.first);
+			if (irFunction.has_value()) {
+				irOutput << irFunction.value() << std::endl;
+				registerAssignments = registerAllocator.allocate(function, irFunction.value(), false);
+			} else {
+				registerAssignments = registerAllocator.allocate(function, false);
+			}
+			std::vector<std::string> savedRegisters = getSavedRegisters();
 			outfile << "; =============== PROLOGUE ===============" << std::endl;
 			outfile << "\tpush rbp" << std::endl;
 			outfile << "\tmov rbp, rsp" << std::endl;
-			outfile << "; =============== END PROLOGUE ===============" << std::endl;
+			int offset = printSaveRegisters(outfile, savedRegisters);
+			int savedOffset = offset;
+			frameDepth = offset;
+			// Printed after the frame is reserved, which is only known once the body is done
+			std::stringstream body;
 
-			int offset = 0;
 			int argOffset = 0;
 
 			std::vector<std::string> localSymbols;
 
+			// Methods read their fields through rdi, their returns stay calls
+			currentFunction = nullptr;
+			accumulatorOperator.clear();
+			// The object stays in rdi and the arguments in their registers for the whole method
+			liveArguments = {"rdi"};
+			for (size_t i = 1; i < function.mArgs.size() && i < 6; i++) {
+				liveArguments.emplace_back(getRegister(callingConvention[i], 3));
+			}
+			currentReturnType = function.mReturnType.builtinType;
+			size_t integers = 0;
+			int floats = 0;
 			for (size_t i = 0; i < function.mArgs.size(); i++) {
 				const auto& arg = function.mArgs[i];
-				std::string reg = i < 6 ? getRegister(callingConvention[i], getSizeFromByteSize(arg.mType.byteSize)) : "rbp+";
+				localSymbols.push_back(arg.mName);
+				if (isFloat(arg.mType.builtinType)) {
+					// xmm registers don't survive calls, the argument gets a stack slot
+					offset -= 8;
+					body << "\tmovsd qword [rbp" << offset << "], xmm" << floats++ << std::endl;
+					symbolTable.insert(std::make_pair(arg.mName, SymbolInfo {"rbp", offset, arg.mType, getSizeFromType(arg.mType)}));
+					continue;
+				}
+				std::string reg = integers < 6 ? getRegister(callingConvention[integers], getSizeFromByteSize(arg.mType.byteSize)) : "rbp+";
+				integers++;
 
 				addToSymbols(&argOffset, Variable{arg.mType, arg.mName, {}}, reg);
-				localSymbols.push_back(arg.mName);
 			}
 
-			int allocs = 0;
-			printBody(outfile, p, function.mBody, function.mName, &offset, &allocs);
+			frameDepth = std::min(frameDepth, offset);
+			printBody(body, p, function.mBody, function.mName, &offset);
+			printFrame(outfile, savedOffset);
+			outfile << "; =============== END PROLOGUE ===============" << std::endl;
+			outfile << body.str();
 
 			for (const auto& symbolName : localSymbols) {
 				symbolTable.erase(symbolName);
@@ -512,6 +863,7 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 
 			outfile << ".exit:" << std::endl;
 			outfile << "; =============== EPILOGUE ===============" << std::endl;
+			printRestoreRegisters(outfile, savedRegisters);
 			outfile << "\tmov rsp, rbp" << std::endl;
 			outfile << "\tpop rbp" << std::endl;
 			outfile << "\tret" << std::endl;
@@ -532,17 +884,32 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 			}
 			outfile << function.mName << ":" << std::endl;
 		}
+		std::optional<forest::ir::Function> irFunction = irBuilder.lowerFunction(function);
+		if (irFunction.has_value()) {
+			irOutput << irFunction.value() << std::endl;
+			registerAssignments = registerAllocator.allocate(function, irFunction.value());
+		} else {
+			registerAssignments = registerAllocator.allocate(function);
+		}
+		// _start never returns, so there is nobody to save the registers for
+		std::vector<std::string> savedRegisters;
+		if (function.mName != "main")
+			savedRegisters = getSavedRegisters();
 		outfile << "; =============== PROLOGUE ===============" << std::endl;
 		outfile << "\tpush rbp" << std::endl;
 		outfile << "\tmov rbp, rsp" << std::endl;
-		outfile << "; =============== END PROLOGUE ===============" << std::endl;
-
-
 		// Construct symbol table, keeping track of scope
 		// offset from stack, type
-		int offset = 0;
+		int offset = printSaveRegisters(outfile, savedRegisters);
+		int savedOffset = offset;
+		frameDepth = offset;
+		// Printed after the frame is reserved, which is only known once the body is done
+		std::stringstream body;
+
 		int argOffset = 0;
 
+		// Arguments are moved out of their registers below, nothing in them survives a call
+		liveArguments.clear();
 		std::vector<std::string> localSymbols;
 		if (function.mName == "main") {
 			const auto& argv = function.mArgs[0];
@@ -550,25 +917,52 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 			addToSymbols(&argOffset, Variable {argv.mType, argv.mName, {} }, "rbp+");
 			localSymbols.push_back(argv.mName);
 		} else {
-			int size = 0;
-			for (size_t i = 0; i < function.mArgs.size(); i++) {
-				const auto& arg = function.mArgs[i];
-				size += arg.mType.byteSize;
-			}
-			outfile << "\tsub rsp, " << nearestMultipleOf(size, 8) << std::endl;
+			bool tailCalls = analyseRecursion(function);
+			currentSavedRegisters = savedRegisters;
+			currentReturnType = function.mReturnType.builtinType;
 			const char* sizes[] = {"byte", "word", "dword", "qword"};
+			if (!accumulatorOperator.empty()) {
+				// Starts as the identity of the operator, so the first return gives back its own value
+				offset -= 8;
+				accumulatorOffset = offset;
+				const char* identity = accumulatorOperator == "*" ? "1" : accumulatorOperator == "&" ? "-1" : "0";
+				body << "\tmov qword [rbp" << accumulatorOffset << "], " << identity << "; TAIL CALL accumulator" << std::endl;
+			}
+			if (tailCalls)
+				body << ".tail_call:" << std::endl;
+			// Integers and floating point numbers are passed in their own registers
+			size_t integers = 0;
+			int floats = 0;
 			for (size_t i = 0; i < function.mArgs.size(); i++) {
 				const auto& arg = function.mArgs[i];
-				std::string reg = i < 6 ? getRegister(callingConvention[i], getSizeFromByteSize(arg.mType.byteSize)) : "rbp+";
+				localSymbols.push_back(arg.mName);
+				if (isFloat(arg.mType.builtinType)) {
+					int s = addToSymbols(&offset, Variable{arg.mType, arg.mName, {}});
+					body << "\t" << (arg.mType.builtinType == Builtin_Type::F64 ? "movsd " : "movss ") << sizes[s] << " [rbp" << offset << "], xmm" << floats++ << std::endl;
+					continue;
+				}
+				size_t number = integers++;
+				std::string reg = number < 6 ? getRegister(callingConvention[number], getSizeFromByteSize(arg.mType.byteSize)) : "rbp+";
 
+				auto assigned = registerAssignments.find(&arg);
+				if (number < 6 && assigned != registerAssignments.end()) {
+					SymbolInfo symbol {assigned->second, 0, arg.mType, getSizeFromType(arg.mType), false, true};
+					symbolTable.insert(std::make_pair(arg.mName, symbol));
+					printRegisterStore(body, symbol, callingConvention[number]);
+					continue;
+				}
 				int s = addToSymbols(&offset, Variable{arg.mType, arg.mName, {}});
-				outfile << "\tmov " << sizes[s] << " [rbp" << offset << "], " << reg << std::endl;
-				localSymbols.push_back(arg.mName);
+				body << "\tmov " << sizes[s] << " [rbp" << offset << "], " << reg << std::endl;
 			}
 		}
 
-		int allocs = 0;
-		printBody(outfile, p, function.mBody, function.mName, &offset, &allocs);
+		frameDepth = std::min(frameDepth, offset);
+		printBody(body, p, function.mBody, function.mName, &offset);
+		printFrame(outfile, savedOffset);
+		outfile << "; =============== END PROLOGUE ===============" << std::endl;
+		outfile << body.str();
+		currentFunction = nullptr;
+		accumulatorOperator.clear();
 
 		for (const auto& symbolName : localSymbols) {
 			symbolTable.erase(symbolName);
@@ -577,17 +971,79 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 		outfile << ".exit:" << std::endl;
 		if (function.mName != "main") {
 			outfile << "; =============== EPILOGUE ===============" << std::endl;
+			printRestoreRegisters(outfile, savedRegisters);
 			outfile << "\tmov rsp, rbp" << std::endl;
 			outfile << "\tpop rbp" << std::endl;
 			outfile << "\tret" << std::endl;
 			outfile << "; =============== END EPILOGUE ===============" << std::endl;
 		} else {
+			outfile << "\tcall stdout_flush" << std::endl;
 			outfile << "\tmov rax, 60" << std::endl;;
 			outfile << "\tsyscall" << std::endl;
 		}
 	}
 
-	outfile.close();
+	std::string assembly = outfile.str();
+	// Functions of the files this one imports are compiled in their own translation unit
+	std::set<std::string> defined;
+	for (const auto& function : p.functions)
+		defined.insert(function.mName);
+	for (const auto& klass : p.classes) {
+		for (const auto& function : klass.second.mFunctions)
+			defined.insert(klass.first + "_" + function.mName);
+	}
+	std::stringstream externs;
+	for (const auto& symbol : calledSymbols) {
+		if (!defined.contains(symbol) && external.insert(symbol).second)
+			externs << "\textern " << symbol << std::endl;
+	}
+	assembly.insert(externsEnd, externs.str());
+	generatedStart += std::streamoff(externs.str().size());
+	// stdout_flush saves everything the syscall needs, the code before system calls depends on that
+	const std::vector<std::string> convention = {"rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11"};
+	forest::assembler::Peephole peephole({"array_out_of_bounds"}, {
+		{"stdout_flush", {{}, {"rax"}}},
+		{"stdout_write", {{"rsi", "rdx"}, {"rax", "rcx", "rdx", "rsi", "rdi", "r11"}}},
+		{"stdout_write_byte", {{"rdi"}, {"rax", "rcx", "rdx", "rsi", "r11"}}},
+		{"find_ui64_in_string", {{"rdi"}, {"rax", "rbx", "rcx", "rdx", "r8"}}},
+		{"printString", {{"rdi"}, {"rax", "rcx", "rdx", "rsi", "rdi", "r11"}}},
+		{"print_ui64", {{"rdi"}, convention}},
+		{"print_ui64_newline", {{"rdi"}, convention}},
+		{"print_i64", {{"rdi"}, convention}},
+		{"print_i64_newline", {{"rdi"}, convention}},
+		{"print_f64", {{}, convention}},
+		{"print_f64_newline", {{}, convention}},
+	});
+	assembly.replace(generatedStart, std::string::npos, peephole.optimise(std::string_view(assembly).substr(generatedStart)));
+	if (!constantArrays.empty())
+		assembly += "section .rodata\n" + readOnlyData.str();
+	fs::path objectPath = buildPath / (fileName.stem().string() + ".o");
+
+	if (ctx.m_Configuration.m_BuildType == BuildType::DEBUG) {
+		// The IR the register allocation was based on, next to the assembly
+		std::ofstream irFile(buildPath / (fileName.stem().string() + ".ir"));
+		irFile << irOutput.str();
+	}
+	{
+		// Also written when the built-in assembler doesn't need it, yasm is handed the same file
+		std::ofstream asmFile(outPath);
+		asmFile << assembly;
+	}
+
+	AssemblerKind assemblerKind = ctx.m_Configuration.m_Assembler;
+	if (assemblerKind == AssemblerKind::DEFAULT)
+		assemblerKind = ctx.m_Configuration.m_BuildType == BuildType::DEBUG ? AssemblerKind::YASM : AssemblerKind::BUILTIN;
+	if (assemblerKind == AssemblerKind::BUILTIN) {
+		forest::assembler::Assembler builtin;
+		std::optional<std::vector<uint8_t>> object = builtin.assemble(assembly);
+		if (object.has_value()) {
+			std::ofstream objectFile(objectPath, std::ios::binary);
+			objectFile.write(reinterpret_cast<const char*>(object->data()), std::streamsize(object->size()));
+			return;
+		}
+		if (ctx.m_Configuration.m_BuildType == BuildType::DEBUG)
+			std::cerr << "Built-in assembler can't assemble " << outPath.string() << ", using yasm: " << builtin.getError() << std::endl;
+	}
 
 	std::stringstream assembler;
 	assembler << "yasm -f elf64";
@@ -598,8 +1054,9 @@ void X86_64LinuxYasmCompiler::compile(fs::path& filePath, const Programme& p, co
 	std::system(assembler.str().c_str());
 }
 
-void X86_64LinuxYasmCompiler::setup(std::ofstream& outfile) {
+void X86_64LinuxYasmCompiler::setup(std::ostream& outfile) {
 	outfile << "array_out_of_bounds:" << std::endl;
+	outfile << "\tcall stdout_flush" << std::endl;
 	outfile << "\tmov rdi, 2" << std::endl;
 	outfile << "\tmov rax, 1" << std::endl;
 	outfile << "\tmov rsi, Array_OOB" << std::endl;
@@ -608,7 +1065,6 @@ void X86_64LinuxYasmCompiler::setup(std::ofstream& outfile) {
 	outfile << "\tmov rdi, 1" << std::endl;
 	outfile << "\tmov rax, 60" << std::endl;
 	outfile << "\tsyscall" << std::endl;
-	outfile << "global find_ui64_in_string" << std::endl;
 	outfile << "find_ui64_in_string:" << std::endl;
 	outfile << "\txor rcx, rcx" << std::endl;
 	outfile << ".loop:" << std::endl;
@@ -639,46 +1095,300 @@ void X86_64LinuxYasmCompiler::setup(std::ofstream& outfile) {
 }
 
 
-void X86_64LinuxYasmCompiler::printLibs(std::ofstream& outfile) {
-	outfile << "global print_ui64" << std::endl;
+void X86_64LinuxYasmCompiler::printStdoutRuntime(std::ostream& outfile, StdoutBuffering buffering) {
+	// Writes the rdx bytes at rsi, a pipe can take fewer than asked for and a signal can interrupt the write before
+	// anything is written (-EINTR). Gives up on any other error, there is nowhere left to report it
+	outfile << "global stdout_write_all" << std::endl;
+	outfile << "stdout_write_all:" << std::endl;
+	outfile << "	test rdx, rdx" << std::endl;
+	outfile << "	jz .done" << std::endl;
+	outfile << "	mov rax, 1" << std::endl;
+	outfile << "	mov rdi, 1" << std::endl;
+	outfile << "	syscall" << std::endl;
+	outfile << "	cmp rax, -4" << std::endl;
+	outfile << "	je stdout_write_all" << std::endl;
+	outfile << "	test rax, rax" << std::endl;
+	outfile << "	jle .done" << std::endl;
+	outfile << "	add rsi, rax" << std::endl;
+	outfile << "	sub rdx, rax" << std::endl;
+	outfile << "	jmp stdout_write_all" << std::endl;
+	outfile << ".done:" << std::endl;
+	outfile << "	ret" << std::endl;
+
+	// Only clobbers rax, so it can go right before a syscall with its arguments already in place
+	outfile << "global stdout_flush" << std::endl;
+	outfile << "stdout_flush:" << std::endl;
+	outfile << "\tpush rdi" << std::endl;
+	outfile << "\tpush rsi" << std::endl;
+	outfile << "\tpush rdx" << std::endl;
+	outfile << "\tpush rcx" << std::endl;
+	outfile << "\tpush r11" << std::endl;
+	outfile << "\tmov rdx, qword [stdout_length]" << std::endl;
+	outfile << "\tmov rsi, stdout_buffer" << std::endl;
+	outfile << "\tcall stdout_write_all" << std::endl;
+	outfile << "\tmov qword [stdout_length], 0" << std::endl;
+	outfile << "\tpop r11" << std::endl;
+	outfile << "\tpop rcx" << std::endl;
+	outfile << "\tpop rdx" << std::endl;
+	outfile << "\tpop rsi" << std::endl;
+	outfile << "\tpop rdi" << std::endl;
+	outfile << "\tret" << std::endl;
+
+	outfile << "global stdout_write" << std::endl;
+	outfile << "stdout_write:" << std::endl;
+	if (buffering != StdoutBuffering::NONE) {
+		outfile << "\tmov rax, qword [stdout_length]" << std::endl;
+		outfile << "\tadd rax, rdx" << std::endl;
+		outfile << "\tcmp rax, " << c_StdoutBufferSize << std::endl;
+		outfile << "\tjbe .copy" << std::endl;
+		outfile << "\tcall stdout_flush" << std::endl;
+		outfile << "\tcmp rdx, " << c_StdoutBufferSize << std::endl;
+		outfile << "\tjbe .copy" << std::endl;
+	}
+	// Doesn't fit in the buffer, even when it's empty
+	outfile << "\tjmp stdout_write_all" << std::endl;
+	if (buffering != StdoutBuffering::NONE) {
+		outfile << ".copy:" << std::endl;
+		outfile << "\tmov rdi, stdout_buffer" << std::endl;
+		outfile << "\tadd rdi, qword [stdout_length]" << std::endl;
+		outfile << "\tadd qword [stdout_length], rdx" << std::endl;
+		outfile << "\tmov rcx, rdx" << std::endl;
+		outfile << "\trep movsb" << std::endl;
+		if (buffering == StdoutBuffering::LINE) {
+			outfile << "\ttest rdx, rdx" << std::endl;
+			outfile << "\tjz .written" << std::endl;
+			outfile << "\tcmp byte [rdi-1], 0xA" << std::endl;
+			outfile << "\tjne .written" << std::endl;
+			outfile << "\tcall stdout_flush" << std::endl;
+			outfile << ".written:" << std::endl;
+		}
+		outfile << "\tret" << std::endl;
+	}
+
+	outfile << "global stdout_write_byte" << std::endl;
+	outfile << "stdout_write_byte:" << std::endl;
+	outfile << "\tpush rdi" << std::endl;
+	outfile << "\tmov rsi, rsp" << std::endl;
+	outfile << "\tmov rdx, 1" << std::endl;
+	outfile << "\tcall stdout_write" << std::endl;
+	outfile << "\tpop rdi" << std::endl;
+	outfile << "\tret" << std::endl;
+}
+
+void X86_64LinuxYasmCompiler::printLibs(std::ostream& outfile) {
+	// "00", "01", ..., "99", so the digits can be written two at a time
+	outfile << "section .rodata" << std::endl;
+	outfile << "print_digit_pairs:" << std::endl;
+	for (int tens = 0; tens < 10; tens++) {
+		outfile << "\tdb \"";
+		for (int ones = 0; ones < 10; ones++) {
+			outfile << tens << ones;
+		}
+		outfile << "\"" << std::endl;
+	}
+	outfile << "print_f64_inf: db \"inf\"" << std::endl;
+	outfile << "print_f64_nan: db \"nan\"" << std::endl;
+	outfile << "section .text" << std::endl;
+
+	// All the entry points set up the same frame: rsi is the end of the digits which are written backwards from there,
+	// rcx the amount of characters already written, and r10 is 1 when a '-' has to go in front
 	outfile << "print_ui64:" << std::endl;
+	outfile << "\txor r10, r10" << std::endl;
 	outfile << "\tpush rbp" << std::endl;
 	outfile << "\tmov rsi, rsp" << std::endl;
-	outfile << "\tsub rsp, 22" << std::endl;
-	outfile << "\tmov rax, rdi" << std::endl;
-	outfile << "\tmov rbx, 0xA" << std::endl;
+	outfile << "\tsub rsp, 24" << std::endl;
+	outfile << "\txor rcx, rcx" << std::endl;
+	outfile << "\tjmp to_string_ui64" << std::endl;
+	outfile << "print_ui64_newline:" << std::endl;
+	outfile << "\txor r10, r10" << std::endl;
+	outfile << "\tjmp print_newline_start" << std::endl;
+	outfile << "print_i64:" << std::endl;
+	outfile << "\txor r10, r10" << std::endl;
+	outfile << "\ttest rdi, rdi" << std::endl;
+	outfile << "\tjns .positive" << std::endl;
+	outfile << "\tneg rdi ; Also right for the lowest i64, as an unsigned number" << std::endl;
+	outfile << "\tinc r10" << std::endl;
+	outfile << ".positive:" << std::endl;
+	outfile << "\tpush rbp" << std::endl;
+	outfile << "\tmov rsi, rsp" << std::endl;
+	outfile << "\tsub rsp, 24" << std::endl;
 	outfile << "\txor rcx, rcx" << std::endl;
+	outfile << "\tjmp to_string_ui64" << std::endl;
+	outfile << "print_i64_newline:" << std::endl;
+	outfile << "\txor r10, r10" << std::endl;
+	outfile << "\ttest rdi, rdi" << std::endl;
+	outfile << "\tjns print_newline_start" << std::endl;
+	outfile << "\tneg rdi" << std::endl;
+	outfile << "\tinc r10" << std::endl;
+	outfile << "print_newline_start:" << std::endl;
+	outfile << "\tpush rbp" << std::endl;
+	outfile << "\tmov rsi, rsp" << std::endl;
+	outfile << "\tsub rsp, 24" << std::endl;
+	outfile << "\tdec rsi" << std::endl;
+	outfile << "\tmov byte [rsi], 0xA" << std::endl;
+	outfile << "\tmov rcx, 1" << std::endl;
+
+	// n / 100 is ((n >> 2) * 0x28F5C28F5C28F5C3) >> 66, exact for every 64-bit n, and a lot cheaper than div
 	outfile << "to_string_ui64:" << std::endl;
+	outfile << "\tmov r8, 0x28F5C28F5C28F5C3" << std::endl;
+	outfile << ".pairs:" << std::endl;
+	outfile << "\tcmp rdi, 100" << std::endl;
+	outfile << "\tjb .lastPair" << std::endl;
+	outfile << "\tmov rax, rdi" << std::endl;
+	outfile << "\tshr rax, 2" << std::endl;
+	outfile << "\tmul r8" << std::endl;
+	outfile << "\tshr rdx, 2 ; n / 100" << std::endl;
+	outfile << "\timul rax, rdx, 100" << std::endl;
+	outfile << "\tmov r9, rdi" << std::endl;
+	outfile << "\tsub r9, rax ; n % 100" << std::endl;
+	outfile << "\tmov rdi, rdx" << std::endl;
+	outfile << "\tmovzx eax, word [print_digit_pairs+r9*2]" << std::endl;
+	outfile << "\tsub rsi, 2" << std::endl;
+	outfile << "\tmov word [rsi], ax" << std::endl;
+	outfile << "\tadd rcx, 2" << std::endl;
+	outfile << "\tjmp .pairs" << std::endl;
+	outfile << ".lastPair:" << std::endl;
+	outfile << "\tcmp rdi, 10" << std::endl;
+	outfile << "\tjb .lastDigit" << std::endl;
+	outfile << "\tmovzx eax, word [print_digit_pairs+rdi*2]" << std::endl;
+	outfile << "\tsub rsi, 2" << std::endl;
+	outfile << "\tmov word [rsi], ax" << std::endl;
+	outfile << "\tadd rcx, 2" << std::endl;
+	outfile << "\tjmp .sign" << std::endl;
+	outfile << ".lastDigit:" << std::endl;
+	outfile << "\tlea eax, [rdi+0x30] ; '0'" << std::endl;
 	outfile << "\tdec rsi" << std::endl;
-	outfile << "\txor rdx, rdx" << std::endl;
-	outfile << "\tdiv rbx" << std::endl;
-	outfile << "\tadd rdx, 0x30 ; '0'" << std::endl;
-	outfile << "\tmov byte [rsi], dl" << std::endl;
+	outfile << "\tmov byte [rsi], al" << std::endl;
+	outfile << "\tinc rcx" << std::endl;
+	outfile << ".sign:" << std::endl;
+	outfile << "\ttest r10, r10" << std::endl;
+	outfile << "\tjz .write" << std::endl;
+	outfile << "\tdec rsi" << std::endl;
+	outfile << "\tmov byte [rsi], 0x2D ; '-'" << std::endl;
 	outfile << "\tinc rcx" << std::endl;
-	outfile << "\ttest rax, rax" << std::endl;
-	outfile << "\tjnz to_string_ui64" << std::endl;
 	outfile << ".write:" << std::endl;
-	outfile << "\tinc rax" << std::endl;
-	outfile << "\tmov rdi, 1" << std::endl;
 	outfile << "\tmov rdx, rcx" << std::endl;
-	outfile << "\tsyscall" << std::endl;
-	outfile << "\tadd rsp, 22" << std::endl;
+	outfile << "\tcall stdout_write" << std::endl;
+	outfile << "\tadd rsp, 24" << std::endl;
 	outfile << "\tpop rbp" << std::endl;
 	outfile << "\tret" << std::endl;
-	outfile << "global print_ui64_newline" << std::endl;
-	outfile << "print_ui64_newline:" << std::endl;
+
+	// xmm0 is written as the integer part and up to six decimals, with trailing zeros trimmed. Numbers from 2^63 up are
+	// divided by 10 until they fit a register, and the digits that took off are written as zeros
+	outfile << "print_f64:" << std::endl;
+	outfile << "\tmov r11, 0" << std::endl;
+	outfile << "\tjmp print_f64_start" << std::endl;
+	outfile << "print_f64_newline:" << std::endl;
+	outfile << "\tmov r11, 1" << std::endl;
+	outfile << "print_f64_start:" << std::endl;
 	outfile << "\tpush rbp" << std::endl;
-	outfile << "\tmov rsi, rsp" << std::endl;
-	outfile << "\tsub rsp, 22" << std::endl;
-	outfile << "\tmov rax, rdi" << std::endl;
-	outfile << "\tmov rbx, 0xA" << std::endl;
+	outfile << "\tmov rbp, rsp" << std::endl;
+	outfile << "\tsub rsp, 64" << std::endl;
+	outfile << "\tmov qword [rbp-8], r11" << std::endl;
+	outfile << "\tmovq rax, xmm0" << std::endl;
+	outfile << "\tmov rcx, rax" << std::endl;
+	outfile << "\tshr rcx, 63" << std::endl;
+	outfile << "\tshl rax, 1" << std::endl;
+	outfile << "\tshr rax, 1 ; |x|" << std::endl;
+	outfile << "\tmov qword [rbp-16], rax" << std::endl;
+	outfile << "\tmov rdx, 0x7FF0000000000000" << std::endl;
+	outfile << "\tcmp rax, rdx" << std::endl;
+	outfile << "\tja .nan" << std::endl;
+	outfile << "\tje .infinity" << std::endl;
+	outfile << "\ttest rcx, rcx" << std::endl;
+	outfile << "\tjz .scale" << std::endl;
+	outfile << "\tmov rdi, 0x2D ; '-'" << std::endl;
+	outfile << "\tcall stdout_write_byte" << std::endl;
+	outfile << ".scale:" << std::endl;
+	outfile << "\tmov qword [rbp-24], 0" << std::endl;
+	outfile << "\tmovsd xmm0, qword [rbp-16]" << std::endl;
+	outfile << "\tmov rax, 0x43E0000000000000 ; 2^63" << std::endl;
+	outfile << "\tmovq xmm1, rax" << std::endl;
+	outfile << "\tmov rax, 0x4024000000000000 ; 10.0" << std::endl;
+	outfile << "\tmovq xmm2, rax" << std::endl;
+	outfile << ".scaleLoop:" << std::endl;
+	outfile << "\tucomisd xmm0, xmm1" << std::endl;
+	outfile << "\tjb .split" << std::endl;
+	outfile << "\tdivsd xmm0, xmm2" << std::endl;
+	outfile << "\tinc qword [rbp-24]" << std::endl;
+	outfile << "\tjmp .scaleLoop" << std::endl;
+	outfile << ".split:" << std::endl;
+	outfile << "\tcvttsd2si rax, xmm0" << std::endl;
+	outfile << "\tcvtsi2sd xmm1, rax" << std::endl;
+	outfile << "\tsubsd xmm0, xmm1" << std::endl;
+	outfile << "\tmov rcx, 0x412E848000000000 ; 1000000.0" << std::endl;
+	outfile << "\tmovq xmm1, rcx" << std::endl;
+	outfile << "\tmulsd xmm0, xmm1" << std::endl;
+	outfile << "\tcvtsd2si rcx, xmm0" << std::endl;
+	outfile << "\tcmp rcx, 1000000" << std::endl;
+	outfile << "\tjb .fraction" << std::endl;
+	outfile << "\tsub rcx, 1000000" << std::endl;
+	outfile << "\tinc rax" << std::endl;
+	outfile << ".fraction:" << std::endl;
+	outfile << "\tcmp qword [rbp-24], 0" << std::endl;
+	outfile << "\tje .integer" << std::endl;
 	outfile << "\txor rcx, rcx" << std::endl;
-	outfile << "\tdec rsi" << std::endl;
-	outfile << "\tmov byte [rsi], bl" << std::endl;
-	outfile << "\tinc rcx" << std::endl;
-	outfile << "\tjmp to_string_ui64" << std::endl;
+	outfile << ".integer:" << std::endl;
+	outfile << "\tmov qword [rbp-32], rcx" << std::endl;
+	outfile << "\tmov rdi, rax" << std::endl;
+	outfile << "\tcall print_ui64" << std::endl;
+	outfile << ".zeros:" << std::endl;
+	outfile << "\tcmp qword [rbp-24], 0" << std::endl;
+	outfile << "\tje .digits" << std::endl;
+	outfile << "\tmov rdi, 0x30 ; '0'" << std::endl;
+	outfile << "\tcall stdout_write_byte" << std::endl;
+	outfile << "\tdec qword [rbp-24]" << std::endl;
+	outfile << "\tjmp .zeros" << std::endl;
+	outfile << ".digits:" << std::endl;
+	outfile << "\tmov rax, qword [rbp-32]" << std::endl;
+	outfile << "\tlea rsi, [rbp-48]" << std::endl;
+	outfile << "\tmov byte [rsi], 0x2E ; '.'" << std::endl;
+	outfile << "\tmov rcx, 6" << std::endl;
+	outfile << "\tmov r9, 10" << std::endl;
+	outfile << ".digit:" << std::endl;
+	outfile << "\txor rdx, rdx" << std::endl;
+	outfile << "\tdiv r9" << std::endl;
+	outfile << "\tadd dl, 0x30" << std::endl;
+	outfile << "\tmov byte [rsi+rcx], dl" << std::endl;
+	outfile << "\tloop .digit" << std::endl;
+	outfile << "\tmov rdx, 7" << std::endl;
+	outfile << ".trim:" << std::endl;
+	outfile << "\tcmp rdx, 2" << std::endl;
+	outfile << "\tje .write" << std::endl;
+	outfile << "\tcmp byte [rsi+rdx-1], 0x30" << std::endl;
+	outfile << "\tjne .write" << std::endl;
+	outfile << "\tdec rdx" << std::endl;
+	outfile << "\tjmp .trim" << std::endl;
+	outfile << ".write:" << std::endl;
+	outfile << "\tcmp qword [rbp-8], 0" << std::endl;
+	outfile << "\tje .output" << std::endl;
+	outfile << "\tmov byte [rsi+rdx], 0xA" << std::endl;
+	outfile << "\tinc rdx" << std::endl;
+	outfile << ".output:" << std::endl;
+	outfile << "\tcall stdout_write" << std::endl;
+	outfile << "\tjmp .done" << std::endl;
+	outfile << ".infinity:" << std::endl;
+	outfile << "\ttest rcx, rcx" << std::endl;
+	outfile << "\tjz .inf" << std::endl;
+	outfile << "\tmov rdi, 0x2D ; '-'" << std::endl;
+	outfile << "\tcall stdout_write_byte" << std::endl;
+	outfile << ".inf:" << std::endl;
+	outfile << "\tmov rsi, print_f64_inf" << std::endl;
+	outfile << "\tjmp .special" << std::endl;
+	outfile << ".nan:" << std::endl;
+	outfile << "\tmov rsi, print_f64_nan" << std::endl;
+	outfile << ".special:" << std::endl;
+	outfile << "\tmov rdx, 3" << std::endl;
+	outfile << "\tcall stdout_write" << std::endl;
+	outfile << "\tcmp qword [rbp-8], 0" << std::endl;
+	outfile << "\tje .done" << std::endl;
+	outfile << "\tmov rdi, 0xA" << std::endl;
+	outfile << "\tcall stdout_write_byte" << std::endl;
+	outfile << ".done:" << std::endl;
+	outfile << "\tmov rsp, rbp" << std::endl;
+	outfile << "\tpop rbp" << std::endl;
+	outfile << "\tret" << std::endl;
 
-	outfile << "global printString" << std::endl;
 	outfile << "printString:" << std::endl;
 	outfile << "\tmov rsi, rdi" << std::endl;
 	outfile << "\txor rdx, rdx" << std::endl;
@@ -691,35 +1401,49 @@ void X86_64LinuxYasmCompiler::printLibs(std::ofstream& outfile) {
 	outfile << ".strCountDone:" << std::endl;
 	outfile << "\tcmp rdx, 0" << std::endl;
 	outfile << "\tje .prtDone" << std::endl;
-	outfile << "\tmov rax, 1" << std::endl;
-	outfile << "\tmov rdi, 1" << std::endl;
-	outfile << "\tsyscall" << std::endl;
+	outfile << "\tcall stdout_write" << std::endl;
 	outfile << ".prtDone:" << std::endl;
 	outfile << "\tret" << std::endl;
 }
 
-void X86_64LinuxYasmCompiler::printFunctionCall(std::ofstream& outfile, const Programme& p, const FuncCallStatement& fc) {
+void X86_64LinuxYasmCompiler::printFunctionCall(std::ostream& outfile, const Programme& p, const FuncCallStatement& fc) {
 	// TODO: We assume only one argument here
 	// TODO: We assume entire expression tree is collapsed
 	Expression* arg = fc.mArgs[0];
 	const char* sizes[] = {"byte", "word", "dword", "qword"};
-	if (arg->mValue.mType == TokenType::LITERAL && arg->mValue.mSubType == TokenSubType::STRING_LITERAL) {
+	bool isWrite = fc.mClassName == "stdout" && (fc.mFunctionName == "write" || fc.mFunctionName == "writeln");
+	if (isWrite && arg->mValue.mSubType != TokenSubType::STRING_LITERAL && getFloatType(p, arg).has_value()) {
+		outfile << "; =============== FUNC CALL + FLOAT ===============" << std::endl;
+		printFloatExpression(outfile, p, arg, Builtin_Type::F64, 0);
+		outfile << "\tcall " << (fc.mFunctionName == "write" ? "print_f64" : "print_f64_newline") << std::endl;
+		outfile << "; =============== END FUNC CALL + FLOAT ===============" << std::endl;
+	} else if (arg->mValue.mType == TokenType::LITERAL && arg->mValue.mSubType == TokenSubType::STRING_LITERAL) {
 		Literal l = p.findLiteralByContent(arg->mValue.mText).value();
+		bool isRead = fc.mFunctionName == "read" || fc.mFunctionName == "readln";
 		outfile << "; =============== FUNC CALL + STRING ===============" << std::endl;
-		outfile << "\tmov rax, " << (fc.mFunctionName == "read" || fc.mFunctionName == "readln" ? 0 : 1) << std::endl;
-		outfile << "\tmov rdi, " << (fc.mClassName == "stdin" ? 0 : 1) << std::endl;
-		outfile << "\tmov rsi, " << l.mAlias << std::endl;
-		outfile << "\tmov rdx, " << l.mSize << std::endl;
-		outfile << "\tsyscall" << std::endl;
+		if (!isRead && fc.mClassName == "stdout") {
+			outfile << "\tmov rsi, " << l.mAlias << std::endl;
+			outfile << "\tmov rdx, " << l.mSize << std::endl;
+			outfile << "\tcall stdout_write" << std::endl;
+		} else {
+			// Whatever was written before has to be visible before waiting on input
+			outfile << "\tcall stdout_flush" << std::endl;
+			outfile << "\tmov rax, " << (isRead ? 0 : 1) << std::endl;
+			outfile << "\tmov rdi, " << (fc.mClassName == "stdin" ? 0 : 1) << std::endl;
+			outfile << "\tmov rsi, " << l.mAlias << std::endl;
+			outfile << "\tmov rdx, " << l.mSize << std::endl;
+			outfile << "\tsyscall" << std::endl;
+		}
 		outfile << "; =============== END FUNC CALL + STRING ===============" << std::endl;
 
 	} else if (arg->mValue.mType == TokenType::LITERAL && arg->mValue.mSubType == TokenSubType::INTEGER_LITERAL) {
 		outfile << "; =============== FUNC CALL + INT ===============" << std::endl;
 		outfile << "\tmov rdi, " << arg->mValue.mText << std::endl;
+		bool sign = getSizeFromNumber(arg->mValue.mText) < 0;
 		if (fc.mFunctionName == "write") {
-			outfile << "\tcall print_ui64" << std::endl;
+			outfile << "\tcall " << (sign ? "print_i64" : "print_ui64") << std::endl;
 		} else if (fc.mFunctionName == "writeln") {
-			outfile << "\tcall print_ui64_newline" << std::endl;
+			outfile << "\tcall " << (sign ? "print_i64_newline" : "print_ui64_newline") << std::endl;
 		}
 		outfile << "; =============== END FUNC CALL + INT ===============" << std::endl;
 
@@ -727,19 +1451,21 @@ void X86_64LinuxYasmCompiler::printFunctionCall(std::ofstream& outfile, const Pr
 		SymbolInfo& var = symbolTable[arg->mValue.mText];
 		outfile << "; =============== FUNC CALL + VARIABLE ===============" << std::endl;
 		if (var.type.builtinType == Builtin_Type::UI8) {
-			outfile << "\tmov rax, 1" << std::endl;
-			outfile << "\tmov rdi, 1" << std::endl;
 			outfile << "\tlea rsi, " << var.location(true) << std::endl;
 			outfile << "\tmov rdx, 1" << std::endl;
-			outfile << "\tsyscall" << std::endl;
+			outfile << "\tcall stdout_write" << std::endl;
 		} else {
-			const char* moveAction = getMoveAction(3, var.size, false);
-			const char* reg = var.size < 2 ? "rdi" : getRegister("di", var.size);
-			outfile << "\t" << moveAction << " " << reg << ", " << sizes[var.size] << " " << var.location() << "; variable " << arg->mValue.mText << std::endl;
+			bool sign = var.type.name[0] == 'i'; // This might cause a problem later with user-defined types starting with i
+			const char* moveAction = getMoveAction(3, var.size, sign);
+			const char* reg = var.size < 2 || sign ? "rdi" : getRegister("di", var.size);
+			if (var.inRegister)
+				outfile << "\t" << moveAction << " " << reg << ", " << getRegister(var.reg.substr(1), var.size) << "; variable " << arg->mValue.mText << std::endl;
+			else
+				outfile << "\t" << moveAction << " " << reg << ", " << sizes[var.size] << " " << var.location() << "; variable " << arg->mValue.mText << std::endl;
 			if (fc.mFunctionName == "write") {
-				outfile << "\tcall print_ui64" << std::endl;
+				outfile << "\tcall " << (sign ? "print_i64" : "print_ui64") << std::endl;
 			} else if (fc.mFunctionName == "writeln") {
-				outfile << "\tcall print_ui64_newline" << std::endl;
+				outfile << "\tcall " << (sign ? "print_i64_newline" : "print_ui64_newline") << std::endl;
 			}
 		}
 		outfile << "; =============== END FUNC CALL + VARIABLE ===============" << std::endl;
@@ -756,18 +1482,15 @@ void X86_64LinuxYasmCompiler::printFunctionCall(std::ofstream& outfile, const Pr
 		//outfile << "\tmov rdi, qword [rsp+8+" << offset << "*8] ; Move the CLI arg into rdi" << std::endl;
 		outfile << "\tcall printString" << std::endl;
 		if (fc.mFunctionName == "writeln") {
-			outfile << "\tmov rax, 1" << std::endl;
-			outfile << "\tmov rdi, 1" << std::endl;
-			outfile << "\tmov rsi, 0xA" << std::endl;
-			outfile << "\tmov rdx, 1" << std::endl;
-			outfile << "\tsyscall" << std::endl;
+			outfile << "\tmov rdi, 0xA" << std::endl;
+			outfile << "\tcall stdout_write_byte" << std::endl;
 		}
 	} else if (arg->mValue.mType == TokenType::OPERATOR && arg->mValue.mText == ".") { // Struct indexing
 		outfile << "; We don't support struct indexing yet" << std::endl;
 	}
 }
 
-void X86_64LinuxYasmCompiler::printSyscall(std::ofstream& outfile, const std::string& syscall) {
+void X86_64LinuxYasmCompiler::printSyscall(std::ostream& outfile, const std::string& syscall) {
 	if (syscallTable.contains(syscall)) {
 		uint32_t call = syscallTable[syscall];
 		outfile << "\tmov rax, " << call << std::endl;
@@ -778,40 +1501,143 @@ void X86_64LinuxYasmCompiler::printSyscall(std::ofstream& outfile, const std::st
 	}
 }
 
+bool X86_64LinuxYasmCompiler::analyseRecursion(const Function& function) {
+	accumulatorOperator.clear();
+	currentFunction = nullptr;
+	// Arguments past the sixth live in the caller's frame, which a jump can't refill
+	if (function.mName == "main" || function.mArgs.size() > 6 || takesAddress(function.mBody)) return false;
+	// Floating point arguments come in xmm registers, the jumps only refill the integer ones
+	if (std::any_of(function.mArgs.begin(), function.mArgs.end(), [](const FuncArg& arg) { return isFloat(arg.mType.builtinType); })) return false;
+	currentFunction = &function;
+
+	std::string op;
+	bool selfTailCall = findSelfCalls(function.mBody, function.mName, op);
+	// The accumulator is combined with 64-bit integer instructions, which only keeps the low bits right for integers
+	Builtin_Type returnType = function.mReturnType.builtinType;
+	if (returnType >= Builtin_Type::UI8 && returnType <= Builtin_Type::I64)
+		accumulatorOperator = op;
+	return selfTailCall || !accumulatorOperator.empty();
+}
+
+bool X86_64LinuxYasmCompiler::printTailCall(std::ostream& outfile, const Programme& p, const Expression* expression) {
+	if (currentFunction == nullptr) return false;
+	const char callingConvention[6][4] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+
+	const Expression* call = expression;
+	const Expression* operand = nullptr;
+	if (!accumulatorOperator.empty()) {
+		const Expression* accumulated = findAccumulatedCall(expression, currentFunction->mName, accumulatorOperator);
+		if (accumulated != nullptr) {
+			call = accumulated;
+			operand = expression->mChildren[0] == accumulated ? expression->mChildren[1] : expression->mChildren[0];
+		}
+	}
+	if (!isDirectCall(call) || call->mChildren.size() - 2 > 6) return false;
+
+	const std::string& name = call->mChildren[0]->mValue.mText;
+	bool self = name == currentFunction->mName;
+	// Another function's result would still have to be combined with the accumulator
+	if (name == "main" || (!self && !accumulatorOperator.empty())) return false;
+	auto callee = std::find_if(p.functions.begin(), p.functions.end(), [&](const Function& function) { return function.mName == name; });
+	if (callee == p.functions.end() || callee->mArgs.size() > 6) return false;
+	if (std::any_of(callee->mArgs.begin(), callee->mArgs.end(), [](const FuncArg& arg) { return isFloat(arg.mType.builtinType); })) return false;
+	// The result has to be where our caller expects it, and converted if it isn't the same type
+	bool floatReturn = isFloat(callee->mReturnType.builtinType) || isFloat(currentFunction->mReturnType.builtinType);
+	if (floatReturn && callee->mReturnType.builtinType != currentFunction->mReturnType.builtinType) return false;
+
+	if (operand != nullptr) {
+		printExpression(outfile, p, operand, 0);
+		outfile << "\tmov rbx, qword [rbp" << accumulatorOffset << "]" << std::endl;
+		outfile << "\t" << getAccumulatorInstruction() << " rax, rbx" << std::endl;
+		outfile << "\tmov qword [rbp" << accumulatorOffset << "], rax; TAIL CALL accumulate" << std::endl;
+	}
+
+	size_t liveBefore = liveArguments.size();
+	for (size_t i = 2; i < call->mChildren.size(); i++) {
+		const Expression* child = call->mChildren[i];
+		std::string value;
+		if (child->mValue.mSubType == TokenSubType::STRING_LITERAL) {
+			value = p.findLiteralByContent(child->mValue.mText)->mAlias;
+		} else {
+			printExpression(outfile, p, child, 0);
+			value = "rax";
+		}
+		outfile << "\tmov " << callingConvention[i - 2] << ", " << value << std::endl;
+		liveArguments.emplace_back(callingConvention[i - 2]);
+	}
+	liveArguments.resize(liveBefore);
+
+	if (self) {
+		outfile << "\tjmp .tail_call" << std::endl;
+	} else {
+		// The callee returns straight to our caller
+		printRestoreRegisters(outfile, currentSavedRegisters);
+		outfile << "\tmov rsp, rbp" << std::endl;
+		outfile << "\tpop rbp" << std::endl;
+		outfile << "\tjmp " << name << "; TAIL CALL" << std::endl;
+	}
+	return true;
+}
+
 
-void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme& p, const Block& block, const std::string& labelName, int* offset, int* allocs) {
+void X86_64LinuxYasmCompiler::printBody(std::ostream& outfile, const Programme& p, const Block& block, const std::string& labelName, int* offset) {
 	const char callingConvention[6][4] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
 	const char* sizes[] = {"byte", "word", "dword", "qword"};
 	std::vector<std::string> localSymbols;
 	int localOffset = 0;
-	if (block.stackMemory != 0) {
-		int toAlloc = nearestMultipleOf(block.stackMemory + block.biggestAlloc, 8);
-		outfile << "\tsub rsp, " << toAlloc << std::endl;
-		(*allocs) += toAlloc;
-	}
+	// f32 and f64 values are printed into xmm0 and stored from there
+	auto printValue = [&](const Expression* value, const Type& type) {
+		if (isFloat(type.builtinType))
+			printFloatExpression(outfile, p, value, type.builtinType, 0);
+		else
+			printExpression(outfile, p, value, 0);
+	};
+	auto getStore = [](const Type& type) {
+		return type.builtinType == Builtin_Type::F64 ? "movsd" : type.builtinType == Builtin_Type::F32 ? "movss" : "mov";
+	};
+	auto getStoreRegister = [&](const Type& type, int size) {
+		return isFloat(type.builtinType) ? "xmm0" : getRegister("a", size);
+	};
 
 	for (size_t i = 0; i < block.statements.size(); i++) {
 		const auto& statement = block.statements[i];
 		switch (statement.mType) {
 			case Statement_Type::RETURN_CALL:
-				printExpression(outfile, p, statement.mContent, 0);
+				if (printTailCall(outfile, p, statement.mContent)) break;
+				if (isFloat(currentReturnType))
+					printFloatExpression(outfile, p, statement.mContent, currentReturnType, 0);
+				else
+					printExpression(outfile, p, statement.mContent, 0);
+				if (!accumulatorOperator.empty()) {
+					outfile << "\tmov rbx, qword [rbp" << accumulatorOffset << "]" << std::endl;
+					outfile << "\t" << getAccumulatorInstruction() << " rax, rbx; TAIL CALL accumulate" << std::endl;
+				}
 				if (labelName == "main") {
 					outfile << "\tmov rdi, rax" << std::endl;
 				} else {
-					if (*allocs > 0)
-						outfile << "\tadd rsp, " << *allocs << std::endl;
 					outfile << "\tjmp .exit" << std::endl;
 				}
 
 				break;
 			case Statement_Type::VAR_DECLARATION:
+				if (statement.variable.value().mType.builtinType == Builtin_Type::ARRAY) {
+					// The elements go upwards from here, like an array that is assigned
+					(*offset) -= int(statement.variable.value().mType.byteSize);
+					localOffset -= int(statement.variable.value().mType.byteSize);
+				}
 				addToSymbols(offset, statement.variable.value());
 				addToSymbols(&localOffset, statement.variable.value());
 				localSymbols.push_back(statement.variable.value().mName);
 				break;
 			case Statement_Type::VAR_DECL_ASSIGN: {
-				Variable v = statement.variable.value();
-				if (v.mType.builtinType == Builtin_Type::ARRAY) {
+				const Variable& v = statement.variable.value();
+				std::optional<std::string> constantArray = getConstantArray(v);
+				Block rest {std::vector<Statement>(block.statements.begin() + i + 1, block.statements.end())};
+				if (constantArray.has_value() && !writesVariable(rest, v.mName)) {
+					// Never written, the elements are read straight from the read-only data
+					symbolTable.insert(std::make_pair(v.mName, SymbolInfo {constantArray.value(), 0, v.mType, getSizeFromType(v.mType), true}));
+					localSymbols.push_back(v.mName);
+				} else if (v.mType.builtinType == Builtin_Type::ARRAY) {
 					// Note: This subtraction is because we want to make the array initialise upwards towards the top of the stack
 					// Reason for this is because register indexing is not allowed to go -rax, only +rax
 					(*offset) -= int(v.mType.byteSize);
@@ -823,16 +1649,27 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 					SymbolInfo& arr = symbolTable[v.mName];
 					int actualSize = getSizeFromByteSize(arr.type.subTypes[0].byteSize);
 
-					for (int i = 0; i < v.mValues.size(); i++) {
-						printExpression(outfile, p, v.mValues[i], 0);
-						outfile << "\tmov " << sizes[actualSize] << " [" << arr.reg;
-						if (arr.offset > 0)
-							outfile << "+" << arr.offset - i * int(arr.type.byteSize / v.mValues.size());
-						else if (arr.offset <= 0)
-							outfile << "-" << -(arr.offset + i * int(arr.type.byteSize / v.mValues.size()));
-						outfile << "], " << getRegister("a", actualSize) << "; VAR_DECL_ASSIGN ARRAY variable " << v.mName << "[" << i << "]" << std::endl;
+					if (constantArray.has_value()) {
+						// Written later, so it needs its own copy
+						printBlockCopy(outfile, VectorLocation {constantArray.value(), 0}, VectorLocation {arr.reg, arr.offset}, arr.type.byteSize);
+					} else if (Parser::isPacked(v.mType)) {
+						for (int i = 0; i < v.mValues.size(); i++) {
+							printValue(v.mValues[i], arr.type.subTypes[0]);
+							outfile << "\tmov r11, " << i << std::endl;
+							printBitStore(outfile, v.mName, v.mValues[i]);
+						}
+					} else {
+						for (int i = 0; i < v.mValues.size(); i++) {
+							printValue(v.mValues[i], arr.type.subTypes[0]);
+							outfile << "\t" << getStore(arr.type.subTypes[0]) << " " << sizes[actualSize] << " [" << arr.reg;
+							if (arr.offset > 0)
+								outfile << "+" << arr.offset - i * int(arr.type.byteSize / v.mValues.size());
+							else if (arr.offset <= 0)
+								outfile << "-" << -(arr.offset + i * int(arr.type.byteSize / v.mValues.size()));
+							outfile << "], " << getStoreRegister(arr.type.subTypes[0], actualSize) << "; VAR_DECL_ASSIGN ARRAY variable " << v.mName << "[" << i << "]" << std::endl;
+						}
 					}
-				} else if (v.mType.builtinType == Builtin_Type::STRUCT) {
+				} else if (hasFields(v.mType.builtinType)) {
 					const Struct& s = p.structs.at(v.mType.name);
 					(*offset) -= int(s.mSize);
 					localOffset -= int(s.mSize);
@@ -840,7 +1677,9 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 					addToSymbols(&localOffset, v);
 					localSymbols.push_back(v.mName);
 					SymbolInfo& var = symbolTable[v.mName];
-					if (v.mValues.size() == 1 && v.mValues[0]->mValue.mText == "@") {
+					if (v.mType.builtinType != Builtin_Type::STRUCT && v.mValues.size() == 1 && v.mValues[0]->mValue.mText != "@") {
+						printVectorAssignment(outfile, p, v.mName, v.mValues[0]);
+					} else if (v.mValues.size() == 1 && v.mValues[0]->mValue.mText == "@") {
 						printExpression(outfile, p, v.mValues[0]->mChildren[0], 0);
 						outfile << "\tmov r10, rax" << std::endl;
 						for (int i = 0; i < s.mFields.size(); i++) {
@@ -858,14 +1697,14 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 						for (int i = 0; i < s.mFields.size(); i++) {
 							Expression* exp = v.mValues.at(i);
 							if (exp == nullptr) continue;
-							printExpression(outfile, p, exp, 0);
+							printValue(exp, s.mFields[i].mType);
 							int actualSize = getSizeFromByteSize(s.mFields[i].mType.byteSize); // TODO: This won't work for nested structs
-							outfile << "\tmov " << sizes[actualSize] << " [" << var.reg;
+							outfile << "\t" << getStore(s.mFields[i].mType) << " " << sizes[actualSize] << " [" << var.reg;
 							if (var.offset > 0)
 								outfile << "+" << var.offset - s.mFields[i].mOffset;
 							else
 								outfile << "-" << -(var.offset + s.mFields[i].mOffset);
-							outfile << "], " << getRegister("a", actualSize) << "; VAR_DECL_ASSIGN STRUCT " << v.mType.name << " " << v.mName << "." << s.mFields[i].mNames[0] << std::endl;
+							outfile << "], " << getStoreRegister(s.mFields[i].mType, actualSize) << "; VAR_DECL_ASSIGN STRUCT " << v.mType.name << " " << v.mName << "." << s.mFields[i].mNames[0] << std::endl;
 						}
 					}
 				} else if (v.mType.builtinType == Builtin_Type::CLASS) {
@@ -895,14 +1734,14 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 						for (int i = 0; i < c.mFields.size(); i++) {
 							Expression* exp = v.mValues.at(i);
 							if (exp == nullptr) continue;
-							printExpression(outfile, p, exp, 0);
+							printValue(exp, c.mFields[i].mType);
 							int actualSize = getSizeFromByteSize(c.mFields[i].mType.byteSize); // TODO: This won't work for nested structs
-							outfile << "\tmov " << sizes[actualSize] << " [" << var.reg;
+							outfile << "\t" << getStore(c.mFields[i].mType) << " " << sizes[actualSize] << " [" << var.reg;
 							if (var.offset > 0)
 								outfile << "+" << var.offset - c.mFields[i].mOffset;
 							else
 								outfile << "-" << -(var.offset + c.mFields[i].mOffset);
-							outfile << "], " << getRegister("a", actualSize) << "; VAR_DECL_ASSIGN CLASS " << v.mType.name << "." << c.mFields[i].mNames[0] << std::endl;
+							outfile << "], " << getStoreRegister(c.mFields[i].mType, actualSize) << "; VAR_DECL_ASSIGN CLASS " << v.mType.name << "." << c.mFields[i].mNames[0] << std::endl;
 						}
 					}
 				} else {
@@ -910,42 +1749,79 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 						std::cerr << "[X86_64 Compiler]: ERROR: Variable '" << v.mName << "' is being declared and assigned with no expression" << std::endl;
 						exit(1);
 					}
-					printExpression(outfile, p, v.mValues[0], 0);
+					printValue(v.mValues[0], v.mType);
 					int size = addToSymbols(offset, v);
 					addToSymbols(&localOffset, v);
 					localSymbols.push_back(v.mName);
-					outfile << "\tmov " << sizes[size] << " " << symbolTable[v.mName].location() << ", " << getRegister("a", size) << "; VAR_DECL_ASSIGN else variable " << v.mName << std::endl;
+					const SymbolInfo& symbol = symbolTable[v.mName];
+					if (symbol.inRegister)
+						printRegisterStore(outfile, symbol, "a");
+					else
+						outfile << "\t" << getStore(v.mType) << " " << sizes[size] << " " << symbol.location() << ", " << getStoreRegister(v.mType, size) << "; VAR_DECL_ASSIGN else variable " << v.mName << std::endl;
 				}
 
 				break;
 			}
 			case Statement_Type::VAR_ASSIGNMENT: {
-				Variable v = statement.variable.value();
+				const Variable& v = statement.variable.value();
 				uint64_t index = v.mName.find('.');
 				if (index != std::string::npos || statement.mContent != nullptr) {
 					// Array or struct property
-					if (v.mType.builtinType == Builtin_Type::ARRAY) {
+					if (v.mType.builtinType == Builtin_Type::ARRAY && v.mType.subTypes[0].builtinType == Builtin_Type::STRUCT) {
+						// `arr[i].field = value` stores the one field, `arr[i] = {...}` every field that has a value
+						std::string arrayName = v.mName.substr(0, index);
+						SymbolInfo& arr = symbolTable[arrayName];
+						const Struct& s = p.structs.at(arr.type.subTypes[0].name);
+						printExpression(outfile, p, statement.mContent, 0);
+						int64_t length = Parser::getLength(arr.type);
+						if (boundsChecks || !isInBounds(statement.mContent, length)) {
+							outfile << "	cmp rax, " << length << "; check bounds" << std::endl;
+							outfile << "	jge array_out_of_bounds" << std::endl;
+						}
+						outfile << "	push rax" << std::endl;
+
+						int target = index == std::string::npos ? -1 : s.getIndexOfProperty(v.mName.substr(index + 1));
+						for (int i = 0; i < s.mFields.size(); i++) {
+							if (target >= 0 && i != target) continue;
+							const Expression* value = target >= 0 ? (v.mValues.empty() ? nullptr : v.mValues[0]) : v.mValues.at(i);
+							if (value == nullptr) continue;
+							const StructField& sf = s.mFields[i];
+							int actualSize = getSizeFromByteSize(sf.mType.byteSize);
+							printValue(value, sf.mType);
+							outfile << "	mov r11, qword [rsp]" << std::endl;
+							std::string address = getElementFieldAddress(outfile, p, arrayName, sf, "r11");
+							outfile << "	" << getStore(sf.mType) << " " << sizes[actualSize] << " " << address << ", " << getStoreRegister(sf.mType, actualSize) << "; VAR_ASSIGNMENT ARRAY " << arrayName << "[]." << sf.mNames[0] << std::endl;
+						}
+						outfile << "	add rsp, 8" << std::endl;
+					} else if (v.mType.builtinType == Builtin_Type::ARRAY) {
 						SymbolInfo& arr = symbolTable[v.mName];
 						int actualSize = getSizeFromByteSize(arr.type.subTypes[0].byteSize);
 						printExpression(outfile, p, statement.mContent, 0);
-						outfile << "\tcmp rax, " << arr.type.byteSize / arr.type.subTypes[0].byteSize << "; check bounds" << std::endl;
-						outfile << "\tjge array_out_of_bounds" << std::endl;
+						int64_t length = Parser::getLength(arr.type);
+						if (boundsChecks || !isInBounds(statement.mContent, length)) {
+							outfile << "\tcmp rax, " << length << "; check bounds" << std::endl;
+							outfile << "\tjge array_out_of_bounds" << std::endl;
+						}
 						outfile << "\tpush rax" << std::endl;
 
 						if (v.mValues.empty()) {
 							std::cerr << "[X86_64 Compiler]: ERROR: Array variable '" << v.mName << "' is being assigned with no expression" << std::endl;
 							exit(1);
 						}
-						printExpression(outfile, p, v.mValues[0], 0);
+						printValue(v.mValues[0], arr.type.subTypes[0]);
 						outfile << "\tpop r11" << std::endl;
-						outfile << "\tmov " << sizes[actualSize] << " [" << arr.reg;
-						if (arr.offset > 0)
-							outfile << "+" << arr.offset << "+r11*" << int(arr.type.subTypes[0].byteSize);
-						else if (arr.offset < 0)
-							outfile << "-" << -arr.offset <<  "+r11*" << int(arr.type.subTypes[0].byteSize);
-						else
-							outfile << "+r11*" << int(arr.type.subTypes[0].byteSize);
-						outfile << "], " << getRegister("a", actualSize) << "; VAR_ASSIGNMENT ARRAY " << v.mName << std::endl;
+						if (Parser::isPacked(arr.type)) {
+							printBitStore(outfile, v.mName, v.mValues[0]);
+						} else {
+							outfile << "\t" << getStore(arr.type.subTypes[0]) << " " << sizes[actualSize] << " [" << arr.reg;
+							if (arr.offset > 0)
+								outfile << "+" << arr.offset << "+r11*" << int(arr.type.subTypes[0].byteSize);
+							else if (arr.offset < 0)
+								outfile << "-" << -arr.offset <<  "+r11*" << int(arr.type.subTypes[0].byteSize);
+							else
+								outfile << "+r11*" << int(arr.type.subTypes[0].byteSize);
+							outfile << "], " << getStoreRegister(arr.type.subTypes[0], actualSize) << "; VAR_ASSIGNMENT ARRAY " << v.mName << std::endl;
+						}
 
 					} else if (v.mType.builtinType == Builtin_Type::REF) {
 						// TODO: Allow for struct refs with property indexing
@@ -968,10 +1844,10 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 							std::cerr << "[X86_64 Compiler]: ERROR: Ref variable '" << v.mName << "' is being assigned with no expression" << std::endl;
 							exit(1);
 						}
-						printExpression(outfile, p, v.mValues[0], 0);
+						printValue(v.mValues[0], ref.type.subTypes[0]);
 						outfile << "\tpop r11" << std::endl;
-						outfile << "\tmov " << sizes[actualSize] << " [r11], " << getRegister("a", actualSize) << "; VAR_ASSIGNMENT REF " << v.mName << std::endl;
-					} else if (v.mType.builtinType == Builtin_Type::STRUCT) {
+						outfile << "\t" << getStore(ref.type.subTypes[0]) << " " << sizes[actualSize] << " [r11], " << getStoreRegister(ref.type.subTypes[0], actualSize) << "; VAR_ASSIGNMENT REF " << v.mName << std::endl;
+					} else if (hasFields(v.mType.builtinType)) {
 						std::string propName = v.mName.substr(index + 1);
 						std::string varName = v.mName.substr(0, index);
 						SymbolInfo& var = symbolTable[varName];
@@ -984,13 +1860,13 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 							std::cerr << "[X86_64 Compiler]: ERROR: Struct property '" << propName << "' of struct variable '" << varName << "' is being assigned with no expression" << std::endl;
 							exit(1);
 						}
-						printExpression(outfile, p, v.mValues[0], 0);
-						outfile << "\tmov " << sizes[actualSize] << " [" << var.reg;
+						printValue(v.mValues[0], sf.mType);
+						outfile << "\t" << getStore(sf.mType) << " " << sizes[actualSize] << " [" << var.reg;
 						if (var.offset > 0)
 							outfile << "+" << var.offset - sf.mOffset;
 						else
 							outfile << "-" << -(var.offset + sf.mOffset);
-						outfile << "], " << getRegister("a", actualSize) << "; VAR_ASSIGNMENT STRUCT " << v.mName << std::endl;
+						outfile << "], " << getStoreRegister(sf.mType, actualSize) << "; VAR_ASSIGNMENT STRUCT " << v.mName << std::endl;
 					} else if (v.mType.builtinType == Builtin_Type::CLASS) {
 						std::string propName = v.mName.substr(index + 1);
 						std::string varName = v.mName.substr(0, index);
@@ -1000,44 +1876,52 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 						const StructField& sf = c.mFields[fieldIndex];
 						int actualSize = getSizeFromByteSize(sf.mType.byteSize);
 
-						printExpression(outfile, p, v.mValues[0], 0);
-						outfile << "\tmov " << sizes[actualSize] << " [" << var.reg;
+						printValue(v.mValues[0], sf.mType);
+						outfile << "\t" << getStore(sf.mType) << " " << sizes[actualSize] << " [" << var.reg;
 						if (var.offset > 0)
 							outfile << "+" << var.offset - sf.mOffset;
 						else
 							outfile << "-" << -(var.offset + sf.mOffset);
-						outfile << "], " << getRegister("a", actualSize) << "; VAR_ASSIGNMENT CLASS " << v.mName << std::endl;
+						outfile << "], " << getStoreRegister(sf.mType, actualSize) << "; VAR_ASSIGNMENT CLASS " << v.mName << std::endl;
 					}
 				} else {
 					// Redefinition
-					if (v.mType.builtinType == Builtin_Type::ARRAY) {
+					if (Parser::isPacked(v.mType)) {
+						for (int i = 0; i < v.mValues.size(); i++) {
+							printValue(v.mValues[i], v.mType.subTypes[0]);
+							outfile << "\tmov r11, " << i << std::endl;
+							printBitStore(outfile, v.mName, v.mValues[i]);
+						}
+					} else if (v.mType.builtinType == Builtin_Type::ARRAY) {
 						SymbolInfo& arr = symbolTable[v.mName];
 						int actualSize = getSizeFromByteSize(arr.type.subTypes[0].byteSize);
 
 						for (int i = 0; i < v.mValues.size(); i++) {
-							printExpression(outfile, p, v.mValues[i], 0);
-							outfile << "\tmov " << sizes[actualSize] << " [" << arr.reg;
+							printValue(v.mValues[i], arr.type.subTypes[0]);
+							outfile << "\t" << getStore(arr.type.subTypes[0]) << " " << sizes[actualSize] << " [" << arr.reg;
 							if (arr.offset > 0)
 								outfile << "+" << arr.offset - i * int(arr.type.byteSize / v.mValues.size());
 							else if (arr.offset <= 0)
 								outfile << "-" << -(arr.offset + i * int(arr.type.byteSize / v.mValues.size()));
-							outfile << "], " << getRegister("a", actualSize) << "; VAR_ASSIGNMENT ARRAY " << v.mName << "[" << i << "]" << std::endl;
+							outfile << "], " << getStoreRegister(arr.type.subTypes[0], actualSize) << "; VAR_ASSIGNMENT ARRAY " << v.mName << "[" << i << "]" << std::endl;
 						}
-					} else if (v.mType.builtinType == Builtin_Type::STRUCT) {
+					} else if (v.mType.builtinType != Builtin_Type::STRUCT && hasFields(v.mType.builtinType) && v.mValues.size() == 1 && v.mValues[0]->mValue.mText != "@") {
+						printVectorAssignment(outfile, p, v.mName, v.mValues[0]);
+					} else if (hasFields(v.mType.builtinType)) {
 						const Struct& s = p.structs.at(v.mType.name);
 						SymbolInfo& var = symbolTable[v.mName];
 
 						for (int i = 0; i < s.mFields.size(); i++) {
 							Expression* exp = v.mValues.at(i);
 							if (exp == nullptr) continue;
-							printExpression(outfile, p, exp, 0);
+							printValue(exp, s.mFields[i].mType);
 							int actualSize = getSizeFromByteSize(s.mFields[i].mType.byteSize); // TODO: This won't work for nested structs
-							outfile << "\tmov " << sizes[actualSize] << " [" << var.reg;
+							outfile << "\t" << getStore(s.mFields[i].mType) << " " << sizes[actualSize] << " [" << var.reg;
 							if (var.offset > 0)
 								outfile << "+" << var.offset - s.mFields[i].mOffset;
 							else
 								outfile << "-" << -(var.offset + s.mFields[i].mOffset);
-							outfile << "], " << getRegister("a", actualSize) << "; VAR_ASSIGNMENT STRUCT " << v.mType.name << "." << s.mFields[i].mNames[0] << std::endl;
+							outfile << "], " << getStoreRegister(s.mFields[i].mType, actualSize) << "; VAR_ASSIGNMENT STRUCT " << v.mType.name << "." << s.mFields[i].mNames[0] << std::endl;
 						}
 					}  else if (v.mType.builtinType == Builtin_Type::CLASS) {
 						const Class& c = p.classes.at(v.mType.name);
@@ -1046,14 +1930,14 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 						for (int i = 0; i < c.mFields.size(); i++) {
 							Expression* exp = v.mValues.at(i);
 							if (exp == nullptr) continue;
-							printExpression(outfile, p, exp, 0);
+							printValue(exp, c.mFields[i].mType);
 							int actualSize = getSizeFromByteSize(c.mFields[i].mType.byteSize); // TODO: This won't work for nested structs
-							outfile << "\tmov " << sizes[actualSize] << " [" << var.reg;
+							outfile << "\t" << getStore(c.mFields[i].mType) << " " << sizes[actualSize] << " [" << var.reg;
 							if (var.offset > 0)
 								outfile << "+" << var.offset - c.mFields[i].mOffset;
 							else
 								outfile << "-" << -(var.offset + c.mFields[i].mOffset);
-							outfile << "], " << getRegister("a", actualSize) << "; VAR_ASSIGNMENT CLASS " << v.mType.name << "." << c.mFields[i].mNames[0] << std::endl;
+							outfile << "], " << getStoreRegister(c.mFields[i].mType, actualSize) << "; VAR_ASSIGNMENT CLASS " << v.mType.name << "." << c.mFields[i].mNames[0] << std::endl;
 						}
 					} else {
 						if (!symbolTable.contains(v.mName)) {
@@ -1062,55 +1946,123 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 								std::cerr << "[X86_64 Compiler]: ERROR: Class property '" << v.mName << "' is being assigned with no expression" << std::endl;
 								exit(1);
 							}
-							printExpression(outfile, p, v.mValues[0], 0);
 							const Class& klass = p.classes.at(currentClass);
 							int propIndex = klass.getIndexOfProperty(v.mName);
-							int leftSize = getSizeFromType(klass.mFields[propIndex].mType);
-							outfile << "\tmov " << sizes[leftSize] << " [rdi+" << klass.mFields[propIndex].mOffset << "], " << getRegister("a", leftSize) << "; VAR_ASSIGNMENT else CLASS " << klass.mName << "." << v.mName << std::endl;
+							const Type& propType = klass.mFields[propIndex].mType;
+							printValue(v.mValues[0], propType);
+							int leftSize = getSizeFromType(propType);
+							outfile << "\t" << getStore(propType) << " " << sizes[leftSize] << " [rdi+" << klass.mFields[propIndex].mOffset << "], " << getStoreRegister(propType, leftSize) << "; VAR_ASSIGNMENT else CLASS " << klass.mName << "." << v.mName << std::endl;
 						} else {
 							SymbolInfo& symbol = symbolTable[v.mName];
 							if (v.mValues.empty()) {
 								std::cerr << "[X86_64 Compiler]: ERROR: Variable '" << v.mName << "' is being assigned with no expression" << std::endl;
 								exit(1);
 							}
-							printExpression(outfile, p, v.mValues[0], 0);
-							bool dereferenceNeeded = symbol.reg == "rbp" || symbol.isGlobal;
-							outfile << "\tmov " << sizes[symbol.size] << " " << symbol.location(dereferenceNeeded) << ", " << getRegister("a", symbol.size) << "; VAR_ASSIGNMENT else variable " << v.mName << std::endl;
+							printValue(v.mValues[0], symbol.type);
+							if (symbol.inRegister) {
+								printRegisterStore(outfile, symbol, "a");
+							} else {
+								bool dereferenceNeeded = symbol.reg == "rbp" || symbol.isGlobal;
+								outfile << "\t" << getStore(symbol.type) << " " << sizes[symbol.size] << " " << symbol.location(dereferenceNeeded) << ", " << getStoreRegister(symbol.type, symbol.size) << "; VAR_ASSIGNMENT else variable " << v.mName << std::endl;
+							}
 						}
 					}
 				}
 			}
 			case Statement_Type::LOOP: {
 				if (!statement.loopStatement.has_value()) continue;
-				LoopStatement ls = statement.loopStatement.value();
+				const LoopStatement& ls = statement.loopStatement.value();
 				if (ls.mIterator.has_value()) {
+					const std::string& iteratorName = ls.mIterator.value().mName;
+					std::optional<std::pair<int64_t, int64_t>> maximum = getIndexRange(ls.mRange.value().mMaximum);
+					// What the vectorised part doesn't do, or all of it, goes one element at a time
+					const Expression* minimumExpression = ls.mRange.value().mMinimum;
+					Expression remainderStart;
+					if (!boundsChecks) {
+						std::optional<int64_t> vectorEnd = printVectorisedLoop(outfile, p, ls);
+						if (vectorEnd.has_value()) {
+							if (vectorEnd.value() == maximum->first) break;
+							remainderStart.mValue = minimumExpression->mValue;
+							remainderStart.mValue.mType = TokenType::LITERAL;
+							remainderStart.mValue.mSubType = TokenSubType::INTEGER_LITERAL;
+							remainderStart.mValue.mText = std::to_string(vectorEnd.value());
+							minimumExpression = &remainderStart;
+						}
+					}
+					std::optional<std::pair<int64_t, int64_t>> minimum = getIndexRange(minimumExpression);
+					bool constantRange = minimum.has_value() && maximum.has_value() && minimum->first == minimum->second && maximum->first == maximum->second;
+
 					int size = addToSymbols(offset, ls.mIterator.value());
 					addToSymbols(&localOffset, ls.mIterator.value());
-					localSymbols.push_back(ls.mIterator.value().mName);
-					SymbolInfo& symbol = symbolTable[ls.mIterator.value().mName];
+					localSymbols.push_back(iteratorName);
+					SymbolInfo& symbol = symbolTable[iteratorName];
 					std::string op = "inc "; // TODO: Find better way of detecting whether to increment or decrement
 					std::string label = ".label";
 					uint32_t localLabelCount = ++labelCount;
 					label = label.append(std::to_string(localLabelCount));
 					loopLabels.push_back(label);
-					printExpression(outfile, p, ls.mRange.value().mMinimum, 0);
+					printExpression(outfile, p, minimumExpression, 0);
 					const char* reg = getRegister("a", size);
-					outfile << "\tmov " << sizes[size] << " " << symbol.location() << ", " << reg << "; LOOP " << ls.mIterator.value().mName << std::endl;
+					if (symbol.inRegister)
+						printRegisterStore(outfile, symbol, "a");
+					else
+						outfile << "\tmov " << sizes[size] << " " << symbol.location() << ", " << reg << "; LOOP " << iteratorName << std::endl;
+					auto printStep = [&]() {
+						if (symbol.inRegister) {
+							outfile << "\t" << op << getRegister(symbol.reg.substr(1), size) << "; LOOP " << iteratorName << std::endl;
+							// Wrap around like the stack variable would
+							if (size < 3)
+								printRegisterStore(outfile, symbol, symbol.reg.substr(1));
+						} else {
+							outfile << "\tmov " << reg << ", " << sizes[size] << " "  << symbol.location() << "; LOOP " << iteratorName << std::endl;
+							outfile << "\t" << op << "rax" << std::endl;
+							outfile << "\tmov " << sizes[size] << " " << symbol.location() << ", " << reg << "; LOOP " << iteratorName << std::endl;
+						}
+					};
+
+					// Inside the body min <= iterator < max, as long as the body doesn't change it and the comparison can't wrap around
+					std::optional<std::pair<int64_t, int64_t>> outerRange;
+					if (iteratorRanges.contains(iteratorName)) {
+						outerRange = iteratorRanges[iteratorName];
+						iteratorRanges.erase(iteratorName);
+					}
+					int64_t largest = (int64_t(1) << (std::min(int(ls.mIterator.value().mType.byteSize), 8) * 8 - 1)) - 1;
+					bool fixedIterator = !writesVariable(ls.mBody, iteratorName);
+					if (constantRange && minimum->first >= 0 && maximum->first <= largest && fixedIterator)
+						iteratorRanges[iteratorName] = {minimum->first, maximum->first - 1};
+
+					// Unrolled, every jump back runs `copies` iterations. What doesn't divide evenly is peeled off in front
+					int64_t copies = 1;
+					if (constantRange && loopUnroll > 1 && fixedIterator && isUnrollable(ls.mBody) && maximum->first - minimum->first >= 2)
+						copies = std::min(int64_t(loopUnroll), maximum->first - minimum->first);
+					int64_t peeled = copies > 1 ? (maximum->first - minimum->first) % copies : 0;
+					for (int64_t i = 0; i < peeled; i++) {
+						printBody(outfile, p, ls.mBody, label, offset);
+						printStep();
+					}
+
 					outfile << label << ":" << std::endl;
 					printExpression(outfile, p, ls.mRange.value().mMaximum, 0);
-					outfile << "\tcmp " << sizes[size] << " " << symbol.location() << ", " << reg << "; LOOP " << ls.mIterator.value().mName << std::endl;
+					if (symbol.inRegister)
+						outfile << "\tcmp " << getRegister(symbol.reg.substr(1), size) << ", " << reg << "; LOOP " << iteratorName << std::endl;
+					else
+						outfile << "\tcmp " << sizes[size] << " " << symbol.location() << ", " << reg << "; LOOP " << iteratorName << std::endl;
 					outfile << "\tjl .inside_label" << localLabelCount << std::endl;
 					outfile << "\tjmp .not_label" << localLabelCount << std::endl;
 					outfile << ".inside_label" << localLabelCount << ":" << std::endl;
-					printBody(outfile, p, ls.mBody, label, offset, allocs);
+					for (int64_t i = 0; i < copies; i++) {
+						if (i > 0) printStep();
+						printBody(outfile, p, ls.mBody, label, offset);
+					}
+					iteratorRanges.erase(iteratorName);
+					if (outerRange.has_value())
+						iteratorRanges[iteratorName] = outerRange.value();
 					loopLabels.pop_back();
 					outfile << ".skip_label" << localLabelCount << ":" << std::endl;
-					outfile << "\tmov " << reg << ", " << sizes[size] << " "  << symbol.location() << "; LOOP " << ls.mIterator.value().mName << std::endl;
-					outfile << "\t" << op << "rax" << std::endl;
-					outfile << "\tmov " << sizes[size] << " " << symbol.location() << ", " << reg << "; LOOP " << ls.mIterator.value().mName << std::endl;
+					printStep();
 					outfile << "\tjmp .label" << localLabelCount << std::endl;
 					outfile << ".not_label" << localLabelCount << ":" << std::endl;
-					symbolTable.erase(ls.mIterator.value().mName);
+					symbolTable.erase(iteratorName);
 				} else {
 					if (statement.mContent == nullptr) {
 						// We have "loop { ... }"
@@ -1119,7 +2071,7 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 						label = label.append(std::to_string(localLabelCount));
 						outfile << label << ":" << std::endl;
 						loopLabels.push_back(label);
-						printBody(outfile, p, ls.mBody, label, offset, allocs);
+						printBody(outfile, p, ls.mBody, label, offset);
 						loopLabels.pop_back();
 						outfile << ".skip_label" << localLabelCount << ":" << std::endl;
 						outfile << "\tjmp .label" << localLabelCount << std::endl;
@@ -1142,16 +2094,9 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 				break;
 			case Statement_Type::FUNC_CALL: {
 				FuncCallStatement fc = statement.funcCall.value();
+				std::vector<std::string> savedArguments = printSaveArguments(outfile);
+				size_t liveBefore = liveArguments.size();
 				// If function is stdlib call, need to expand this into something better when stdlib expands
-				if (fc.mIsRecursive) {
-					outfile << "\tpush rdi" << std::endl;
-					outfile << "\tpush rsi" << std::endl;
-					outfile << "\tpush rdx" << std::endl;
-					outfile << "\tpush rcx" << std::endl;
-					outfile << "\tpush r8" << std::endl;
-					outfile << "\tpush r9" << std::endl;
-					outfile << "\tpush r10" << std::endl;
-				}
 				if (fc.mClassName == "stdout" || fc.mClassName == "stdin") {
 					printFunctionCall(outfile, p, fc);
 				} else {
@@ -1159,30 +2104,54 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 						const SymbolInfo& symbol = symbolTable[fc.mClassName];
 						outfile << "\tlea rax, " << symbol.location(true) << std::endl;
 						outfile << "\tmov " << callingConvention[0] << ", rax" << std::endl;
+						liveArguments.emplace_back(callingConvention[0]);
 					} else {
+						// The object of a method isn't one of its parameters
+						bool isMethod = !fc.mClassName.empty();
+						const Function* callee = nullptr;
+						if (!fc.mIsExternal)
+							callee = findFunction(p, isMethod ? symbolTable[fc.mClassName].type.name : "", fc.mFunctionName);
+						std::vector<const Expression*> arguments(fc.mArgs.begin() + (isMethod ? 1 : 0), fc.mArgs.end());
+						std::vector<std::pair<int, std::optional<Builtin_Type>>> registers = getArgumentRegisters(p, callee, arguments, isMethod ? 1 : 0);
+						std::vector<int> floatArguments;
 						for (int i = fc.mArgs.size() - 1; i >= 0; i--) {
 							if (i == 0 && !fc.mClassName.empty()) {
 								const SymbolInfo& symbol = symbolTable[fc.mClassName];
 								outfile << "\tlea rax, " << symbol.location(true) << std::endl;
 								outfile << "\tmov " << callingConvention[0] << ", rax" << std::endl;
+								liveArguments.emplace_back(callingConvention[0]);
 								continue;
 							}
 							std::string value;
 							Expression* expr = fc.mArgs[i];
+							const auto& [number, floatType] = registers[i - (isMethod ? 1 : 0)];
+							if (floatType.has_value()) {
+								printFloatExpression(outfile, p, expr, floatType.value(), 0);
+								outfile << "\tsub rsp, 8" << std::endl;
+								outfile << "\tmovsd qword [rsp], xmm0" << std::endl;
+								floatArguments.push_back(number);
+								continue;
+							}
 							if (expr->mValue.mSubType == TokenSubType::STRING_LITERAL) {
 								value = p.findLiteralByContent(expr->mValue.mText)->mAlias;
 							} else {
 								printExpression(outfile, p, expr, 0);
 								value = "rax";
 							}
-							if (i <= 6)
-								outfile << "\tmov " << callingConvention[i] << ", " << value << std::endl;
-							else
+							if (number < 6) {
+								outfile << "\tmov " << callingConvention[number] << ", " << value << std::endl;
+								liveArguments.emplace_back(callingConvention[number]);
+							} else
 								outfile << "\tpush " << value << std::endl;
 						}
+						printFloatArguments(outfile, floatArguments);
+						if (fc.mFunctionName == "printf" && fc.mIsExternal) {
+							outfile << "\tmov rax, " << floatArguments.size() << std::endl;
+						}
 					}
-					if (fc.mFunctionName == "printf" && fc.mIsExternal) {
-						outfile << "\tmov rax, 0" << std::endl;
+					// Anything that can write to the file descriptors itself has to see the buffered output first
+					if (fc.mIsExternal || fc.mFunctionName.substr(0, 4) == "SYS_") {
+						outfile << "\tcall stdout_flush" << std::endl;
 					}
 					if (fc.mFunctionName.substr(0, 4) == "SYS_") {
 						printSyscall(outfile, fc.mFunctionName);
@@ -1191,25 +2160,19 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 						outfile << "\tmov rax, 11" << std::endl;
 						outfile << "\tsyscall" << std::endl;
 					} else {
-						outfile << "\tcall ";
+						std::stringstream target;
 						if (!fc.mNamespace.empty())
-							outfile << fc.mNamespace << "_";
+							target << fc.mNamespace << "_";
 						if (!fc.mClassName.empty()) {
 							const SymbolInfo& symbol = symbolTable[fc.mClassName];
-							outfile << symbol.type.name << "_";
+							target << symbol.type.name << "_";
 						}
-						outfile << statement.funcCall.value().mFunctionName << std::endl;
+						target << statement.funcCall.value().mFunctionName;
+						printCall(outfile, target.str(), fc.mIsExternal && fc.mArgs.size() <= 6);
 					}
 				}
-				if (fc.mIsRecursive) {
-					outfile << "\tpop r10" << std::endl;
-					outfile << "\tpop r9" << std::endl;
-					outfile << "\tpop r8" << std::endl;
-					outfile << "\tpop rcx" << std::endl;
-					outfile << "\tpop rdx" << std::endl;
-					outfile << "\tpop rsi" << std::endl;
-					outfile << "\tpop rdi" << std::endl;
-				}
+				liveArguments.resize(liveBefore);
+				printRestoreArguments(outfile, savedArguments);
 				break;
 			}
 			case Statement_Type::NOTHING:
@@ -1217,7 +2180,7 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 				break;
 			case Statement_Type::IF: {
 				// TODO: If statements with a function call for expression don't work
-				IfStatement is = statement.ifStatement.value();
+				const IfStatement& is = statement.ifStatement.value();
 				printExpression(outfile, p, statement.mContent, 0);
 				std::string label = ".if";
 				uint32_t localIfCount = ++ifCount;
@@ -1229,11 +2192,11 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 				else
 					outfile << "\tjmp .end_if" << localIfCount << std::endl;
 				outfile << label << ":" << std::endl;
-				printBody(outfile, p, is.mBody, label, offset, allocs);
+				printBody(outfile, p, is.mBody, label, offset);
 				outfile << "\tjmp .end_if" << localIfCount << std::endl;
 				if (is.mElse.has_value()) {
 					outfile << ".else_if" << localIfCount << ":" << std::endl;
-					printBody(outfile, p, is.mElseBody.value(), label, offset, allocs);
+					printBody(outfile, p, is.mElseBody.value(), label, offset);
 				}
 				outfile << ".end_if" << localIfCount << ":" << std::endl;
 				break;
@@ -1244,12 +2207,9 @@ void X86_64LinuxYasmCompiler::printBody(std::ofstream& outfile, const Programme&
 		}
 	}
 
-	if (block.stackMemory != 0) {
-		int toDeAlloc = nearestMultipleOf(block.stackMemory + block.biggestAlloc, 8);
-		outfile << "\tadd rsp, " << toDeAlloc << std::endl;
-		(*allocs) -= toDeAlloc;
-	}
-
+	// Offsets only go down inside a block, so this is as deep as it went. Its slots are free again afterwards, the
+	// blocks after it reuse them and the frame only has to fit the deepest nesting
+	frameDepth = std::min(frameDepth, *offset);
 	*offset -= localOffset;
 	for (const auto& symbolName : localSymbols) {
 		symbolTable.erase(symbolName);
@@ -1282,12 +2242,24 @@ std::stringstream X86_64LinuxYasmCompiler::moveToRegister(const std::string& reg
 	return ss;
 }
 
-ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfile, const Programme& p, const Expression* expression, uint8_t nodeType) {
+ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ostream& outfile, const Programme& p, const Expression* expression, uint8_t nodeType) {
 	if (expression == nullptr) return ExpressionPrinted{};
 
+	if (expression->mValue.mText != "(" || expression->mChildren.empty()) {
+		if (std::optional<Builtin_Type> floatType = getFloatType(p, expression); floatType.has_value()) {
+			// A floating point value where an integer is expected is truncated, like a cast in C
+			printFloatExpression(outfile, p, expression, floatType.value(), 0);
+			outfile << "\tcvtt" << (floatType.value() == Builtin_Type::F64 ? "sd" : "ss") << "2si rax, xmm0" << std::endl;
+			if (nodeType == 1) {
+				outfile << "\tmov rbx, rax; printExpression, nodeType=1, float" << std::endl;
+			}
+			return ExpressionPrinted{ true, true, 3 };
+		}
+	}
+
 	const char* sizes[] = {"byte", "word", "dword", "qword"};
 
-	if (nodeType == 0 && expression->mChildren.empty()) {
+	if (nodeType == 0 && expression->isLeaf()) {
 		// No expression, just base value
 		if (expression->mValue.mSubType == TokenSubType::STRING_LITERAL) {
 			outfile << "\tmov rax, " << p.findLiteralByContent(expression->mValue.mText).value().mAlias << std::endl;
@@ -1300,7 +2272,9 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 			bool sign = val.type.name[0] == 'i'; // This might cause a problem later with user-defined types starting with i
 			const char* moveAction = getMoveAction(3, val.size, sign);
 			const char* reg = (val.size < 2 || sign) ? "rax" : getRegister("a", val.size);
-			if (val.isGlobal) {
+			if (val.inRegister) {
+				outfile << "\tmov rax, " << val.reg << "; printExpression register variable " << expression->mValue.mText << std::endl;
+			} else if (val.isGlobal) {
 				outfile << "\t" << moveAction << " " << reg << ", " << sizes[val.size] << " "  << val.location(true) << "; printExpression global variable " << expression->mValue.mText << std::endl;
 			} else {
 				bool dereferenceNeeded = val.reg == "rbp";
@@ -1347,12 +2321,23 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 		// NOTE: Isn't only arrays, but can also be refs, strings, or if we want, numbers indexed to the bits
 		int actualSize = getSizeFromByteSize(arr.type.subTypes[0].byteSize);
 		if (arr.type.builtinType == Builtin_Type::ARRAY) {
+			int64_t length = Parser::getLength(arr.type);
 			if (arr.offset > 0) {
 				outfile << "\tcmp rax, " << sizes[actualSize] << " " << arr.location() << "; check bounds" << std::endl;
-			} else {
-				outfile << "\tcmp rax, " << arr.type.byteSize / arr.type.subTypes[0].byteSize << "; check bounds" << std::endl;
+				outfile << "\tjge array_out_of_bounds" << std::endl;
+			} else if (boundsChecks || !isInBounds(expression->mChildren[1], length)) {
+				outfile << "\tcmp rax, " << length << "; check bounds" << std::endl;
+				outfile << "\tjge array_out_of_bounds" << std::endl;
+			}
+			if (Parser::isPacked(arr.type)) {
+				printBitWord(outfile, expression->mChildren[0]->mValue.mText, "rax");
+				outfile << "\tbt r12, rax" << std::endl;
+				outfile << "\tsetc al" << std::endl;
+				outfile << "\tmovzx rax, al" << std::endl;
+				if (nodeType == 1)
+					outfile << "\tmov rbx, rax; printExpression, nodeType=1, packed array index" << std::endl;
+				return ExpressionPrinted{true, false, 3};
 			}
-			outfile << "\tjge array_out_of_bounds" << std::endl;
 			bool sign = arr.type.subTypes[0].name[0] == 'i'; // This might cause a problem later with user-defined types starting with i
 			const char* moveAction = getMoveAction(3, actualSize, sign);
 			const char* reg = actualSize < 2 ? "r12" : getRegister("12", actualSize);
@@ -1385,89 +2370,30 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 			}
 		}
 		return ExpressionPrinted{true, false, 3};
-	} else if (expression->mValue.mText == "(") {
-		const char callingConvention[6][4] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
-		std::stringstream ss;
-		bool printArgs = false;
-		int i = 0;
-		std::string classVariable = "";
-		outfile << "\tpush rdi" << std::endl;
-		outfile << "\tpush rsi" << std::endl;
-		outfile << "\tpush rdx" << std::endl;
-		outfile << "\tpush rcx" << std::endl;
-		outfile << "\tpush r8" << std::endl;
-		outfile << "\tpush r9" << std::endl;
-		outfile << "\tpush r10" << std::endl;
-		for (const auto& child : expression->mChildren) {
-			if (child->mValue.mText == "e" || child->mValue.mText == ":") continue;
-			if (child->mValue.mText == "(") {
-				printArgs = true;
-				if (!classVariable.empty()) {
-					const SymbolInfo& symbol = symbolTable[classVariable];
-					outfile << "\tlea rax, " << symbol.location(true) << std::endl;
-					outfile << "\tmov " << callingConvention[0] << ", rax" << std::endl;
-					i++;
-				}
-				continue;
-			}
-			if (!printArgs) {
-				if (child->mValue.mType == TokenType::OPERATOR)
-					ss << "_";
-				else {
-					if (!symbolTable.contains(child->mValue.mText)) {
-						ss << child->mValue.mText;
-						continue;
-					}
-					const SymbolInfo& symbol = symbolTable[child->mValue.mText];
-					ss << symbol.type.name;
-					classVariable = child->mValue.mText;
-				}
-			} else {
-				std::string value;
-
-				if (child->mValue.mSubType == TokenSubType::STRING_LITERAL) {
-					value = p.findLiteralByContent(child->mValue.mText)->mAlias;
-				} else {
-					printExpression(outfile, p, child, 0);
-					value = "rax";
-				}
-				if (i <= 6)
-					outfile << "\tmov " << callingConvention[i] << ", " << value << std::endl;
-				else
-					outfile << "\tpush " << value << std::endl; // TODO: This is a bug, values should be pushed onto the stack in reverse order
-				i++;
-			}
+	} else if (expression->mValue.mText == "(" && !expression->mChildren.empty() && expression->mChildren[0]->mValue.mText == "dot") {
+		printVectorDot(outfile, p, expression);
+		// The dot product of floating point vectors is in xmm0, and truncated where an integer is expected
+		if (std::optional<Builtin_Type> floatType = getFloatType(p, expression); floatType.has_value())
+			outfile << "\tcvtt" << (floatType.value() == Builtin_Type::F64 ? "sd" : "ss") << "2si rax, xmm0" << std::endl;
+		if (nodeType == 1) {
+			outfile << "\tmov rbx, rax; printExpression, nodeType=1, dot" << std::endl;
 		}
-		if (ss.str() == "printf") {
-			outfile << "\tmov rax, 0" << std::endl;
+		return ExpressionPrinted{ true, false, 3 };
+	} else if (expression->mValue.mText == "(" && isBitReduction(p, expression)) {
+		printBitReduction(outfile, expression);
+		if (nodeType == 1) {
+			outfile << "\tmov rbx, rax; printExpression, nodeType=1, " << expression->mChildren[0]->mValue.mText << std::endl;
 		}
-		if (ss.str().substr(0, 4) == "SYS_") {
-			printSyscall(outfile, ss.str());
-			outfile << "\tsyscall" << std::endl;
-		} else if (ss.str() == "alloc") {
-			outfile << "\tmov rax, 9" << std::endl;
-			outfile << "\tmov rsi, rdi" << std::endl;
-			outfile << "\txor rdi, rdi" << std::endl;
-			outfile << "\tmov rdx, 3" << std::endl;
-			outfile << "\tmov r10, 34" << std::endl;
-			outfile << "\txor r8, r8" << std::endl;
-			outfile << "\txor r9, r9" << std::endl;
-			outfile << "\tsyscall" << std::endl;
-		} else {
-			outfile << "\tcall " << ss.str() << std::endl;
+		return ExpressionPrinted{ true, false, 3 };
+	} else if (expression->mValue.mText == "(") {
+		printCallExpression(outfile, p, expression);
+		if (const Function* callee = findCallee(p, expression); callee != nullptr && isFloat(callee->mReturnType.builtinType)) {
+			outfile << "\tcvtt" << (callee->mReturnType.builtinType == Builtin_Type::F64 ? "sd" : "ss") << "2si rax, xmm0" << std::endl;
 		}
 		if (nodeType == 1) {
 			outfile << "\tmov rbx, rax; printExpression, nodeType=1, function call" << std::endl;
 		}
 
-		outfile << "\tpop r10" << std::endl;
-		outfile << "\tpop r9" << std::endl;
-		outfile << "\tpop r8" << std::endl;
-		outfile << "\tpop rcx" << std::endl;
-		outfile << "\tpop rdx" << std::endl;
-		outfile << "\tpop rsi" << std::endl;
-		outfile << "\tpop rdi" << std::endl;
-
 		return ExpressionPrinted{ true, false, 3 };
 	} else if (expression->mValue.mSubType == TokenSubType::OP_UNARY) {
 		if (expression->mValue.mText == "\\") {
@@ -1493,7 +2419,10 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 					leftSize = left.size;
 					const char* reg = "r11";
 					const char* moveAction = getMoveAction(3, leftSize, leftSign);
-					outfile << "\t" << moveAction << " " << reg << ", " << sizes[left.size] << " " << left.location() << "; printExpression variable " << expression->mChildren[0]->mValue.mText << std::endl;
+					if (left.inRegister)
+						outfile << "\tmov " << reg << ", " << left.reg << "; printExpression register variable " << expression->mChildren[0]->mValue.mText << std::endl;
+					else
+						outfile << "\t" << moveAction << " " << reg << ", " << sizes[left.size] << " " << left.location() << "; printExpression variable " << expression->mChildren[0]->mValue.mText << std::endl;
 					outfile << "\tmov rax, [r11]" << std::endl;
 				} else if (child->mValue.mSubType == TokenSubType::STRING_LITERAL) {
 					throw std::runtime_error("Cannot dereference a string literal value");
@@ -1519,7 +2448,11 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 					SymbolInfo& left = symbolTable[expression->mChildren[0]->mValue.mText];
 					leftSign = left.type.name[0] == 'i'; // This might cause a problem later with user-defined types starting with i
 					leftSize = left.size;
-					if (left.type.builtinType == Builtin_Type::BOOL) {
+					if (left.inRegister) {
+						outfile << "\tcmp " << left.reg << ", 0; printExpression !" << expression->mChildren[0]->mValue.mText << std::endl;
+						outfile << "\tsete al" << std::endl;
+						outfile << "\tmovzx rax, al" << std::endl;
+					} else if (left.type.builtinType == Builtin_Type::BOOL) {
 						const char* reg = leftSize < 2 ? "rax" : getRegister("a", leftSize);
 						const char* moveAction = getMoveAction(3, leftSize, leftSign);
 						outfile << "\t" << moveAction << " " << reg << ", " << sizes[left.size] << " " << left.location() << "; printExpression !" << expression->mChildren[0]->mValue.mText << std::endl;
@@ -1557,7 +2490,10 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 					leftSize = left.size;
 					const char* reg = "rax";
 					const char* moveAction = getMoveAction(3, leftSize, leftSign);
-					outfile << "\t" << moveAction << " " << reg << ", " << sizes[left.size] << " " << left.location() << "; printExpression ~" << expression->mChildren[0]->mValue.mText << std::endl;
+					if (left.inRegister)
+						outfile << "\tmov " << reg << ", " << left.reg << "; printExpression ~" << expression->mChildren[0]->mValue.mText << std::endl;
+					else
+						outfile << "\t" << moveAction << " " << reg << ", " << sizes[left.size] << " " << left.location() << "; printExpression ~" << expression->mChildren[0]->mValue.mText << std::endl;
 					outfile << "\tnot rax" << std::endl;
 				} else if (child->mValue.mSubType == TokenSubType::STRING_LITERAL) {
 					throw std::runtime_error("Cannot `~` a string literal value");
@@ -1584,7 +2520,10 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 					leftSize = left.size;
 					const char* reg = "rax";
 					const char* moveAction = getMoveAction(3, leftSize, leftSign);
-					outfile << "\t" << moveAction << " " << reg << ", " << sizes[left.size] << " " << left.location() << "; printExpression -" << expression->mChildren[0]->mValue.mText << std::endl;
+					if (left.inRegister)
+						outfile << "\tmov " << reg << ", " << left.reg << "; printExpression -" << expression->mChildren[0]->mValue.mText << std::endl;
+					else
+						outfile << "\t" << moveAction << " " << reg << ", " << sizes[left.size] << " " << left.location() << "; printExpression -" << expression->mChildren[0]->mValue.mText << std::endl;
 					outfile << "\tneg rax" << std::endl;
 				} else if (child->mValue.mSubType == TokenSubType::STRING_LITERAL) {
 					throw std::runtime_error("Cannot `-` a string literal value");
@@ -1605,6 +2544,17 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 		}
 		return ExpressionPrinted{ true, false, 3 };
 	} else if (expression->mValue.mText == ".") {
+		if (const StructField* field = findElementField(p, expression); field != nullptr) {
+			// A field of an element of an array of structs
+			std::string address = printElementField(outfile, p, expression, *field);
+			int actualSize = getSizeFromByteSize(field->mType.byteSize);
+			const char* moveAction = getMoveAction(3, actualSize, field->mType.name[0] == 'i');
+			outfile << "	" << moveAction << " " << getRegister("a", std::string_view(moveAction) == "mov" ? actualSize : 3) << ", " << sizes[actualSize] << " " << address << "; printExpression array of structs " << expression->mChildren[0]->mChildren[0]->mValue.mText << "[]." << field->mNames[0] << std::endl;
+			if (nodeType == 1) {
+				outfile << "	mov rbx, rax; printExpression, nodeType=1, array of structs" << std::endl;
+			}
+			return ExpressionPrinted{ true, false, actualSize };
+		}
 		// We have a struct property
 		if (!symbolTable.contains(expression->mChildren[0]->mValue.mText)) {
 			throw std::runtime_error("Trying to get property of unknown symbol " + expression->mChildren[0]->mValue.mText);
@@ -1613,18 +2563,18 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 		std::string propName = expression->mChildren[1]->mValue.mText; // Right is property name
 		std::string structName = left.type.name;
 		// Left can be a ref<T> with subtype struct
-		if (!left.type.subTypes.empty()) {
+		if (left.type.builtinType == Builtin_Type::REF) {
 			structName = left.type.subTypes[0].name; // TODO: We assume only one level deep
 		}
 		int actualSize = 0;
-		if (left.type.builtinType == Builtin_Type::STRUCT || (left.type.subTypes[0].builtinType == Builtin_Type::STRUCT)) {
+		if (hasFields(left.type.builtinType) || (left.type.builtinType == Builtin_Type::REF && left.type.subTypes[0].builtinType == Builtin_Type::STRUCT)) {
 			const Struct& s = p.structs.at(structName);
 			int fieldIndex = s.getIndexOfProperty(propName);
 			const StructField& sf = s.mFields[fieldIndex];
 			actualSize = getSizeFromByteSize(sf.mType.byteSize);
 			const char* moveAction = getMoveAction(3, actualSize, sf.mType.name[0] == 'i');
 
-			outfile << "\t" << moveAction << " " << getRegister("a", actualSize >= 2 ? actualSize : 3) << ", " << sizes[actualSize] << " [" << left.reg;
+			outfile << "\t" << moveAction << " " << getRegister("a", std::string_view(moveAction) == "mov" ? actualSize : 3) << ", " << sizes[actualSize] << " [" << left.reg;
 			if (left.reg != "rbp") {
 				outfile << "+" << left.offset + sf.mOffset;
 			} else {
@@ -1645,7 +2595,7 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 			actualSize = getSizeFromByteSize(sf.mType.byteSize);
 			const char* moveAction = getMoveAction(3, actualSize, sf.mType.name[0] == 'i');
 
-			outfile << "\t" << moveAction << " " << getRegister("a", actualSize >= 2 ? actualSize : 3) << ", " << sizes[actualSize] << " [" << left.reg;
+			outfile << "\t" << moveAction << " " << getRegister("a", std::string_view(moveAction) == "mov" ? actualSize : 3) << ", " << sizes[actualSize] << " [" << left.reg;
 			if (left.reg != "rbp") {
 				outfile << "+" << left.offset + sf.mOffset;
 			} else {
@@ -1662,6 +2612,16 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 		return ExpressionPrinted{ true, false, actualSize };
 	}
 
+	const std::string& op = expression->mValue.mText;
+	bool isComparison = op == "<" || op == "<=" || op == "==" || op == "!=" || op == ">" || op == ">=";
+	if (isComparison && (getFloatType(p, expression->mChildren[0]).has_value() || getFloatType(p, expression->mChildren[1]).has_value())) {
+		printFloatComparison(outfile, p, expression);
+		if (nodeType == 1) {
+			outfile << "\tmov rbx, rax; printExpression, nodeType=1, float comparison" << std::endl;
+		}
+		return ExpressionPrinted{ true, false, 3 };
+	}
+
 	ExpressionPrinted leftPrinted = printExpression(outfile, p, expression->mChildren[0], -1);
 	if (leftPrinted.printed) {
 		outfile << "\tpush rax; printExpression, leftPrinted, save left" << std::endl; // Save left
@@ -1685,7 +2645,9 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 			const char* reg = leftSize < 2 || leftSign ? "rax" : getRegister("a", leftSize);
 			const char* moveAction = getMoveAction(3, leftSize, leftSign);
 			bool dereferenceNeeded = left.isGlobal;
-			if (left.reg == "rbp")
+			if (left.inRegister)
+				outfile << "\tmov rax, " << left.reg << "; printExpression, left identifier, register variable " << expression->mChildren[0]->mValue.mText << std::endl;
+			else if (left.reg == "rbp")
 				outfile << "\t" << moveAction << " " << reg << ", " << sizes[left.size] << " " << left.location() << "; printExpression, left identifier, rbp variable " << expression->mChildren[0]->mValue.mText << std::endl;
 			else
 				outfile << "\t" << moveAction << " " << reg << ", " << sizes[left.size] << " " << left.location(dereferenceNeeded) << "; printExpression, left identifier, not rbp" << std::endl;
@@ -1727,7 +2689,9 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 			const char* reg = rightSize < 2 || rightSign ? "rbx" : getRegister("b", rightSize);
 			const char* moveAction = getMoveAction(3, rightSize, rightSign);
 			bool dereferenceNeeded = right.isGlobal;
-			if (right.reg == "rbp")
+			if (right.inRegister)
+				outfile << "\tmov rbx, " << right.reg << "; printExpression, right identifier, register variable " << expression->mChildren[1]->mValue.mText << std::endl;
+			else if (right.reg == "rbp")
 				outfile << "\t" << moveAction << " " << reg << ", " << sizes[right.size] << " " << right.location() << "; printExpression, right identifier, rbp variable " << expression->mChildren[1]->mValue.mText << std::endl;
 			else
 				outfile << "\t" << moveAction << " " << reg << ", " << sizes[right.size] << " " << right.location(dereferenceNeeded) << "; printExpression, right identifier, not rbp" << std::endl;
@@ -1852,7 +2816,7 @@ ExpressionPrinted X86_64LinuxYasmCompiler::printExpression(std::ofstream& outfil
 	return curr;
 }
 
-void X86_64LinuxYasmCompiler::printConditionalMove(std::ofstream& outfile, int leftSize, int rightSize, const char* instruction) {
+void X86_64LinuxYasmCompiler::printConditionalMove(std::ostream& outfile, int leftSize, int rightSize, const char* instruction) {
 	int size = getEvenSize(leftSize, rightSize);
 	std::string r1 = getRegister("a", size);
 	std::string r2 = getRegister("b", size);
@@ -1863,6 +2827,479 @@ void X86_64LinuxYasmCompiler::printConditionalMove(std::ofstream& outfile, int l
 	outfile << "\tmov rax, rcx; printConditionalMove" << std::endl;
 }
 
+void X86_64LinuxYasmCompiler::printCallExpression(std::ostream& outfile, const Programme& p, const Expression* expression) {
+	const char callingConvention[6][4] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+	std::stringstream ss;
+	bool printArgs = false;
+	int i = 0;
+	std::string classVariable = "";
+	std::vector<std::string> savedArguments = printSaveArguments(outfile);
+	size_t liveBefore = liveArguments.size();
+	bool isExternal = false;
+	std::vector<std::pair<int, std::optional<Builtin_Type>>> registers;
+	std::vector<int> floatArguments;
+	size_t argument = 0;
+	for (const auto& child : expression->mChildren) {
+		if (!printArgs && child->mValue.mText == "e") isExternal = true;
+		if (child->mValue.mText == "e" || child->mValue.mText == ":") continue;
+		if (child->mValue.mText == "(") {
+			printArgs = true;
+			if (!classVariable.empty()) {
+				const SymbolInfo& symbol = symbolTable[classVariable];
+				outfile << "\tlea rax, " << symbol.location(true) << std::endl;
+				outfile << "\tmov " << callingConvention[0] << ", rax" << std::endl;
+				liveArguments.emplace_back(callingConvention[0]);
+				i++;
+			}
+			registers = getArgumentRegisters(p, isExternal ? nullptr : findCallee(p, expression), getArguments(expression), i);
+			continue;
+		}
+		if (!printArgs) {
+			if (child->mValue.mType == TokenType::OPERATOR)
+				ss << "_";
+			else {
+				if (!symbolTable.contains(child->mValue.mText)) {
+					ss << child->mValue.mText;
+					continue;
+				}
+				const SymbolInfo& symbol = symbolTable[child->mValue.mText];
+				ss << symbol.type.name;
+				classVariable = child->mValue.mText;
+			}
+		} else {
+			const auto& [number, floatType] = registers[argument++];
+			if (floatType.has_value()) {
+				// Kept on the stack until all the arguments are done, anything printed after it can use the xmm registers
+				printFloatExpression(outfile, p, child, floatType.value(), 0);
+				outfile << "\tsub rsp, 8" << std::endl;
+				outfile << "\tmovsd qword [rsp], xmm0" << std::endl;
+				floatArguments.push_back(number);
+				continue;
+			}
+			std::string value;
+
+			if (child->mValue.mSubType == TokenSubType::STRING_LITERAL) {
+				value = p.findLiteralByContent(child->mValue.mText)->mAlias;
+			} else {
+				printExpression(outfile, p, child, 0);
+				value = "rax";
+			}
+			if (number < 6) {
+				outfile << "\tmov " << callingConvention[number] << ", " << value << std::endl;
+				liveArguments.emplace_back(callingConvention[number]);
+			} else
+				outfile << "\tpush " << value << std::endl; // TODO: This is a bug, values should be pushed onto the stack in reverse order
+			i++;
+		}
+	}
+	if (!floatArguments.empty() && i > 6) {
+		std::cerr << "[X86_64 Compiler]: ERROR: Calls with floating point arguments can't have more than 6 integer arguments, '" << ss.str() << "' has " << i << std::endl;
+		exit(1);
+	}
+	printFloatArguments(outfile, floatArguments);
+	if (isExternal || ss.str().substr(0, 4) == "SYS_") {
+		outfile << "\tcall stdout_flush" << std::endl;
+	}
+	if (ss.str() == "printf") {
+		outfile << "\tmov rax, " << floatArguments.size() << std::endl;
+	}
+	if (ss.str().substr(0, 4) == "SYS_") {
+		printSyscall(outfile, ss.str());
+		outfile << "\tsyscall" << std::endl;
+	} else if (ss.str() == "alloc") {
+		outfile << "\tmov rax, 9" << std::endl;
+		outfile << "\tmov rsi, rdi" << std::endl;
+		outfile << "\txor rdi, rdi" << std::endl;
+		outfile << "\tmov rdx, 3" << std::endl;
+		outfile << "\tmov r10, 34" << std::endl;
+		outfile << "\txor r8, r8" << std::endl;
+		outfile << "\txor r9, r9" << std::endl;
+		outfile << "\tsyscall" << std::endl;
+	} else {
+		if (!isExternal)
+			calledSymbols.insert(ss.str());
+		printCall(outfile, ss.str(), isExternal && i <= 6);
+	}
+	liveArguments.resize(liveBefore);
+	printRestoreArguments(outfile, savedArguments);
+}
+
+std::vector<std::pair<int, std::optional<Builtin_Type>>> X86_64LinuxYasmCompiler::getArgumentRegisters(const Programme& p, const Function* callee, const std::vector<const Expression*>& arguments, int firstInteger) {
+	std::vector<std::pair<int, std::optional<Builtin_Type>>> result;
+	int integers = firstInteger;
+	int floats = 0;
+	for (size_t i = 0; i < arguments.size(); i++) {
+		std::optional<Builtin_Type> type;
+		if (callee != nullptr && i < callee->mArgs.size()) {
+			if (isFloat(callee->mArgs[i].mType.builtinType))
+				type = callee->mArgs[i].mType.builtinType;
+		} else if (arguments[i]->mValue.mSubType != TokenSubType::STRING_LITERAL && getFloatType(p, arguments[i]).has_value()) {
+			// C promotes floating point numbers passed to variadic functions to double
+			type = Builtin_Type::F64;
+		}
+		if (!type.has_value()) {
+			result.emplace_back(integers++, std::nullopt);
+			continue;
+		}
+		if (floats == 8) {
+			std::cerr << "[X86_64 Compiler]: ERROR: Calls can't have more than 8 floating point arguments" << std::endl;
+			exit(1);
+		}
+		result.emplace_back(floats++, type);
+	}
+	return result;
+}
+
+void X86_64LinuxYasmCompiler::printFloatArguments(std::ostream& outfile, const std::vector<int>& registers) {
+	if (registers.empty()) return;
+	for (size_t i = 0; i < registers.size(); i++) {
+		size_t slot = registers.size() - 1 - i;
+		outfile << "\tmovsd xmm" << registers[i] << ", qword [rsp";
+		if (slot > 0)
+			outfile << "+" << slot * 8;
+		outfile << "]" << std::endl;
+	}
+	outfile << "\tadd rsp, " << registers.size() * 8 << std::endl;
+}
+
+const Function* X86_64LinuxYasmCompiler::findFunction(const Programme& p, const std::string& className, const std::string& name) {
+	const std::vector<Function>* functions = &p.functions;
+	if (!className.empty()) {
+		auto klass = p.classes.find(className);
+		if (klass == p.classes.end()) return nullptr;
+		functions = &klass->second.mFunctions;
+	}
+	auto function = std::find_if(functions->begin(), functions->end(), [&](const Function& f) { return f.mName == name; });
+	if (function != functions->end()) return &*function;
+	if (!className.empty()) return nullptr;
+	// The signature of a function from an imported file still decides which registers its arguments go in
+	function = std::find_if(p.importedFunctions.begin(), p.importedFunctions.end(), [&](const Function& f) { return f.mName == name; });
+	return function == p.importedFunctions.end() ? nullptr : &*function;
+}
+
+const Function* X86_64LinuxYasmCompiler::findCallee(const Programme& p, const Expression* call) {
+	std::string className;
+	std::string name;
+	for (const auto* child : call->mChildren) {
+		if (child->mValue.mText == "(") break;
+		// External functions aren't in the programme
+		if (child->mValue.mText == "e") return nullptr;
+		if (child->mValue.mType != TokenType::IDENTIFIER) continue;
+		auto symbol = symbolTable.find(child->mValue.mText);
+		if (symbol != symbolTable.end())
+			className = symbol->second.type.name;
+		else
+			name = child->mValue.mText;
+	}
+	return findFunction(p, className, name);
+}
+
+const StructField* X86_64LinuxYasmCompiler::findField(const Programme& p, const Type& type, const std::string& name) {
+	const std::string& structName = type.builtinType == Builtin_Type::REF && !type.subTypes.empty() ? type.subTypes[0].name : type.name;
+	const std::vector<StructField>* fields = nullptr;
+	int index = -1;
+	if (p.structs.contains(structName)) {
+		const Struct& s = p.structs.at(structName);
+		fields = &s.mFields;
+		index = s.getIndexOfProperty(name);
+	} else if (p.classes.contains(structName)) {
+		const Class& c = p.classes.at(structName);
+		fields = &c.mFields;
+		index = c.getIndexOfProperty(name);
+	}
+	return index < 0 ? nullptr : &(*fields)[index];
+}
+
+std::optional<Builtin_Type> X86_64LinuxYasmCompiler::mergeFloatTypes(const Expression* left, std::optional<Builtin_Type> leftType, const Expression* right, std::optional<Builtin_Type> rightType) {
+	if (!leftType.has_value()) return rightType;
+	if (!rightType.has_value() || leftType == rightType) return leftType;
+	// A literal is an f64, it shouldn't make the arithmetic on an f32 any wider
+	bool leftLiteral = left->mValue.mSubType == TokenSubType::FLOAT_LITERAL;
+	bool rightLiteral = right->mValue.mSubType == TokenSubType::FLOAT_LITERAL;
+	if (leftLiteral != rightLiteral)
+		return leftLiteral ? rightType : leftType;
+	return Builtin_Type::F64;
+}
+
+std::optional<Builtin_Type> X86_64LinuxYasmCompiler::getFloatType(const Programme& p, const Expression* expression) {
+	if (expression == nullptr) return std::nullopt;
+	auto floatOf = [](const Type& type) -> std::optional<Builtin_Type> {
+		if (isFloat(type.builtinType)) return type.builtinType;
+		return std::nullopt;
+	};
+	const Token& value = expression->mValue;
+	const auto& children = expression->mChildren;
+	if (expression->isLeaf()) {
+		if (value.mSubType == TokenSubType::FLOAT_LITERAL) return Builtin_Type::F64;
+		if (value.mType != TokenType::IDENTIFIER) return std::nullopt;
+		auto symbol = symbolTable.find(value.mText);
+		if (symbol != symbolTable.end()) return floatOf(symbol->second.type);
+		// Class member
+		auto klass = p.classes.find(currentClass);
+		if (klass == p.classes.end()) return std::nullopt;
+		int index = klass->second.getIndexOfProperty(value.mText);
+		return index < 0 ? std::nullopt : floatOf(klass->second.mFields[index].mType);
+	}
+	if (value.mType != TokenType::OPERATOR || value.mSubType == TokenSubType::STRING_LITERAL || children[0] == nullptr) return std::nullopt;
+
+	if (value.mText == "(") {
+		const Function* callee = findCallee(p, expression);
+		if (callee != nullptr) return floatOf(callee->mReturnType);
+		// The dot product of two vectors is a number of their element type
+		if (children[0]->mValue.mText != "dot") return std::nullopt;
+		std::vector<const Expression*> arguments = getArguments(expression);
+		std::optional<Type> vector = arguments.empty() ? std::nullopt : getVectorType(arguments[0]);
+		return vector.has_value() ? floatOf(vector->subTypes[0]) : std::nullopt;
+	}
+	if (value.mText == "[" || value.mText == ".") {
+		if (const StructField* field = findElementField(p, expression); field != nullptr) return floatOf(field->mType);
+		auto symbol = symbolTable.find(children[0]->mValue.mText);
+		if (symbol == symbolTable.end() || children.size() != 2) return std::nullopt;
+		const Type& type = symbol->second.type;
+		if (value.mText == "[") {
+			bool indexable = type.builtinType == Builtin_Type::ARRAY || type.builtinType == Builtin_Type::REF;
+			return indexable && !type.subTypes.empty() ? floatOf(type.subTypes[0]) : std::nullopt;
+		}
+		const StructField* field = findField(p, type, children[1]->mValue.mText);
+		return field == nullptr ? std::nullopt : floatOf(field->mType);
+	}
+	if (value.mSubType == TokenSubType::OP_UNARY)
+		return value.mText == "-" ? getFloatType(p, children[0]) : std::nullopt;
+	if (children.size() != 2) return std::nullopt;
+
+	std::optional<Builtin_Type> left = getFloatType(p, children[0]);
+	std::optional<Builtin_Type> right = getFloatType(p, children[1]);
+	const std::string& op = value.mText;
+	if (op == "+" || op == "-" || op == "*" || op == "/")
+		return mergeFloatTypes(children[0], left, children[1], right);
+	if ((left.has_value() || right.has_value()) && (op == "%" || op == "&" || op == "|" || op == "^" || op == "<<" || op == ">>")) {
+		std::cerr << "[X86_64 Compiler]: ERROR: '" << op << "' can't be used on floating point numbers" << std::endl;
+		exit(1);
+	}
+	return std::nullopt;
+}
+
+bool X86_64LinuxYasmCompiler::containsFloat(const Programme& p, const Expression* expression) {
+	if (expression == nullptr) return false;
+	if (getFloatType(p, expression).has_value()) return true;
+	// The right hand side of a '.' is a field name, not a variable
+	if (expression->mValue.mText == ".") return false;
+	return std::any_of(expression->mChildren.begin(), expression->mChildren.end(), [&](const Expression* child) { return containsFloat(p, child); });
+}
+
+bool X86_64LinuxYasmCompiler::preservesFloatRegisters(const Programme& p, const Expression* expression) {
+	if (expression == nullptr) return true;
+	if (containsCall(expression)) return false;
+	if (!getFloatType(p, expression).has_value()) return !containsFloat(p, expression);
+	// Printing the index is integer code
+	if (expression->mValue.mText == "[") return !containsFloat(p, expression->mChildren[1]);
+	if (expression->mValue.mText == ".") return expression->mChildren[0]->mValue.mText != "[" || preservesFloatRegisters(p, expression->mChildren[0]);
+	return std::all_of(expression->mChildren.begin(), expression->mChildren.end(), [&](const Expression* child) { return preservesFloatRegisters(p, child); });
+}
+
+void X86_64LinuxYasmCompiler::printFloatExpression(std::ostream& outfile, const Programme& p, const Expression* expression, Builtin_Type type, int reg) {
+	const char* suffix = type == Builtin_Type::F64 ? "sd" : "ss";
+	std::string xmm = "xmm" + std::to_string(reg);
+	const Token& value = expression->mValue;
+
+	if (expression->isLeaf() && (value.mSubType == TokenSubType::FLOAT_LITERAL || value.mSubType == TokenSubType::INTEGER_LITERAL)) {
+		// SSE has no immediates, the bits go through the a register
+		if (type == Builtin_Type::F64)
+			outfile << "\tmov rax, " << getFloatBits(value.mText, type) << "; printFloatExpression " << value.mText << std::endl << "\tmovq " << xmm << ", rax" << std::endl;
+		else
+			outfile << "\tmov eax, " << getFloatBits(value.mText, type) << "; printFloatExpression " << value.mText << std::endl << "\tmovd " << xmm << ", eax" << std::endl;
+		return;
+	}
+
+	std::optional<Builtin_Type> own = getFloatType(p, expression);
+	if (!own.has_value()) {
+		// An integer, the arithmetic leaves the value in the size of its operands
+		ExpressionPrinted printed = printExpression(outfile, p, expression, 0);
+		bool arithmetic = value.mType == TokenType::OPERATOR && value.mSubType != TokenSubType::OP_UNARY && value.mText != "(" && value.mText != "[" && value.mText != ".";
+		if (arithmetic && printed.printed && printed.size < 3) {
+			if (printed.sign)
+				outfile << "\t" << (printed.size == 2 ? "movsxd" : "movsx") << " rax, " << getRegister("a", printed.size) << std::endl;
+			else if (printed.size == 2)
+				outfile << "\tmov eax, eax" << std::endl;
+			else
+				outfile << "\tmovzx rax, " << getRegister("a", printed.size) << std::endl;
+		}
+		outfile << "\tcvtsi2" << suffix << " " << xmm << ", rax" << std::endl;
+		return;
+	}
+
+	if (value.mText == "(") {
+		if (findCallee(p, expression) == nullptr && expression->mChildren[0]->mValue.mText == "dot")
+			printVectorDot(outfile, p, expression);
+		else
+			printCallExpression(outfile, p, expression);
+		if (own.value() != type)
+			outfile << "\tcvt" << (own.value() == Builtin_Type::F64 ? "sd2ss " : "ss2sd ") << xmm << ", xmm0" << std::endl;
+		else if (reg != 0)
+			outfile << "\tmovapd " << xmm << ", xmm0" << std::endl;
+		return;
+	}
+
+	if (value.mSubType == TokenSubType::OP_UNARY) {
+		// Flipping the sign bit
+		printFloatExpression(outfile, p, expression->mChildren[0], type, reg);
+		std::string mask = "xmm" + std::to_string(reg + 1);
+		if (type == Builtin_Type::F64)
+			outfile << "\tmov rax, 0x8000000000000000" << std::endl << "\tmovq " << mask << ", rax" << std::endl;
+		else
+			outfile << "\tmov eax, 0x80000000" << std::endl << "\tmovd " << mask << ", eax" << std::endl;
+		outfile << "\txorpd " << xmm << ", " << mask << "; printFloatExpression, negate" << std::endl;
+		return;
+	}
+
+	std::optional<std::pair<std::string, Builtin_Type>> operand = printFloatOperand(outfile, p, expression);
+	if (operand.has_value()) {
+		if (operand->second == type)
+			outfile << "\tmov" << suffix << " " << xmm << ", " << operand->first << std::endl;
+		else
+			outfile << "\tcvt" << (operand->second == Builtin_Type::F64 ? "sd2ss " : "ss2sd ") << xmm << ", " << operand->first << std::endl;
+		return;
+	}
+
+	std::string right = printFloatOperands(outfile, p, expression->mChildren[0], expression->mChildren[1], type, reg);
+	const std::string& op = value.mText;
+	const char* instruction = op == "+" ? "add" : op == "-" ? "sub" : op == "*" ? "mul" : "div";
+	outfile << "\t" << instruction << suffix << " " << xmm << ", " << right << "; printFloatExpression " << op << std::endl;
+}
+
+std::string X86_64LinuxYasmCompiler::printFloatOperands(std::ostream& outfile, const Programme& p, const Expression* left, const Expression* right, Builtin_Type type, int reg) {
+	std::string xmm = "xmm" + std::to_string(reg);
+	std::string next = "xmm" + std::to_string(reg + 1);
+	printFloatExpression(outfile, p, left, type, reg);
+	bool preserves = preservesFloatRegisters(p, right);
+	// A variable of the same type is used straight from memory
+	if (preserves && getFloatType(p, right) == type) {
+		std::optional<std::pair<std::string, Builtin_Type>> operand = printFloatOperand(outfile, p, right);
+		if (operand.has_value()) return operand->first;
+	}
+	if (preserves && reg < 13) {
+		printFloatExpression(outfile, p, right, type, reg + 1);
+		return next;
+	}
+	// Calls don't keep any xmm register, the left hand side waits on the stack
+	outfile << "\tsub rsp, 8" << std::endl;
+	outfile << "\tmovsd qword [rsp], " << xmm << std::endl;
+	printFloatExpression(outfile, p, right, type, reg);
+	outfile << "\tmovapd " << next << ", " << xmm << std::endl;
+	outfile << "\tmovsd " << xmm << ", qword [rsp]" << std::endl;
+	outfile << "\tadd rsp, 8" << std::endl;
+	return next;
+}
+
+std::optional<std::pair<std::string, Builtin_Type>> X86_64LinuxYasmCompiler::printFloatOperand(std::ostream& outfile, const Programme& p, const Expression* expression) {
+	auto sized = [](Builtin_Type type, const std::string& address) {
+		return std::make_pair(std::string(type == Builtin_Type::F64 ? "qword " : "dword ") + address, type);
+	};
+	const Token& value = expression->mValue;
+	const auto& children = expression->mChildren;
+	if (expression->isLeaf()) {
+		if (value.mType != TokenType::IDENTIFIER) return std::nullopt;
+		auto symbol = symbolTable.find(value.mText);
+		if (symbol == symbolTable.end()) {
+			auto klass = p.classes.find(currentClass);
+			if (klass == p.classes.end()) return std::nullopt;
+			int index = klass->second.getIndexOfProperty(value.mText);
+			if (index < 0 || !isFloat(klass->second.mFields[index].mType.builtinType)) return std::nullopt;
+			const StructField& field = klass->second.mFields[index];
+			return sized(field.mType.builtinType, "[rdi+" + std::to_string(field.mOffset) + "]");
+		}
+		const SymbolInfo& var = symbol->second;
+		if (!isFloat(var.type.builtinType) || var.inRegister) return std::nullopt;
+		return sized(var.type.builtinType, var.location());
+	}
+	if (children.size() != 2 || children[0] == nullptr || (value.mText != "." && value.mText != "[")) return std::nullopt;
+	if (const StructField* field = findElementField(p, expression); field != nullptr) {
+		if (!isFloat(field->mType.builtinType)) return std::nullopt;
+		return sized(field->mType.builtinType, printElementField(outfile, p, expression, *field));
+	}
+	auto symbol = symbolTable.find(children[0]->mValue.mText);
+	if (symbol == symbolTable.end()) return std::nullopt;
+	const SymbolInfo& var = symbol->second;
+
+	if (value.mText == ".") {
+		const StructField* field = findField(p, var.type, children[1]->mValue.mText);
+		if (field == nullptr || !isFloat(field->mType.builtinType)) return std::nullopt;
+		std::stringstream address;
+		address << "[" << var.reg;
+		if (var.reg != "rbp")
+			address << "+" << var.offset + field->mOffset;
+		else if (var.offset > 0)
+			address << "+" << int(var.offset - field->mOffset);
+		else
+			address << "-" << -(int(var.offset + field->mOffset));
+		address << "]";
+		return sized(field->mType.builtinType, address.str());
+	}
+
+	bool indexable = var.type.builtinType == Builtin_Type::ARRAY || var.type.builtinType == Builtin_Type::REF;
+	if (!indexable || var.type.subTypes.empty() || !isFloat(var.type.subTypes[0].builtinType)) return std::nullopt;
+	const Type& element = var.type.subTypes[0];
+	printExpression(outfile, p, children[1], 0);
+	if (var.type.builtinType == Builtin_Type::REF) {
+		outfile << "\tmov rbx, " << element.byteSize << std::endl;
+		outfile << "\tmul rbx" << std::endl;
+		outfile << "\tmov rbx, qword " << var.location(var.reg == "rbp") << std::endl;
+		outfile << "\tadd rax, rbx" << std::endl;
+		return sized(element.builtinType, "[rax]");
+	}
+	int64_t length = Parser::getLength(var.type);
+	if (var.offset <= 0 && (boundsChecks || !isInBounds(children[1], length))) {
+		outfile << "\tcmp rax, " << length << "; check bounds" << std::endl;
+		outfile << "\tjge array_out_of_bounds" << std::endl;
+	}
+	std::stringstream address;
+	address << "[" << var.reg;
+	if (var.offset > 0)
+		address << "+" << var.offset;
+	else if (var.offset < 0)
+		address << "-" << -var.offset;
+	address << "+rax*" << element.byteSize << "]";
+	return sized(element.builtinType, address.str());
+}
+
+void X86_64LinuxYasmCompiler::printFloatComparison(std::ostream& outfile, const Programme& p, const Expression* expression) {
+	const std::string& op = expression->mValue.mText;
+	const Expression* left = expression->mChildren[0];
+	const Expression* right = expression->mChildren[1];
+	Builtin_Type type = mergeFloatTypes(left, getFloatType(p, left), right, getFloatType(p, right)).value();
+	// `a < b` is `b > a`, above and above or equal are the ones that are false for unordered operands
+	if (op == "<" || op == "<=")
+		std::swap(left, right);
+	std::string operand = printFloatOperands(outfile, p, left, right, type, 0);
+	outfile << "\tmov rcx, 0" << std::endl;
+	outfile << "\tmov rdx, 1" << std::endl;
+	outfile << "\tucomi" << (type == Builtin_Type::F64 ? "sd" : "ss") << " xmm0, " << operand << std::endl;
+	if (op == "<" || op == ">") {
+		outfile << "\tcmova rcx, rdx" << std::endl;
+	} else if (op == "<=" || op == ">=") {
+		outfile << "\tcmovae rcx, rdx" << std::endl;
+	} else if (op == "==") {
+		outfile << "\tcmove rcx, rdx" << std::endl;
+		outfile << "\tmov rdx, 0" << std::endl;
+		outfile << "\tcmovp rcx, rdx" << std::endl;
+	} else {
+		outfile << "\tcmovne rcx, rdx" << std::endl;
+		outfile << "\tcmovp rcx, rdx" << std::endl;
+	}
+	outfile << "\tmov rax, rcx; printFloatComparison" << std::endl;
+}
+
+std::string X86_64LinuxYasmCompiler::getFloatBits(const std::string& text, Builtin_Type type) {
+	double value = std::stod(text);
+	std::stringstream ss;
+	ss << "0x" << std::uppercase << std::hex;
+	if (type == Builtin_Type::F32)
+		ss << std::bit_cast<uint32_t>(float(value));
+	else
+		ss << std::bit_cast<uint64_t>(value);
+	return ss.str();
+}
+
 const char* X86_64LinuxYasmCompiler::getRegister(const std::string& reg, int size) {
 	if (size == 0) {
 		if (reg == "a") return "al";
@@ -1994,6 +3431,8 @@ int X86_64LinuxYasmCompiler::getSizeFromType(const Type& type) {
 		case Builtin_Type::STRUCT:
 		case Builtin_Type::ARRAY:
 		case Builtin_Type::CLASS:
+		case Builtin_Type::VECTOR:
+		case Builtin_Type::MATRIX:
 			break;
 		case Builtin_Type::UI8:
 		case Builtin_Type::I8:
@@ -2070,3 +3509,831 @@ const char* X86_64LinuxYasmCompiler::escape(const char* input) {
 		default: return input;
 	}
 }
+
+const char* X86_64LinuxYasmCompiler::getAccumulatorInstruction() {
+	if (accumulatorOperator == "*") return "imul";
+	if (accumulatorOperator == "&") return "and";
+	if (accumulatorOperator == "|") return "or";
+	if (accumulatorOperator == "^") return "xor";
+	return "add";
+}
+
+// `name(args)` is a '(' node with the children [name, '(', args...], namespaces, classes and e: come before the name
+bool X86_64LinuxYasmCompiler::isDirectCall(const Expression* expression) {
+	if (expression == nullptr || expression->mValue.mText != "(" || expression->mValue.mSubType == TokenSubType::STRING_LITERAL) return false;
+	const auto& children = expression->mChildren;
+	return children.size() >= 2 && children[0] != nullptr && children[0]->mValue.mType == TokenType::IDENTIFIER
+		&& children[1] != nullptr && children[1]->mValue.mText == "(";
+}
+
+bool X86_64LinuxYasmCompiler::containsCall(const Expression* expression) {
+	if (expression == nullptr) return false;
+	if (expression->mValue.mText == "(" && expression->mValue.mSubType != TokenSubType::STRING_LITERAL) return true;
+	return std::any_of(expression->mChildren.begin(), expression->mChildren.end(), [](const Expression* child) { return containsCall(child); });
+}
+
+// Anything with an address, a '\' or a local that is passed around by address, could be read after the frame is gone
+bool X86_64LinuxYasmCompiler::takesAddress(const Block& block) {
+	std::function<bool(const Expression*)> addressOf = [&](const Expression* expression) {
+		if (expression == nullptr) return false;
+		if (expression->mValue.mSubType == TokenSubType::OP_UNARY && expression->mValue.mText == "\\") return true;
+		return std::any_of(expression->mChildren.begin(), expression->mChildren.end(), addressOf);
+	};
+	std::function<bool(const Statement&)> statementTakesAddress = [&](const Statement& statement) {
+		if (addressOf(statement.mContent)) return true;
+		if (statement.funcCall.has_value() && std::any_of(statement.funcCall->mArgs.begin(), statement.funcCall->mArgs.end(), addressOf))
+			return true;
+		if (statement.variable.has_value()) {
+			Builtin_Type type = statement.variable->mType.builtinType;
+			bool declared = statement.mType == Statement_Type::VAR_DECLARATION || statement.mType == Statement_Type::VAR_DECL_ASSIGN;
+			if (declared && (type == Builtin_Type::ARRAY || hasFields(type) || type == Builtin_Type::CLASS))
+				return true;
+			if (std::any_of(statement.variable->mValues.begin(), statement.variable->mValues.end(), addressOf))
+				return true;
+		}
+		if (statement.loopStatement.has_value()) {
+			const LoopStatement& ls = statement.loopStatement.value();
+			if (ls.mRange.has_value() && (addressOf(ls.mRange->mMinimum) || addressOf(ls.mRange->mMaximum))) return true;
+			if (takesAddress(ls.mBody)) return true;
+		}
+		if (statement.ifStatement.has_value()) {
+			if (takesAddress(statement.ifStatement->mBody)) return true;
+			if (statement.ifStatement->mElseBody.has_value() && takesAddress(statement.ifStatement->mElseBody.value())) return true;
+		}
+		return std::any_of(statement.mSubStatements.begin(), statement.mSubStatements.end(), statementTakesAddress);
+	};
+	return std::any_of(block.statements.begin(), block.statements.end(), statementTakesAddress);
+}
+
+bool X86_64LinuxYasmCompiler::isInBounds(const Expression* index, int64_t length) {
+	std::optional<std::pair<int64_t, int64_t>> range = getIndexRange(index);
+	return range.has_value() && range->first >= 0 && range->second < length;
+}
+
+// The smallest and largest value of integer literals, loop iterators with a known range, and sums and differences of those
+std::optional<std::pair<int64_t, int64_t>> X86_64LinuxYasmCompiler::getIndexRange(const Expression* index) {
+	if (index == nullptr) return std::nullopt;
+	const std::string& text = index->mValue.mText;
+	if (index->isLeaf() && index->mValue.mSubType == TokenSubType::INTEGER_LITERAL) {
+		int64_t value;
+		auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+		// Anything that isn't a small decimal number, like hex or binary, just isn't proven
+		if (error != std::errc() || end != text.data() + text.size() || value < -(int64_t(1) << 32) || value > (int64_t(1) << 32))
+			return std::nullopt;
+		return std::make_pair(value, value);
+	}
+	if (index->isLeaf() && index->mValue.mType == TokenType::IDENTIFIER) {
+		if (!iteratorRanges.contains(text)) return std::nullopt;
+		return iteratorRanges[text];
+	}
+	if (index->mValue.mSubType == TokenSubType::OP_BINARY && index->mChildren.size() == 2 && (text == "+" || text == "-")) {
+		std::optional<std::pair<int64_t, int64_t>> left = getIndexRange(index->mChildren[0]);
+		std::optional<std::pair<int64_t, int64_t>> right = getIndexRange(index->mChildren[1]);
+		if (!left.has_value() || !right.has_value()) return std::nullopt;
+		if (text == "+")
+			return std::make_pair(left->first + right->first, left->second + right->second);
+		return std::make_pair(left->first - right->second, left->second - right->first);
+	}
+	return std::nullopt;
+}
+
+// Whether anything in the block assigns to, declares over or takes the address of the variable
+bool X86_64LinuxYasmCompiler::writesVariable(const Block& block, const std::string& name) {
+	std::function<bool(const Expression*)> addressOf = [&](const Expression* expression) {
+		if (expression == nullptr) return false;
+		if (expression->mValue.mSubType == TokenSubType::OP_UNARY && expression->mValue.mText == "\\") return true;
+		return std::any_of(expression->mChildren.begin(), expression->mChildren.end(), addressOf);
+	};
+	std::function<bool(const Statement&)> statementWrites = [&](const Statement& statement) {
+		if (addressOf(statement.mContent)) return true;
+		if (statement.funcCall.has_value() && std::any_of(statement.funcCall->mArgs.begin(), statement.funcCall->mArgs.end(), addressOf))
+			return true;
+		if (statement.variable.has_value()) {
+			if (statement.variable->mName == name) return true;
+			if (std::any_of(statement.variable->mValues.begin(), statement.variable->mValues.end(), addressOf))
+				return true;
+		}
+		if (statement.loopStatement.has_value()) {
+			const LoopStatement& ls = statement.loopStatement.value();
+			if (ls.mIterator.has_value() && ls.mIterator->mName == name) return true;
+			if (writesVariable(ls.mBody, name)) return true;
+		}
+		if (statement.ifStatement.has_value()) {
+			if (writesVariable(statement.ifStatement->mBody, name)) return true;
+			if (statement.ifStatement->mElseBody.has_value() && writesVariable(statement.ifStatement->mElseBody.value(), name)) return true;
+		}
+		return std::any_of(statement.mSubStatements.begin(), statement.mSubStatements.end(), statementWrites);
+	};
+	return std::any_of(block.statements.begin(), block.statements.end(), statementWrites);
+}
+
+std::optional<int64_t> X86_64LinuxYasmCompiler::printVectorisedLoop(std::ostream& outfile, const Programme& p, const LoopStatement& loop) {
+	const std::string& iterator = loop.mIterator.value().mName;
+	std::optional<std::pair<int64_t, int64_t>> minimum = getIndexRange(loop.mRange.value().mMinimum);
+	std::optional<std::pair<int64_t, int64_t>> maximum = getIndexRange(loop.mRange.value().mMaximum);
+	if (!minimum.has_value() || !maximum.has_value() || minimum->first != minimum->second || maximum->first != maximum->second || minimum->first < 0)
+		return std::nullopt;
+	if (loop.mBody.stackMemory != 0 || loop.mBody.statements.empty()) return std::nullopt;
+
+	auto isInteger = [](Builtin_Type type) { return type >= Builtin_Type::UI8 && type <= Builtin_Type::I64; };
+	auto isIterator = [&](const Expression* expression) {
+		return expression != nullptr && expression->isLeaf() && expression->mValue.mType == TokenType::IDENTIFIER && expression->mValue.mText == iterator;
+	};
+	// Every array has to hold the whole range, with elements of the same size, as the lanes only line up then
+	int elementSize = 0;
+	auto isArray = [&](const std::string& name) {
+		auto symbol = symbolTable.find(name);
+		if (symbol == symbolTable.end()) return false;
+		const Type& type = symbol->second.type;
+		if (type.builtinType != Builtin_Type::ARRAY || symbol->second.offset > 0 || type.subTypes.empty() || !isInteger(type.subTypes[0].builtinType))
+			return false;
+		if (elementSize == 0) elementSize = int(type.subTypes[0].byteSize);
+		return int(type.subTypes[0].byteSize) == elementSize && maximum->first <= int64_t(Parser::getLength(type));
+	};
+	// Literals and variables don't change in the loop, they are broadcast into a register of their own before it
+	std::vector<const Expression*> invariants;
+	bool usesIterator = false;
+	std::function<bool(const Expression*, int)> isVectorisable = [&](const Expression* expression, int depth) {
+		if (expression == nullptr || depth >= 8) return false;
+		const std::string& text = expression->mValue.mText;
+		if (expression->isLeaf()) {
+			if (isIterator(expression)) {
+				usesIterator = true;
+				return true;
+			}
+			if (expression->mValue.mType == TokenType::IDENTIFIER) {
+				auto symbol = symbolTable.find(text);
+				if (symbol == symbolTable.end() || !isInteger(symbol->second.type.builtinType)) return false;
+			} else if (expression->mValue.mSubType != TokenSubType::INTEGER_LITERAL) {
+				return false;
+			}
+			invariants.push_back(expression);
+			return true;
+		}
+		if (text == "[")
+			return expression->mChildren.size() == 2 && expression->mChildren[0] != nullptr && isArray(expression->mChildren[0]->mValue.mText) && isIterator(expression->mChildren[1]);
+		if (expression->mValue.mSubType != TokenSubType::OP_BINARY || expression->mChildren.size() != 2) return false;
+		if (text == "<<") {
+			std::optional<std::pair<int64_t, int64_t>> count = getIndexRange(expression->mChildren[1]);
+			return elementSize > 1 && count.has_value() && count->first == count->second && count->first >= 0 && count->first < 64
+				&& isVectorisable(expression->mChildren[0], depth + 1);
+		}
+		// Only what doesn't depend on the bits above the element, so the lanes give what the truncating store would
+		if (text != "+" && text != "-" && text != "&" && text != "|" && text != "^" && !(text == "*" && elementSize == 2)) return false;
+		return isVectorisable(expression->mChildren[0], depth + 1) && isVectorisable(expression->mChildren[1], depth + 1);
+	};
+	for (const auto& statement : loop.mBody.statements) {
+		if (statement.mType != Statement_Type::VAR_ASSIGNMENT || !statement.variable.has_value() || statement.variable->mValues.size() != 1) return std::nullopt;
+		if (!isIterator(statement.mContent) || !isArray(statement.variable->mName)) return std::nullopt;
+		if (!isVectorisable(statement.variable->mValues[0], 0)) return std::nullopt;
+	}
+	int lanes = 16 / elementSize;
+	int64_t count = maximum->first - minimum->first;
+	if (count < lanes || invariants.size() > 6) return std::nullopt;
+	int64_t end = minimum->first + count / lanes * lanes;
+
+	std::map<const Expression*, int> registers;
+	for (size_t i = 0; i < invariants.size(); i++) {
+		int reg = 8 + int(i);
+		registers[invariants[i]] = reg;
+		printExpression(outfile, p, invariants[i], 0);
+		outfile << "\tmovq xmm" << reg << ", rax; VECTOR LOOP " << iterator << " broadcast" << std::endl;
+		printBroadcast(outfile, reg, elementSize);
+	}
+	if (usesIterator) {
+		// xmm14 holds the values of the iterator for each lane, xmm15 what they go up by
+		uint64_t halves[2] = {0, 0};
+		uint64_t mask = elementSize == 8 ? ~uint64_t(0) : (uint64_t(1) << (elementSize * 8)) - 1;
+		for (int lane = 0; lane < lanes; lane++) {
+			int bit = lane * elementSize * 8;
+			halves[bit / 64] |= (uint64_t(minimum->first + lane) & mask) << (bit % 64);
+		}
+		outfile << "\tmov rax, " << int64_t(halves[0]) << "; VECTOR LOOP " << iterator << " lanes" << std::endl;
+		outfile << "\tmovq xmm14, rax" << std::endl;
+		outfile << "\tmov rax, " << int64_t(halves[1]) << std::endl;
+		outfile << "\tmovq xmm15, rax" << std::endl;
+		outfile << "\tpunpcklqdq xmm14, xmm15" << std::endl;
+		outfile << "\tmov rax, " << lanes << std::endl;
+		outfile << "\tmovq xmm15, rax" << std::endl;
+		printBroadcast(outfile, 15, elementSize);
+	}
+
+	std::string label = ".vector_label" + std::to_string(++labelCount);
+	outfile << "\tmov r11, " << minimum->first << "; VECTOR LOOP " << iterator << std::endl;
+	outfile << label << ":" << std::endl;
+	for (const auto& statement : loop.mBody.statements) {
+		int reg = printVectorExpression(outfile, statement.variable->mValues[0], elementSize, 0, registers);
+		const SymbolInfo& arr = symbolTable[statement.variable->mName];
+		outfile << "\tmovdqu [" << arr.reg;
+		if (arr.offset < 0)
+			outfile << "-" << -arr.offset;
+		outfile << "+r11*" << elementSize << "], xmm" << reg << "; VECTOR LOOP store " << statement.variable->mName << std::endl;
+	}
+	const char suffix = "bwdq"[elementSize == 1 ? 0 : elementSize == 2 ? 1 : elementSize == 4 ? 2 : 3];
+	if (usesIterator)
+		outfile << "\tpadd" << suffix << " xmm14, xmm15" << std::endl;
+	outfile << "\tadd r11, " << lanes << std::endl;
+	outfile << "\tcmp r11, " << end << std::endl;
+	outfile << "\tjl " << label << std::endl;
+	return end;
+}
+
+int X86_64LinuxYasmCompiler::printVectorExpression(std::ostream& outfile, const Expression* expression, int elementSize, int target, const std::map<const Expression*, int>& invariants) {
+	auto invariant = invariants.find(expression);
+	if (invariant != invariants.end()) return invariant->second;
+	const std::string& text = expression->mValue.mText;
+	if (expression->mValue.mType == TokenType::IDENTIFIER) return 14; // The iterator
+	std::string name = "xmm" + std::to_string(target);
+	if (text == "[") {
+		const SymbolInfo& arr = symbolTable[expression->mChildren[0]->mValue.mText];
+		outfile << "\tmovdqu " << name << ", [" << arr.reg;
+		if (arr.offset < 0)
+			outfile << "-" << -arr.offset;
+		outfile << "+r11*" << elementSize << "]; VECTOR LOOP load " << expression->mChildren[0]->mValue.mText << std::endl;
+		return target;
+	}
+
+	const char suffix = "bwdq"[elementSize == 1 ? 0 : elementSize == 2 ? 1 : elementSize == 4 ? 2 : 3];
+	int left = printVectorExpression(outfile, expression->mChildren[0], elementSize, target, invariants);
+	if (left != target)
+		outfile << "\tmovdqa " << name << ", xmm" << left << std::endl;
+	if (text == "<<") {
+		outfile << "\tpsll" << suffix << " " << name << ", " << getIndexRange(expression->mChildren[1])->first << std::endl;
+		return target;
+	}
+	int right = printVectorExpression(outfile, expression->mChildren[1], elementSize, target + 1, invariants);
+	outfile << "\t";
+	if (text == "+") outfile << "padd" << suffix;
+	else if (text == "-") outfile << "psub" << suffix;
+	else if (text == "*") outfile << "pmullw";
+	else if (text == "&") outfile << "pand";
+	else if (text == "|") outfile << "por";
+	else outfile << "pxor";
+	outfile << " " << name << ", xmm" << right << std::endl;
+	return target;
+}
+
+void X86_64LinuxYasmCompiler::printBroadcast(std::ostream& outfile, int reg, int elementSize) {
+	std::string name = "xmm" + std::to_string(reg);
+	if (elementSize == 1)
+		outfile << "\tpunpcklbw " << name << ", " << name << std::endl;
+	if (elementSize <= 2)
+		outfile << "\tpunpcklwd " << name << ", " << name << std::endl;
+	if (elementSize <= 4)
+		outfile << "\tpshufd " << name << ", " << name << ", 0" << std::endl;
+	else
+		outfile << "\tpunpcklqdq " << name << ", " << name << std::endl;
+}
+
+void X86_64LinuxYasmCompiler::printLaneMultiply(std::ostream& outfile, int elementSize, int destination, int source) {
+	std::string d = "xmm" + std::to_string(destination);
+	std::string s = "xmm" + std::to_string(source);
+	switch (elementSize) {
+		case 1:
+			// The low byte of a word product only depends on the low bytes, the odd bytes are shifted down to be those
+			outfile << "\tmovdqa xmm13, " << d << std::endl;
+			outfile << "\tpmullw xmm13, " << s << std::endl;
+			outfile << "\tmovdqa xmm14, " << s << std::endl;
+			outfile << "\tpsrlw xmm14, 8" << std::endl;
+			outfile << "\tpsrlw " << d << ", 8" << std::endl;
+			outfile << "\tpmullw " << d << ", xmm14" << std::endl;
+			outfile << "\tpsllw " << d << ", 8" << std::endl;
+			outfile << "\tpcmpeqw xmm14, xmm14" << std::endl;
+			outfile << "\tpsrlw xmm14, 8" << std::endl;
+			outfile << "\tpand xmm13, xmm14" << std::endl;
+			outfile << "\tpor " << d << ", xmm13" << std::endl;
+			break;
+		case 2:
+			outfile << "\tpmullw " << d << ", " << s << std::endl;
+			break;
+		case 4:
+			// pmuludq multiplies the even lanes, the odd ones are shifted down into their place and interleaved back after
+			outfile << "\tmovdqa xmm13, " << d << std::endl;
+			outfile << "\tpsrlq xmm13, 32" << std::endl;
+			outfile << "\tmovdqa xmm14, " << s << std::endl;
+			outfile << "\tpsrlq xmm14, 32" << std::endl;
+			outfile << "\tpmuludq " << d << ", " << s << std::endl;
+			outfile << "\tpmuludq xmm13, xmm14" << std::endl;
+			outfile << "\tpshufd " << d << ", " << d << ", 8" << std::endl;
+			outfile << "\tpshufd xmm13, xmm13, 8" << std::endl;
+			outfile << "\tpunpckldq " << d << ", xmm13" << std::endl;
+			break;
+		default:
+			// lo * lo + ((hi * lo + lo * hi) << 32)
+			outfile << "\tmovdqa xmm13, " << d << std::endl;
+			outfile << "\tpsrlq xmm13, 32" << std::endl;
+			outfile << "\tpmuludq xmm13, " << s << std::endl;
+			outfile << "\tmovdqa xmm14, " << s << std::endl;
+			outfile << "\tpsrlq xmm14, 32" << std::endl;
+			outfile << "\tpmuludq xmm14, " << d << std::endl;
+			outfile << "\tpaddq xmm13, xmm14" << std::endl;
+			outfile << "\tpsllq xmm13, 32" << std::endl;
+			outfile << "\tpmuludq " << d << ", " << s << std::endl;
+			outfile << "\tpaddq " << d << ", xmm13" << std::endl;
+			break;
+	}
+}
+
+void X86_64LinuxYasmCompiler::printVectorAssignment(std::ostream& outfile, const Programme& p, const std::string& name, const Expression* expression) {
+	const SymbolInfo& symbol = symbolTable[name];
+	std::optional<Type> type = getVectorType(expression);
+	if (!type.has_value() || type->name != symbol.type.name) {
+		std::cerr << "[X86_64 Compiler]: ERROR: Can't assign a value of type '" << (type.has_value() ? type->name : "scalar") << "' to '" << name << "' of type '" << symbol.type.name << "'" << std::endl;
+		exit(1);
+	}
+	std::function<bool(const Expression*)> reads = [&](const Expression* e) {
+		if (e == nullptr) return false;
+		if (e->mValue.mType == TokenType::IDENTIFIER && e->mValue.mText == name) return true;
+		return std::any_of(e->mChildren.begin(), e->mChildren.end(), reads);
+	};
+
+	int saved = vectorTemporary;
+	vectorTemporary = 0;
+	size_t scratch = getVectorScratch(expression, true);
+	if (scratch != 0)
+		outfile << "\tsub rsp, " << scratch << "; VECTOR " << name << " temporaries" << std::endl;
+	VectorLocation destination = getVectorLocation(name);
+	if (isVectorProduct(expression) && reads(expression)) {
+		// The product reads the variable after it started writing it
+		VectorLocation temporary = allocateVectorTemporary(type->byteSize);
+		printVectorValue(outfile, p, temporary, type.value(), expression);
+		for (const auto& chunk : getVectorChunks(type->byteSize)) {
+			printVectorMove(outfile, 0, temporary.at(chunk.first), chunk.second, false);
+			printVectorMove(outfile, 0, destination.at(chunk.first), chunk.second, true);
+		}
+	} else {
+		printVectorValue(outfile, p, destination, type.value(), expression);
+	}
+	if (scratch != 0)
+		outfile << "\tadd rsp, " << scratch << std::endl;
+	vectorTemporary = saved;
+}
+
+void X86_64LinuxYasmCompiler::printVectorValue(std::ostream& outfile, const Programme& p, const VectorLocation& destination, const Type& type, const Expression* expression) {
+	const char* sizes[] = {"byte", "word", "dword", "qword"};
+	const Type& element = type.subTypes[0];
+	int elementSize = int(element.byteSize);
+	bool floating = isFloat(element.builtinType);
+	if (expression->mValue.mText == "(") {
+		std::vector<const Expression*> arguments = getArguments(expression);
+		VectorLocation left = printVectorOperand(outfile, p, arguments[0]);
+		VectorLocation right = printVectorOperand(outfile, p, arguments[1]);
+		printCross(outfile, destination, type, left, right);
+		return;
+	}
+	if (isVectorProduct(expression)) {
+		Type leftType = getVectorType(expression->mChildren[0]).value();
+		Type rightType = getVectorType(expression->mChildren[1]).value();
+		VectorLocation left = printVectorOperand(outfile, p, expression->mChildren[0]);
+		VectorLocation right = printVectorOperand(outfile, p, expression->mChildren[1]);
+		if (rightType.builtinType == Builtin_Type::MATRIX) {
+			printMatrixProduct(outfile, destination, leftType, rightType, left, right);
+			return;
+		}
+		// Every lane is the dot product of a row with the vector
+		size_t rows = Parser::getShape(leftType).first;
+		int rowSize = int(leftType.byteSize / rows);
+		int actualSize = getSizeFromByteSize(elementSize);
+		for (size_t row = 0; row < rows; row++) {
+			printDot(outfile, VectorLocation {left.base, left.offset + int(row) * rowSize}, right, rightType);
+			if (floating)
+				outfile << "\tmovs" << (elementSize == 8 ? "d " : "s ") << sizes[actualSize] << " " << destination.at(int(row) * elementSize) << ", xmm0; VECTOR row " << row << std::endl;
+			else
+				outfile << "\tmov " << sizes[actualSize] << " " << destination.at(int(row) * elementSize) << ", " << getRegister("a", actualSize) << "; VECTOR row " << row << std::endl;
+		}
+		return;
+	}
+
+	// Lane by lane, variables and products are loaded from memory and scalars are repeated over xmm8 to xmm12
+	std::map<const Expression*, VectorLocation> memory;
+	std::vector<const Expression*> scalars;
+	std::function<void(const Expression*, int)> collect = [&](const Expression* operand, int depth) {
+		if (depth >= 7) {
+			std::cerr << "[X86_64 Compiler]: ERROR: Vector arithmetic is nested too deeply, split it up with a variable" << std::endl;
+			exit(1);
+		}
+		if (!getVectorType(operand).has_value())
+			scalars.push_back(operand);
+		else if (operand->mValue.mType == TokenType::IDENTIFIER)
+			memory[operand] = getVectorLocation(operand->mValue.mText);
+		else if (isVectorProduct(operand))
+			memory[operand] = printVectorOperand(outfile, p, operand);
+		else {
+			collect(operand->mChildren[0], depth + 1);
+			collect(operand->mChildren[1], depth + 1);
+		}
+	};
+	collect(expression, 0);
+	if (scalars.size() > 5) {
+		std::cerr << "[X86_64 Compiler]: ERROR: Vector arithmetic uses more than 5 scalars, split it up with a variable" << std::endl;
+		exit(1);
+	}
+	// Scalars next to floating point lanes are converted to the element type, in xmm0 instead of rax
+	const char* scalarRegister = floating ? "xmm0" : "rax";
+	auto printScalar = [&](const Expression* scalar) {
+		if (floating)
+			printFloatExpression(outfile, p, scalar, element.builtinType, 0);
+		else
+			printExpression(outfile, p, scalar, 0);
+	};
+	// A call can overwrite every xmm register, so its value waits on the stack until the others are in place
+	std::map<const Expression*, VectorLocation> spilled;
+	for (const auto* scalar : scalars) {
+		if (!containsCall(scalar)) continue;
+		printScalar(scalar);
+		spilled[scalar] = allocateVectorTemporary(8);
+		outfile << "\t" << (floating ? "movq" : "mov") << " qword " << spilled[scalar].at(0) << ", " << scalarRegister << std::endl;
+	}
+	std::map<const Expression*, int> registers;
+	for (size_t i = 0; i < scalars.size(); i++) {
+		int reg = 8 + int(i);
+		registers[scalars[i]] = reg;
+		auto found = spilled.find(scalars[i]);
+		if (found != spilled.end()) {
+			outfile << "\tmovq xmm" << reg << ", qword " << found->second.at(0) << "; VECTOR broadcast" << std::endl;
+		} else {
+			printScalar(scalars[i]);
+			outfile << "\tmovq xmm" << reg << ", " << scalarRegister << "; VECTOR broadcast" << std::endl;
+		}
+		printBroadcast(outfile, reg, elementSize);
+	}
+	for (const auto& chunk : getVectorChunks(type.byteSize)) {
+		int reg = printVectorChunk(outfile, expression, chunk, element, 0, registers, memory);
+		printVectorMove(outfile, reg, destination.at(chunk.first), chunk.second, true);
+	}
+}
+
+VectorLocation X86_64LinuxYasmCompiler::printVectorOperand(std::ostream& outfile, const Programme& p, const Expression* expression) {
+	if (expression->mValue.mType == TokenType::IDENTIFIER)
+		return getVectorLocation(expression->mValue.mText);
+	Type type = getVectorType(expression).value();
+	VectorLocation temporary = allocateVectorTemporary(type.byteSize);
+	printVectorValue(outfile, p, temporary, type, expression);
+	return temporary;
+}
+
+int X86_64LinuxYasmCompiler::printVectorChunk(std::ostream& outfile, const Expression* expression, std::pair<int, int> chunk, const Type& element, int target,
+		const std::map<const Expression*, int>& registers, const std::map<const Expression*, VectorLocation>& memory) {
+	auto reg = registers.find(expression);
+	if (reg != registers.end()) return reg->second;
+	auto location = memory.find(expression);
+	if (location != memory.end()) {
+		printVectorMove(outfile, target, location->second.at(chunk.first), chunk.second, false);
+		return target;
+	}
+
+	std::string name = "xmm" + std::to_string(target);
+	int left = printVectorChunk(outfile, expression->mChildren[0], chunk, element, target, registers, memory);
+	if (left != target)
+		outfile << "\tmovdqa " << name << ", xmm" << left << std::endl;
+	int right = printVectorChunk(outfile, expression->mChildren[1], chunk, element, target + 1, registers, memory);
+	printLaneOperation(outfile, element, expression->mValue.mText, target, right);
+	return target;
+}
+
+void X86_64LinuxYasmCompiler::printLaneOperation(std::ostream& outfile, const Type& element, const std::string& operation, int destination, int source) {
+	int elementSize = int(element.byteSize);
+	if (isFloat(element.builtinType)) {
+		const char* name = operation == "+" ? "add" : operation == "-" ? "sub" : "mul";
+		outfile << "\t" << name << (elementSize == 8 ? "pd" : "ps") << " xmm" << destination << ", xmm" << source << std::endl;
+		return;
+	}
+	if (operation == "*") {
+		printLaneMultiply(outfile, elementSize, destination, source);
+		return;
+	}
+	const char suffix = "bwdq"[elementSize == 1 ? 0 : elementSize == 2 ? 1 : elementSize == 4 ? 2 : 3];
+	outfile << "\t" << (operation == "+" ? "padd" : "psub") << suffix << " xmm" << destination << ", xmm" << source << std::endl;
+}
+
+void X86_64LinuxYasmCompiler::printVectorMove(std::ostream& outfile, int reg, const std::string& address, int size, bool store) {
+	// Variables on the stack are only aligned to 8 bytes
+	const char* instruction = size == 16 ? "movdqu" : size == 8 ? "movq" : "movd";
+	const char* width = size == 16 ? "" : size == 8 ? "qword " : "dword ";
+	if (store)
+		outfile << "\t" << instruction << " " << width << address << ", xmm" << reg << std::endl;
+	else
+		outfile << "\t" << instruction << " xmm" << reg << ", " << width << address << std::endl;
+}
+
+void X86_64LinuxYasmCompiler::printVectorDot(std::ostream& outfile, const Programme& p, const Expression* expression) {
+	std::vector<const Expression*> arguments = getArguments(expression);
+	std::optional<Type> left = arguments.size() == 2 ? getVectorType(arguments[0]) : std::nullopt;
+	std::optional<Type> right = arguments.size() == 2 ? getVectorType(arguments[1]) : std::nullopt;
+	if (!left.has_value() || !right.has_value() || left->name != right->name || left->builtinType != Builtin_Type::VECTOR) {
+		std::cerr << "[X86_64 Compiler]: ERROR: dot takes two vectors of the same type" << std::endl;
+		exit(1);
+	}
+
+	int saved = vectorTemporary;
+	vectorTemporary = 0;
+	size_t scratch = getVectorScratch(arguments[0], false) + getVectorScratch(arguments[1], false);
+	if (scratch != 0)
+		outfile << "\tsub rsp, " << scratch << "; VECTOR dot temporaries" << std::endl;
+	VectorLocation leftLocation = printVectorOperand(outfile, p, arguments[0]);
+	VectorLocation rightLocation = printVectorOperand(outfile, p, arguments[1]);
+	printDot(outfile, leftLocation, rightLocation, left.value());
+	if (scratch != 0)
+		outfile << "\tadd rsp, " << scratch << std::endl;
+	vectorTemporary = saved;
+}
+
+void X86_64LinuxYasmCompiler::printDot(std::ostream& outfile, const VectorLocation& left, const VectorLocation& right, const Type& type) {
+	const Type& element = type.subTypes[0];
+	int elementSize = int(element.byteSize);
+	int used = int(Parser::getShape(type).second) * elementSize; // Without the padding lane of vec3
+	for (const auto& chunk : getVectorChunks(type.byteSize)) {
+		if (chunk.first >= used) break;
+		int reg = chunk.first == 0 ? 0 : 1;
+		std::string name = "xmm" + std::to_string(reg);
+		printVectorMove(outfile, reg, left.at(chunk.first), chunk.second, false);
+		printVectorMove(outfile, 2, right.at(chunk.first), chunk.second, false);
+		printLaneOperation(outfile, element, "*", reg, 2);
+		// The shifts bring in zero bits, which are 0.0 in floating point lanes too
+		int bytes = std::min(chunk.second, used - chunk.first);
+		if (bytes < chunk.second) {
+			outfile << "\tpslldq " << name << ", " << 16 - bytes << std::endl;
+			outfile << "\tpsrldq " << name << ", " << 16 - bytes << std::endl;
+		}
+		if (reg != 0)
+			printLaneOperation(outfile, element, "+", 0, 1);
+	}
+	// Adds the upper half onto the lower one until the sum is in the lowest lane
+	for (int shift = 8; shift >= elementSize; shift /= 2) {
+		outfile << "\tmovdqa xmm1, xmm0" << std::endl;
+		outfile << "\tpsrldq xmm1, " << shift << std::endl;
+		printLaneOperation(outfile, element, "+", 0, 1);
+	}
+	if (isFloat(element.builtinType))
+		return;
+	bool sign = element.name[0] == 'i';
+	if (elementSize == 8) {
+		outfile << "\tmovq rax, xmm0; VECTOR dot" << std::endl;
+		return;
+	}
+	outfile << "\tmovd eax, xmm0; VECTOR dot" << std::endl;
+	if (elementSize == 4 && sign)
+		outfile << "\tmovsxd rax, eax" << std::endl;
+	else if (elementSize < 4)
+		outfile << "\t" << (sign ? "movsx" : "movzx") << " rax, " << (elementSize == 2 ? "ax" : "al") << std::endl;
+}
+
+void X86_64LinuxYasmCompiler::printCross(std::ostream& outfile, const VectorLocation& destination, const Type& type, const VectorLocation& left, const VectorLocation& right) {
+	const char* sizes[] = {"byte", "word", "dword", "qword"};
+	const Type& element = type.subTypes[0];
+	int elementSize = int(element.byteSize);
+	if (elementSize == 2 || elementSize == 4) {
+		// (a.yzx * b.zxy) - (a.zxy * b.yzx), the words of vec3<i16> all fit in the low half that pshuflw shuffles
+		const char* shuffle = elementSize == 4 ? "pshufd" : "pshuflw";
+		int size = int(type.byteSize);
+		printVectorMove(outfile, 0, left.at(0), size, false);
+		printVectorMove(outfile, 1, right.at(0), size, false);
+		outfile << "\t" << shuffle << " xmm2, xmm0, 0xC9" << std::endl;
+		outfile << "\t" << shuffle << " xmm3, xmm1, 0xD2" << std::endl;
+		printLaneOperation(outfile, element, "*", 2, 3);
+		outfile << "\t" << shuffle << " xmm3, xmm0, 0xD2" << std::endl;
+		outfile << "\t" << shuffle << " xmm4, xmm1, 0xC9" << std::endl;
+		printLaneOperation(outfile, element, "*", 3, 4);
+		printLaneOperation(outfile, element, "-", 2, 3);
+		printVectorMove(outfile, 2, destination.at(0), size, true);
+		return;
+	}
+	if (element.builtinType == Builtin_Type::F64) {
+		// Two lanes to a register, the shuffles would cost more than doing every lane on its own
+		for (int lane = 0; lane < 3; lane++) {
+			int next = (lane + 1) % 3;
+			int last = (lane + 2) % 3;
+			outfile << "\tmovsd xmm0, qword " << left.at(next * 8) << std::endl;
+			outfile << "\tmulsd xmm0, qword " << right.at(last * 8) << std::endl;
+			outfile << "\tmovsd xmm1, qword " << left.at(last * 8) << std::endl;
+			outfile << "\tmulsd xmm1, qword " << right.at(next * 8) << std::endl;
+			outfile << "\tsubsd xmm0, xmm1" << std::endl;
+			outfile << "\tmovsd qword " << destination.at(lane * 8) << ", xmm0; VECTOR cross" << std::endl;
+		}
+		return;
+	}
+	// SSE2 can't shuffle bytes, and the multiplication of quadwords is longer than doing it with imul
+	int actualSize = getSizeFromByteSize(elementSize);
+	auto load = [&](const char* reg, const VectorLocation& vector, int lane) {
+		if (elementSize == 8)
+			outfile << "\tmov " << reg << ", qword " << vector.at(lane * elementSize) << std::endl;
+		else
+			outfile << "\tmovzx " << reg << ", byte " << vector.at(lane * elementSize) << std::endl;
+	};
+	for (int lane = 0; lane < 3; lane++) {
+		int next = (lane + 1) % 3;
+		int last = (lane + 2) % 3;
+		load("rax", left, next);
+		load("rcx", right, last);
+		outfile << "\timul rax, rcx" << std::endl;
+		load("rcx", left, last);
+		load("rdx", right, next);
+		outfile << "\timul rcx, rdx" << std::endl;
+		outfile << "\tsub rax, rcx" << std::endl;
+		outfile << "\tmov " << sizes[actualSize] << " " << destination.at(lane * elementSize) << ", " << getRegister("a", actualSize) << "; VECTOR cross" << std::endl;
+	}
+}
+
+void X86_64LinuxYasmCompiler::printMatrixProduct(std::ostream& outfile, const VectorLocation& destination, const Type& leftType, const Type& rightType, const VectorLocation& left, const VectorLocation& right) {
+	const char* sizes[] = {"byte", "word", "dword", "qword"};
+	// Every row of the result is the sum of the rows of the right matrix, each multiplied by an element of the left row
+	auto [rows, inner] = Parser::getShape(leftType);
+	int elementSize = int(leftType.subTypes[0].byteSize);
+	int leftRow = int(leftType.byteSize / rows);
+	int rightRow = int(rightType.byteSize / inner);
+	const Type& elementType = leftType.subTypes[0];
+	for (int row = 0; row < int(rows); row++) {
+		for (const auto& chunk : getVectorChunks(rightRow)) {
+			for (int k = 0; k < int(inner); k++) {
+				std::string element = left.at(row * leftRow + k * elementSize);
+				if (elementSize == 8)
+					outfile << "\tmov rax, qword " << element << std::endl;
+				else if (elementSize == 4)
+					outfile << "\tmov eax, dword " << element << std::endl;
+				else
+					outfile << "\tmovzx eax, " << sizes[getSizeFromByteSize(elementSize)] << " " << element << std::endl;
+				outfile << "\tmovq xmm1, rax" << std::endl;
+				printBroadcast(outfile, 1, elementSize);
+				printVectorMove(outfile, 2, right.at(k * rightRow + chunk.first), chunk.second, false);
+				printLaneOperation(outfile, elementType, "*", 2, 1);
+				if (k == 0)
+					outfile << "\tmovdqa xmm0, xmm2" << std::endl;
+				else
+					printLaneOperation(outfile, elementType, "+", 0, 2);
+			}
+			printVectorMove(outfile, 0, destination.at(row * rightRow + chunk.first), chunk.second, true);
+		}
+	}
+}
+
+std::optional<Type> X86_64LinuxYasmCompiler::getVectorType(const Expression* expression) {
+	if (expression == nullptr) return std::nullopt;
+	const std::string& text = expression->mValue.mText;
+	if (expression->mValue.mType == TokenType::IDENTIFIER) {
+		auto symbol = symbolTable.find(text);
+		if (symbol == symbolTable.end()) return std::nullopt;
+		Builtin_Type type = symbol->second.type.builtinType;
+		if (type != Builtin_Type::VECTOR && type != Builtin_Type::MATRIX) return std::nullopt;
+		return symbol->second.type;
+	}
+	if (text == "(") {
+		if (expression->mChildren.empty() || expression->mChildren[0]->mValue.mText != "cross") return std::nullopt;
+		std::vector<const Expression*> arguments = getArguments(expression);
+		std::optional<Type> left = arguments.size() == 2 ? getVectorType(arguments[0]) : std::nullopt;
+		std::optional<Type> right = arguments.size() == 2 ? getVectorType(arguments[1]) : std::nullopt;
+		if (!left.has_value() || !right.has_value() || left->name != right->name || left->builtinType != Builtin_Type::VECTOR || Parser::getShape(left.value()).second != 3) {
+			std::cerr << "[X86_64 Compiler]: ERROR: cross takes two vec3 of the same type" << std::endl;
+			exit(1);
+		}
+		return left;
+	}
+	if (expression->mValue.mSubType != TokenSubType::OP_BINARY || expression->mChildren.size() != 2 || (text != "+" && text != "-" && text != "*"))
+		return std::nullopt;
+
+	std::optional<Type> left = getVectorType(expression->mChildren[0]);
+	std::optional<Type> right = getVectorType(expression->mChildren[1]);
+	if (!left.has_value()) return right;
+	if (!right.has_value()) return left;
+	if (text == "*" && left->builtinType == Builtin_Type::MATRIX && left->subTypes[0].name == right->subTypes[0].name) {
+		auto [rows, inner] = Parser::getShape(left.value());
+		auto [rightRows, columns] = Parser::getShape(right.value());
+		if (right->builtinType == Builtin_Type::MATRIX && rightRows == inner)
+			return Parser::getMatrixType(rows, columns, left->subTypes[0]);
+		if (right->builtinType == Builtin_Type::VECTOR && columns == inner)
+			return Parser::getVectorType(rows, left->subTypes[0]);
+	} else if (left->name == right->name && (text != "*" || left->builtinType == Builtin_Type::VECTOR)) {
+		return left;
+	}
+	std::cerr << "[X86_64 Compiler]: ERROR: Can't use '" << text << "' on a " << left->name << " and a " << right->name << std::endl;
+	exit(1);
+}
+
+bool X86_64LinuxYasmCompiler::isVectorProduct(const Expression* expression) {
+	if (expression->mValue.mText == "(") return getVectorType(expression).has_value();
+	if (expression->mValue.mText != "*" || expression->mChildren.size() != 2) return false;
+	std::optional<Type> left = getVectorType(expression->mChildren[0]);
+	std::optional<Type> right = getVectorType(expression->mChildren[1]);
+	return left.has_value() && right.has_value() && left->builtinType == Builtin_Type::MATRIX;
+}
+
+size_t X86_64LinuxYasmCompiler::getVectorScratch(const Expression* expression, bool direct) {
+	std::optional<Type> type = getVectorType(expression);
+	if (!type.has_value()) return containsCall(expression) ? 16 : 0;
+	if (expression->mValue.mType == TokenType::IDENTIFIER) return 0;
+	bool product = isVectorProduct(expression);
+	size_t size = !direct || product ? nearestMultipleOf(int(type->byteSize), 16) : 0;
+	// The operands of products have to be in memory, lane by lane arithmetic is printed straight into its destination
+	std::vector<const Expression*> operands = expression->mValue.mText == "(" ? getArguments(expression) : std::vector<const Expression*>(expression->mChildren.begin(), expression->mChildren.end());
+	for (const auto* operand : operands) {
+		size += getVectorScratch(operand, !product);
+	}
+	return size;
+}
+
+VectorLocation X86_64LinuxYasmCompiler::getVectorLocation(const std::string& name) {
+	const SymbolInfo& symbol = symbolTable[name];
+	if (symbol.reg != "rbp" || symbol.offset > 0) {
+		std::cerr << "[X86_64 Compiler]: ERROR: Vector arithmetic only works on local variables for now, '" << name << "' isn't one" << std::endl;
+		exit(1);
+	}
+	return VectorLocation {"rbp", symbol.offset};
+}
+
+VectorLocation X86_64LinuxYasmCompiler::allocateVectorTemporary(size_t byteSize) {
+	VectorLocation temporary {"rsp", vectorTemporary};
+	vectorTemporary += nearestMultipleOf(int(byteSize), 16);
+	return temporary;
+}
+
+// The pieces an xmm register moves at once, as (offset, size). Vectors and matrices are always a multiple of 4 bytes
+std::vector<std::pair<int, int>> X86_64LinuxYasmCompiler::getVectorChunks(size_t byteSize) {
+	std::vector<std::pair<int, int>> chunks;
+	int offset = 0;
+	for (int size : {16, 8, 4}) {
+		while (int(byteSize) - offset >= size) {
+			chunks.emplace_back(offset, size);
+			offset += size;
+		}
+	}
+	return chunks;
+}
+
+// The arguments of a call in an expression come after the "(" that separates them from the name
+std::vector<const Expression*> X86_64LinuxYasmCompiler::getArguments(const Expression* call) {
+	std::vector<const Expression*> arguments;
+	bool parsingArgs = false;
+	for (const auto* child : call->mChildren) {
+		if (parsingArgs)
+			arguments.push_back(child);
+		else if (child->mValue.mText == "(")
+			parsingArgs = true;
+	}
+	return arguments;
+}
+
+// Small bodies that can be printed several times in a row: no breaks or skips that expect a single copy, no locals and no loops
+bool X86_64LinuxYasmCompiler::isUnrollable(const Block& block) {
+	size_t statements = 0;
+	std::function<bool(const Block&)> check = [&](const Block& body) {
+		if (body.stackMemory != 0) return false;
+		for (const auto& statement : body.statements) {
+			if (++statements > 8) return false;
+			switch (statement.mType) {
+				case Statement_Type::BREAK:
+				case Statement_Type::SKIP:
+				case Statement_Type::LOOP:
+				case Statement_Type::VAR_DECLARATION:
+				case Statement_Type::VAR_DECL_ASSIGN:
+					return false;
+				default:
+					break;
+			}
+			if (statement.ifStatement.has_value()) {
+				if (!check(statement.ifStatement->mBody)) return false;
+				if (statement.ifStatement->mElseBody.has_value() && !check(statement.ifStatement->mElseBody.value())) return false;
+			}
+			if (!statement.mSubStatements.empty()) return false;
+		}
+		return true;
+	};
+	return check(block);
+}
+
+// Returns whether a `return name(...)` was found, and sets the operator of the first `return e OP name(...)`
+bool X86_64LinuxYasmCompiler::findSelfCalls(const Block& block, const std::string& name, std::string& accumulatorOperator) {
+	bool found = false;
+	for (const auto& statement : block.statements) {
+		if (statement.mType == Statement_Type::RETURN_CALL) {
+			const Expression* expression = statement.mContent;
+			if (isDirectCall(expression) && expression->mChildren[0]->mValue.mText == name) {
+				found = true;
+			} else if (accumulatorOperator.empty() && expression != nullptr && expression->mValue.mType == TokenType::OPERATOR) {
+				if (findAccumulatedCall(expression, name, expression->mValue.mText) != nullptr)
+					accumulatorOperator = expression->mValue.mText;
+			}
+		}
+		if (statement.loopStatement.has_value())
+			found |= findSelfCalls(statement.loopStatement->mBody, name, accumulatorOperator);
+		if (statement.ifStatement.has_value()) {
+			found |= findSelfCalls(statement.ifStatement->mBody, name, accumulatorOperator);
+			if (statement.ifStatement->mElseBody.has_value())
+				found |= findSelfCalls(statement.ifStatement->mElseBody.value(), name, accumulatorOperator);
+		}
+	}
+	return found;
+}
+
+// The call in `e OP name(...)` or `name(...) OP e`. Neither `e` nor the arguments may call anything, as `e` is
+// evaluated before the arguments when it is folded into the accumulator
+const Expression* X86_64LinuxYasmCompiler::findAccumulatedCall(const Expression* expression, const std::string& name, const std::string& op) {
+	if (expression == nullptr || expression->mValue.mText != op || expression->mChildren.size() != 2) return nullptr;
+	if (op != "+" && op != "*" && op != "&" && op != "|" && op != "^") return nullptr;
+	for (int side = 0; side < 2; side++) {
+		const Expression* call = expression->mChildren[side];
+		if (!isDirectCall(call) || call->mChildren[0]->mValue.mText != name || containsCall(expression->mChildren[1 - side]))
+			continue;
+		if (std::none_of(call->mChildren.begin() + 2, call->mChildren.end(), [](const Expression* arg) { return containsCall(arg); }))
+			return call;
+	}
+	return nullptr;
+}
@@ -4,7 +4,10 @@
 #include <filesystem>
 #include "Parser.hpp"
 #include "ConfigParser.hpp"
+#include "RegisterAllocator.hpp"
+#include "IRBuilder.hpp"
 #include <map>
+#include <set>
 
 using namespace forest::parser;
 namespace fs = std::filesystem;
@@ -15,6 +18,7 @@ struct SymbolInfo {
 	Type type {};
 	int size {};
 	bool isGlobal = false;
+	bool inRegister = false; // Allocated to a callee-saved register, always holds the value extended to 64 bits
 
 	std::string location(bool dereference = true) const {
 		std::stringstream ss;
@@ -35,6 +39,17 @@ struct SymbolInfo {
 	}
 };
 
+// Where the bytes of a vector or matrix start, they go up in memory from there
+struct VectorLocation {
+	std::string base {};
+	int offset {};
+
+	std::string at(int byte) const {
+		int total = offset + byte;
+		return "[" + base + (total < 0 ? "-" : "+") + std::to_string(total < 0 ? -total : total) + "]";
+	}
+};
+
 struct ExpressionPrinted {
 	bool printed = false;
 	bool sign = false;
@@ -47,23 +62,161 @@ public:
 	void compile(fs::path& filePath, const Programme& p, const CompileContext& ctx);
 
 private:
+	static constexpr size_t c_StdoutBufferSize = 4096;
 	uint32_t labelCount = 0;
 	uint32_t ifCount = 0;
 	std::vector<std::string> loopLabels{};
 	std::map<std::string, SymbolInfo> symbolTable;
 	std::map<std::string, uint32_t> syscallTable;
 	std::string currentClass{};
-	void printBody(std::ofstream& outfile, const Programme& p, const Block& block, const std::string& labelName, int* offset, int* allocs);
-	void setup(std::ofstream& outfile);
-	void printLibs(std::ofstream& outfile);
-	void printFunctionCall(std::ofstream& outfile, const Programme& p, const FuncCallStatement& fc);
-	void printSyscall(std::ofstream& outfile, const std::string& syscall);
+	forest::ir::IRBuilder irBuilder;
+	RegisterAllocator registerAllocator;
+	std::map<const void*, std::string> registerAssignments;
+	std::vector<std::string> liveArguments{}; // Argument registers holding a value that is still needed after the next call
+	std::set<std::string> calledSymbols{}; // Everything a call in an expression jumps to, the ones defined elsewhere get an extern
+	const Function* currentFunction = nullptr; // The free function being compiled when its returns may become tail calls
+	std::vector<std::string> currentSavedRegisters{};
+	std::string accumulatorOperator{}; // Set when self-recursive returns are folded into an accumulator instead of a call
+	int accumulatorOffset{};
+	bool boundsChecks = true; // Debug builds check every index, even the ones that are proven to be in range
+	std::map<std::string, std::pair<int64_t, int64_t>> iteratorRanges{}; // The values loop iterators take in their body, inclusive
+	size_t loopUnroll = 1;
+	int vectorTemporary{}; // The next free byte above rsp for the temporaries of the vector arithmetic being printed
+	Builtin_Type currentReturnType = Builtin_Type::VOID; // f32 and f64 are returned in xmm0 instead of rax
+	int frameDepth{}; // The lowest offset from rbp the function being printed uses, its frame is reserved once in the prologue
+	std::map<const Variable*, std::string> constantArrays{}; // The labels of the local arrays whose initialiser is in .rodata
+	std::stringstream readOnlyData{}; // Goes after the code, the peephole pass doesn't need to see it
+	/**
+	 * @param offset The offset from rbp the next local goes below. Every block gives its slots back at the end, and
+	 * `frameDepth` keeps track of how deep it went
+	 */
+	void printBody(std::ostream& outfile, const Programme& p, const Block& block, const std::string& labelName, int* offset);
+	void setup(std::ostream& outfile);
+	void printLibs(std::ostream& outfile);
+	/**
+	 * Prints stdout_write (rsi = data, rdx = length), stdout_write_byte (dil) and stdout_flush, which all writes to stdout go through.
+	 * Only the translation unit with main gets them, together with the buffer in .bss
+	 */
+	void printStdoutRuntime(std::ostream& outfile, StdoutBuffering buffering);
+	void printFunctionCall(std::ostream& outfile, const Programme& p, const FuncCallStatement& fc);
+	void printSyscall(std::ostream& outfile, const std::string& syscall);
+	/**
+	 * Decides whether `return f(...)` in the function can become a jump. Calls to itself jump back to .tail_call, after the
+	 * arguments are stored, and `return e OP f(...)` with OP one of + * & | ^ keeps `e` in an accumulator that every other
+	 * return is combined with. Functions that take an address of their locals can't reuse or give up their frame.
+	 * @return Whether the function needs the .tail_call label
+	 */
+	bool analyseRecursion(const Function& function);
+	/**
+	 * Prints the return of a call as a jump: back to .tail_call when it calls itself, to the other function after the
+	 * epilogue otherwise, so it returns straight to our caller
+	 * @return Whether the return was printed, if not it has to be printed as a normal return
+	 */
+	bool printTailCall(std::ostream& outfile, const Programme& p, const Expression* expression);
 	/**
 	 * Will print the expression. The resulting value will be in the a register (rax, eax, ax, al)
 	 */
-	ExpressionPrinted printExpression(std::ofstream& outfile, const Programme& p, const Expression* expression, uint8_t nodeType);
-	void printConditionalMove(std::ofstream& outfile, int leftSize, int rightSize, const char* instruction);
+	ExpressionPrinted printExpression(std::ostream& outfile, const Programme& p, const Expression* expression, uint8_t nodeType);
+	void printConditionalMove(std::ostream& outfile, int leftSize, int rightSize, const char* instruction);
+	/**
+	 * Prints a call in an expression, with the integer arguments in rdi, rsi, ... and the f32 and f64 ones in xmm0 to xmm7.
+	 * The result is in rax, or in xmm0 when the function returns a floating point number
+	 */
+	void printCallExpression(std::ostream& outfile, const Programme& p, const Expression* expression);
+	/**
+	 * Which register each argument of a call goes in. Integers and floating point numbers are counted separately, like
+	 * System V does, the first integer register is `firstInteger` when the object of a method takes rdi
+	 * @return The number of the register for every argument, with the type of the floating point ones: the type of the
+	 * parameter, or f64 when a floating point value goes to an external function
+	 */
+	std::vector<std::pair<int, std::optional<Builtin_Type>>> getArgumentRegisters(const Programme& p, const Function* callee, const std::vector<const Expression*>& arguments, int firstInteger);
+	// Loads the floating point arguments that were saved on the stack, in the order they were saved, into their xmm registers
+	void printFloatArguments(std::ostream& outfile, const std::vector<int>& registers);
+	const Function* findFunction(const Programme& p, const std::string& className, const std::string& name);
+	const Function* findCallee(const Programme& p, const Expression* call);
+	/**
+	 * The type of the value of the expression when it is a floating point number, f32 or f64. Arithmetic with an f64 in it
+	 * is done in f64, unless the f64 is only a literal next to an f32. Nothing when the value is an integer
+	 */
+	std::optional<Builtin_Type> getFloatType(const Programme& p, const Expression* expression);
+	bool containsFloat(const Programme& p, const Expression* expression);
+	// Whether printing the expression leaves xmm0 up to the register it is printed in alone
+	bool preservesFloatRegisters(const Programme& p, const Expression* expression);
+	/**
+	 * Prints the expression as a floating point number of the type into the low element of xmm{reg}. Integers are
+	 * converted with cvtsi2sd, and the registers above `reg` hold the right hand sides of the arithmetic
+	 */
+	void printFloatExpression(std::ostream& outfile, const Programme& p, const Expression* expression, Builtin_Type type, int reg);
+	/**
+	 * Prints the left operand into xmm{reg}
+	 * @return The right operand, a memory operand or the register above `reg`
+	 */
+	std::string printFloatOperands(std::ostream& outfile, const Programme& p, const Expression* left, const Expression* right, Builtin_Type type, int reg);
+	/**
+	 * Prints the address of a floating point variable, struct field, array element or element behind a ref
+	 * @return The memory operand with its size and the type that is stored there, nothing when the value isn't in memory
+	 */
+	std::optional<std::pair<std::string, Builtin_Type>> printFloatOperand(std::ostream& outfile, const Programme& p, const Expression* expression);
+	// `<`, `<=`, `==`, `!=`, `>` and `>=` with a floating point operand, ucomisd leaves unordered (NaN) comparisons false, except for `!=`
+	void printFloatComparison(std::ostream& outfile, const Programme& p, const Expression* expression);
+	// The field of the struct or class, or of the struct behind a ref, nothing when it doesn't have one with that name
+	const StructField* findField(const Programme& p, const Type& type, const std::string& name);
+	static std::optional<Builtin_Type> mergeFloatTypes(const Expression* left, std::optional<Builtin_Type> leftType, const Expression* right, std::optional<Builtin_Type> rightType);
+	// The bits of the number as the floating point type, in hexadecimal
+	static std::string getFloatBits(const std::string& text, Builtin_Type type);
 	int addToSymbols(int* offset, const Variable& variable, const std::string& reg = "rbp-", bool isGlobal = false);
+	std::vector<std::string> getSavedRegisters();
+	/**
+	 * Pushes the callee-saved registers the register allocator handed out
+	 * @return The offset from rbp the first local variable goes below
+	 */
+	int printSaveRegisters(std::ostream& outfile, const std::vector<std::string>& registers);
+	void printRestoreRegisters(std::ostream& outfile, const std::vector<std::string>& registers);
+	// Reserves the whole frame of the function below the saved registers, down to `frameDepth`
+	void printFrame(std::ostream& outfile, int savedOffset);
+	/**
+	 * Puts the initialiser of a local array in .rodata when all of its elements are literals, once, even when the
+	 * declaration is printed more than once
+	 * @return The label of the data, nothing when the array has to be initialised element by element
+	 */
+	std::optional<std::string> getConstantArray(const Variable& variable);
+	// Copies 16 bytes at a time through xmm0, the rest through the a register
+	void printBlockCopy(std::ostream& outfile, const VectorLocation& source, const VectorLocation& destination, size_t byteSize);
+	/**
+	 * Loads the qword of a packed bool array that holds the flag whose number is in `index` into r12, the number of the
+	 * qword goes in r10. `bt`, `bts` and `btr` on r12 with the same index then only look at the low 6 bits
+	 * @return The memory operand of the qword, to write it back
+	 */
+	std::string printBitWord(std::ostream& outfile, const std::string& name, const std::string& index);
+	// Stores the value in al into the flag whose number is in r11
+	void printBitStore(std::ostream& outfile, const std::string& name, const Expression* value);
+	// `count(flags)`, `any(flags)` and `all(flags)` on a packed bool array, a word at a time with popcnt, or and and
+	void printBitReduction(std::ostream& outfile, const Expression* expression);
+	// Whether a call is one of the reductions above, a function of the programme with the same name comes first
+	bool isBitReduction(const Programme& p, const Expression* call);
+	// The field that `arr[i].field` reads on an array of structs, nothing when the expression isn't one
+	const StructField* findElementField(const Programme& p, const Expression* expression);
+	/**
+	 * The memory operand of a field of the element of an array of structs whose number is in `index`. The field of a #soa
+	 * struct is in its own column of the array. When the stride isn't 1, 2, 4 or 8 bytes the index register gets multiplied
+	 */
+	std::string getElementFieldAddress(std::ostream& outfile, const Programme& p, const std::string& name, const StructField& field, const std::string& index);
+	// Prints the index of `arr[i].field` into rax and checks its bounds, @return the memory operand of the field
+	std::string printElementField(std::ostream& outfile, const Programme& p, const Expression* expression, const StructField& field);
+	/**
+	 * Pushes the argument registers that are live, instead of every one of them
+	 * @return The registers that were pushed, to hand to printRestoreArguments after the call
+	 */
+	std::vector<std::string> printSaveArguments(std::ostream& outfile);
+	void printRestoreArguments(std::ostream& outfile, const std::vector<std::string>& registers);
+	/**
+	 * Calls the target, realigning the stack to 16 bytes first when it follows the System V ABI (external functions)
+	 */
+	void printCall(std::ostream& outfile, const std::string& target, bool alignStack);
+	/**
+	 * Moves the value in the given register (a, b, di, etc...) into a symbol that lives in a register, extending it to 64 bits
+	 */
+	void printRegisterStore(std::ostream& outfile, const SymbolInfo& symbol, const std::string& source);
 	std::stringstream moveToRegister(const std::string& reg, const SymbolInfo& symbol);
 	const char* getRegister(const std::string& reg, int size);
 	int getSizeFromNumber(const std::string& text);
@@ -76,6 +229,69 @@ private:
 	const char* getDefineBytes(size_t byteSize);
 	const char* getReserveBytes(size_t byteSize);
 	const char* escape(const char* input);
+	const char* getAccumulatorInstruction();
+	/**
+	 * Whether the index is proven to be within [0, length), using the ranges of the loop iterators it is made of.
+	 * The bounds check can be left out for those
+	 */
+	bool isInBounds(const Expression* index, int64_t length);
+	/**
+	 * Prints the part of an element-wise loop over arrays, like `loop i, 0..16 { a[i] = b[i] + i; }`, that fits in whole xmm
+	 * registers, with SSE2 on 16 bytes at a time. The index lives in r11
+	 * @return The first element that is left for the normal loop, nothing when the loop can't be vectorised
+	 */
+	std::optional<int64_t> printVectorisedLoop(std::ostream& outfile, const Programme& p, const LoopStatement& loop);
+	/**
+	 * @return The xmm register with the value, which is `target` unless the value was already in one
+	 */
+	int printVectorExpression(std::ostream& outfile, const Expression* expression, int elementSize, int target, const std::map<const Expression*, int>& invariants);
+	std::optional<std::pair<int64_t, int64_t>> getIndexRange(const Expression* index);
+	// Repeats the lowest element of the xmm register over all of it
+	void printBroadcast(std::ostream& outfile, int reg, int elementSize);
+	/**
+	 * Multiplies the lanes of the destination by those of the source, keeping the low bits like imul. SSE2 only has that
+	 * for words, the other sizes are pieced together from pmullw and pmuludq in xmm13 to xmm15
+	 */
+	void printLaneMultiply(std::ostream& outfile, int elementSize, int destination, int source);
+	/**
+	 * Stores the value of arithmetic on vectors and matrices (vecN<T> and matRxC<T>) in the variable. `+`, `-` and `*` go
+	 * lane by lane, 16 bytes at a time in xmm registers, with scalars repeated over a register. `*` of a matrix by a
+	 * vector or matrix and `cross(a, b)` are products, those and what they use that isn't a variable go through
+	 * temporaries on the stack
+	 */
+	void printVectorAssignment(std::ostream& outfile, const Programme& p, const std::string& name, const Expression* expression);
+	void printVectorValue(std::ostream& outfile, const Programme& p, const VectorLocation& destination, const Type& type, const Expression* expression);
+	// The variable the expression is, or a temporary the value of the expression is stored in
+	VectorLocation printVectorOperand(std::ostream& outfile, const Programme& p, const Expression* expression);
+	/**
+	 * @return The xmm register with the value of the lanes in the chunk (offset, size) of the expression
+	 */
+	int printVectorChunk(std::ostream& outfile, const Expression* expression, std::pair<int, int> chunk, const Type& element, int target,
+		const std::map<const Expression*, int>& registers, const std::map<const Expression*, VectorLocation>& memory);
+	// `+`, `-` or `*` on the lanes of two xmm registers into `destination`, addps, subps and mulps or their pd forms for f32 and f64
+	void printLaneOperation(std::ostream& outfile, const Type& element, const std::string& operation, int destination, int source);
+	void printVectorMove(std::ostream& outfile, int reg, const std::string& address, int size, bool store);
+	// `dot(a, b)`, the sum of the lanes of a * b, ends up in rax extended like the elements, or in xmm0 for f32 and f64
+	void printVectorDot(std::ostream& outfile, const Programme& p, const Expression* expression);
+	void printDot(std::ostream& outfile, const VectorLocation& left, const VectorLocation& right, const Type& type);
+	void printCross(std::ostream& outfile, const VectorLocation& destination, const Type& type, const VectorLocation& left, const VectorLocation& right);
+	void printMatrixProduct(std::ostream& outfile, const VectorLocation& destination, const Type& leftType, const Type& rightType, const VectorLocation& left, const VectorLocation& right);
+	// The vector or matrix type of the value of the expression, nothing when it is a scalar
+	std::optional<Type> getVectorType(const Expression* expression);
+	bool isVectorProduct(const Expression* expression);
+	// How many bytes of temporaries the expression needs, `direct` when its value goes straight into its destination
+	size_t getVectorScratch(const Expression* expression, bool direct);
+	VectorLocation getVectorLocation(const std::string& name);
+	VectorLocation allocateVectorTemporary(size_t byteSize);
+	static std::vector<std::pair<int, int>> getVectorChunks(size_t byteSize);
+	static std::vector<const Expression*> getArguments(const Expression* call);
+	static bool isDirectCall(const Expression* expression);
+	static bool containsCall(const Expression* expression);
+	static bool takesAddress(const Block& block);
+	static bool writesVariable(const Block& block, const std::string& name);
+	static bool isUnrollable(const Block& block);
+	static bool findSelfCalls(const Block& block, const std::string& name, std::string& accumulatorOperator);
+	static const Expression* findAccumulatedCall(const Expression* expression, const std::string& name, const std::string& op);
 };
 
 
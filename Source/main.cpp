@@ -5,15 +5,55 @@
 #include <vector>
 #include <unordered_set>
 #include <filesystem>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
 
 #include "Tokeniser.hpp"
 #include "Parser.hpp"
 #include "ConfigParser.hpp"
+#include "Optimiser.hpp"
 #include "X86_64LinuxYasmCompiler.hpp"
+#include "BuildCache.hpp"
 
 using namespace forest::parser;
 namespace fs = std::filesystem;
 
+struct TranslationUnit {
+	fs::path source;
+	std::optional<Programme> programme{}; // Empty when the object file from an earlier build can be reused
+	BuildCache::Entry entry{};
+};
+
+// Runs task(0) to task(count - 1) on up to one thread per core, and rethrows the first exception once all of them finished
+static void runParallel(size_t count, const std::function<void(size_t)>& task) {
+	size_t workerCount = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+	std::atomic<size_t> next = 0;
+	std::exception_ptr error;
+	std::mutex errorMutex;
+	auto work = [&]() {
+		for (size_t i = next++; i < count; i = next++) {
+			try {
+				task(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!error) error = std::current_exception();
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < workerCount; i++)
+		workers.emplace_back(work);
+	work();
+	for (auto& worker : workers)
+		worker.join();
+	if (error)
+		std::rethrow_exception(error);
+}
+
 int main(int argc, char** argv) {
 	// If the path is a directory, look for the config file
 	fs::path filePath = argc == 1 || argc > 2 ? "../Examples/rule110.tree" : argv[1];
@@ -38,72 +78,83 @@ int main(int argc, char** argv) {
 		std::cout << "Using file: " << filePath << std::endl;
 	}
 
-	std::ifstream file;
-	file.open(filePath);
-	std::stringstream buffer;
-	buffer << file.rdbuf();
-	file.close();
-
-	std::string code = buffer.str();
-
-	std::vector<Token> tokens = Tokeniser::parse(code, filePath);
-
 	CompileContext ctx;
+	uint64_t configurationHash = 0;
 	if (useProject) {
 		// Relative to filepath, read entrypoint
+		std::vector<Token> tokens = Tokeniser::parseFile(filePath);
 		ctx = CompileContext(tokens);
-		tokens.clear();
-		std::stringstream().swap(buffer);
+		configurationHash = BuildCache::hashFile(filePath).value_or(0);
 		filePath = filePath.replace_filename(ctx.m_Configuration.m_Entrypoint);
-		file.open(filePath);
-		buffer << file.rdbuf();
-		file.close();
-		tokens = Tokeniser::parse(buffer.str(), filePath);
 	}
-
-	Parser parser;
-	Programme p = parser.parse(tokens);
-	bool found_main = false;
-
-	for (auto& function : p.functions) {
-		if (function.mName == "main") {
-			found_main = true;
-			break;
+	fs::path originalPath = filePath;
+	fs::path buildPath = filePath.parent_path() / "build";
+	fs::create_directory(buildPath);
+	BuildCache cache(configurationHash);
+
+	// Units whose object file is still up to date are taken from the cache, everything else is tokenised and parsed
+	auto load = [&](TranslationUnit& unit) {
+		std::optional<BuildCache::Entry> cached = cache.lookup(unit.source);
+		if (cached.has_value()) {
+			unit.entry = cached.value();
+			return;
+		}
+		std::vector<Token> tokens = Tokeniser::parseFile(unit.source);
+		Programme programme = Parser().parse(tokens);
+		forest::optimiser::Optimiser().optimise(programme, ctx);
+		for (const auto& import : programme.imports) {
+			unit.entry.imports.push_back(BuildCache::resolveImport(import.mFrom, import.mPath).string());
+		}
+		unit.entry.libDependencies = programme.libDependencies;
+		unit.programme = std::move(programme);
+	};
+
+	std::vector<TranslationUnit> units(1);
+	units[0].source = filePath;
+	load(units[0]);
+	if (units[0].programme.has_value()) {
+		const auto& functions = units[0].programme->functions;
+		bool found_main = std::any_of(functions.begin(), functions.end(), [](const Function& function) { return function.mName == "main"; });
+		if (!found_main) {
+			std::cerr << "Expected a function called 'main' to be in file: " << filePath << std::endl;
+			return 1;
 		}
 	}
-	if (!found_main) {
-		std::cerr << "Expected a function called 'main' to be in file: " << filePath << std::endl;
-		return 1;
-	}
-	fs::path originalPath = filePath;
 
-	X86_64LinuxYasmCompiler compiler;
-	compiler.compile(filePath, p, ctx);
-	std::vector<Programme> programmes;
+	// Find every translation unit first. Each one is tokenised and parsed on its own, so a whole level of the import
+	// graph can be read at the same time.
 	std::unordered_set<fs::path> paths;
-	programmes.push_back(p);
-	fs::path buildPath = filePath.parent_path() / "build";
-	paths.insert(buildPath / filePath.stem().replace_extension("o"));
-
-	for (size_t i = 0; i < programmes.size(); i++) {
-		const auto& programme = programmes.at(i);
-		for (const auto& import : programme.imports) {
-			fs::path tempPath = filePath.replace_filename(import.mPath);
-			if (paths.contains(buildPath / tempPath.stem().replace_extension("o"))) continue;
-			tokens.clear();
-			std::stringstream().swap(buffer);
-			file.open(tempPath);
-			buffer << file.rdbuf();
-			file.close();
-			tokens = Tokeniser::parse(buffer.str(), tempPath);
-			parser = Parser();
-			Programme nextProgramme = parser.parse(tokens);
-			programmes.push_back(nextProgramme);
-			paths.insert(buildPath / tempPath.stem().replace_extension("o"));
-			compiler.compile(tempPath, nextProgramme, ctx);
+	paths.insert(BuildCache::getObjectPath(filePath));
+	for (size_t levelStart = 0; levelStart < units.size();) {
+		size_t levelEnd = units.size();
+		std::vector<fs::path> level;
+		for (size_t i = levelStart; i < levelEnd; i++) {
+			for (const auto& import : units[i].entry.imports) {
+				fs::path importPath = import;
+				// Each unit writes its object file next to its own source, which is where the linker has to look too
+				if (paths.insert(BuildCache::getObjectPath(importPath)).second)
+					level.push_back(importPath);
+			}
 		}
+		for (const auto& importPath : level) {
+			units.push_back(TranslationUnit{importPath});
+		}
+		runParallel(units.size() - levelEnd, [&](size_t i) {
+			load(units[levelEnd + i]);
+		});
+		levelStart = levelEnd;
 	}
 
+	// Translation units only meet again in the linker, so they are compiled and assembled side by side
+	runParallel(units.size(), [&](size_t i) {
+		TranslationUnit& unit = units[i];
+		if (!unit.programme.has_value()) return;
+		cache.invalidate(unit.source);
+		fs::path source = unit.source;
+		X86_64LinuxYasmCompiler().compile(source, unit.programme.value(), ctx);
+		cache.store(unit.source, unit.entry);
+	});
+
 	std::stringstream linker;
 	linker << "ld";
 	if (ctx.m_Configuration.m_BuildType != BuildType::DEBUG)
@@ -116,9 +167,8 @@ int main(int argc, char** argv) {
 		linker << path << " ";
 	}
 
-	std::vector<std::string> dependencies;
-	for (const auto& programme : programmes) {
-		for (auto& dependency : programme.libDependencies) {
+	for (const auto& unit : units) {
+		for (const auto& dependency : unit.entry.libDependencies) {
 			linker << " -l" << dependency;
 		}
 	}